@@ -76,7 +76,11 @@ enum class ControlCommand {
      *
      * The server then sends a response to the source IP.  Its payload
      * is the node name and port, a null byte, and a string describing
-     * the worker status.  Possible values: "ok", "error", "fade".
+     * the worker status.  Possible values: "ok", "error", "fade",
+     * "outlier".  This is followed by null-separated decimal numbers:
+     * the number of requests currently in flight to this node, the
+     * average response latency [ms] and the average error rate
+     * [percent].
      */
     NODE_STATUS = 4,
 
@@ -144,6 +148,14 @@ enum class ControlCommand {
      * #TranslationCommand::ATTACH_SESSION value.
      */
     DISCARD_SESSION = 14,
+
+    /**
+     * Set the minimum number of idle child processes per FastCGI
+     * and LHTTP application (overriding "child_stock_min_idle").
+     * The payload is a 32 bit integer in network byte order; 0
+     * disables pre-spawning.
+     */
+    CHILD_MIN_IDLE = 15,
 };
 
 struct ControlStats {
@@ -208,6 +220,61 @@ struct ControlStats {
      */
     uint64_t http_traffic_received;
     uint64_t http_traffic_sent;
+
+    /**
+     * Number of idle child processes (FastCGI, LHTTP).
+     */
+    uint32_t idle_children;
+
+    /**
+     * Sum of the adaptive idle targets of all FastCGI/LHTTP
+     * applications with recent demand.
+     */
+    uint32_t warm_children;
+
+    /**
+     * Total number of child processes which were spawned in
+     * advance since the server was started.
+     */
+    uint64_t prespawned_children;
+
+    /**
+     * Number of translation cache hits whose VALIDATE_MTIME check
+     * was answered by an inotify watch or a recent lstat() result
+     * instead of a new system call.
+     */
+    uint64_t translation_cache_validations_avoided;
+
+    /**
+     * Number of translation cache hits on expandable responses
+     * which were served from a memoized expansion result, and the
+     * number of those which had to run the regex.
+     */
+    uint64_t translation_cache_expand_hits;
+    uint64_t translation_cache_expand_misses;
+
+    /**
+     * Number of outgoing connections which were established while
+     * a request was waiting for it (because there was no idle
+     * one), and the number of those which were established in
+     * advance.
+     */
+    uint64_t connect_waits;
+    uint64_t prewarmed_connections;
+
+    /**
+     * Sum of the adaptive idle targets of all upstream servers
+     * with recent demand.
+     */
+    uint64_t warm_connections;
+
+    /**
+     * Size of I/O buffers per size class (4 kB, 16 kB, 32 kB).
+     * #io_buffers_size is the sum of these.
+     */
+    uint64_t io_buffers_small_size, io_buffers_small_brutto_size;
+    uint64_t io_buffers_medium_size, io_buffers_medium_brutto_size;
+    uint64_t io_buffers_large_size, io_buffers_large_brutto_size;
 };
 
 struct ControlHeader {
@@ -34,6 +34,7 @@
 #define BENG_PROXY_DEFAULT_FIFO_BUFFER_HXX
 
 #include "SliceFifoBuffer.hxx"
+#include "fb_pool.hxx"
 
 /**
  * A frontend for #SliceFifoBuffer which allows to replace it with a
@@ -43,6 +44,14 @@
 class DefaultFifoBuffer : public SliceFifoBuffer {
 public:
 	void Allocate() noexcept;
+
+	/**
+	 * Allocate from the given size class.
+	 */
+	void Allocate(FbSize size) noexcept {
+		SliceFifoBuffer::Allocate(fb_pool_get(size));
+	}
+
 	void AllocateIfNull() noexcept;
 	void CycleIfEmpty() noexcept;
 };
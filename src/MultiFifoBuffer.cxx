@@ -59,7 +59,7 @@ MultiFifoBuffer::Push(ConstBuffer<uint8_t> src) noexcept
 	while (!src.empty()) {
 		buffers.emplace_back();
 		auto &b = buffers.back();
-		b.Allocate();
+		b.Allocate(FbSizeFor(src.size));
 
 		auto w = b.Write();
 		size_t nbytes = std::min(w.size, src.size);
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "RubberCache.hxx"
+#include "istream/UnusedPtr.hxx"
+#include "istream/istream_null.hxx"
+#include "istream_unlock.hxx"
+#include "istream_rubber.hxx"
+#include "AllocatorStats.hxx"
+#include "pool/pool.hxx"
+
+#include <assert.h>
+
+static constexpr Event::Duration compress_interval = std::chrono::minutes(10);
+
+RubberCacheItem::RubberCacheItem(PoolPtr &&_pool,
+				 std::chrono::steady_clock::time_point now,
+				 std::chrono::system_clock::time_point system_now,
+				 std::chrono::system_clock::time_point _expires,
+				 size_t _size, RubberAllocation &&_body) noexcept
+	:PoolHolder(std::move(_pool)),
+	 CacheItem(now, system_now, _expires, pool_netto_size(pool) + _size),
+	 size(_size), body(std::move(_body))
+{
+}
+
+void
+RubberCacheItem::Destroy() noexcept
+{
+	pool_trash(pool);
+	this->~RubberCacheItem();
+}
+
+RubberCache::RubberCache(struct pool &_pool, const char *name,
+			 EventLoop &event_loop, size_t max_size) noexcept
+	:pool(pool_new_dummy(&_pool, name)),
+	 slice_pool(1024, 65536),
+	 rubber(max_size),
+	 /* leave 12.5% of the rubber allocator empty, to increase the
+	    chances that a hole can be found for a new allocation, to
+	    reduce the pressure that rubber_compress() creates */
+	 cache(event_loop, 65521, max_size * 7 / 8),
+	 compress_timer(event_loop, BIND_THIS_METHOD(OnCompressTimer))
+{
+	compress_timer.Schedule(compress_interval);
+}
+
+RubberCache::~RubberCache() noexcept = default;
+
+AllocatorStats
+RubberCache::GetStats() const noexcept
+{
+	return slice_pool.GetStats() + rubber.GetStats();
+}
+
+void
+RubberCache::FlushTag(const char *tag) noexcept
+{
+	auto i = per_tag.find(tag);
+	if (i == per_tag.end())
+		return;
+
+	auto &list = i->second;
+	while (!list.empty())
+		cache.Remove(list.front());
+}
+
+PoolPtr
+RubberCache::NewItemPool(const char *name) noexcept
+{
+	return pool_new_slice(pool, name, &slice_pool);
+}
+
+void
+RubberCache::Put(const char *key, const char *tag,
+		 RubberCacheItem &item) noexcept
+{
+	if (tag != nullptr)
+		per_tag[tag].push_back(item);
+
+	cache.Put(p_strdup(item.GetPool(), key), item);
+}
+
+UnusedIstreamPtr
+RubberCache::OpenBody(struct pool &caller_pool,
+		      RubberCacheItem &item) noexcept
+{
+	assert(!item.body || ((CacheItem &)item).GetSize() >= item.size);
+
+	auto body = item.body
+		? istream_rubber_new(caller_pool, rubber, item.body.GetId(),
+				     0, item.size, false)
+		: istream_null_new(caller_pool);
+
+	return istream_unlock_new(caller_pool, std::move(body), item);
+}
+
+void
+RubberCache::OnCompressTimer() noexcept
+{
+	Compress();
+	compress_timer.Schedule(compress_interval);
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "cache.hxx"
+#include "rubber.hxx"
+#include "SlicePool.hxx"
+#include "pool/Holder.hxx"
+#include "event/FarTimerEvent.hxx"
+#include "util/LeakDetector.hxx"
+
+#include <boost/intrusive/list.hpp>
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+struct pool;
+struct AllocatorStats;
+class UnusedIstreamPtr;
+
+/**
+ * Base class for the items of a #RubberCache.  The body is stored in
+ * a #Rubber allocation; everything else is allocated from the item's
+ * own pool.
+ */
+struct RubberCacheItem : PoolHolder, CacheItem, LeakDetector {
+	using AutoUnlink =
+		boost::intrusive::link_mode<boost::intrusive::auto_unlink>;
+	using PerTagHook = boost::intrusive::list_member_hook<AutoUnlink>;
+
+	/**
+	 * A doubly linked list of cache items with the same cache tag.
+	 */
+	PerTagHook per_tag_siblings;
+
+	/**
+	 * The size of #body.
+	 */
+	const size_t size;
+
+	/**
+	 * The body; undefined if the body is empty.
+	 */
+	const RubberAllocation body;
+
+	RubberCacheItem(PoolPtr &&_pool,
+			std::chrono::steady_clock::time_point now,
+			std::chrono::system_clock::time_point system_now,
+			std::chrono::system_clock::time_point _expires,
+			size_t _size, RubberAllocation &&_body) noexcept;
+
+	virtual ~RubberCacheItem() noexcept = default;
+
+	using PoolHolder::GetPool;
+
+	/* virtual methods from class CacheItem */
+	void Destroy() noexcept override;
+};
+
+/**
+ * The common core of caches which store bodies in a #Rubber
+ * allocator: the #Cache, the allocators, a lookup table for flushing
+ * all items with a certain cache tag, and a timer which compresses
+ * the allocators periodically.
+ */
+class RubberCache final : LeakDetector {
+	PoolPtr pool;
+	SlicePool slice_pool;
+	Rubber rubber;
+	Cache cache;
+
+	using PerTagHook =
+		boost::intrusive::member_hook<RubberCacheItem,
+					      RubberCacheItem::PerTagHook,
+					      &RubberCacheItem::per_tag_siblings>;
+	using PerTagList =
+		boost::intrusive::list<RubberCacheItem, PerTagHook,
+				       boost::intrusive::constant_time_size<false>>;
+
+	/**
+	 * Lookup table to speed up FlushTag().
+	 */
+	std::unordered_map<std::string, PerTagList> per_tag;
+
+	FarTimerEvent compress_timer;
+
+public:
+	/**
+	 * @param name the name of the cache's pool
+	 * @param max_size the size of the #Rubber allocator
+	 */
+	RubberCache(struct pool &_pool, const char *name,
+		    EventLoop &event_loop, size_t max_size) noexcept;
+
+	~RubberCache() noexcept;
+
+	RubberCache(const RubberCache &) = delete;
+	RubberCache &operator=(const RubberCache &) = delete;
+
+	auto &GetEventLoop() const noexcept {
+		return compress_timer.GetEventLoop();
+	}
+
+	struct pool &GetPool() const noexcept {
+		return *pool;
+	}
+
+	Rubber &GetRubber() noexcept {
+		return rubber;
+	}
+
+	auto SteadyNow() const noexcept {
+		return cache.SteadyNow();
+	}
+
+	auto SystemNow() const noexcept {
+		return cache.SystemNow();
+	}
+
+	void ForkCow(bool inherit) noexcept {
+		rubber.ForkCow(inherit);
+		slice_pool.ForkCow(inherit);
+	}
+
+	[[gnu::pure]]
+	AllocatorStats GetStats() const noexcept;
+
+	void Flush() noexcept {
+		cache.Flush();
+		Compress();
+	}
+
+	/**
+	 * Remove all items which were added with the given cache tag.
+	 */
+	void FlushTag(const char *tag) noexcept;
+
+	/**
+	 * Create a new pool for an item.
+	 */
+	PoolPtr NewItemPool(const char *name) noexcept;
+
+	/**
+	 * Add an item (allocated from a pool returned by
+	 * NewItemPool()).
+	 *
+	 * @param tag an optional cache tag for FlushTag()
+	 */
+	void Put(const char *key, const char *tag,
+		 RubberCacheItem &item) noexcept;
+
+	RubberCacheItem *Get(const char *key) noexcept {
+		return (RubberCacheItem *)cache.Get(key);
+	}
+
+	/**
+	 * Create an istream which reads the item's body.  The item is
+	 * locked until the istream is closed.
+	 */
+	UnusedIstreamPtr OpenBody(struct pool &caller_pool,
+				  RubberCacheItem &item) noexcept;
+
+private:
+	void Compress() noexcept {
+		rubber.Compress();
+		slice_pool.Compress();
+	}
+
+	void OnCompressTimer() noexcept;
+};
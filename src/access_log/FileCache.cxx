@@ -0,0 +1,498 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "FileCache.hxx"
+#include "system/Error.hxx"
+
+#ifdef HAVE_URING
+#include <liburing.h>
+#endif
+
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+
+#include <sys/stat.h>
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+
+static bool
+make_parent_directory_recursive(char *path)
+{
+	char *slash = strrchr(path, '/');
+	if (slash == nullptr || slash == path)
+		return true;
+
+	*slash = 0;
+	int ret = mkdir(path, 0777);
+	if (ret >= 0) {
+		/* success */
+		*slash = '/';
+		return true;
+	} else if (errno == ENOENT) {
+		if (!make_parent_directory_recursive(path))
+			return false;
+
+		/* try again */
+		ret = mkdir(path, 0777);
+		*slash = '/';
+		return ret >= 0;
+	} else {
+		fprintf(stderr, "Failed to create directory %s: %s\n",
+			path, strerror(errno));
+
+		return false;
+	}
+}
+
+static bool
+make_parent_directory(const char *path)
+{
+	char buffer[PATH_MAX];
+	if (strlen(path) >= sizeof(buffer)) {
+		fprintf(stderr, "Path too long\n");
+		return false;
+	}
+
+	strcpy(buffer, path);
+
+	return make_parent_directory_recursive(buffer);
+}
+
+static UniqueFileDescriptor
+open_log_file(const char *path)
+{
+	UniqueFileDescriptor fd;
+
+	if (!fd.Open(path, O_CREAT|O_APPEND|O_WRONLY, 0666) &&
+	    errno == ENOENT) {
+		if (!make_parent_directory(path))
+			return fd;
+
+		/* try again */
+		fd.Open(path, O_CREAT|O_APPEND|O_WRONLY, 0666);
+	}
+
+	if (!fd.IsDefined())
+		fprintf(stderr, "Failed to open %s: %s\n",
+			path, strerror(errno));
+
+	return fd;
+}
+
+static void
+WriteFully(FileDescriptor fd, const char *path, std::string_view data) noexcept
+{
+	while (!data.empty()) {
+		ssize_t nbytes = fd.Write(data.data(), data.size());
+		if (nbytes < 0) {
+			if (errno == EINTR)
+				continue;
+
+			fprintf(stderr, "Failed to write %s: %s\n",
+				path, strerror(errno));
+			return;
+		}
+
+		data.remove_prefix(nbytes);
+	}
+}
+
+LogFileCache::LogFileCache(const Options &_options)
+	:options(_options)
+{
+	if (options.uring) {
+#ifdef HAVE_URING
+		ring = std::make_unique<struct io_uring>();
+		int result = io_uring_queue_init(64, ring.get(), 0);
+		if (result < 0) {
+			ring.reset();
+			throw MakeErrno(-result, "io_uring_queue_init() failed");
+		}
+#else
+		throw std::runtime_error("io_uring support is disabled");
+#endif
+	}
+}
+
+LogFileCache::~LogFileCache() noexcept
+{
+	CloseAll();
+
+#ifdef HAVE_URING
+	if (ring)
+		io_uring_queue_exit(ring.get());
+#endif
+}
+
+LogFileCache::File *
+LogFileCache::Open(const char *path) noexcept
+{
+	if (auto i = files.find(path); i != files.end()) {
+		File &file = i->second;
+
+		/* move to the front of the LRU list */
+		lru.erase(lru.iterator_to(file));
+		lru.push_front(file);
+		return &file;
+	}
+
+	if (files.size() >= options.max_files && !lru.empty())
+		Evict(lru.back());
+
+	auto fd = open_log_file(path);
+	if (!fd.IsDefined())
+		return nullptr;
+
+	auto i = files.emplace(std::piecewise_construct,
+			       std::forward_as_tuple(path),
+			       std::forward_as_tuple(std::move(fd))).first;
+	File &file = i->second;
+	file.path = &i->first;
+
+	ReserveBuffer(file);
+	lru.push_front(file);
+	return &file;
+}
+
+inline void
+LogFileCache::ReserveBuffer(File &file) const noexcept
+{
+	/* allocate the whole buffer now; at least sizeof(std::string)
+	   bytes, so the characters never live inside the std::string
+	   object (small string optimization), because moving an
+	   orphaned buffer away must not move its characters */
+	file.buffer.reserve(std::max(options.buffer_size,
+				     sizeof(std::string)));
+}
+
+void
+LogFileCache::Evict(File &file) noexcept
+{
+	Flush(file);
+
+	lru.erase(lru.iterator_to(file));
+
+	/* erase by iterator, because the key is owned by the node
+	   being erased */
+	files.erase(files.find(std::string_view{*file.path}));
+}
+
+bool
+LogFileCache::Append(const char *path, std::string_view line) noexcept
+{
+	File *file = Open(path);
+	if (file == nullptr)
+		return false;
+
+	if (file->buffer.size() + line.size() > options.buffer_size) {
+		Flush(*file);
+
+		if (line.size() > options.buffer_size) {
+			/* doesn't fit into the buffer at all */
+			WriteFully(file->fd, file->path->c_str(), line);
+			return true;
+		}
+	}
+
+	if (file->buffer.empty()) {
+		file->dirty_since = Clock::now();
+		dirty.push_back(*file);
+	}
+
+	file->buffer.append(line);
+	return true;
+}
+
+void
+LogFileCache::Flush(File &file) noexcept
+{
+	if (file.buffer.empty())
+		return;
+
+	WriteFully(file.fd, file.path->c_str(), file.buffer);
+	file.buffer.clear();
+	dirty.erase(dirty.iterator_to(file));
+}
+
+#ifdef HAVE_URING
+
+bool
+LogFileCache::CancelUring(std::vector<File *>::const_iterator begin,
+			  std::vector<File *>::const_iterator end) noexcept
+{
+	for (auto i = begin; i != end; ++i) {
+		File &file = **i;
+		if (!file.in_flight)
+			continue;
+
+		/* the submission queue was emptied by
+		   io_uring_submit(), so there is room for one cancel
+		   request per write */
+		auto *sqe = io_uring_get_sqe(ring.get());
+		if (sqe == nullptr)
+			return false;
+
+		io_uring_prep_cancel(sqe, &file, 0);
+
+		/* no File pointer: WaitUring() ignores the
+		   completions of cancel requests */
+		io_uring_sqe_set_data(sqe, nullptr);
+	}
+
+	int result;
+	do {
+		result = io_uring_submit(ring.get());
+	} while (result == -EINTR);
+
+	if (result < 0) {
+		fprintf(stderr, "io_uring_submit() failed: %s\n",
+			strerror(-result));
+		return false;
+	}
+
+	return true;
+}
+
+bool
+LogFileCache::WaitUring(std::vector<File *>::const_iterator begin,
+			std::vector<File *>::const_iterator end) noexcept
+{
+	unsigned n = 0;
+	for (auto i = begin; i != end; ++i)
+		if ((*i)->in_flight)
+			++n;
+
+	bool canceled = false;
+
+	while (n > 0) {
+		struct io_uring_cqe *cqe;
+		int result;
+		do {
+			result = io_uring_wait_cqe(ring.get(), &cqe);
+		} while (result == -EINTR);
+
+		if (result < 0) {
+			fprintf(stderr, "io_uring_wait_cqe() failed: %s\n",
+				strerror(-result));
+
+			if (canceled || !CancelUring(begin, end)) {
+				/* the kernel may still be reading from
+				   the buffers; don't touch them again,
+				   and give up on these lines */
+				for (auto i = begin; i != end; ++i) {
+					File &file = **i;
+					if (!file.in_flight)
+						continue;
+
+					fprintf(stderr, "Discarding %zu bytes for %s\n",
+						file.buffer.size(),
+						file.path->c_str());
+
+					file.in_flight = false;
+					orphaned_buffers.emplace_back(std::move(file.buffer));
+					file.buffer.clear();
+					ReserveBuffer(file);
+					dirty.erase(dirty.iterator_to(file));
+				}
+
+				return false;
+			}
+
+			canceled = true;
+			continue;
+		}
+
+		auto *data = io_uring_cqe_get_data(cqe);
+		const int res = cqe->res;
+		io_uring_cqe_seen(ring.get(), cqe);
+
+		if (data == nullptr)
+			/* completion of a cancel request */
+			continue;
+
+		File &file = *(File *)data;
+		assert(file.in_flight);
+		file.in_flight = false;
+		--n;
+
+		if (res == -ECANCELED)
+			/* not written; leave the buffer dirty for the
+			   synchronous fallback */
+			continue;
+
+		if (res < 0) {
+			fprintf(stderr, "Failed to write %s: %s\n",
+				file.path->c_str(), strerror(-res));
+		} else if (std::size_t(res) < file.buffer.size()) {
+			/* short write: write the rest
+			   synchronously */
+			WriteFully(file.fd, file.path->c_str(),
+				   std::string_view{file.buffer}.substr(res));
+		}
+
+		file.buffer.clear();
+		dirty.erase(dirty.iterator_to(file));
+	}
+
+	return !canceled;
+}
+
+void
+LogFileCache::FlushUring(const std::vector<File *> &list) noexcept
+{
+	auto i = list.begin();
+
+	while (i != list.end()) {
+		const auto first = i;
+
+		/* fill the submission queue */
+		unsigned n = 0;
+		for (; i != list.end(); ++i) {
+			auto *sqe = io_uring_get_sqe(ring.get());
+			if (sqe == nullptr)
+				break;
+
+			File &file = **i;
+
+			/* the offset is ignored because of O_APPEND */
+			io_uring_prep_write(sqe, file.fd.Get(),
+					    file.buffer.data(),
+					    file.buffer.size(), 0);
+			io_uring_sqe_set_data(sqe, &file);
+			++n;
+		}
+
+		/* submit without waiting, so an interrupted wait
+		   cannot be mistaken for a failed submission */
+		int result;
+		do {
+			result = io_uring_submit(ring.get());
+		} while (result == -EINTR);
+
+		if (result < 0)
+			fprintf(stderr, "io_uring_submit() failed: %s\n",
+				strerror(-result));
+
+		const unsigned submitted = result > 0 ? result : 0;
+		for (unsigned j = 0; j < submitted; ++j)
+			first[j]->in_flight = true;
+
+		/* collect all completions (or cancel the writes)
+		   before touching the buffers again; the kernel may
+		   still be reading from them */
+		if (!WaitUring(first, first + submitted) || submitted < n) {
+			/* give up on io_uring and fall back to
+			   synchronous writes for the rest; Flush()
+			   skips the files whose buffers have already
+			   been written or discarded */
+			io_uring_queue_exit(ring.get());
+			ring.reset();
+
+			for (auto j = first; j != list.end(); ++j)
+				Flush(**j);
+			return;
+		}
+	}
+}
+
+#endif
+
+void
+LogFileCache::Flush(const std::vector<File *> &list) noexcept
+{
+#ifdef HAVE_URING
+	if (ring) {
+		FlushUring(list);
+		return;
+	}
+#endif
+
+	for (File *file : list)
+		Flush(*file);
+}
+
+void
+LogFileCache::FlushExpired() noexcept
+{
+	if (dirty.empty())
+		return;
+
+	const auto expired = Clock::now() - options.max_age;
+
+	std::vector<File *> list;
+	for (auto &file : dirty) {
+		if (file.dirty_since > expired)
+			break;
+
+		list.push_back(&file);
+	}
+
+	Flush(list);
+}
+
+void
+LogFileCache::FlushAll() noexcept
+{
+	std::vector<File *> list;
+	for (auto &file : dirty)
+		list.push_back(&file);
+
+	Flush(list);
+}
+
+void
+LogFileCache::CloseAll() noexcept
+{
+	FlushAll();
+
+	lru.clear();
+	files.clear();
+}
+
+int
+LogFileCache::GetFlushTimeout() const noexcept
+{
+	if (dirty.empty())
+		return -1;
+
+	const auto remaining = dirty.front().dirty_since + options.max_age
+		- Clock::now();
+	if (remaining <= Clock::duration::zero())
+		return 0;
+
+	/* round up to avoid busy-looping */
+	return std::chrono::ceil<std::chrono::milliseconds>(remaining).count();
+}
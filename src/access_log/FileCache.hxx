@@ -0,0 +1,227 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "io/UniqueFileDescriptor.hxx"
+
+#include <boost/intrusive/list.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef HAVE_URING
+struct io_uring;
+#endif
+
+/**
+ * A LRU cache of open log files for log-split.  Lines are collected
+ * in a buffer per file, which is written when it is full, when its
+ * oldest line has reached a certain age, or when the file is evicted
+ * from the cache.
+ */
+class LogFileCache {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Options {
+		/**
+		 * The maximum number of files kept open.
+		 */
+		std::size_t max_files = 256;
+
+		/**
+		 * The buffer size per file.  0 means every line is
+		 * written immediately.
+		 */
+		std::size_t buffer_size = 16384;
+
+		/**
+		 * Buffered lines are written after this duration at
+		 * the latest.
+		 */
+		Clock::duration max_age = std::chrono::seconds(1);
+
+		/**
+		 * Submit the writes of all due buffers with one
+		 * io_uring_enter() call.
+		 */
+		bool uring = false;
+	};
+
+private:
+	const Options options;
+
+	struct File {
+		using LinkMode = boost::intrusive::link_mode<boost::intrusive::normal_link>;
+		using Hook = boost::intrusive::list_member_hook<LinkMode>;
+
+		Hook lru_hook, dirty_hook;
+
+		/**
+		 * Points to the key in #LogFileCache::files.
+		 */
+		const std::string *path;
+
+		UniqueFileDescriptor fd;
+
+		std::string buffer;
+
+		/**
+		 * When was the first line added to the (empty)
+		 * #buffer?
+		 */
+		Clock::time_point dirty_since;
+
+#ifdef HAVE_URING
+		/**
+		 * Is an io_uring write of the #buffer pending?
+		 */
+		bool in_flight = false;
+#endif
+
+		explicit File(UniqueFileDescriptor &&_fd) noexcept
+			:fd(std::move(_fd)) {}
+	};
+
+	std::map<std::string, File, std::less<>> files;
+
+	/**
+	 * All open files, most recently used first.
+	 */
+	boost::intrusive::list<File,
+			       boost::intrusive::member_hook<File, File::Hook,
+							     &File::lru_hook>,
+			       boost::intrusive::constant_time_size<false>> lru;
+
+	/**
+	 * Files with a non-empty buffer, oldest first.
+	 */
+	boost::intrusive::list<File,
+			       boost::intrusive::member_hook<File, File::Hook,
+							     &File::dirty_hook>,
+			       boost::intrusive::constant_time_size<false>> dirty;
+
+#ifdef HAVE_URING
+	std::unique_ptr<struct io_uring> ring;
+
+	/**
+	 * Buffers of io_uring writes whose completion could not be
+	 * collected.  The kernel may still read from them, so they
+	 * are kept alive until the cache is destroyed.
+	 */
+	std::vector<std::string> orphaned_buffers;
+#endif
+
+public:
+	/**
+	 * Throws on error (e.g. if io_uring is not available).
+	 */
+	explicit LogFileCache(const Options &_options);
+
+	/**
+	 * Writes all buffers and closes all files.
+	 */
+	~LogFileCache() noexcept;
+
+	LogFileCache(const LogFileCache &) = delete;
+	LogFileCache &operator=(const LogFileCache &) = delete;
+
+	/**
+	 * Append a line (including the newline character) to the
+	 * given file.  It is opened (and its parent directories are
+	 * created) if necessary.
+	 *
+	 * @return false if the file could not be opened
+	 */
+	bool Append(const char *path, std::string_view line) noexcept;
+
+	/**
+	 * Write all buffers which have reached the maximum age.
+	 */
+	void FlushExpired() noexcept;
+
+	/**
+	 * Write all buffers.
+	 */
+	void FlushAll() noexcept;
+
+	/**
+	 * Write all buffers and close all files.  They will be
+	 * reopened by the next Append() call; this is used after log
+	 * rotation.
+	 */
+	void CloseAll() noexcept;
+
+	/**
+	 * Returns the number of milliseconds until the next buffer
+	 * expires (for poll()), or -1 if all buffers are empty.
+	 */
+	[[gnu::pure]]
+	int GetFlushTimeout() const noexcept;
+
+private:
+	File *Open(const char *path) noexcept;
+	void ReserveBuffer(File &file) const noexcept;
+	void Evict(File &file) noexcept;
+
+	void Flush(File &file) noexcept;
+	void Flush(const std::vector<File *> &list) noexcept;
+
+#ifdef HAVE_URING
+	/**
+	 * Wait for the completions of all writes submitted for the
+	 * given files and finish them.  If waiting fails, the
+	 * pending writes are canceled, and their completions are
+	 * collected before returning.
+	 *
+	 * @return false on error (the buffers of canceled writes are
+	 * still dirty)
+	 */
+	bool WaitUring(std::vector<File *>::const_iterator begin,
+		       std::vector<File *>::const_iterator end) noexcept;
+
+	/**
+	 * Cancel all pending writes of the given files.
+	 *
+	 * @return false on error
+	 */
+	bool CancelUring(std::vector<File *>::const_iterator begin,
+			 std::vector<File *>::const_iterator end) noexcept;
+
+	void FlushUring(const std::vector<File *> &list) noexcept;
+#endif
+};
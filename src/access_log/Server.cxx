@@ -34,11 +34,31 @@
 #include "net/log/Parser.hxx"
 
 #include <sys/socket.h>
+#include <poll.h>
+#include <errno.h>
 #include <stdlib.h>
 
 AccessLogServer::AccessLogServer()
 	:AccessLogServer(SocketDescriptor(STDIN_FILENO)) {}
 
+bool
+AccessLogServer::Wait(int timeout_ms, const sigset_t *sigmask) noexcept
+{
+	struct pollfd pfd{fd.Get(), POLLIN, 0};
+
+	struct timespec timeout, *timeout_p = nullptr;
+	if (timeout_ms >= 0) {
+		timeout.tv_sec = timeout_ms / 1000;
+		timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+		timeout_p = &timeout;
+	}
+
+	/* errors other than EINTR are reported by the following
+	   recvmmsg() call */
+	int result = ppoll(&pfd, 1, timeout_p, sigmask);
+	return result > 0 || (result < 0 && errno != EINTR);
+}
+
 bool
 AccessLogServer::Fill()
 {
@@ -39,6 +39,8 @@
 
 #include <array>
 
+#include <signal.h>
+
 /**
  * An extension of #Net::Log::Datagram which contains information on
  * the receipt.
@@ -79,6 +81,23 @@ public:
 
 	const ReceivedAccessLogDatagram *Receive();
 
+	/**
+	 * Are there datagrams left from the last recvmmsg() call?  If
+	 * yes, then Receive() will not block.
+	 */
+	bool HasBuffered() const noexcept {
+		return current_payload < n_payloads;
+	}
+
+	/**
+	 * Wait until the socket becomes readable.  Signals in the
+	 * given mask are unblocked while waiting.
+	 *
+	 * @param timeout_ms the timeout in milliseconds or -1
+	 * @return false on timeout or if a signal was caught
+	 */
+	bool Wait(int timeout_ms, const sigset_t *sigmask=nullptr) noexcept;
+
 	template<typename F>
 	void Run(F &&f) {
 		while (const auto *d = Receive())
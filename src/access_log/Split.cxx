@@ -36,20 +36,19 @@
  */
 
 #include "Server.hxx"
+#include "FileCache.hxx"
 #include "net/log/OneLine.hxx"
 #include "time/Convert.hxx"
 #include "util/ConstBuffer.hxx"
+#include "util/PrintException.hxx"
+
+#include <algorithm>
 
-#include <sys/stat.h>
-#include <sys/types.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <errno.h>
-#include <limits.h>
+#include <signal.h>
 
 static bool use_local_time = false;
 
@@ -153,115 +152,136 @@ generate_path(const char *template_, const Net::Log::Datagram &d)
 }
 
 static bool
-make_parent_directory_recursive(char *path)
+Dump(LogFileCache &files, const char *template_path,
+     const Net::Log::Datagram &d)
 {
-	char *slash = strrchr(path, '/');
-	if (slash == nullptr || slash == path)
-		return true;
-
-	*slash = 0;
-	int ret = mkdir(path, 0777);
-	if (ret >= 0) {
-		/* success */
-		*slash = '/';
-		return true;
-	} else if (errno == ENOENT) {
-		if (!make_parent_directory_recursive(path))
-			return false;
-
-		/* try again */
-		ret = mkdir(path, 0777);
-		*slash = '/';
-		return ret >= 0;
-	} else {
-		fprintf(stderr, "Failed to create directory %s: %s\n",
-			path, strerror(errno));
-
-		return false;
-	}
-}
-
-static bool
-make_parent_directory(const char *path)
-{
-	char buffer[PATH_MAX];
-	if (strlen(path) >= sizeof(buffer)) {
-		fprintf(stderr, "Path too long\n");
+	const char *path = generate_path(template_path, d);
+	if (path == nullptr)
 		return false;
-	}
 
-	strcpy(buffer, path);
+	char buffer[16384];
+	char *end = FormatOneLine(buffer, sizeof(buffer) - 1, d);
+	*end++ = '\n';
 
-	return make_parent_directory_recursive(buffer);
+	files.Append(path, {buffer, std::size_t(end - buffer)});
+	return true;
 }
 
-static FileDescriptor
-open_log_file(const char *path)
-{
-	static FileDescriptor cache_fd = FileDescriptor::Undefined();
-	static char cache_path[PATH_MAX];
-
-	if (cache_fd.IsDefined()) {
-		if (strcmp(path, cache_path) == 0)
-			return cache_fd;
-
-		cache_fd.Close();
-	}
-
-	if (!cache_fd.Open(path, O_CREAT|O_APPEND|O_WRONLY, 0666) &&
-	    errno == ENOENT) {
-		if (!make_parent_directory(path))
-			return cache_fd;
-
-		/* try again */
-		cache_fd.Open(path, O_CREAT|O_APPEND|O_WRONLY, 0666);
-	}
+static volatile sig_atomic_t quit = false;
 
-	if (!cache_fd.IsDefined()) {
-		fprintf(stderr, "Failed to open %s: %s\n",
-			path, strerror(errno));
-		return cache_fd;
-	}
+static void
+OnQuitSignal(int) noexcept
+{
+	quit = true;
+}
 
-	strcpy(cache_path, path);
+static volatile sig_atomic_t reopen = false;
 
-	return cache_fd;
+static void
+OnReopenSignal(int) noexcept
+{
+	reopen = true;
 }
 
-static bool
-Dump(const char *template_path, const Net::Log::Datagram &d)
+static void
+Usage()
 {
-	const char *path = generate_path(template_path, d);
-	if (path == nullptr)
-		return false;
+	fprintf(stderr, "Usage: log-split [--localtime] [--max-files=N]"
+		" [--buffer-size=BYTES] [--flush-interval=MS] [--io-uring]"
+		" TEMPLATE [...]\n");
+}
 
-	auto fd = open_log_file(path);
-	if (fd.IsDefined())
-		LogOneLine(fd, d);
+static unsigned long
+ParseNumber(const char *s)
+{
+	char *endptr;
+	unsigned long value = strtoul(s, &endptr, 10);
+	if (endptr == s || *endptr != 0) {
+		Usage();
+		exit(EXIT_FAILURE);
+	}
 
-	return true;
+	return value;
 }
 
 int main(int argc, char **argv)
-{
+try {
+	LogFileCache::Options options;
+
 	int argi = 1;
-	if (argi < argc && strcmp(argv[argi], "--localtime") == 0) {
-		++argi;
-		use_local_time = true;
+	for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; ++argi) {
+		const char *arg = argv[argi];
+		if (strcmp(arg, "--localtime") == 0)
+			use_local_time = true;
+		else if (strncmp(arg, "--max-files=", 12) == 0)
+			options.max_files = std::max(ParseNumber(arg + 12), 1UL);
+		else if (strncmp(arg, "--buffer-size=", 14) == 0)
+			options.buffer_size = ParseNumber(arg + 14);
+		else if (strncmp(arg, "--flush-interval=", 17) == 0)
+			options.max_age = std::chrono::milliseconds(ParseNumber(arg + 17));
+		else if (strcmp(arg, "--io-uring") == 0)
+			options.uring = true;
+		else {
+			Usage();
+			return EXIT_FAILURE;
+		}
 	}
 
 	if (argi >= argc) {
-		fprintf(stderr, "Usage: log-split [--localtime] TEMPLATE [...]\n");
+		Usage();
 		return EXIT_FAILURE;
 	}
 
 	ConstBuffer<const char *> templates(&argv[argi], argc - argi);
 
-	AccessLogServer().Run([templates](const Net::Log::Datagram &d){
+	LogFileCache files(options);
+
+	/* the signals are only delivered while waiting for
+	   datagrams, so buffered lines can be written before exiting
+	   (SIGTERM, SIGINT) or closing all files (SIGHUP, after log
+	   rotation) */
+	struct sigaction sa{};
+	sa.sa_handler = OnQuitSignal;
+	sigaction(SIGTERM, &sa, nullptr);
+	sigaction(SIGINT, &sa, nullptr);
+	sa.sa_handler = OnReopenSignal;
+	sigaction(SIGHUP, &sa, nullptr);
+
+	sigset_t signals, wait_mask;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGHUP);
+	sigprocmask(SIG_BLOCK, &signals, &wait_mask);
+
+	AccessLogServer server;
+
+	while (!quit) {
+		if (reopen) {
+			reopen = false;
+			files.CloseAll();
+		}
+
+		if (!server.HasBuffered() &&
+		    !server.Wait(files.GetFlushTimeout(), &wait_mask)) {
+			/* timeout or signal */
+			files.FlushExpired();
+			continue;
+		}
+
+		const auto *d = server.Receive();
+		if (d == nullptr)
+			break;
+
 		for (const char *t : templates)
-			if (Dump(t, d))
+			if (Dump(files, t, *d))
 				break;
-	});
 
-	return 0;
+		files.FlushExpired();
+	}
+
+	return EXIT_SUCCESS;
+} catch (const std::exception &e) {
+	PrintException(e);
+	return EXIT_FAILURE;
 }
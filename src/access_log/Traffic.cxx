@@ -32,12 +32,21 @@
 
 /*
  * Print the site name and the bytes transferred for each request.
+ *
+ * With --interval, traffic is summed per site instead, and a
+ * snapshot is printed periodically, on SIGUSR1 and before exiting.
  */
 
 #include "Server.hxx"
+#include "TrafficAggregator.hxx"
 #include "net/log/Datagram.hxx"
 
+#include <chrono>
+
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 static void
 dump(const Net::Log::Datagram &d)
@@ -47,11 +56,108 @@ dump(const Net::Log::Datagram &d)
 		       (unsigned long long)(d.traffic_received + d.traffic_sent));
 }
 
+static volatile sig_atomic_t quit = false, snapshot_requested = false;
+
+static void
+OnQuitSignal(int) noexcept
+{
+	quit = true;
+}
+
+static void
+OnSnapshotSignal(int) noexcept
+{
+	snapshot_requested = true;
+}
+
+static void
+Aggregate(std::chrono::seconds interval, SnapshotFormat format)
+{
+	TrafficAggregator aggregator(format);
+
+	/* the signals are only delivered while waiting for
+	   datagrams */
+	struct sigaction sa{};
+	sa.sa_handler = OnQuitSignal;
+	sigaction(SIGTERM, &sa, nullptr);
+	sigaction(SIGINT, &sa, nullptr);
+	sa.sa_handler = OnSnapshotSignal;
+	sigaction(SIGUSR1, &sa, nullptr);
+
+	sigset_t signals, wait_mask;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &signals, &wait_mask);
+
+	using Clock = std::chrono::steady_clock;
+	auto next_snapshot = Clock::now() + interval;
+
+	AccessLogServer server;
+
+	while (!quit) {
+		const auto now = Clock::now();
+		if (snapshot_requested || now >= next_snapshot) {
+			snapshot_requested = false;
+			aggregator.Snapshot();
+			next_snapshot = now + interval;
+		}
+
+		if (!server.HasBuffered()) {
+			const auto timeout = std::chrono::ceil<std::chrono::milliseconds>(next_snapshot - now);
+			if (!server.Wait(timeout.count(), &wait_mask))
+				/* timeout or signal */
+				continue;
+		}
+
+		const auto *d = server.Receive();
+		if (d == nullptr)
+			break;
+
+		aggregator.Add(*d);
+	}
+
+	aggregator.Snapshot();
+}
+
+static void
+Usage()
+{
+	fprintf(stderr, "Usage: log-traffic [--interval=SECONDS"
+		" [--format=text|json|binary]]\n");
+}
+
 int main(int argc, char **argv)
 {
-	(void)argc;
-	(void)argv;
+	unsigned long interval = 0;
+	SnapshotFormat format = SnapshotFormat::TEXT;
+
+	for (int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		if (strncmp(arg, "--interval=", 11) == 0) {
+			char *endptr;
+			interval = strtoul(arg + 11, &endptr, 10);
+			if (endptr == arg + 11 || *endptr != 0 || interval == 0) {
+				Usage();
+				return EXIT_FAILURE;
+			}
+		} else if (strcmp(arg, "--format=text") == 0)
+			format = SnapshotFormat::TEXT;
+		else if (strcmp(arg, "--format=json") == 0)
+			format = SnapshotFormat::JSON;
+		else if (strcmp(arg, "--format=binary") == 0)
+			format = SnapshotFormat::BINARY;
+		else {
+			Usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (interval > 0)
+		Aggregate(std::chrono::seconds(interval), format);
+	else
+		AccessLogServer().Run(dump);
 
-	AccessLogServer().Run(dump);
 	return 0;
 }
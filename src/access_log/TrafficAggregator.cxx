@@ -0,0 +1,158 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "TrafficAggregator.hxx"
+#include "JsonWriter.hxx"
+#include "net/log/Datagram.hxx"
+#include "util/ByteOrder.hxx"
+
+#include <algorithm>
+
+void
+TrafficAggregator::Add(const Net::Log::Datagram &d)
+{
+	if (d.site == nullptr)
+		return;
+
+	auto i = sites.find(d.site);
+	if (i == sites.end())
+		i = sites.emplace(d.site, SiteTraffic{}).first;
+
+	auto &t = i->second;
+	++t.requests;
+	if (d.valid_traffic) {
+		t.received += d.traffic_received;
+		t.sent += d.traffic_sent;
+	}
+}
+
+void
+TrafficAggregator::Snapshot(time_t now) noexcept
+{
+	switch (format) {
+	case SnapshotFormat::TEXT:
+		WriteText();
+		break;
+
+	case SnapshotFormat::JSON:
+		WriteJson(now);
+		break;
+
+	case SnapshotFormat::BINARY:
+		WriteBinary(now);
+		break;
+	}
+
+	fflush(file);
+	sites.clear();
+}
+
+/**
+ * One line "SITENAME REQUESTS RECEIVED SENT" per site; the snapshot
+ * ends with an empty line.
+ */
+void
+TrafficAggregator::WriteText() noexcept
+{
+	for (const auto &[site, t] : sites)
+		fprintf(file, "%s %llu %llu %llu\n", site.c_str(),
+			(unsigned long long)t.requests,
+			(unsigned long long)t.received,
+			(unsigned long long)t.sent);
+
+	fputc('\n', file);
+}
+
+/**
+ * One JSON object per snapshot (JSON Lines).
+ */
+void
+TrafficAggregator::WriteJson(time_t now) noexcept
+{
+	JsonWriter::Sink sink(file);
+
+	JsonWriter::Object o(sink);
+	o.AddMember("time", int64_t(now));
+
+	JsonWriter::Object s(o.AddMember("sites"));
+	for (const auto &[site, t] : sites) {
+		JsonWriter::Object j(s.AddMember(site.c_str()));
+		j.AddMember("requests", t.requests);
+		j.AddMember("received", t.received);
+		j.AddMember("sent", t.sent);
+		j.Flush();
+	}
+
+	s.Flush();
+	o.Flush();
+	sink.NewLine();
+}
+
+/**
+ * A header (uint32 magic, uint64 time, uint32 number of sites),
+ * followed by one record per site (uint16 name length, name, uint64
+ * requests, received, sent).  All numbers are big-endian.
+ */
+void
+TrafficAggregator::WriteBinary(time_t now) noexcept
+{
+	static constexpr uint32_t MAGIC = 0x54524146; // "TRAF"
+
+	WriteBE32(MAGIC);
+	WriteBE64(now);
+	WriteBE32(sites.size());
+
+	for (const auto &[site, t] : sites) {
+		const uint16_t length = std::min(site.length(),
+						 std::size_t(UINT16_MAX));
+		const uint16_t length_be = ToBE16(length);
+		fwrite(&length_be, sizeof(length_be), 1, file);
+		fwrite(site.data(), 1, length, file);
+		WriteBE64(t.requests);
+		WriteBE64(t.received);
+		WriteBE64(t.sent);
+	}
+}
+
+inline void
+TrafficAggregator::WriteBE32(uint32_t value) noexcept
+{
+	value = ToBE32(value);
+	fwrite(&value, sizeof(value), 1, file);
+}
+
+inline void
+TrafficAggregator::WriteBE64(uint64_t value) noexcept
+{
+	value = ToBE64(value);
+	fwrite(&value, sizeof(value), 1, file);
+}
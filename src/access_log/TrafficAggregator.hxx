@@ -0,0 +1,93 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
+#include <stdio.h>
+#include <time.h>
+
+namespace Net::Log { struct Datagram; }
+
+enum class SnapshotFormat {
+	TEXT,
+	JSON,
+	BINARY,
+};
+
+struct SiteTraffic {
+	uint64_t requests = 0, received = 0, sent = 0;
+};
+
+/**
+ * Sums up the traffic of each site until the next snapshot.
+ */
+class TrafficAggregator {
+	const SnapshotFormat format;
+
+	FILE *const file;
+
+	std::map<std::string, SiteTraffic, std::less<>> sites;
+
+public:
+	explicit TrafficAggregator(SnapshotFormat _format,
+				   FILE *_file=stdout) noexcept
+		:format(_format), file(_file) {}
+
+	void Add(const Net::Log::Datagram &d);
+
+	/**
+	 * Print all sites which had traffic since the last snapshot,
+	 * and start over.
+	 */
+	void Snapshot() noexcept {
+		Snapshot(time(nullptr));
+	}
+
+	/**
+	 * Like Snapshot(), but with an explicit time stamp (for the
+	 * JSON and binary formats).
+	 */
+	void Snapshot(time_t now) noexcept;
+
+private:
+	void WriteText() noexcept;
+	void WriteJson(time_t now) noexcept;
+	void WriteBinary(time_t now) noexcept;
+
+	void WriteBE32(uint32_t value) noexcept;
+	void WriteBE64(uint64_t value) noexcept;
+};
@@ -60,10 +60,16 @@ BpConfig::HandleSet(StringView name, const char *value)
 		max_connections = ParsePositiveLong(value, 1024 * 1024);
 	} else if (name.Equals("tcp_stock_limit")) {
 		tcp_stock_limit = ParseUnsignedLong(value);
+	} else if (name.Equals("tcp_stock_min_idle")) {
+		tcp_stock_min_idle = ParseUnsignedLong(value);
+	} else if (name.Equals("tcp_fast_open")) {
+		tcp_fast_open = ParseBool(value);
 	} else if (name.Equals("fastcgi_stock_limit")) {
 		fcgi_stock_limit = ParseUnsignedLong(value);
 	} else if (name.Equals("fcgi_stock_max_idle")) {
 		fcgi_stock_max_idle = ParseUnsignedLong(value);
+	} else if (name.Equals("child_stock_min_idle")) {
+		child_stock_min_idle = ParseUnsignedLong(value);
 	} else if (name.Equals("was_stock_limit")) {
 		was_stock_limit = ParseUnsignedLong(value);
 	} else if (name.Equals("was_stock_max_idle")) {
@@ -76,10 +82,20 @@ BpConfig::HandleSet(StringView name, const char *value)
 		filter_cache_size = ParseSize(value);
 	} else if (name.Equals("nfs_cache_size")) {
 		nfs_cache_size = ParseSize(value);
+	} else if (name.Equals("file_cache_size")) {
+		file_cache_size = ParseUnsignedLong(value);
+	} else if (name.Equals("file_cache_ttl")) {
+		file_cache_ttl = Pg::ParseIntervalS(value);
+		if (file_cache_ttl <= file_cache_ttl.zero())
+			throw std::runtime_error("Invalid value");
+	} else if (name.Equals("widget_fragment_cache_size")) {
+		widget_fragment_cache_size = ParseSize(value);
 	} else if (name.Equals("translate_cache_size")) {
 		translate_cache_size = ParseUnsignedLong(value);
 	} else if (name.Equals("translate_stock_limit")) {
 		translate_stock_limit = ParseUnsignedLong(value);
+	} else if (name.Equals("translate_multiplex")) {
+		translate_multiplex = ParseBool(value);
 	} else if (name.Equals("stopwatch")) {
 		/* deprecated */
 	} else if (name.Equals("dump_widget_tree")) {
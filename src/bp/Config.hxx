@@ -39,6 +39,7 @@
 
 #include <forward_list>
 #include <chrono>
+#include <string>
 
 #include <stddef.h>
 
@@ -106,6 +107,29 @@ struct BpConfig {
 
 	std::forward_list<ControlListener> control_listen;
 
+	/**
+	 * Session replication between cluster nodes (see
+	 * #SessionReplicator).
+	 */
+	struct SessionReplication {
+		/**
+		 * Receive replicas from peers on this socket.
+		 */
+		SocketConfig listen;
+
+		/**
+		 * Send local modifications to these peers.  Only
+		 * datagrams from these hosts are accepted by the
+		 * receiver.
+		 */
+		std::forward_list<AllocatedSocketAddress> peers;
+
+		/**
+		 * The shared secret used to authenticate datagrams.
+		 */
+		std::string secret;
+	} session_replication;
+
 	std::forward_list<AllocatedSocketAddress> translation_sockets;
 
 	/** maximum number of simultaneous connections */
@@ -117,13 +141,59 @@ struct BpConfig {
 
 	size_t nfs_cache_size = 256 * 1024 * 1024;
 
+	/**
+	 * The maximum number of open file descriptors kept by the
+	 * #OpenFileCache.  0 disables it.
+	 */
+	unsigned file_cache_size = 0;
+
+	/**
+	 * How long may a file descriptor stay in the #OpenFileCache?
+	 */
+	std::chrono::seconds file_cache_ttl = std::chrono::seconds(1);
+
+	/**
+	 * The maximum amount of memory used by the
+	 * #WidgetFragmentCache.  0 disables it.
+	 */
+	size_t widget_fragment_cache_size = 0;
+
 	unsigned translate_cache_size = 131072;
 	unsigned translate_stock_limit = 64;
 
+	/**
+	 * Send many concurrent requests over one translation server
+	 * connection (if the server supports it)?
+	 */
+	bool translate_multiplex = false;
+
 	unsigned tcp_stock_limit = 0;
 
+	/**
+	 * The minimum number of idle connections per upstream
+	 * server.  0 disables pre-warming.
+	 */
+	unsigned tcp_stock_min_idle = 0;
+
+	/**
+	 * Use TCP Fast Open for outgoing connections?
+	 */
+	bool tcp_fast_open = false;
+
 	unsigned fcgi_stock_limit = 0, fcgi_stock_max_idle = 8;
 
+	/**
+	 * The "max_idle" setting of the LHTTP stock (not
+	 * configurable).
+	 */
+	static constexpr unsigned lhttp_stock_max_idle = 8;
+
+	/**
+	 * The minimum number of idle child processes per FastCGI and
+	 * LHTTP application.  0 disables pre-spawning.
+	 */
+	unsigned child_stock_min_idle = 0;
+
 	unsigned was_stock_limit = 0, was_stock_max_idle = 16;
 
 	unsigned cluster_size = 0, cluster_node = 0;
@@ -74,6 +74,20 @@ class BpConfigParser final : public NestedConfigParser {
 		void Finish() override;
 	};
 
+	class SessionReplication final : public ConfigParser {
+		BpConfigParser &parent;
+		BpConfig::SessionReplication config;
+
+	public:
+		explicit SessionReplication(BpConfigParser &_parent)
+			:parent(_parent) {}
+
+	protected:
+		/* virtual methods from class ConfigParser */
+		void ParseLine(FileLineParser &line) override;
+		void Finish() override;
+	};
+
 public:
 	explicit BpConfigParser(BpConfig &_config)
 		:config(_config) {}
@@ -86,6 +100,7 @@ protected:
 private:
 	void CreateListener(FileLineParser &line);
 	void CreateControl(FileLineParser &line);
+	void CreateSessionReplication(FileLineParser &line);
 };
 
 class SslClientConfigParser : public ConfigParser {
@@ -267,6 +282,48 @@ BpConfigParser::CreateControl(FileLineParser &line)
 	SetChild(std::make_unique<Control>(*this));
 }
 
+void
+BpConfigParser::SessionReplication::ParseLine(FileLineParser &line)
+{
+	const char *word = line.ExpectWord();
+
+	if (strcmp(word, "bind") == 0) {
+		config.listen.bind_address = ParseSocketAddress(line.ExpectValueAndEnd(),
+								5479, true);
+	} else if (strcmp(word, "interface") == 0) {
+		config.listen.interface = line.ExpectValueAndEnd();
+	} else if (strcmp(word, "peer") == 0) {
+		config.peers.emplace_front(ParseSocketAddress(line.ExpectValueAndEnd(),
+							      5479, false));
+	} else if (strcmp(word, "secret") == 0) {
+		config.secret = line.ExpectValueAndEnd();
+		if (config.secret.length() < 16)
+			throw LineParser::Error("Secret is too short");
+	} else
+		throw LineParser::Error("Unknown option");
+}
+
+void
+BpConfigParser::SessionReplication::Finish()
+{
+	if (config.peers.empty())
+		throw LineParser::Error("No peers specified");
+
+	if (config.secret.empty())
+		throw LineParser::Error("No secret specified");
+
+	parent.config.session_replication = std::move(config);
+
+	ConfigParser::Finish();
+}
+
+inline void
+BpConfigParser::CreateSessionReplication(FileLineParser &line)
+{
+	line.ExpectSymbolAndEol('{');
+	SetChild(std::make_unique<SessionReplication>(*this));
+}
+
 void
 BpConfigParser::ParseLine2(FileLineParser &line)
 {
@@ -276,6 +333,8 @@ BpConfigParser::ParseLine2(FileLineParser &line)
 		CreateListener(line);
 	else if (strcmp(word, "control") == 0)
 		CreateControl(line);
+	else if (strcmp(word, "session_replication") == 0)
+		CreateSessionReplication(line);
 	else if (strcmp(word, "access_logger") == 0) {
 		if (line.SkipSymbol('{')) {
 			line.ExpectEnd();
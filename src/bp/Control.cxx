@@ -34,7 +34,9 @@
 #include "Instance.hxx"
 #include "session/Manager.hxx"
 #include "fcache.hxx"
+#include "widget/FragmentCache.hxx"
 #include "nfs/Cache.hxx"
+#include "istream/YamlSubstIstream.hxx"
 #include "control/Server.hxx"
 #include "control/Local.hxx"
 #include "translation/Builder.hxx"
@@ -44,10 +46,15 @@
 #include "pool/pool.hxx"
 #include "net/SocketAddress.hxx"
 #include "io/Logger.hxx"
+#include "util/ByteOrder.hxx"
 #include "util/ConstBuffer.hxx"
 #include "util/WritableBuffer.hxx"
 #include "stopwatch.hxx"
 
+#include <algorithm>
+
+#include <string.h>
+
 using namespace BengProxy;
 
 static void
@@ -182,6 +189,11 @@ BpInstance::OnControlPacket(ControlServer &control_server,
 		break;
 
 	case ControlCommand::FLUSH_FILTER_CACHE:
+#ifdef HAVE_YAML
+		if (payload.empty())
+			FlushYamlSubstCache();
+#endif
+
 		if (filter_cache != nullptr) {
 			if (payload.empty())
 				filter_cache_flush(*filter_cache);
@@ -191,6 +203,15 @@ BpInstance::OnControlPacket(ControlServer &control_server,
 								   payload.size).c_str());
 		}
 
+		if (widget_fragment_cache != nullptr) {
+			if (payload.empty())
+				widget_fragment_cache_flush(*widget_fragment_cache);
+			else
+				widget_fragment_cache_flush_tag(*widget_fragment_cache,
+								std::string((const char *)payload.data,
+									    payload.size).c_str());
+		}
+
 		break;
 
 	case ControlCommand::STOPWATCH_PIPE:
@@ -201,6 +222,19 @@ BpInstance::OnControlPacket(ControlServer &control_server,
 		if (!payload.empty() && session_manager)
 			session_manager->DiscardAttachSession(ConstBuffer<std::byte>::FromVoid(payload));
 		break;
+
+	case ControlCommand::CHILD_MIN_IDLE:
+		if (is_privileged && payload.size == sizeof(uint32_t)) {
+			uint32_t value;
+			memcpy(&value, payload.data, sizeof(value));
+			/* more than "max_idle" would be killed right
+			   away */
+			SetChildMinIdle(std::min<unsigned>(FromBE32(value),
+							   std::max(config.fcgi_stock_max_idle,
+								    config.lhttp_stock_max_idle)));
+		}
+
+		break;
 	}
 }
 
@@ -31,6 +31,7 @@
  */
 
 #include "FileHeaders.hxx"
+#include "OpenFileCache.hxx"
 #include "file_address.hxx"
 #include "Request.hxx"
 #include "Instance.hxx"
@@ -145,7 +146,7 @@ Request::DispatchCompressedFile(const char *path, FileDescriptor fd,
 	UniqueFileDescriptor compressed_fd;
 
 	try {
-		compressed_fd = OpenReadOnly(handler.file.base, path);
+		compressed_fd = OpenReadOnly(GetFileBase(), path);
 	} catch (...) {
 		return false;
 	}
@@ -255,7 +256,13 @@ void
 Request::OnOpenStat(UniqueFileDescriptor fd,
 		    struct statx &st) noexcept
 {
-	HandleFileAddress(*handler.file.address, std::move(fd), st);
+	const auto &address = *handler.file.address;
+
+	if (instance.open_file_cache)
+		instance.open_file_cache->Put(address.base, address.path,
+					      fd, st);
+
+	HandleFileAddress(address, std::move(fd), st);
 }
 
 void
@@ -266,6 +273,27 @@ Request::OnOpenStatError(std::exception_ptr e) noexcept
 
 #endif
 
+FileDescriptor
+Request::GetFileBase()
+{
+	auto &file = handler.file;
+
+	if (file.address->base == nullptr)
+		return file.base = FileDescriptor(AT_FDCWD);
+
+	if (!file.base.IsDefined()) {
+		// TODO: use uring
+		file.base = file.base_ = IsKernelVersionOrNewer({5, 6, 13})
+			? OpenPath(file.address->base)
+			/* O_PATH file descriptors are broken in
+			   io_uring until at least 5.6.12, see
+			   https://lkml.org/lkml/2020/5/7/1287 */
+			: OpenDirectory(file.address->base);
+	}
+
+	return file.base;
+}
+
 void
 Request::HandleFileAddress(const FileAddress &address) noexcept
 {
@@ -291,23 +319,26 @@ Request::HandleFileAddress(const FileAddress &address) noexcept
 
 	/* open the file */
 
-	if (address.base != nullptr) {
-		// TODO: use uring
-		try {
-			handler.file.base =
-				handler.file.base_ = IsKernelVersionOrNewer({5, 6, 13})
-				? OpenPath(address.base)
-				/* O_PATH file descriptors are broken
-				   in io_uring until at least 5.6.12,
-				   see
-				   https://lkml.org/lkml/2020/5/7/1287 */
-				: OpenDirectory(address.base);
-		} catch (...) {
-			LogDispatchError(std::current_exception());
+	handler.file.base = FileDescriptor::Undefined();
+
+	if (instance.open_file_cache) {
+		/* look up before opening the base directory; on a
+		   hit, it is only opened if needed (see
+		   GetFileBase()) */
+		struct statx st;
+		auto fd = instance.open_file_cache->Get(address.base, path, st);
+		if (fd.IsDefined()) {
+			HandleFileAddress(address, std::move(fd), st);
 			return;
 		}
-	} else
-		handler.file.base = FileDescriptor(AT_FDCWD);
+	}
+
+	try {
+		GetFileBase();
+	} catch (...) {
+		LogDispatchError(std::current_exception());
+		return;
+	}
 
 #ifdef HAVE_URING
 	if (instance.uring) {
@@ -333,6 +364,9 @@ Request::HandleFileAddress(const FileAddress &address) noexcept
 		return;
 	}
 
+	if (instance.open_file_cache)
+		instance.open_file_cache->Put(address.base, path, fd, st);
+
 	HandleFileAddress(address, std::move(fd), st);
 }
 
@@ -906,6 +906,11 @@ Request::HandleHttpRequest(CancellablePointer &caller_cancel_ptr) noexcept
 			       dissected_uri,
 			       connection.listener.GetTag());
 
+	/* all users of translate.response treat it as read-only, so
+	   cached responses may be used without copying */
+	translate.request.cache_lease =
+		&((BpRequestLogger *)request.logger)->translation_cache_lease;
+
 	if (translate.request.host == nullptr) {
 		DispatchError(HTTP_STATUS_BAD_REQUEST, "No Host header");
 		return;
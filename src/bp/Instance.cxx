@@ -44,6 +44,8 @@
 #include "BufferedResourceLoader.hxx"
 #include "http_cache.hxx"
 #include "fcache.hxx"
+#include "OpenFileCache.hxx"
+#include "widget/FragmentCache.hxx"
 #include "translation/Stock.hxx"
 #include "translation/Cache.hxx"
 #include "translation/Multi.hxx"
@@ -61,10 +63,12 @@
 #include "stock/MapStock.hxx"
 #include "session/Manager.hxx"
 #include "session/Save.hxx"
+#include "session/Replication.hxx"
 #include "nfs/Stock.hxx"
 #include "nfs/Cache.hxx"
 #include "spawn/Client.hxx"
 #include "access_log/Glue.hxx"
+#include "istream/YamlSubstIstream.hxx"
 #include "util/PrintException.hxx"
 #include "random.hxx"
 
@@ -126,6 +130,20 @@ BpInstance::FreeStocksAndCaches() noexcept
 		filter_cache = nullptr;
 	}
 
+#ifdef HAVE_YAML
+	/* release the cached trees (and their pools) now; the
+	   static destructor would run after the pool allocator has
+	   been shut down */
+	FlushYamlSubstCache();
+#endif
+
+	open_file_cache.reset();
+
+	if (widget_fragment_cache != nullptr) {
+		widget_fragment_cache_close(widget_fragment_cache);
+		widget_fragment_cache = nullptr;
+	}
+
 	if (lhttp_stock != nullptr) {
 		lhttp_stock_free(lhttp_stock);
 		lhttp_stock = nullptr;
@@ -186,6 +204,9 @@ BpInstance::ForkCow(bool inherit) noexcept
 	if (filter_cache != nullptr)
 		filter_cache_fork_cow(*filter_cache, inherit);
 
+	if (widget_fragment_cache != nullptr)
+		widget_fragment_cache_fork_cow(*widget_fragment_cache, inherit);
+
 #ifdef HAVE_LIBNFS
 	if (nfs_cache != nullptr)
 		nfs_cache_fork_cow(*nfs_cache, inherit);
@@ -251,6 +272,16 @@ BpInstance::FadeChildren() noexcept
 		delegate_stock->FadeAll();
 }
 
+void
+BpInstance::SetChildMinIdle(unsigned min_idle) noexcept
+{
+	if (lhttp_stock != nullptr)
+		lhttp_stock_set_min_idle(*lhttp_stock, min_idle);
+
+	if (fcgi_stock != nullptr)
+		fcgi_stock_set_min_idle(*fcgi_stock, min_idle);
+}
+
 void
 BpInstance::FadeTaggedChildren(const char *tag) noexcept
 {
@@ -304,6 +335,7 @@ BpInstance::SaveSessions() noexcept
 void
 BpInstance::ScheduleSaveSessions() noexcept
 {
-	/* save all sessions every 2 minutes */
+	/* flush the session journal (and compact it if necessary)
+	   every 2 minutes */
 	session_save_timer.Schedule(std::chrono::minutes(2));
 }
@@ -81,7 +81,11 @@ class NfsStock;
 class NfsCache;
 class HttpCache;
 class FilterCache;
+class OpenFileCache;
+class WidgetFragmentCache;
 class SessionManager;
+class SessionReplicator;
+class SessionReplicationReceiver;
 namespace Uring { class Manager; }
 class BPListener;
 struct BpConnection;
@@ -125,6 +129,17 @@ struct BpInstance final : PInstance, ControlHandler, SpawnServerClientHandler {
 
 	std::unique_ptr<SessionManager> session_manager;
 
+	/**
+	 * Send local session modifications to peer nodes (see
+	 * BpConfig::session_replication).
+	 */
+	std::unique_ptr<SessionReplicator> session_replicator;
+
+	/**
+	 * Receive session replicas from peer nodes.
+	 */
+	std::unique_ptr<SessionReplicationReceiver> session_replication_receiver;
+
 	/**
 	 * The configured control channel servers (see
 	 * BpConfig::control_listen).  May be empty if none was
@@ -172,6 +187,10 @@ struct BpInstance final : PInstance, ControlHandler, SpawnServerClientHandler {
 
 	FilterCache *filter_cache = nullptr;
 
+	std::unique_ptr<OpenFileCache> open_file_cache;
+
+	WidgetFragmentCache *widget_fragment_cache = nullptr;
+
 	LhttpStock *lhttp_stock = nullptr;
 	FcgiStock *fcgi_stock = nullptr;
 
@@ -221,6 +240,12 @@ struct BpInstance final : PInstance, ControlHandler, SpawnServerClientHandler {
 	void FadeChildren() noexcept;
 	void FadeTaggedChildren(const char *tag) noexcept;
 
+	/**
+	 * Set the minimum number of idle FastCGI/LHTTP child
+	 * processes per application.
+	 */
+	void SetChildMinIdle(unsigned min_idle) noexcept;
+
 	void ShutdownCallback() noexcept;
 
 	void FlushTranslationCaches() noexcept;
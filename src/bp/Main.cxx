@@ -39,6 +39,7 @@
 #include "fb_pool.hxx"
 #include "session/Manager.hxx"
 #include "session/Save.hxx"
+#include "session/Replication.hxx"
 #include "tcp_stock.hxx"
 #include "translation/Stock.hxx"
 #include "translation/Cache.hxx"
@@ -54,6 +55,8 @@
 #include "was/Stock.hxx"
 #include "delegate/Stock.hxx"
 #include "fcache.hxx"
+#include "OpenFileCache.hxx"
+#include "widget/FragmentCache.hxx"
 #include "thread/Pool.hxx"
 #include "pipe_stock.hxx"
 #include "nfs/Stock.hxx"
@@ -97,6 +100,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <sys/socket.h>
 
 #ifdef __linux
 #include <sys/prctl.h>
@@ -165,6 +169,16 @@ BpInstance::ShutdownCallback() noexcept
 
 	background_manager.AbortAll();
 
+	session_replication_receiver.reset();
+
+	if (session_replicator) {
+		/* send the last modifications before the peers take
+		   over */
+		session_replicator->Flush();
+		session_manager->SetReplicator(nullptr);
+		session_replicator.reset();
+	}
+
 	session_save_timer.Cancel();
 	session_save_deinit(*session_manager);
 
@@ -197,6 +211,12 @@ BpInstance::ReloadEventCallback(int) noexcept
 	if (filter_cache != nullptr)
 		filter_cache_flush(*filter_cache);
 
+	if (open_file_cache)
+		open_file_cache->Flush();
+
+	if (widget_fragment_cache != nullptr)
+		widget_fragment_cache_flush(*widget_fragment_cache);
+
 #ifdef HAVE_LIBNFS
 	if (nfs_cache != nullptr)
 		nfs_cache_flush(*nfs_cache);
@@ -362,11 +382,35 @@ try {
 						 instance.config.cluster_node);
 
 	if (!instance.config.session_save_path.empty()) {
-		session_save_init(*instance.session_manager,
+		session_save_init(instance.event_loop,
+				  *instance.session_manager,
 				  instance.config.session_save_path.c_str());
 		instance.ScheduleSaveSessions();
 	}
 
+	const auto &session_replication = instance.config.session_replication;
+
+	if (!session_replication.peers.empty()) {
+		const SessionReplicationKey key(session_replication.secret);
+
+		if (!session_replication.listen.bind_address.IsNull()) {
+			instance.session_replication_receiver =
+				std::make_unique<SessionReplicationReceiver>(instance.event_loop,
+									     session_replication.listen.Create(SOCK_DGRAM),
+									     *instance.session_manager,
+									     key);
+			for (const auto &peer : session_replication.peers)
+				instance.session_replication_receiver->AddPeer(peer);
+		}
+
+		instance.session_replicator =
+			std::make_unique<SessionReplicator>(instance.event_loop,
+							    key);
+		for (const auto &peer : session_replication.peers)
+			instance.session_replicator->AddPeer(peer);
+		instance.session_manager->SetReplicator(instance.session_replicator.get());
+	}
+
 	local_control_handler_init(&instance);
 
 	try {
@@ -398,11 +442,14 @@ try {
 
 	instance.tcp_stock = new TcpStock(instance.event_loop,
 					  instance.config.tcp_stock_limit);
+	instance.tcp_stock->SetMinIdle(instance.config.tcp_stock_min_idle);
 	instance.tcp_balancer = new TcpBalancer(*instance.tcp_stock,
 						instance.failure_manager);
 
 	instance.fs_stock = new FilteredSocketStock(instance.event_loop,
 						    instance.config.tcp_stock_limit);
+	instance.fs_stock->SetMinIdle(instance.config.tcp_stock_min_idle);
+	instance.fs_stock->SetFastOpen(instance.config.tcp_fast_open);
 	instance.fs_balancer = new FilteredSocketBalancer(*instance.fs_stock,
 							  instance.failure_manager);
 
@@ -413,7 +460,8 @@ try {
 	assert(!instance.config.translation_sockets.empty());
 
 	instance.translation_stocks =
-		std::make_unique<TranslationStockBuilder>(instance.config.translate_stock_limit);
+		std::make_unique<TranslationStockBuilder>(instance.config.translate_stock_limit,
+							  instance.config.translate_multiplex);
 	instance.uncached_translation_service =
 		std::make_unique<MultiTranslationService>();
 
@@ -448,7 +496,8 @@ try {
 		new WidgetRegistry(instance.root_pool,
 				   *instance.uncached_translation_service);
 
-	instance.lhttp_stock = lhttp_stock_new(0, 8, instance.event_loop,
+	instance.lhttp_stock = lhttp_stock_new(0, instance.config.lhttp_stock_max_idle,
+					       instance.event_loop,
 					       *instance.spawn_service,
 					       child_log_socket,
 					       child_log_options);
@@ -459,6 +508,8 @@ try {
 					     *instance.spawn_service,
 					     child_log_socket, child_log_options);
 
+	instance.SetChildMinIdle(instance.config.child_stock_min_idle);
+
 #ifdef HAVE_LIBWAS
 	instance.was_stock = new WasStock(instance.event_loop,
 					  *instance.spawn_service,
@@ -514,6 +565,12 @@ try {
 
 	instance.pipe_stock = new PipeStock(instance.event_loop);
 
+	if (instance.config.file_cache_size > 0)
+		instance.open_file_cache =
+			std::make_unique<OpenFileCache>(instance.event_loop,
+							instance.config.file_cache_size,
+							instance.config.file_cache_ttl);
+
 	if (instance.config.filter_cache_size > 0) {
 		instance.filter_cache = filter_cache_new(instance.root_pool,
 							 instance.config.filter_cache_size,
@@ -524,6 +581,12 @@ try {
 	} else
 		instance.filter_resource_loader = instance.direct_resource_loader;
 
+	if (instance.config.widget_fragment_cache_size > 0)
+		instance.widget_fragment_cache =
+			widget_fragment_cache_new(instance.root_pool,
+						  instance.event_loop,
+						  instance.config.widget_fragment_cache_size);
+
 	instance.buffered_filter_resource_loader =
 		new BufferedResourceLoader(instance.event_loop,
 					   *instance.filter_resource_loader,
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "OpenFileCache.hxx"
+#include "event/Loop.hxx"
+
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+struct OpenFileCache::Item final : CacheItem {
+	const std::string key;
+
+	const UniqueFileDescriptor fd;
+
+	Item(std::chrono::steady_clock::time_point _expires,
+	     std::string &&_key,
+	     UniqueFileDescriptor &&_fd) noexcept
+		:CacheItem(_expires, 1),
+		 key(std::move(_key)), fd(std::move(_fd)) {}
+
+	/* virtual methods from class CacheItem */
+	void Destroy() noexcept override {
+		delete this;
+	}
+};
+
+/**
+ * Build the cache key from the base directory path and the relative
+ * path.  The length prefix makes the key unambiguous.
+ */
+static std::string
+MakeKey(const char *base, const char *path) noexcept
+{
+	std::string key;
+
+	if (base != nullptr) {
+		key = std::to_string(strlen(base));
+		key.push_back(':');
+		key.append(base);
+	}
+
+	key.push_back('|');
+	key.append(path);
+	return key;
+}
+
+static UniqueFileDescriptor
+DuplicateCloseOnExec(FileDescriptor fd) noexcept
+{
+	return UniqueFileDescriptor(fcntl(fd.Get(), F_DUPFD_CLOEXEC, 0));
+}
+
+/**
+ * Open a new file description for the same file (through
+ * /proc/self/fd), which does not walk the original path.  Unlike
+ * dup(), the new file descriptor has its own file offset.
+ */
+static UniqueFileDescriptor
+Reopen(FileDescriptor fd) noexcept
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd.Get());
+	return UniqueFileDescriptor(open(path,
+					 O_RDONLY|O_NOCTTY|O_CLOEXEC));
+}
+
+OpenFileCache::OpenFileCache(EventLoop &event_loop, unsigned max_items,
+			     std::chrono::steady_clock::duration _ttl) noexcept
+	:cache(event_loop, max_items / 4 + 16, max_items),
+	 ttl(_ttl) {}
+
+OpenFileCache::~OpenFileCache() noexcept = default;
+
+UniqueFileDescriptor
+OpenFileCache::Get(const char *base, const char *path,
+		   struct statx &st) noexcept
+{
+	const auto key = MakeKey(base, path);
+
+	auto *item = (Item *)cache.Get(key.c_str());
+	if (item == nullptr)
+		return {};
+
+	/* this doesn't walk the path, but it sees modifications of
+	   the file, and whether it has been deleted or replaced */
+	if (statx(item->fd.Get(), "", AT_EMPTY_PATH,
+		  STATX_TYPE|STATX_MTIME|STATX_INO|STATX_SIZE|STATX_NLINK,
+		  &st) < 0 ||
+	    st.stx_nlink == 0) {
+		cache.Remove(*item);
+		return {};
+	}
+
+	auto fd = Reopen(item->fd);
+	if (!fd.IsDefined())
+		cache.Remove(*item);
+
+	return fd;
+}
+
+void
+OpenFileCache::Put(const char *base, const char *path,
+		   FileDescriptor fd, const struct statx &st) noexcept
+{
+	if (!S_ISREG(st.stx_mode))
+		return;
+
+	auto key = MakeKey(base, path);
+
+	auto fd2 = DuplicateCloseOnExec(fd);
+	if (!fd2.IsDefined())
+		return;
+
+	auto *item = new Item(cache.SteadyNow() + ttl,
+			      std::move(key), std::move(fd2));
+	cache.Put(item->key.c_str(), *item);
+}
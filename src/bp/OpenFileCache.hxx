@@ -0,0 +1,103 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "cache.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+
+#include <chrono>
+
+#include <sys/stat.h>
+
+/**
+ * A cache of open file descriptors for static files.  This saves the
+ * path walk in open() for files which are requested very often.
+ *
+ * Items are keyed by the base directory path (see FileAddress::base)
+ * and the relative path, so a hit does not need to open the base
+ * directory at all.  On each hit, the cached file descriptor is
+ * checked with statx(); an item whose file has been deleted or
+ * replaced by rename() (no links left) is discarded.  Items still
+ * expire after a short time, because replacing a parent directory or
+ * an additional hard link is not noticed.
+ *
+ * The cache keeps its own file descriptor which is never used for
+ * I/O; callers get a new file description opened through
+ * /proc/self/fd, which they own and which has its own file offset.
+ */
+class OpenFileCache {
+	struct Item;
+
+	Cache cache;
+
+	const std::chrono::steady_clock::duration ttl;
+
+public:
+	/**
+	 * @param max_items the maximum number of cached file
+	 * descriptors
+	 * @param _ttl the time after which an item expires
+	 */
+	OpenFileCache(EventLoop &event_loop, unsigned max_items,
+		      std::chrono::steady_clock::duration _ttl) noexcept;
+
+	~OpenFileCache() noexcept;
+
+	OpenFileCache(const OpenFileCache &) = delete;
+	OpenFileCache &operator=(const OpenFileCache &) = delete;
+
+	/**
+	 * Look up a file in the cache.
+	 *
+	 * @param base the base directory path (see FileAddress::base)
+	 * or nullptr
+	 * @param path the path relative to #base
+	 * @param st on success, a fresh statx() result is stored here
+	 * @return a new file descriptor (reopened from the cached
+	 * one) or an undefined object on cache miss
+	 */
+	UniqueFileDescriptor Get(const char *base, const char *path,
+				 struct statx &st) noexcept;
+
+	/**
+	 * Add a file which was just opened to the cache.  The given
+	 * file descriptor is duplicated; the caller keeps ownership.
+	 * Only regular files are cached.
+	 */
+	void Put(const char *base, const char *path,
+		 FileDescriptor fd, const struct statx &st) noexcept;
+
+	void Flush() noexcept {
+		cache.Flush();
+	}
+};
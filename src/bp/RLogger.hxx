@@ -33,6 +33,7 @@
 #pragma once
 
 #include "http/Logger.hxx"
+#include "translation/CacheLease.hxx"
 
 #include <chrono>
 
@@ -62,6 +63,14 @@ struct BpRequestLogger final : IncomingHttpRequestLogger {
 	 */
 	const char *site_name = nullptr;
 
+	/**
+	 * Pins the #TranslationCache items whose responses are used by
+	 * this request without a copy.  It lives here because response
+	 * headers and the access log may refer to the response after
+	 * the #Request has been destroyed.
+	 */
+	TranslationCacheLease translation_cache_lease;
+
 	explicit BpRequestLogger(BpInstance &_instance) noexcept;
 
 	std::chrono::steady_clock::duration GetDuration(std::chrono::steady_clock::time_point now) const noexcept {
@@ -504,6 +504,15 @@ public:
 				     UniqueFileDescriptor &fd,
 				     const struct statx &st) noexcept;
 
+	/**
+	 * Return the base directory of the current #FileAddress,
+	 * opening it if that has not been done yet (it is skipped
+	 * on #OpenFileCache hits).
+	 *
+	 * Throws on error.
+	 */
+	FileDescriptor GetFileBase();
+
 	void HandleFileAddress(const FileAddress &address) noexcept;
 	void HandleFileAddress(const FileAddress &address,
 			       UniqueFileDescriptor fd,
@@ -196,6 +196,7 @@ Request::NewWidgetContext() const noexcept
 	ctx->peer_subject = connection.peer_subject;
 	ctx->peer_issuer_subject = connection.peer_issuer_subject;
 	ctx->user = user;
+	ctx->fragment_cache = instance.widget_fragment_cache;
 
 	return ctx;
 }
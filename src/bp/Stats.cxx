@@ -32,13 +32,18 @@
 
 #include "Instance.hxx"
 #include "tcp_stock.hxx"
+#include "child_stock.hxx"
+#include "lhttp_stock.hxx"
+#include "fcgi/Stock.hxx"
 #include "fs/Stock.hxx"
 #include "stock/Stats.hxx"
 #include "fb_pool.hxx"
 #include "SlicePool.hxx"
 #include "translation/Builder.hxx"
+#include "translation/Cache.hxx"
 #include "http_cache.hxx"
 #include "fcache.hxx"
+#include "widget/FragmentCache.hxx"
 #include "nfs/Cache.hxx"
 #include "session/Manager.hxx"
 #include "AllocatorStats.hxx"
@@ -55,15 +60,22 @@ BpInstance::GetStats() const noexcept
 	tcp_stock->AddStats(tcp_stock_stats);
 	fs_stock->AddStats(tcp_stock_stats);
 
+	StockPrewarmStats prewarm_stats;
+	tcp_stock->AddStats(prewarm_stats);
+	fs_stock->AddStats(prewarm_stats);
+
 	AllocatorStats tcache_stats = AllocatorStats::Zero();
 	if (translation_caches)
 		tcache_stats += translation_caches->GetStats();
 	const auto http_cache_stats = http_cache != nullptr
 		? http_cache_get_stats(*http_cache)
 		: AllocatorStats::Zero();
-	const auto fcache_stats = filter_cache != nullptr
+	auto fcache_stats = filter_cache != nullptr
 		? filter_cache_get_stats(*filter_cache)
 		: AllocatorStats::Zero();
+	if (widget_fragment_cache != nullptr)
+		/* widget fragments are accounted as filter cache */
+		fcache_stats += widget_fragment_cache_get_stats(*widget_fragment_cache);
 
 	stats.incoming_connections = ToBE32(connections.size());
 	stats.outgoing_connections = ToBE32(tcp_stock_stats.busy
@@ -87,10 +99,49 @@ BpInstance::GetStats() const noexcept
 	stats.nfs_cache_brutto_size = ToBE64(nfs_cache_stats.brutto_size);
 #endif
 
-	const auto io_buffers_stats = fb_pool_get().GetStats();
+	ChildStockStats child_stock_stats;
+	if (lhttp_stock != nullptr)
+		lhttp_stock_add_stats(*lhttp_stock, child_stock_stats);
+	if (fcgi_stock != nullptr)
+		fcgi_stock_add_stats(*fcgi_stock, child_stock_stats);
+
+	stats.idle_children = ToBE32(child_stock_stats.idle);
+	stats.warm_children = ToBE32(child_stock_stats.warm_target);
+	stats.prespawned_children = ToBE64(child_stock_stats.prespawned);
+
+	stats.connect_waits = ToBE64(prewarm_stats.waits);
+	stats.prewarmed_connections = ToBE64(prewarm_stats.prewarmed);
+	stats.warm_connections = ToBE64(prewarm_stats.warm_target);
+
+	if (translation_caches) {
+		const auto counters = translation_caches->GetCounters();
+		stats.translation_cache_validations_avoided =
+			ToBE64(counters.validations_avoided);
+		stats.translation_cache_expand_hits =
+			ToBE64(counters.expand_hits);
+		stats.translation_cache_expand_misses =
+			ToBE64(counters.expand_misses);
+	}
+
+	const auto io_buffers_stats = fb_pool_get_stats();
 	stats.io_buffers_size = ToBE64(io_buffers_stats.netto_size);
 	stats.io_buffers_brutto_size = ToBE64(io_buffers_stats.brutto_size);
 
+	const auto io_buffers_small_stats =
+		fb_pool_get(FbSize::SMALL).GetStats();
+	stats.io_buffers_small_size = ToBE64(io_buffers_small_stats.netto_size);
+	stats.io_buffers_small_brutto_size = ToBE64(io_buffers_small_stats.brutto_size);
+
+	const auto io_buffers_medium_stats =
+		fb_pool_get(FbSize::MEDIUM).GetStats();
+	stats.io_buffers_medium_size = ToBE64(io_buffers_medium_stats.netto_size);
+	stats.io_buffers_medium_brutto_size = ToBE64(io_buffers_medium_stats.brutto_size);
+
+	const auto io_buffers_large_stats =
+		fb_pool_get(FbSize::LARGE).GetStats();
+	stats.io_buffers_large_size = ToBE64(io_buffers_large_stats.netto_size);
+	stats.io_buffers_large_brutto_size = ToBE64(io_buffers_large_stats.brutto_size);
+
 	/* TODO: add stats from all worker processes;  */
 
 	return stats;
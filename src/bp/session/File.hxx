@@ -36,6 +36,7 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 static constexpr uint32_t MAGIC_FILE = 2461362039;
@@ -45,3 +46,33 @@ static constexpr uint32_t MAGIC_WIDGET_SESSION = 983957472;
 static constexpr uint32_t MAGIC_COOKIE = 860919820;
 static constexpr uint32_t MAGIC_END_OF_RECORD = 1588449078;
 static constexpr uint32_t MAGIC_END_OF_LIST = 1556616445;
+static constexpr uint32_t MAGIC_JOURNAL = 2461362040;
+static constexpr uint32_t MAGIC_DELETE_SESSION = 663845835;
+static constexpr uint32_t MAGIC_REPLICATION = 2461362041;
+
+/**
+ * The part of a replication datagram header which protects against
+ * replays.  It is covered by the MAC.
+ */
+struct SessionReplicationHeader {
+	/**
+	 * A random number identifying the sending process.
+	 */
+	uint64_t sender;
+
+	/**
+	 * Incremented by the sender for each datagram.
+	 */
+	uint64_t sequence;
+
+	/**
+	 * The sender's wall clock time [seconds since the epoch].
+	 */
+	int64_t time;
+};
+
+/**
+ * The size of a serialized replication datagram header.
+ */
+static constexpr size_t REPLICATION_HEADER_SIZE =
+	2 * sizeof(uint32_t) + 3 * sizeof(uint64_t);
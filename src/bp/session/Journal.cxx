@@ -0,0 +1,424 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Journal.hxx"
+#include "Manager.hxx"
+#include "Write.hxx"
+#include "File.hxx"
+#include "thread/Pool.hxx"
+#include "thread/Queue.hxx"
+#include "io/BufferedOutputStream.hxx"
+#include "io/FdOutputStream.hxx"
+#include "io/FileWriter.hxx"
+#include "io/VectorOutputStream.hxx"
+#include "io/Logger.hxx"
+#include "system/Error.hxx"
+
+#include <cassert>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+SessionJournal::SessionJournal(EventLoop &event_loop,
+			       const char *_snapshot_path,
+			       std::size_t _snapshot_size) noexcept
+	:queue(thread_pool_get_queue(event_loop)),
+	 flush_timer(event_loop, BIND_THIS_METHOD(OnFlushTimer)),
+	 snapshot_size(_snapshot_size),
+	 compact_event(event_loop, BIND_THIS_METHOD(OnCompactEvent)),
+	 snapshot_path(_snapshot_path),
+	 journal_path(MakeJournalPath(_snapshot_path))
+{
+}
+
+SessionJournal::~SessionJournal() noexcept
+{
+	assert(IsIdle());
+}
+
+std::string
+SessionJournal::MakeJournalPath(const char *snapshot_path) noexcept
+{
+	return std::string(snapshot_path) + ".journal";
+}
+
+void
+SessionJournal::Modified(Session &session) noexcept
+{
+	if (!session.journal_hook.is_linked())
+		dirty.push_back(session);
+
+	if (!flush_timer.IsPending())
+		flush_timer.Schedule(flush_interval);
+}
+
+void
+SessionJournal::Deleted(Session &session) noexcept
+{
+	if (session.journal_hook.is_linked())
+		session.journal_hook.unlink();
+
+	deleted.push_back(session.id);
+
+	if (!flush_timer.IsPending())
+		flush_timer.Schedule(flush_interval);
+}
+
+std::vector<std::byte>
+SessionJournal::SerializeModifications() noexcept
+{
+	std::vector<std::byte> data;
+	VectorOutputStream vos(data);
+
+	try {
+		BufferedOutputStream bos(vos);
+
+		for (const auto &id : deleted) {
+			session_write_magic(bos, MAGIC_DELETE_SESSION);
+			session_write_id(bos, id);
+		}
+
+		bos.Flush();
+	} catch (...) {
+		LogConcat(1, "SessionJournal", "Failed to serialize deletions: ",
+			  std::current_exception());
+		data.clear();
+	}
+
+	deleted.clear();
+
+	dirty.clear_and_dispose([&data, &vos](Session *session){
+		const std::size_t old_size = data.size();
+
+		try {
+			BufferedOutputStream bos(vos);
+			session_write_magic(bos, MAGIC_SESSION);
+			session_write(bos, session);
+			bos.Flush();
+		} catch (...) {
+			/* roll back the partial record */
+			data.resize(old_size);
+			LogConcat(2, "SessionJournal", "Failed to serialize session: ",
+				  std::current_exception());
+		}
+	});
+
+	return data;
+}
+
+void
+SessionJournal::Flush() noexcept
+{
+	flush_timer.Cancel();
+
+	auto data = SerializeModifications();
+	if (data.empty())
+		return;
+
+	journal_size += data.size();
+
+	if (compact_manager != nullptr)
+		compact_tail.push_back(data);
+
+	Submit(std::move(data), false);
+}
+
+void
+SessionJournal::Compact(SessionManager &manager) noexcept
+{
+	if (compact_manager != nullptr)
+		/* already in progress */
+		return;
+
+	/* write all pending modifications to the old journal first,
+	   so replaying it over the new snapshot (after a crash
+	   between replacing the snapshot and truncating the journal)
+	   yields the same state */
+	Flush();
+
+	LogConcat(5, "SessionJournal", "compacting ", journal_path);
+
+	assert(compact_data.empty());
+	assert(compact_tail.empty());
+
+	try {
+		VectorOutputStream vos(compact_data);
+		BufferedOutputStream bos(vos);
+		session_write_file_header(bos);
+		bos.Flush();
+	} catch (...) {
+		LogConcat(1, "SessionJournal", "Failed to serialize sessions: ",
+			  std::current_exception());
+		compact_data.clear();
+		return;
+	}
+
+	compact_manager = &manager;
+	compact_cursor = 0;
+	compact_event.Schedule();
+}
+
+void
+SessionJournal::CancelCompaction() noexcept
+{
+	compact_event.Cancel();
+	compact_manager = nullptr;
+	compact_data.clear();
+	compact_data.shrink_to_fit();
+	compact_tail.clear();
+}
+
+bool
+SessionJournal::SerializeSnapshot(std::size_t max_sessions) noexcept
+{
+	assert(compact_manager != nullptr);
+
+	bool complete;
+
+	try {
+		VectorOutputStream vos(compact_data);
+		BufferedOutputStream bos(vos);
+		complete = compact_manager->VisitSome(compact_cursor, max_sessions,
+						      [](const Session &session, void *ctx){
+			auto &os = *(BufferedOutputStream *)ctx;
+			session_write_magic(os, MAGIC_SESSION);
+			session_write(os, &session);
+		}, &bos);
+
+		if (complete)
+			session_write_file_tail(bos);
+
+		bos.Flush();
+	} catch (...) {
+		LogConcat(1, "SessionJournal", "Failed to serialize sessions: ",
+			  std::current_exception());
+		CancelCompaction();
+		return false;
+	}
+
+	return complete;
+}
+
+void
+SessionJournal::FinishCompaction(std::list<Chunk> &chunks) noexcept
+{
+	assert(compact_manager != nullptr);
+
+	flush_timer.Cancel();
+
+	/* sessions which have been modified while the snapshot was
+	   being built may be contained in an older version; append
+	   them to the old journal and include them in
+	   #compact_tail */
+	if (auto data = SerializeModifications(); !data.empty()) {
+		compact_tail.push_back(data);
+		chunks.emplace_back(std::move(data), false);
+	}
+
+	snapshot_size = compact_data.size();
+	chunks.emplace_back(std::move(compact_data), true);
+	compact_data.clear();
+
+	/* ... and replay them over the new snapshot */
+	journal_size = 0;
+	for (auto &i : compact_tail) {
+		journal_size += i.size();
+		chunks.emplace_back(std::move(i), false);
+	}
+
+	compact_tail.clear();
+	compact_manager = nullptr;
+}
+
+bool
+SessionJournal::ContinueCompaction(std::size_t max_sessions) noexcept
+{
+	if (!SerializeSnapshot(max_sessions))
+		/* more sessions remain, unless the compaction has
+		   failed */
+		return compact_manager == nullptr;
+
+	std::list<Chunk> chunks;
+	FinishCompaction(chunks);
+	Submit(std::move(chunks));
+	return true;
+}
+
+void
+SessionJournal::OnCompactEvent() noexcept
+{
+	if (!ContinueCompaction(COMPACT_BATCH))
+		compact_event.Schedule();
+}
+
+bool
+SessionJournal::Close() noexcept
+{
+	flush_timer.Cancel();
+
+	queue.Cancel(*this);
+
+	/* the worker threads have been joined (and the #ThreadQueue
+	   must not be used anymore); write the remaining chunks
+	   synchronously from the main thread */
+	std::list<Chunk> chunks;
+	chunks.swap(pending);
+
+	if (compact_manager != nullptr) {
+		/* finish the snapshot in one go; there is no main
+		   loop to be blocked anymore */
+		compact_event.Cancel();
+		if (SerializeSnapshot(SIZE_MAX))
+			FinishCompaction(chunks);
+	}
+
+	if (auto data = SerializeModifications(); !data.empty())
+		chunks.emplace_back(std::move(data), false);
+
+	WriteChunks(std::move(chunks));
+
+	return IsIdle();
+}
+
+inline void
+SessionJournal::Submit(std::vector<std::byte> &&data, bool snapshot) noexcept
+{
+	{
+		const std::lock_guard<std::mutex> lock(mutex);
+		pending.emplace_back(std::move(data), snapshot);
+	}
+
+	queue.Add(*this);
+}
+
+void
+SessionJournal::Submit(std::list<Chunk> &&chunks) noexcept
+{
+	{
+		const std::lock_guard<std::mutex> lock(mutex);
+		pending.splice(pending.end(), chunks);
+	}
+
+	queue.Add(*this);
+}
+
+void
+SessionJournal::WriteSnapshot(const std::vector<std::byte> &data)
+{
+	FileWriter fw(snapshot_path.c_str());
+	FdOutputStream fos(fw.GetFileDescriptor());
+	fos.Write(data.data(), data.size());
+	fw.Commit();
+
+	/* the snapshot contains everything recorded in the journal
+	   so far */
+	ResetJournal();
+}
+
+void
+SessionJournal::ResetJournal()
+{
+	journal_fd.Close();
+
+	if (!journal_fd.Open(journal_path.c_str(),
+			     O_CREAT|O_TRUNC|O_WRONLY|O_APPEND, 0600))
+		throw FormatErrno("Failed to create %s", journal_path.c_str());
+
+	std::vector<std::byte> header;
+	VectorOutputStream vos(header);
+	BufferedOutputStream bos(vos);
+	session_write_journal_header(bos);
+	bos.Flush();
+
+	FdOutputStream(journal_fd).Write(header.data(), header.size());
+}
+
+void
+SessionJournal::AppendJournal(const std::vector<std::byte> &data)
+{
+	if (!journal_fd.IsDefined()) {
+		if (!journal_fd.Open(journal_path.c_str(),
+				     O_CREAT|O_WRONLY|O_APPEND, 0600))
+			throw FormatErrno("Failed to open %s",
+					  journal_path.c_str());
+
+		if (lseek(journal_fd.Get(), 0, SEEK_END) == 0)
+			/* this is a new file */
+			ResetJournal();
+	}
+
+	FdOutputStream(journal_fd).Write(data.data(), data.size());
+}
+
+void
+SessionJournal::WriteChunks(std::list<Chunk> &&chunks) noexcept
+{
+	for (const auto &chunk : chunks) {
+		try {
+			if (chunk.snapshot)
+				WriteSnapshot(chunk.data);
+			else
+				AppendJournal(chunk.data);
+		} catch (...) {
+			LogConcat(1, "SessionJournal",
+				  chunk.snapshot
+				  ? "Failed to save sessions: "
+				  : "Failed to write session journal: ",
+				  std::current_exception());
+
+			/* reopen the journal the next time */
+			journal_fd.Close();
+		}
+	}
+}
+
+void
+SessionJournal::Run() noexcept
+{
+	std::list<Chunk> chunks;
+
+	{
+		const std::lock_guard<std::mutex> lock(mutex);
+		chunks.swap(pending);
+	}
+
+	WriteChunks(std::move(chunks));
+}
+
+void
+SessionJournal::Done() noexcept
+{
+	/* nothing to do; if more chunks have been submitted in the
+	   meantime, ThreadQueue::Add() has already rescheduled this
+	   job */
+}
@@ -0,0 +1,287 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Append-only journal of session modifications.
+ */
+
+#pragma once
+
+#include "Session.hxx"
+#include "thread/Job.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "event/DeferEvent.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+
+#include <boost/intrusive/list.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class SessionManager;
+class ThreadQueue;
+
+/**
+ * Records all session modifications in an append-only journal file
+ * next to the session snapshot file.  Modified sessions are collected
+ * and serialized in batches on the main thread; the resulting buffers
+ * are written by a worker thread.  From time to time, the journal is
+ * compacted into a new snapshot.
+ *
+ * After a crash, the snapshot is loaded and then the journal is
+ * replayed (see session_save_init()).
+ */
+class SessionJournal final : ThreadJob {
+	/** write modified sessions to the journal every second */
+	static constexpr Event::Duration flush_interval = std::chrono::seconds(1);
+
+	/**
+	 * Don't compact the journal before it has grown to this size
+	 * (or to the size of the previous snapshot, whichever is
+	 * larger).
+	 */
+	static constexpr std::size_t MIN_COMPACT_SIZE = 4 * 1024 * 1024;
+
+	/**
+	 * Serialize (approximately) this number of sessions per
+	 * main loop iteration while compacting.
+	 */
+	static constexpr std::size_t COMPACT_BATCH = 1024;
+
+	ThreadQueue &queue;
+
+	CoarseTimerEvent flush_timer;
+
+	using DirtyList =
+		boost::intrusive::list<Session,
+				       boost::intrusive::member_hook<Session,
+								     Session::DirtyHook,
+								     &Session::journal_hook>,
+				       boost::intrusive::constant_time_size<false>>;
+
+	/**
+	 * Sessions which have been modified since the last Flush().
+	 */
+	DirtyList dirty;
+
+	/**
+	 * Sessions which have been deleted since the last Flush().
+	 */
+	std::vector<SessionId> deleted;
+
+	/**
+	 * The number of journal bytes submitted since the last
+	 * snapshot.
+	 */
+	std::size_t journal_size = 0;
+
+	/**
+	 * The size of the most recent snapshot.
+	 */
+	std::size_t snapshot_size = 0;
+
+	/**
+	 * Serializes the next batch of sessions while a compaction is
+	 * in progress.
+	 */
+	DeferEvent compact_event;
+
+	/**
+	 * The #SessionManager being compacted; nullptr if no
+	 * compaction is in progress.
+	 */
+	SessionManager *compact_manager = nullptr;
+
+	/**
+	 * The SessionManager::VisitSome() cursor of the compaction in
+	 * progress.
+	 */
+	unsigned compact_cursor;
+
+	/**
+	 * The partial snapshot of the compaction in progress.
+	 */
+	std::vector<std::byte> compact_data;
+
+	/**
+	 * Copies of all journal chunks submitted since the
+	 * compaction has begun.  The snapshot may contain older
+	 * versions of these sessions, therefore these chunks are
+	 * appended to the new journal again.
+	 */
+	std::vector<std::vector<std::byte>> compact_tail;
+
+	struct Chunk {
+		std::vector<std::byte> data;
+
+		/**
+		 * If true, then #data is a complete snapshot which
+		 * replaces the snapshot file and truncates the
+		 * journal.  If false, it is appended to the journal.
+		 */
+		bool snapshot;
+
+		Chunk(std::vector<std::byte> &&_data, bool _snapshot) noexcept
+			:data(std::move(_data)), snapshot(_snapshot) {}
+	};
+
+	/**
+	 * Protects #pending.
+	 */
+	std::mutex mutex;
+
+	/**
+	 * Chunks waiting to be written by the worker thread, in
+	 * submission order.
+	 */
+	std::list<Chunk> pending;
+
+	/*
+	 * The following attributes are only used by the worker
+	 * thread (or by the main thread after the worker threads have
+	 * been joined).
+	 */
+
+	const std::string snapshot_path, journal_path;
+
+	UniqueFileDescriptor journal_fd;
+
+public:
+	SessionJournal(EventLoop &event_loop, const char *_snapshot_path,
+		       std::size_t _snapshot_size) noexcept;
+	~SessionJournal() noexcept;
+
+	SessionJournal(const SessionJournal &) = delete;
+	SessionJournal &operator=(const SessionJournal &) = delete;
+
+	/**
+	 * Build the journal file path for the given snapshot path.
+	 */
+	static std::string MakeJournalPath(const char *snapshot_path) noexcept;
+
+	/**
+	 * The given session has been created or modified.
+	 */
+	void Modified(Session &session) noexcept;
+
+	/**
+	 * The given session is about to be deleted.
+	 */
+	void Deleted(Session &session) noexcept;
+
+	/**
+	 * Serialize all modifications collected so far and submit
+	 * them to the worker thread.
+	 */
+	void Flush() noexcept;
+
+	/**
+	 * Has the journal grown so large that Compact() should be
+	 * called?
+	 */
+	[[gnu::pure]]
+	bool NeedsCompaction() const noexcept {
+		return compact_manager == nullptr &&
+			journal_size > std::max(snapshot_size, MIN_COMPACT_SIZE);
+	}
+
+	/**
+	 * Begin serializing all sessions into a new snapshot.  This
+	 * is done in batches of #COMPACT_BATCH sessions from a
+	 * #DeferEvent; the complete snapshot is then submitted to
+	 * the worker thread, which will replace the snapshot file and
+	 * truncate the journal.  Does nothing if a compaction is
+	 * already in progress.
+	 */
+	void Compact(SessionManager &manager) noexcept;
+
+	/**
+	 * Flush all pending modifications synchronously.  This must
+	 * be called after thread_pool_join().
+	 *
+	 * @return true if this object may be deleted, false if it is
+	 * still referenced by the (stopped) #ThreadQueue
+	 */
+	bool Close() noexcept;
+
+private:
+	std::vector<std::byte> SerializeModifications() noexcept;
+
+	void Submit(std::vector<std::byte> &&data, bool snapshot) noexcept;
+	void Submit(std::list<Chunk> &&chunks) noexcept;
+
+	void WriteChunks(std::list<Chunk> &&chunks) noexcept;
+	void WriteSnapshot(const std::vector<std::byte> &data);
+	void ResetJournal();
+	void AppendJournal(const std::vector<std::byte> &data);
+
+	void OnFlushTimer() noexcept {
+		Flush();
+	}
+
+	void CancelCompaction() noexcept;
+
+	/**
+	 * Serialize the next batch of sessions into the new
+	 * snapshot.
+	 *
+	 * @return true if the snapshot is complete; false if more
+	 * sessions remain or if the compaction has failed (and has
+	 * been canceled)
+	 */
+	bool SerializeSnapshot(std::size_t max_sessions) noexcept;
+
+	/**
+	 * The snapshot is complete: move it (and the journal chunks
+	 * which must be written before and after it) to the given
+	 * list and end the compaction.
+	 */
+	void FinishCompaction(std::list<Chunk> &chunks) noexcept;
+
+	/**
+	 * Serialize the next batch of sessions into the new
+	 * snapshot, and submit it if it is complete.
+	 *
+	 * @return true if the compaction is finished (or has failed)
+	 */
+	bool ContinueCompaction(std::size_t max_sessions) noexcept;
+
+	void OnCompactEvent() noexcept;
+
+	/* virtual methods from class ThreadJob */
+	void Run() noexcept override;
+	void Done() noexcept override;
+};
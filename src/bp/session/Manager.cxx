@@ -32,6 +32,8 @@
 
 #include "Manager.hxx"
 #include "Lease.hxx"
+#include "Journal.hxx"
+#include "Replication.hxx"
 #include "io/Logger.hxx"
 #include "util/DeleteDisposer.hxx"
 #include "util/StaticArray.hxx"
@@ -72,6 +74,12 @@ SessionManager::EraseAndDispose(Session &session)
 {
 	assert(!sessions.empty());
 
+	if (journal != nullptr)
+		journal->Deleted(session);
+
+	if (replicator != nullptr)
+		replicator->Deleted(session);
+
 	auto i = sessions.iterator_to(session);
 	sessions.erase_and_dispose(i, DeleteDisposer{});
 }
@@ -81,6 +89,8 @@ SessionManager::Cleanup() noexcept
 {
 	const Expiry now = Expiry::Now();
 
+	/* expired sessions are not recorded in the journal; they
+	   will be discarded while replaying it anyway */
 	EraseAndDisposeIf(sessions, [now](const Session &session){
 		return session.expires.IsExpired(now);
 	}, DeleteDisposer{});
@@ -258,7 +268,11 @@ SessionManager::Attach(RealmSessionLease lease, const char *realm,
 void
 SessionManager::Put(Session &session) noexcept
 {
-	(void)session;
+	if (journal != nullptr)
+		journal->Modified(session);
+
+	if (replicator != nullptr)
+		replicator->Modified(session);
 }
 
 void
@@ -269,6 +283,34 @@ SessionManager::EraseAndDispose(SessionId id) noexcept
 		EraseAndDispose(*i);
 }
 
+void
+SessionManager::InsertReplica(Session &session) noexcept
+{
+	/* dispose the old version silently; the new one will be
+	   recorded in the journal as a replacement */
+	auto i = sessions.find(session.id, SessionHash(), SessionEqual());
+	if (i != sessions.end())
+		sessions.erase_and_dispose(i, DeleteDisposer{});
+
+	Insert(session);
+
+	if (journal != nullptr)
+		journal->Modified(session);
+}
+
+void
+SessionManager::EraseReplica(SessionId id) noexcept
+{
+	auto i = sessions.find(id, SessionHash(), SessionEqual());
+	if (i == sessions.end())
+		return;
+
+	if (journal != nullptr)
+		journal->Deleted(*i);
+
+	sessions.erase_and_dispose(i, DeleteDisposer{});
+}
+
 void
 SessionManager::DiscardRealmSession(SessionId id, const char *realm_name) noexcept
 {
@@ -284,6 +326,8 @@ SessionManager::DiscardRealmSession(SessionId id, const char *realm_name) noexce
 				    DeleteDisposer{});
 	if (i->realms.empty())
 		EraseAndDispose(*i);
+	else
+		Put(*i);
 }
 
 bool
@@ -305,6 +349,32 @@ SessionManager::Visit(bool (*callback)(const Session *session,
 	return true;
 }
 
+bool
+SessionManager::VisitSome(unsigned &cursor, std::size_t max_sessions,
+			  void (*callback)(const Session &session,
+					   void *ctx), void *ctx)
+{
+	const Expiry now = Expiry::Now();
+
+	std::size_t n = 0;
+	while (cursor < N_BUCKETS && n < max_sessions) {
+		/* visit whole buckets, so no iterator needs to be
+		   kept across calls */
+		for (auto i = sessions.begin(cursor), end = sessions.end(cursor);
+		     i != end; ++i) {
+			if (i->expires.IsExpired(now))
+				continue;
+
+			callback(*i, ctx);
+			++n;
+		}
+
+		++cursor;
+	}
+
+	return cursor >= N_BUCKETS;
+}
+
 void
 SessionManager::DiscardAttachSession(ConstBuffer<std::byte> attach) noexcept
 {
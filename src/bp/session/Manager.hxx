@@ -38,10 +38,13 @@
 #include <boost/intrusive/unordered_set.hpp>
 
 #include <chrono>
+#include <cstddef>
 
 template<typename T> struct ConstBuffer;
 class SessionId;
 class SessionLease;
+class SessionJournal;
+class SessionReplicator;
 class RealmSessionLease;
 
 class SessionManager {
@@ -128,6 +131,18 @@ class SessionManager {
 
 	FarTimerEvent cleanup_timer;
 
+	/**
+	 * If set, then all modifications are recorded in this
+	 * journal.
+	 */
+	SessionJournal *journal = nullptr;
+
+	/**
+	 * If set, then all local modifications are sent to the peer
+	 * nodes.
+	 */
+	SessionReplicator *replicator = nullptr;
+
 public:
 	SessionManager(EventLoop &event_loop, std::chrono::seconds idle_timeout,
 		       unsigned _cluster_size, unsigned _cluster_node) noexcept;
@@ -150,6 +165,14 @@ public:
 		cleanup_timer.Cancel();
 	}
 
+	void SetJournal(SessionJournal *_journal) noexcept {
+		journal = _journal;
+	}
+
+	void SetReplicator(SessionReplicator *_replicator) noexcept {
+		replicator = _replicator;
+	}
+
 	void AdjustNewSessionId(SessionId &id) const noexcept;
 
 	/**
@@ -166,6 +189,23 @@ public:
 	bool Visit(bool (*callback)(const Session *session,
 				    void *ctx), void *ctx);
 
+	/**
+	 * Invoke the callback for some sessions, continuing where the
+	 * previous call left off.  This allows visiting all sessions
+	 * in several steps without blocking the main loop for too
+	 * long.  Sessions which are added or removed between two
+	 * calls may or may not be visited.
+	 *
+	 * @param cursor an opaque position which must be initialized
+	 * to 0 before the first call
+	 * @param max_sessions stop after (approximately) this number
+	 * of sessions
+	 * @return true if all sessions have been visited
+	 */
+	bool VisitSome(unsigned &cursor, std::size_t max_sessions,
+		       void (*callback)(const Session &session,
+					void *ctx), void *ctx);
+
 	[[gnu::pure]]
 	SessionLease Find(SessionId id) noexcept;
 
@@ -196,6 +236,19 @@ public:
 
 	void EraseAndDispose(SessionId id) noexcept;
 
+	/**
+	 * Apply a session received from a peer node, replacing an
+	 * existing session with the same id.  This takes ownership of
+	 * the object like Insert().  The modification is recorded in
+	 * the journal, but is not replicated again.
+	 */
+	void InsertReplica(Session &session) noexcept;
+
+	/**
+	 * Apply a session deletion received from a peer node.
+	 */
+	void EraseReplica(SessionId id) noexcept;
+
 	void DiscardRealmSession(SessionId id, const char *realm) noexcept;
 
 	SessionLease CreateSession() noexcept;
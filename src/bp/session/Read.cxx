@@ -129,6 +129,34 @@ session_read_file_header(BufferedReader &r)
 	Expect32(file, sizeof(Session));
 }
 
+void
+session_read_journal_header(BufferedReader &r)
+{
+	FileReader file(r);
+	Expect32(file, MAGIC_JOURNAL);
+	Expect32(file, sizeof(Session));
+}
+
+SessionReplicationHeader
+session_read_replication_header(BufferedReader &r)
+{
+	FileReader file(r);
+	Expect32(file, MAGIC_REPLICATION);
+	Expect32(file, sizeof(Session));
+
+	SessionReplicationHeader header;
+	header.sender = file.Read64();
+	header.sequence = file.Read64();
+	header.time = file.Read64();
+	return header;
+}
+
+SessionId
+session_read_id(BufferedReader &r)
+{
+	return FileReader(r).ReadT<SessionId>();
+}
+
 static void
 ReadWidgetSessions(FileReader &file, WidgetSession::Set &widgets);
 
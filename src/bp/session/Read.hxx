@@ -41,6 +41,8 @@
 #include <stdint.h>
 
 struct Session;
+struct SessionReplicationHeader;
+class SessionId;
 class BufferedReader;
 
 class SessionDeserializerError {};
@@ -57,6 +59,24 @@ session_read_magic(BufferedReader &r);
 void
 session_read_file_header(BufferedReader &r);
 
+/**
+ * Throws on error.
+ */
+void
+session_read_journal_header(BufferedReader &r);
+
+/**
+ * Throws on error.
+ */
+SessionReplicationHeader
+session_read_replication_header(BufferedReader &r);
+
+/**
+ * Throws on error.
+ */
+SessionId
+session_read_id(BufferedReader &r);
+
 /**
  * Throws on error.
  */
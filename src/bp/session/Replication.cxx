@@ -0,0 +1,560 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Replication.hxx"
+#include "Manager.hxx"
+#include "Read.hxx"
+#include "Write.hxx"
+#include "File.hxx"
+#include "net/SocketAddress.hxx"
+#include "io/BufferedOutputStream.hxx"
+#include "io/BufferedReader.hxx"
+#include "io/Reader.hxx"
+#include "io/VectorOutputStream.hxx"
+#include "io/Logger.hxx"
+#include "system/Error.hxx"
+#include "util/ConstBuffer.hxx"
+#include "util/WritableBuffer.hxx"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <functional>
+
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <sodium.h>
+
+static_assert(SessionReplicationKey::MAC_SIZE == crypto_auth_BYTES);
+
+SessionReplicationKey::SessionReplicationKey(std::string_view secret) noexcept
+{
+	static_assert(std::tuple_size<decltype(key)>::value == crypto_auth_KEYBYTES);
+
+	crypto_generichash(key.data(), key.size(),
+			   (const unsigned char *)secret.data(), secret.size(),
+			   nullptr, 0);
+}
+
+void
+SessionReplicationKey::Sign(std::vector<std::byte> &datagram) const noexcept
+{
+	unsigned char mac[crypto_auth_BYTES];
+	crypto_auth(mac, (const unsigned char *)datagram.data(),
+		    datagram.size(), key.data());
+
+	const auto *p = (const std::byte *)mac;
+	datagram.insert(datagram.end(), p, p + sizeof(mac));
+}
+
+ConstBuffer<std::byte>
+SessionReplicationKey::Verify(ConstBuffer<std::byte> datagram) const noexcept
+{
+	if (datagram.size < MAC_SIZE)
+		return nullptr;
+
+	const ConstBuffer<std::byte> payload(datagram.data,
+					     datagram.size - MAC_SIZE);
+	const auto *mac = (const unsigned char *)(payload.data + payload.size);
+
+	if (crypto_auth_verify(mac, (const unsigned char *)payload.data,
+			       payload.size, key.data()) != 0)
+		return nullptr;
+
+	return payload;
+}
+
+SessionReplicator::Peer::Peer(EventLoop &event_loop, SocketAddress address)
+	:event(event_loop, BIND_THIS_METHOD(OnSocketReady))
+{
+	if (!fd.CreateNonBlock(address.GetFamily(), SOCK_DGRAM, 0))
+		throw MakeErrno("Failed to create socket");
+
+	if (!fd.Connect(address))
+		throw MakeErrno("Failed to connect");
+
+	event.Open(fd);
+}
+
+inline bool
+SessionReplicator::Peer::TrySend(const std::vector<std::byte> &datagram) noexcept
+{
+	ssize_t nbytes = send(fd.Get(), datagram.data(), datagram.size(),
+			      MSG_DONTWAIT|MSG_NOSIGNAL);
+	if (nbytes >= 0) {
+		failing = false;
+		return true;
+	}
+
+	const int e = errno;
+	if (e == EAGAIN || e == ENOBUFS)
+		return false;
+
+	/* the peer is probably down (ECONNREFUSED); discard this
+	   datagram */
+	if (!failing) {
+		failing = true;
+		LogConcat(3, "SessionReplicator", "Failed to send: ",
+			  strerror(e));
+	}
+
+	return true;
+}
+
+inline void
+SessionReplicator::Peer::Enqueue(const std::vector<std::byte> &datagram) noexcept
+{
+	unsigned n_dropped = 0;
+	while (!queue.empty() && queue_size + datagram.size() > MAX_QUEUE) {
+		queue_size -= queue.front().size();
+		queue.pop_front();
+		++n_dropped;
+	}
+
+	if (n_dropped > 0)
+		LogConcat(3, "SessionReplicator", "Queue is full, dropped ",
+			  n_dropped, " datagrams");
+
+	queue.push_back(datagram);
+	queue_size += datagram.size();
+
+	event.ScheduleWrite();
+}
+
+void
+SessionReplicator::Peer::Send(const std::vector<std::byte> &datagram) noexcept
+{
+	/* if there is a queue, append to it to preserve ordering */
+	if (!queue.empty() || !TrySend(datagram))
+		Enqueue(datagram);
+}
+
+void
+SessionReplicator::Peer::OnSocketReady(unsigned) noexcept
+{
+	while (!queue.empty()) {
+		if (!TrySend(queue.front()))
+			/* still full; wait for the next event */
+			return;
+
+		queue_size -= queue.front().size();
+		queue.pop_front();
+	}
+
+	event.CancelWrite();
+}
+
+static uint64_t
+MakeSenderId() noexcept
+{
+	uint64_t id;
+	randombytes_buf(&id, sizeof(id));
+	return id;
+}
+
+/**
+ * The current wall clock time in seconds since the epoch.
+ */
+static int64_t
+GetWallClockSeconds() noexcept
+{
+	using namespace std::chrono;
+	return duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+}
+
+SessionReplicator::SessionReplicator(EventLoop &event_loop,
+				     const SessionReplicationKey &_key) noexcept
+	:key(_key),
+	 flush_timer(event_loop, BIND_THIS_METHOD(OnFlushTimer)),
+	 sender_id(MakeSenderId())
+{
+}
+
+SessionReplicator::~SessionReplicator() noexcept = default;
+
+void
+SessionReplicator::AddPeer(SocketAddress address)
+{
+	peers.emplace_front(GetEventLoop(), address);
+}
+
+void
+SessionReplicator::Modified(Session &session) noexcept
+{
+	if (!session.replication_hook.is_linked())
+		dirty.push_back(session);
+
+	if (!flush_timer.IsPending())
+		flush_timer.Schedule(flush_interval);
+}
+
+void
+SessionReplicator::Deleted(Session &session) noexcept
+{
+	if (session.replication_hook.is_linked())
+		session.replication_hook.unlink();
+
+	deleted.push_back(session.id);
+
+	if (!flush_timer.IsPending())
+		flush_timer.Schedule(flush_interval);
+}
+
+inline void
+SessionReplicator::SendToAll(std::vector<std::byte> &&datagram) noexcept
+{
+	key.Sign(datagram);
+
+	for (auto &peer : peers)
+		peer.Send(datagram);
+}
+
+/**
+ * Serialize one record with the given function.
+ *
+ * @return the record or an empty vector on error
+ */
+template<typename F>
+static std::vector<std::byte>
+SerializeRecord(F &&f) noexcept
+{
+	std::vector<std::byte> record;
+	VectorOutputStream vos(record);
+
+	try {
+		BufferedOutputStream bos(vos);
+		f(bos);
+		bos.Flush();
+	} catch (...) {
+		LogConcat(2, "SessionReplicator", "Failed to serialize: ",
+			  std::current_exception());
+		record.clear();
+	}
+
+	return record;
+}
+
+/**
+ * Calculate a fingerprint of the session state which is used to
+ * detect whether it has been modified since it was last replicated.
+ */
+static std::size_t
+StateFingerprint(const Session &session) noexcept
+{
+	const auto state = SerializeRecord([&session](BufferedOutputStream &os){
+		session_write_state(os, session);
+	});
+
+	return std::hash<std::string_view>{}({(const char *)state.data(), state.size()});
+}
+
+std::vector<std::byte>
+SessionReplicator::MakeHeader() noexcept
+{
+	const SessionReplicationHeader header{sender_id, ++sequence, GetWallClockSeconds()};
+
+	auto result = SerializeRecord([&header](BufferedOutputStream &os){
+		session_write_replication_header(os, header);
+	});
+
+	assert(result.size() == REPLICATION_HEADER_SIZE);
+	return result;
+}
+
+void
+SessionReplicator::Flush() noexcept
+{
+	flush_timer.Cancel();
+
+	if (dirty.empty() && deleted.empty())
+		return;
+
+	std::vector<std::byte> datagram;
+
+	auto add = [this, &datagram](const std::vector<std::byte> &record){
+		if (record.empty())
+			return;
+
+		if (REPLICATION_HEADER_SIZE + record.size() > MAX_DATAGRAM) {
+			LogConcat(2, "SessionReplicator",
+				  "Session is too large for replication");
+			return;
+		}
+
+		if (datagram.size() + record.size() > MAX_DATAGRAM) {
+			SendToAll(std::move(datagram));
+			datagram.clear();
+		}
+
+		if (datagram.empty())
+			/* each datagram gets its own sequence
+			   number */
+			datagram = MakeHeader();
+
+		datagram.insert(datagram.end(), record.begin(), record.end());
+	};
+
+	for (const auto &id : deleted)
+		add(SerializeRecord([&id](BufferedOutputStream &os){
+			session_write_magic(os, MAGIC_DELETE_SESSION);
+			session_write_id(os, id);
+		}));
+
+	deleted.clear();
+
+	const Expiry now = Expiry::Now();
+
+	dirty.clear_and_dispose([&add, now](Session *session){
+		const auto state = StateFingerprint(*session);
+		if (state == session->replicated_state &&
+		    !session->replication_refresh.IsExpired(now))
+			/* the session was only read, and the peers
+			   have a recent copy */
+			return;
+
+		session->replicated_state = state;
+		session->replication_refresh.Touch(now, refresh_interval);
+
+		add(SerializeRecord([session](BufferedOutputStream &os){
+			session_write_magic(os, MAGIC_SESSION);
+			session_write(os, session);
+		}));
+	});
+
+	if (!datagram.empty())
+		SendToAll(std::move(datagram));
+}
+
+namespace {
+
+/**
+ * A #Reader which reads from a memory buffer.
+ */
+class MemoryReader final : public Reader {
+	ConstBuffer<std::byte> buffer;
+
+public:
+	explicit MemoryReader(ConstBuffer<std::byte> _buffer) noexcept
+		:buffer(_buffer) {}
+
+	/* virtual methods from class Reader */
+	std::size_t Read(void *data, std::size_t size) override {
+		if (size > buffer.size)
+			size = buffer.size;
+
+		memcpy(data, buffer.data, size);
+		buffer.skip_front(size);
+		return size;
+	}
+};
+
+}
+
+SessionReplicationReceiver::SessionReplicationReceiver(EventLoop &event_loop,
+						       UniqueSocketDescriptor fd,
+						       SessionManager &_manager,
+						       const SessionReplicationKey &_key) noexcept
+	:manager(_manager), key(_key),
+	 listener(event_loop, std::move(fd), *this)
+{
+}
+
+/**
+ * Do both addresses refer to the same host?  The port is ignored,
+ * because the #SessionReplicator sends from an unbound socket.
+ */
+[[gnu::pure]]
+static bool
+IsSameHost(SocketAddress a, SocketAddress b) noexcept
+{
+	const auto pa = ConstBuffer<std::byte>::FromVoid(a.GetSteadyPart());
+	const auto pb = ConstBuffer<std::byte>::FromVoid(b.GetSteadyPart());
+	if (pa.IsNull() || pb.IsNull())
+		return false;
+
+	if (pa.size == pb.size)
+		return memcmp(pa.data, pb.data, pa.size) == 0;
+
+	/* compare an IPv4 address with an IPv4-mapped IPv6 address
+	   (received on a dual-stack socket) */
+	static constexpr std::byte v4mapped_prefix[12] = {
+		{}, {}, {}, {}, {}, {}, {}, {}, {}, {},
+		std::byte{0xff}, std::byte{0xff},
+	};
+
+	const auto &v4 = pa.size < pb.size ? pa : pb;
+	const auto &v6 = pa.size < pb.size ? pb : pa;
+	return v4.size == 4 && v6.size == 16 &&
+		memcmp(v6.data, v4mapped_prefix, sizeof(v4mapped_prefix)) == 0 &&
+		memcmp(v6.data + sizeof(v4mapped_prefix), v4.data, 4) == 0;
+}
+
+bool
+SessionReplicationReceiver::IsPeer(SocketAddress address) const noexcept
+{
+	for (const auto &peer : peers)
+		if (IsSameHost(address, peer))
+			return true;
+
+	return false;
+}
+
+bool
+SessionReplicationReceiver::CheckReplay(const SessionReplicationHeader &header) noexcept
+{
+	const int64_t now = GetWallClockSeconds();
+	const int64_t max_age_s = max_age.count();
+
+	if (header.time < now - max_age_s || header.time > now + max_age_s)
+		return false;
+
+	/* forget senders whose datagrams are all stale by now */
+	for (auto i = senders.begin(); i != senders.end();) {
+		if (i->second.time < now - max_age_s)
+			i = senders.erase(i);
+		else
+			++i;
+	}
+
+	auto [i, inserted] = senders.try_emplace(header.sender);
+	auto &s = i->second;
+
+	if (inserted) {
+		s.highest = header.sequence;
+		s.window = 1;
+		s.time = header.time;
+		return true;
+	}
+
+	if (header.sequence > s.highest) {
+		const uint64_t shift = header.sequence - s.highest;
+		s.window = shift < REPLAY_WINDOW ? s.window << shift : 0;
+		s.window |= 1;
+		s.highest = header.sequence;
+	} else {
+		const uint64_t offset = s.highest - header.sequence;
+		if (offset >= REPLAY_WINDOW)
+			/* too old */
+			return false;
+
+		const uint64_t bit = uint64_t(1) << offset;
+		if (s.window & bit)
+			/* duplicate */
+			return false;
+
+		s.window |= bit;
+	}
+
+	s.time = std::max(s.time, header.time);
+	return true;
+}
+
+bool
+SessionReplicationReceiver::OnUdpDatagram(ConstBuffer<void> datagram,
+					  WritableBuffer<UniqueFileDescriptor>,
+					  SocketAddress address, int)
+{
+	if (!IsPeer(address)) {
+		LogConcat(3, "SessionReplicationReceiver",
+			  "Datagram from unknown host ignored");
+		return true;
+	}
+
+	const auto payload =
+		key.Verify(ConstBuffer<std::byte>::FromVoid(datagram));
+	if (payload.IsNull()) {
+		LogConcat(3, "SessionReplicationReceiver",
+			  "Datagram with bad MAC ignored");
+		return true;
+	}
+
+	MemoryReader mr(payload);
+	BufferedReader br(mr);
+
+	SessionReplicationHeader header;
+
+	try {
+		header = session_read_replication_header(br);
+	} catch (...) {
+		LogConcat(3, "SessionReplicationReceiver",
+			  "Malformed datagram");
+		return true;
+	}
+
+	if (!CheckReplay(header)) {
+		LogConcat(3, "SessionReplicationReceiver",
+			  "Stale or duplicate datagram ignored");
+		return true;
+	}
+
+	while (true) {
+		uint32_t magic;
+		try {
+			magic = session_read_magic(br);
+		} catch (...) {
+			/* end of datagram */
+			break;
+		}
+
+		try {
+			if (magic == MAGIC_SESSION) {
+				auto session = session_read(br);
+				assert(session);
+
+				/* the peer has this state already; don't
+				   send it back when it is used here */
+				session->replicated_state = StateFingerprint(*session);
+				session->replication_refresh.Touch(Expiry::Now(),
+								   SessionReplicator::refresh_interval);
+
+				manager.InsertReplica(*session.release());
+			} else if (magic == MAGIC_DELETE_SESSION) {
+				manager.EraseReplica(session_read_id(br));
+			} else
+				throw SessionDeserializerError();
+		} catch (...) {
+			LogConcat(3, "SessionReplicationReceiver",
+				  "Malformed record");
+			break;
+		}
+	}
+
+	return true;
+}
+
+void
+SessionReplicationReceiver::OnUdpError(std::exception_ptr ep) noexcept
+{
+	LogConcat(2, "SessionReplicationReceiver", ep);
+}
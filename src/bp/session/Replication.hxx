@@ -0,0 +1,331 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Replication of sessions to peer nodes in a cluster.
+ */
+
+#pragma once
+
+#include "Session.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "event/SocketEvent.hxx"
+#include "event/net/FullUdpHandler.hxx"
+#include "event/net/UdpListener.hxx"
+#include "net/AllocatedSocketAddress.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+
+#include <boost/intrusive/list.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <forward_list>
+#include <list>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct SessionReplicationHeader;
+class SocketAddress;
+class SessionManager;
+
+/**
+ * The key which authenticates replication datagrams.  It is derived
+ * from a secret shared by all nodes of the cluster; each datagram
+ * ends with a HMAC-SHA-512-256 over its contents.
+ */
+class SessionReplicationKey {
+	std::array<unsigned char, 32> key;
+
+public:
+	static constexpr std::size_t MAC_SIZE = 32;
+
+	explicit SessionReplicationKey(std::string_view secret) noexcept;
+
+	/**
+	 * Append the MAC to the datagram.
+	 */
+	void Sign(std::vector<std::byte> &datagram) const noexcept;
+
+	/**
+	 * Verify the MAC at the end of the datagram.
+	 *
+	 * @return the payload without the MAC or nullptr if
+	 * verification has failed
+	 */
+	[[gnu::pure]]
+	ConstBuffer<std::byte> Verify(ConstBuffer<std::byte> datagram) const noexcept;
+};
+
+/**
+ * Sends all local session modifications to the peer nodes of a
+ * cluster, so they can take over when this node fails.  Modified
+ * sessions are collected and sent in batches; each batch is split
+ * into datagrams which contain a #MAGIC_REPLICATION header and a list
+ * of journal records (see session/Write.cxx).
+ *
+ * Datagrams which cannot be sent immediately are queued (up to
+ * #MAX_QUEUE bytes per peer); if the queue is full, the oldest
+ * datagrams are discarded.  Replication is best-effort: a lost update
+ * is repaired by the next modification of the session.
+ *
+ * Sessions which were only read (i.e. their expiry was refreshed, but
+ * nothing else was changed) are not sent again, unless the last
+ * replica is older than #refresh_interval.
+ *
+ * Each datagram header contains a random sender id, a sequence
+ * number and a timestamp (see #SessionReplicationHeader), which
+ * allow the #SessionReplicationReceiver to reject replays.
+ */
+class SessionReplicator final {
+public:
+	/**
+	 * Send sessions which were only read after this duration, to
+	 * refresh their expiry on the peers.
+	 */
+	static constexpr std::chrono::seconds refresh_interval =
+		std::chrono::minutes(1);
+
+private:
+	/** send modified sessions every 250 milliseconds */
+	static constexpr Event::Duration flush_interval =
+		std::chrono::milliseconds(250);
+
+	/**
+	 * The maximum size of a datagram (without the MAC).  This
+	 * stays below the UDP limit of 65507 bytes.
+	 */
+	static constexpr std::size_t MAX_DATAGRAM = 60000;
+
+	/**
+	 * The maximum number of bytes queued for one peer.
+	 */
+	static constexpr std::size_t MAX_QUEUE = 4 * 1024 * 1024;
+
+	class Peer {
+		UniqueSocketDescriptor fd;
+
+		SocketEvent event;
+
+		/**
+		 * Datagrams which could not be sent yet because the
+		 * socket buffer was full.
+		 */
+		std::list<std::vector<std::byte>> queue;
+
+		std::size_t queue_size = 0;
+
+		/**
+		 * Has the last send() failed (other than EAGAIN)?
+		 * Used to avoid log spam while the peer is down.
+		 */
+		bool failing = false;
+
+	public:
+		/**
+		 * Throws on error.
+		 */
+		Peer(EventLoop &event_loop, SocketAddress address);
+
+		void Send(const std::vector<std::byte> &datagram) noexcept;
+
+	private:
+		/**
+		 * @return false if the socket buffer is full
+		 */
+		bool TrySend(const std::vector<std::byte> &datagram) noexcept;
+
+		void Enqueue(const std::vector<std::byte> &datagram) noexcept;
+
+		void OnSocketReady(unsigned events) noexcept;
+	};
+
+	const SessionReplicationKey key;
+
+	std::forward_list<Peer> peers;
+
+	CoarseTimerEvent flush_timer;
+
+	/**
+	 * A random number identifying this process; see
+	 * SessionReplicationHeader::sender.
+	 */
+	const uint64_t sender_id;
+
+	/**
+	 * The sequence number of the last datagram.
+	 */
+	uint64_t sequence = 0;
+
+	using DirtyList =
+		boost::intrusive::list<Session,
+				       boost::intrusive::member_hook<Session,
+								     Session::DirtyHook,
+								     &Session::replication_hook>,
+				       boost::intrusive::constant_time_size<false>>;
+
+	/**
+	 * Sessions which have been modified since the last Flush().
+	 */
+	DirtyList dirty;
+
+	/**
+	 * Sessions which have been deleted since the last Flush().
+	 */
+	std::vector<SessionId> deleted;
+
+public:
+	SessionReplicator(EventLoop &event_loop,
+			  const SessionReplicationKey &_key) noexcept;
+	~SessionReplicator() noexcept;
+
+	SessionReplicator(const SessionReplicator &) = delete;
+	SessionReplicator &operator=(const SessionReplicator &) = delete;
+
+	auto &GetEventLoop() const noexcept {
+		return flush_timer.GetEventLoop();
+	}
+
+	/**
+	 * Throws on error.
+	 */
+	void AddPeer(SocketAddress address);
+
+	/**
+	 * The given session has been created, modified or used.
+	 */
+	void Modified(Session &session) noexcept;
+
+	/**
+	 * The given session is about to be deleted.
+	 */
+	void Deleted(Session &session) noexcept;
+
+	/**
+	 * Send all modifications collected so far.
+	 */
+	void Flush() noexcept;
+
+private:
+	std::vector<std::byte> MakeHeader() noexcept;
+
+	void SendToAll(std::vector<std::byte> &&datagram) noexcept;
+
+	void OnFlushTimer() noexcept {
+		Flush();
+	}
+};
+
+/**
+ * Receives datagrams from #SessionReplicator instances on other
+ * nodes and applies them to the #SessionManager.  Datagrams are only
+ * accepted from the configured peer hosts, and only if their MAC
+ * matches.
+ *
+ * Replays are rejected: a datagram must not be older than #max_age
+ * (which requires synchronized clocks), and each sequence number of
+ * a sender is accepted only once.  Sequence numbers may arrive out
+ * of order within a window of #REPLAY_WINDOW.
+ */
+class SessionReplicationReceiver final : FullUdpHandler {
+	/**
+	 * Datagrams whose timestamp differs from the local clock by
+	 * more than this are rejected.
+	 */
+	static constexpr std::chrono::seconds max_age =
+		std::chrono::minutes(1);
+
+	static constexpr uint64_t REPLAY_WINDOW = 64;
+
+	struct Sender {
+		/**
+		 * The highest sequence number seen so far.
+		 */
+		uint64_t highest;
+
+		/**
+		 * Bit i is set if sequence number (#highest - i) has
+		 * been seen.
+		 */
+		uint64_t window;
+
+		/**
+		 * The newest timestamp seen so far.  Senders are
+		 * forgotten when it exceeds #max_age, because older
+		 * datagrams would be rejected anyway.
+		 */
+		int64_t time;
+	};
+
+	SessionManager &manager;
+
+	const SessionReplicationKey key;
+
+	std::forward_list<AllocatedSocketAddress> peers;
+
+	std::unordered_map<uint64_t, Sender> senders;
+
+	UdpListener listener;
+
+public:
+	SessionReplicationReceiver(EventLoop &event_loop,
+				   UniqueSocketDescriptor fd,
+				   SessionManager &_manager,
+				   const SessionReplicationKey &_key) noexcept;
+
+	/**
+	 * Accept datagrams from this host (the port is ignored).
+	 */
+	void AddPeer(SocketAddress address) noexcept {
+		peers.emplace_front(address);
+	}
+
+private:
+	[[gnu::pure]]
+	bool IsPeer(SocketAddress address) const noexcept;
+
+	/**
+	 * Check the header of a datagram whose MAC has been verified,
+	 * and remember its sequence number.
+	 *
+	 * @return false if the datagram is stale or a duplicate
+	 */
+	bool CheckReplay(const SessionReplicationHeader &header) noexcept;
+
+	/* virtual methods from class UdpHandler */
+	bool OnUdpDatagram(ConstBuffer<void> payload,
+			   WritableBuffer<UniqueFileDescriptor> fds,
+			   SocketAddress address, int uid) override;
+	void OnUdpError(std::exception_ptr ep) noexcept override;
+};
@@ -31,38 +31,22 @@
  */
 
 #include "Save.hxx"
+#include "Journal.hxx"
 #include "Write.hxx"
 #include "Read.hxx"
 #include "File.hxx"
 #include "Manager.hxx"
 #include "Session.hxx"
-#include "io/BufferedOutputStream.hxx"
 #include "io/BufferedReader.hxx"
 #include "io/FdReader.hxx"
-#include "io/FdOutputStream.hxx"
-#include "io/FileWriter.hxx"
+#include "io/UniqueFileDescriptor.hxx"
 #include "io/Logger.hxx"
 
 #include <assert.h>
+#include <sys/stat.h>
 
 static const char *session_save_path;
-
-static bool
-session_save_callback(const Session *session, void *ctx)
-{
-	auto &file = *(BufferedOutputStream *)ctx;
-	session_write_magic(file, MAGIC_SESSION);
-	session_write(file, session);
-	return true;
-}
-
-static void
-session_manager_save(SessionManager &manager, BufferedOutputStream &file)
-{
-	session_write_file_header(file);
-	manager.Visit(session_save_callback, &file);
-	session_write_file_tail(file);
-}
+static SessionJournal *session_journal;
 
 static bool
 session_manager_load(SessionManager &manager, BufferedReader &r)
@@ -99,54 +83,141 @@ session_manager_load(SessionManager &manager, BufferedReader &r)
 	return true;
 }
 
-void
-session_save(SessionManager &manager) noexcept
-try {
-	LogConcat(5, "SessionManager", "saving sessions to ", session_save_path);
+/**
+ * Apply all records from the journal to the #SessionManager.  A
+ * partial record at the end (after a crash while appending) is
+ * ignored.
+ */
+static void
+session_manager_replay(SessionManager &manager, BufferedReader &r)
+{
+	session_read_journal_header(r);
+
+	const Expiry now = Expiry::Now();
 
-	FileWriter fw(session_save_path);
-	FdOutputStream fos(fw.GetFileDescriptor());
+	unsigned num_records = 0;
+	bool in_record = false;
 
-	{
-		BufferedOutputStream bos(fos);
-		session_manager_save(manager, bos);
-		bos.Flush();
+	try {
+		while (true) {
+			uint32_t magic;
+			try {
+				magic = session_read_magic(r);
+			} catch (...) {
+				/* end of file */
+				break;
+			}
+
+			in_record = true;
+
+			if (magic == MAGIC_SESSION) {
+				auto session = session_read(r);
+				assert(session);
+
+				/* replace the old version */
+				manager.EraseAndDispose(session->id);
+
+				if (!session->expires.IsExpired(now))
+					manager.Insert(*session.release());
+			} else if (magic == MAGIC_DELETE_SESSION) {
+				manager.EraseAndDispose(session_read_id(r));
+			} else
+				throw SessionDeserializerError();
+
+			in_record = false;
+			++num_records;
+		}
+	} catch (...) {
+		if (!in_record)
+			throw;
+
+		LogConcat(2, "SessionManager",
+			  "Session journal is truncated after ",
+			  num_records, " records");
 	}
 
-	fw.Commit();
-} catch (...) {
-	LogConcat(2, "SessionManager", "Failed to save sessions",
-		  std::current_exception());
-	return;
+	LogConcat(4, "SessionManager",
+		  "replayed ", num_records, " journal records, now ",
+		  manager.Count(), " sessions");
+}
+
+void
+session_save(SessionManager &manager) noexcept
+{
+	if (session_journal == nullptr)
+		return;
+
+	session_journal->Flush();
+
+	if (session_journal->NeedsCompaction())
+		session_journal->Compact(manager);
 }
 
 void
-session_save_init(SessionManager &manager, const char *path) noexcept
+session_save_init(EventLoop &event_loop, SessionManager &manager,
+		  const char *path) noexcept
 {
 	assert(session_save_path == nullptr);
+	assert(session_journal == nullptr);
 
 	if (path == nullptr)
 		return;
 
 	session_save_path = path;
 
-	UniqueFileDescriptor fd;
-	if (!fd.OpenReadOnly(session_save_path))
-		return;
+	std::size_t snapshot_size = 0;
+
+	if (UniqueFileDescriptor fd; fd.OpenReadOnly(session_save_path)) {
+		struct stat st;
+		if (fstat(fd.Get(), &st) == 0)
+			snapshot_size = st.st_size;
+
+		try {
+			FdReader fr(fd);
+			BufferedReader br(fr);
+
+			session_manager_load(manager, br);
+		} catch (SessionDeserializerError) {
+			LogConcat(1, "SessionManager",
+				  "Session file is corrupt");
+		} catch (...) {
+			LogConcat(1, "SessionManager",
+				  "Failed to load sessions: ",
+				  std::current_exception());
+		}
+	}
 
-	try {
-		FdReader fr(fd);
-		BufferedReader br(fr);
+	const auto journal_path =
+		SessionJournal::MakeJournalPath(session_save_path);
 
-		session_manager_load(manager, br);
-	} catch (SessionDeserializerError) {
-		LogConcat(1, "SessionManager",
-			  "Session file is corrupt");
-	} catch (...) {
-		LogConcat(1, "SessionManager",
-			  "Failed to load sessions: ",
-			  std::current_exception());
+	bool compact = false;
+
+	if (UniqueFileDescriptor fd; fd.OpenReadOnly(journal_path.c_str())) {
+		/* fold the journal into a new snapshot right away;
+		   this also discards a partial record at its end */
+		compact = true;
+
+		try {
+			FdReader fr(fd);
+			BufferedReader br(fr);
+
+			session_manager_replay(manager, br);
+		} catch (SessionDeserializerError) {
+			LogConcat(1, "SessionManager",
+				  "Session journal is corrupt");
+		} catch (...) {
+			LogConcat(1, "SessionManager",
+				  "Failed to replay session journal: ",
+				  std::current_exception());
+		}
 	}
+
+	session_journal = new SessionJournal(event_loop, session_save_path,
+					     snapshot_size);
+	manager.SetJournal(session_journal);
+
+	if (compact)
+		session_journal->Compact(manager);
 }
 
 void
@@ -155,5 +226,13 @@ session_save_deinit(SessionManager &manager) noexcept
 	if (session_save_path == nullptr)
 		return;
 
-	session_save(manager);
+	manager.SetJournal(nullptr);
+
+	if (session_journal->Close())
+		delete session_journal;
+	/* else: the stopped #ThreadQueue still refers to it; leak
+	   it, the process is about to exit anyway */
+
+	session_journal = nullptr;
+	session_save_path = nullptr;
 }
@@ -36,13 +36,28 @@
 
 #pragma once
 
+class EventLoop;
 class SessionManager;
 
+/**
+ * Load the session snapshot from the given file, replay the journal
+ * and record all further modifications in the journal (see
+ * #SessionJournal).
+ */
 void
-session_save_init(SessionManager &manager, const char *path) noexcept;
+session_save_init(EventLoop &event_loop, SessionManager &manager,
+		  const char *path) noexcept;
 
+/**
+ * Write all pending modifications to the journal and stop recording.
+ * This must be called after thread_pool_join().
+ */
 void
 session_save_deinit(SessionManager &manager) noexcept;
 
+/**
+ * Submit all pending modifications to the journal, and compact it
+ * into a new snapshot if it has grown too large.
+ */
 void
 session_save(SessionManager &manager) noexcept;
@@ -44,6 +44,7 @@
 #include "util/ConstBuffer.hxx"
 #include "util/Expiry.hxx"
 
+#include <boost/intrusive/list_hook.hpp>
 #include <boost/intrusive/set.hpp>
 #include <boost/intrusive/unordered_set_hook.hpp>
 
@@ -210,6 +211,34 @@ struct Session {
 	using ByAttachHook = boost::intrusive::unordered_set_member_hook<boost::intrusive::link_mode<boost::intrusive::auto_unlink>>;
 	ByAttachHook by_attach_hook;
 
+	using DirtyHook = boost::intrusive::list_member_hook<boost::intrusive::link_mode<boost::intrusive::auto_unlink>>;
+
+	/**
+	 * If linked, then this session has been modified since it
+	 * was last written to the #SessionJournal.
+	 */
+	DirtyHook journal_hook;
+
+	/**
+	 * If linked, then this session has been modified since it
+	 * was last sent to the #SessionReplicator peers.
+	 */
+	DirtyHook replication_hook;
+
+	/**
+	 * A fingerprint of the session state (see
+	 * session_write_state()) when it was last sent to the
+	 * #SessionReplicator peers.
+	 */
+	std::size_t replicated_state = 0;
+
+	/**
+	 * When shall this session be sent to the #SessionReplicator
+	 * peers again even if it was not modified, to refresh its
+	 * expiry there?
+	 */
+	Expiry replication_refresh = Expiry::AlreadyExpired();
+
 	/** identification number of this session */
 	const SessionId id;
 
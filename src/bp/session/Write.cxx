@@ -147,6 +147,33 @@ session_write_file_tail(BufferedOutputStream &file)
 	session_write_magic(file, MAGIC_END_OF_LIST);
 }
 
+void
+session_write_journal_header(BufferedOutputStream &os)
+{
+	FileWriter file(os);
+	file.Write32(MAGIC_JOURNAL);
+	file.Write32(sizeof(Session));
+}
+
+void
+session_write_replication_header(BufferedOutputStream &os,
+				 const SessionReplicationHeader &header)
+{
+	FileWriter file(os);
+	file.Write32(MAGIC_REPLICATION);
+	file.Write32(sizeof(Session));
+	file.Write64(header.sender);
+	file.Write64(header.sequence);
+	file.Write64(header.time);
+}
+
+void
+session_write_id(BufferedOutputStream &os, const SessionId &id)
+{
+	FileWriter file(os);
+	file.WriteT(id);
+}
+
 static void
 WriteWidgetSessions(FileWriter &file, const WidgetSession::Set &widgets);
 
@@ -205,14 +232,9 @@ WriteRealmSession(FileWriter &file, const RealmSession &session)
 	file.Write32(MAGIC_END_OF_RECORD);
 }
 
-void
-session_write(BufferedOutputStream &os, const Session *session)
+static void
+WriteSessionState(FileWriter &file, const Session *session)
 {
-	FileWriter file(os);
-
-	file.WriteT(session->id);
-	file.Write(session->expires);
-	file.WriteT(session->counter);
 	file.WriteBool(session->is_new);
 	file.WriteBool(session->cookie_sent);
 	file.WriteBool(session->cookie_received);
@@ -227,3 +249,21 @@ session_write(BufferedOutputStream &os, const Session *session)
 	file.Write32(MAGIC_END_OF_LIST);
 	file.Write32(MAGIC_END_OF_RECORD);
 }
+
+void
+session_write(BufferedOutputStream &os, const Session *session)
+{
+	FileWriter file(os);
+
+	file.WriteT(session->id);
+	file.Write(session->expires);
+	file.WriteT(session->counter);
+	WriteSessionState(file, session);
+}
+
+void
+session_write_state(BufferedOutputStream &os, const Session &session)
+{
+	FileWriter file(os);
+	WriteSessionState(file, &session);
+}
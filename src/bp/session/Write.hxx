@@ -39,6 +39,8 @@
 #include <stdint.h>
 
 struct Session;
+struct SessionReplicationHeader;
+class SessionId;
 class BufferedOutputStream;
 
 /**
@@ -59,8 +61,43 @@ session_write_file_header(BufferedOutputStream &os);
 void
 session_write_file_tail(BufferedOutputStream &os);
 
+/**
+ * Write the header of a journal file.
+ *
+ * Throws on error.
+ */
+void
+session_write_journal_header(BufferedOutputStream &os);
+
+/**
+ * Write the header of a replication datagram
+ * (#REPLICATION_HEADER_SIZE bytes).
+ *
+ * Throws on error.
+ */
+void
+session_write_replication_header(BufferedOutputStream &os,
+				 const SessionReplicationHeader &header);
+
+/**
+ * Throws on error.
+ */
+void
+session_write_id(BufferedOutputStream &os, const SessionId &id);
+
 /**
  * Throws on error.
  */
 void
 session_write(BufferedOutputStream &os, const Session *session);
+
+/**
+ * Write the state of the session which is modified by requests,
+ * i.e. everything except the id, the expiry and the usage counter.
+ * This is not a valid record; it is only used to detect
+ * modifications.
+ *
+ * Throws on error.
+ */
+void
+session_write_state(BufferedOutputStream &os, const Session &session);
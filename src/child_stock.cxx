@@ -42,12 +42,33 @@
 #include "net/TempListener.hxx"
 #include "net/UniqueSocketDescriptor.hxx"
 #include "io/UniqueFileDescriptor.hxx"
+#include "io/Logger.hxx"
+#include "pool/pool.hxx"
+#include "AllocatorPtr.hxx"
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include <assert.h>
+#include <string.h>
 #include <unistd.h>
 
+/**
+ * How often is the idle target of each key adapted to the recent
+ * demand?  This also replaces idle child processes which have exited
+ * or were cleared.
+ */
+static constexpr Event::Duration CHILD_STOCK_ADAPT_INTERVAL =
+	std::chrono::minutes(1);
+
+/**
+ * Keys whose child processes have not been used for this duration
+ * are not pre-spawned anymore.
+ */
+static constexpr Event::Duration CHILD_STOCK_PREWARM_EXPIRY =
+	std::chrono::minutes(10);
+
 int
 ChildStockClass::GetChildSocketType(void *) const noexcept
 {
@@ -224,6 +245,23 @@ void
 ChildStock::Create(CreateStockItem c, StockRequest request,
 		   CancellablePointer &)
 {
+	if (prewarming) {
+		++n_prespawned;
+	} else if (min_idle > 0) {
+		/* no idle child process was available for this
+		   request: remember that, so OnAdaptTimer() raises
+		   the idle target for this key */
+		const auto now = GetEventLoop().SteadyNow();
+		auto &state = keys.try_emplace(c.GetStockName(),
+					       min_idle, max_idle, now)
+			.first->second;
+		state.target.AddMiss();
+		state.last_used = now;
+
+		if (!adapt_timer.IsPending())
+			adapt_timer.Schedule(CHILD_STOCK_ADAPT_INTERVAL);
+	}
+
 	auto *item = new ChildStockItem(c, *this, spawn_service,
 					cls.GetChildTag(request.get()));
 
@@ -259,7 +297,10 @@ ChildStock::ChildStock(EventLoop &event_loop, SpawnService &_spawn_service,
 	 spawn_service(_spawn_service), cls(_cls),
 	 backlog(_backlog),
 	 log_socket(_log_socket),
-	 log_options(_log_options)
+	 log_options(_log_options),
+	 max_idle(_max_idle),
+	 adapt_timer(event_loop, BIND_THIS_METHOD(OnAdaptTimer)),
+	 prewarm_event(event_loop, BIND_THIS_METHOD(OnPrewarmEvent))
 {
 }
 
@@ -278,6 +319,11 @@ inline void
 ChildStock::AddIdle(ChildStockItem &item) noexcept
 {
 	idle.push_back(item);
+
+	if (!prewarming && !keys.empty())
+		/* a request has just used this child process */
+		if (auto i = keys.find(item.GetStockName()); i != keys.end())
+			i->second.last_used = GetEventLoop().SteadyNow();
 }
 
 void
@@ -293,6 +339,146 @@ ChildStock::DiscardOldestIdle() noexcept
 	item.InvokeIdleDisconnect();
 }
 
+void
+ChildStock::SetMinIdle(unsigned _min_idle) noexcept
+{
+	/* more idle child processes would be killed by the
+	   #StockMap right away */
+	min_idle = std::min(_min_idle, max_idle);
+
+	/* start over with the new setting */
+	keys.clear();
+	adapt_timer.Cancel();
+	prewarm_event.Cancel();
+}
+
+unsigned
+ChildStock::GetPrewarmCount(const char *key) const noexcept
+{
+	if (min_idle == 0)
+		return 0;
+
+	unsigned target = min_idle;
+	if (auto i = keys.find(key); i != keys.end())
+		target = i->second.target.Get();
+
+	unsigned n_idle = 0;
+	for (const auto &i : idle)
+		if (strcmp(i.GetStockName(), key) == 0)
+			++n_idle;
+
+	return n_idle < target ? target : 0;
+}
+
+void
+ChildStock::Prewarm(const char *key,
+		    const std::function<std::function<StockRequest()>(AllocatorPtr alloc)> &copy_params) noexcept
+{
+	if (min_idle == 0)
+		return;
+
+	auto &state = keys.try_emplace(key, min_idle, max_idle,
+				       GetEventLoop().SteadyNow())
+		.first->second;
+
+	if (!state.pool) {
+		state.pool = pool_new_libc(nullptr, "child_stock_prewarm");
+		state.make_request = copy_params(*state.pool);
+
+		if (!adapt_timer.IsPending())
+			adapt_timer.Schedule(CHILD_STOCK_ADAPT_INTERVAL);
+	}
+
+	if (state.refill || GetPrewarmCount(key) == 0)
+		return;
+
+	state.refill = true;
+	prewarm_event.Schedule();
+}
+
+void
+ChildStock::DoPrewarm(const char *key,
+		      const std::function<StockRequest()> &make_request) noexcept
+{
+	/* check again, the situation may have changed since
+	   Prewarm() */
+	const unsigned n = GetPrewarmCount(key);
+	if (n == 0)
+		return;
+
+	/* borrow items until there are enough; the existing idle
+	   ones are borrowed first, then new ones are spawned; after
+	   returning all of them, they are all idle */
+	std::vector<StockItem *> items;
+	prewarming = true;
+
+	try {
+		items.reserve(n);
+		while (items.size() < n)
+			items.push_back(map.GetNow(key, make_request()));
+	} catch (...) {
+		LogConcat(2, key, "Failed to pre-spawn child process: ",
+			  std::current_exception());
+	}
+
+	/* returning them doesn't count as use (see AddIdle()) */
+	for (auto *i : items)
+		i->Put(false);
+
+	prewarming = false;
+}
+
+void
+ChildStock::OnPrewarmEvent() noexcept
+{
+	for (auto &[key, state] : keys) {
+		if (!state.refill)
+			continue;
+
+		state.refill = false;
+		DoPrewarm(key.c_str(), state.make_request);
+	}
+}
+
+void
+ChildStock::OnAdaptTimer() noexcept
+{
+	const auto now = GetEventLoop().SteadyNow();
+
+	for (auto i = keys.begin(); i != keys.end();) {
+		auto &state = i->second;
+
+		if (now - state.last_used >= CHILD_STOCK_PREWARM_EXPIRY) {
+			i = keys.erase(i);
+			continue;
+		}
+
+		state.target.Adapt(min_idle, max_idle);
+
+		/* replace idle child processes which have exited or
+		   were cleared since the last run */
+		if (state.make_request)
+			DoPrewarm(i->first.c_str(), state.make_request);
+
+		++i;
+	}
+
+	if (!keys.empty())
+		adapt_timer.Schedule(CHILD_STOCK_ADAPT_INTERVAL);
+}
+
+void
+ChildStock::AddStats(ChildStockStats &stats) const noexcept
+{
+	for ([[maybe_unused]] const auto &i : idle)
+		++stats.idle;
+
+	for (const auto &[key, state] : keys)
+		stats.warm_target += state.target.Get();
+
+	stats.prespawned += n_prespawned;
+}
+
 UniqueSocketDescriptor
 child_stock_item_connect(StockItem &_item)
 {
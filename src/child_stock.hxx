@@ -34,11 +34,21 @@
 
 #include "stock/Class.hxx"
 #include "stock/MapStock.hxx"
+#include "stock/AdaptiveIdleTarget.hxx"
 #include "access_log/ChildErrorLogOptions.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "event/DeferEvent.hxx"
+#include "pool/Ptr.hxx"
 #include "io/FdType.hxx"
 #include "net/SocketDescriptor.hxx"
 
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
 struct PreparedChildProcess;
+class AllocatorPtr;
 class UniqueFileDescriptor;
 class UniqueSocketDescriptor;
 class EventLoop;
@@ -88,6 +98,24 @@ public:
 				  PreparedChildProcess &p) = 0;
 };
 
+struct ChildStockStats {
+	/**
+	 * The number of idle child processes.
+	 */
+	unsigned idle = 0;
+
+	/**
+	 * The sum of the adaptive idle targets of all keys with
+	 * recent demand.
+	 */
+	unsigned warm_target = 0;
+
+	/**
+	 * The total number of child processes spawned in advance.
+	 */
+	uint64_t prespawned = 0;
+};
+
 using ChildStockItemHook =
 	boost::intrusive::list_base_hook<boost::intrusive::link_mode<boost::intrusive::auto_unlink>,
 					 boost::intrusive::tag<ChildStockClass>>;
@@ -135,6 +163,83 @@ class ChildStock final : StockClass {
 
 	const ChildErrorLogOptions log_options;
 
+	/**
+	 * The configured minimum number of idle child processes per
+	 * key.  0 disables pre-spawning.
+	 */
+	unsigned min_idle = 0;
+
+	/**
+	 * The upper bound for the adaptive idle target.  More idle
+	 * child processes would be killed by the #StockMap anyway.
+	 */
+	const unsigned max_idle;
+
+	struct KeyState {
+		/**
+		 * Owns the copy of the request parameters (see
+		 * Prewarm()); nullptr until Prewarm() has been
+		 * called for this key.
+		 */
+		PoolPtr pool;
+
+		/**
+		 * Creates a #StockRequest from the copy in #pool.
+		 */
+		std::function<StockRequest()> make_request;
+
+		/**
+		 * The number of idle child processes to be kept.
+		 */
+		AdaptiveIdleTarget target;
+
+		/**
+		 * When was a child process of this key last used?
+		 * Keys which have not been used for a while are
+		 * forgotten, and their child processes are left to
+		 * the clear interval.
+		 */
+		Event::TimePoint last_used;
+
+		/**
+		 * Shall OnPrewarmEvent() top up this key?
+		 */
+		bool refill = false;
+
+		KeyState(unsigned min_idle, unsigned max_idle,
+			 Event::TimePoint now) noexcept
+			:target(min_idle, max_idle), last_used(now) {}
+	};
+
+	/**
+	 * Per-key state for pre-spawning.  Keys which are not in
+	 * this map use #min_idle as their target.
+	 */
+	std::map<std::string, KeyState, std::less<>> keys;
+
+	/**
+	 * Periodically adapts KeyState::target to the recent demand
+	 * and spawns replacements for idle child processes which
+	 * have exited or were cleared.
+	 */
+	CoarseTimerEvent adapt_timer;
+
+	/**
+	 * Spawns the child processes for keys with
+	 * KeyState::refill, after the stock's Create() method which
+	 * scheduled them has returned.
+	 */
+	DeferEvent prewarm_event;
+
+	uint64_t n_prespawned = 0;
+
+	/**
+	 * Is DoPrewarm() currently running?  Used by Create() to
+	 * distinguish pre-spawned child processes from those spawned
+	 * for a request.
+	 */
+	bool prewarming = false;
+
 public:
 	ChildStock(EventLoop &event_loop, SpawnService &_spawn_service,
 		   ChildStockClass &_cls,
@@ -145,6 +250,10 @@ public:
 
 	~ChildStock() noexcept;
 
+	EventLoop &GetEventLoop() const noexcept {
+		return adapt_timer.GetEventLoop();
+	}
+
 	StockMap &GetStockMap() noexcept {
 		return map;
 	}
@@ -172,7 +281,52 @@ public:
 	 */
 	void DiscardOldestIdle() noexcept;
 
+	/**
+	 * Set the minimum number of idle child processes per key.  0
+	 * disables pre-spawning.
+	 */
+	void SetMinIdle(unsigned _min_idle) noexcept;
+
+	/**
+	 * Schedule spawning idle child processes for the given key
+	 * until its idle target is reached.  The child processes are
+	 * spawned from a #DeferEvent, i.e. after the caller has
+	 * returned.  This must be called while the parameters of a
+	 * request for this key are still valid, i.e. right after a
+	 * child process was obtained for it.
+	 *
+	 * The copy of the parameters is kept as long as the key is
+	 * in use, so the adapt timer can replace idle child processes
+	 * which have exited or were cleared.
+	 *
+	 * Errors are logged and ignored.
+	 *
+	 * @param copy_params a function which copies the request
+	 * parameters to the given allocator (which lives as long as
+	 * the key's state) and returns a function creating a
+	 * #StockRequest from this copy; it is invoked at most once
+	 * per key
+	 */
+	void Prewarm(const char *key,
+		     const std::function<std::function<StockRequest()>(AllocatorPtr alloc)> &copy_params) noexcept;
+
+	void AddStats(ChildStockStats &stats) const noexcept;
+
 private:
+	/**
+	 * @return the number of items Prewarm() shall borrow, or 0
+	 * if there are already enough idle child processes
+	 */
+	[[gnu::pure]]
+	unsigned GetPrewarmCount(const char *key) const noexcept;
+
+	void DoPrewarm(const char *key,
+		       const std::function<StockRequest()> &make_request) noexcept;
+
+	void OnPrewarmEvent() noexcept;
+
+	void OnAdaptTimer() noexcept;
+
 	/* virtual methods from class StockClass */
 	void Create(CreateStockItem c, StockRequest request,
 		    CancellablePointer &cancel_ptr) override;
@@ -83,6 +83,11 @@ public:
 		_cancel_ptr = *this;
 	}
 
+	~BalancerRequest() noexcept {
+		if (failure)
+			failure->RemoveOutstanding();
+	}
+
 	BalancerRequest(const BalancerRequest &) = delete;
 
 	void Destroy() noexcept {
@@ -119,7 +124,13 @@ public:
 	void Next(Expiry now) noexcept {
 		auto current_address = list.Pick(now, sticky_hash);
 
+		if (failure)
+			failure->RemoveOutstanding();
+
+		/* the request counts as "outstanding" on this address
+		   until this object is destroyed */
 		failure = list.MakeFailureInfo(current_address);
+		failure->AddOutstanding();
 		request.Send(alloc, std::move(current_address), cancel_ptr);
 	}
 
@@ -46,3 +46,9 @@ FailureManagerProxy::Check(const Expiry now, SocketAddress address,
 			   bool allow_fade) const noexcept {
 	return failure_manager.Check(now, address, allow_fade);
 }
+
+unsigned
+FailureManagerProxy::GetOutstanding(SocketAddress address) const noexcept
+{
+	return failure_manager.GetOutstanding(address);
+}
@@ -50,4 +50,7 @@ public:
 	[[gnu::pure]]
 	bool Check(const Expiry now, SocketAddress address,
 		   bool allow_fade) const noexcept;
+
+	[[gnu::pure]]
+	unsigned GetOutstanding(SocketAddress address) const noexcept;
 };
@@ -0,0 +1,192 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <bitset>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * A Maglev lookup table for consistent hashing (see "Maglev: A Fast
+ * and Reliable Software Network Load Balancer", Eisenbud et al.,
+ * NSDI 2016).  Each node fills the table slots in the order of its
+ * own permutation, taking turns with the other nodes, which gives
+ * every node an (almost) equal share of the slots.  Adding or
+ * removing a node moves only a small fraction of the slots to
+ * different nodes.  Looking up a hash is a single array access.
+ *
+ * @param Node the node type; must be copyable (usually a pointer)
+ * @param M the number of table slots; must be a prime number which
+ * is much larger than the number of nodes
+ * @param MAX_NODES the maximum number of nodes; this sizes the
+ * (stack-allocated) bit set used by Find()
+ */
+template<typename Node, std::size_t M = 65537,
+	 std::size_t MAX_NODES = 0xfffe>
+class MaglevTable {
+	static_assert(M > 2);
+	static_assert(MAX_NODES > 0 && MAX_NODES < 0xffff);
+
+	/**
+	 * An index into #nodes; the maximum value marks an empty slot.
+	 */
+	using Index = uint_least16_t;
+
+	std::vector<Node> nodes;
+
+	/**
+	 * Maps each slot to an index in #nodes.
+	 */
+	std::vector<Index> table;
+
+public:
+	bool empty() const noexcept {
+		return nodes.empty();
+	}
+
+	std::size_t size() const noexcept {
+		return nodes.size();
+	}
+
+	auto begin() const noexcept {
+		return nodes.begin();
+	}
+
+	auto end() const noexcept {
+		return nodes.end();
+	}
+
+	/**
+	 * Populate the table.
+	 *
+	 * @param src a container of nodes
+	 * @param h a function which returns a hash value for a node
+	 * and a seed (0 or 1); the two hashes determine the node's
+	 * permutation and must be independent of other nodes
+	 */
+	template<typename C, typename H>
+	void Build(C &&src, H &&h) noexcept {
+		nodes.clear();
+		for (const auto &i : src)
+			nodes.emplace_back(i);
+
+		table.clear();
+		if (nodes.empty())
+			return;
+
+		assert(nodes.size() <= MAX_NODES);
+
+		const std::size_t n = nodes.size();
+
+		std::vector<std::size_t> offset(n), skip(n), next(n, 0);
+		for (std::size_t i = 0; i < n; ++i) {
+			offset[i] = std::size_t(h(nodes[i], 0)) % M;
+			skip[i] = std::size_t(h(nodes[i], 1)) % (M - 1) + 1;
+		}
+
+		static constexpr Index EMPTY = ~Index{};
+		table.assign(M, EMPTY);
+
+		std::size_t filled = 0;
+		while (true) {
+			for (std::size_t i = 0; i < n; ++i) {
+				/* find this node's next preferred slot
+				   which is still empty */
+				std::size_t slot;
+				do {
+					slot = (offset[i] + next[i] * skip[i]) % M;
+					++next[i];
+				} while (table[slot] != EMPTY);
+
+				table[slot] = Index(i);
+
+				if (++filled == M)
+					return;
+			}
+		}
+	}
+
+	/**
+	 * Look up the node for the given hash.  The table must not be
+	 * empty.
+	 */
+	[[gnu::pure]]
+	const Node &Pick(std::size_t hash) const noexcept {
+		assert(!empty());
+
+		return nodes[table[hash % M]];
+	}
+
+	/**
+	 * Like Pick(), but skip nodes which are rejected by the given
+	 * predicate, walking the table starting at the hash's slot.
+	 * This keeps the assignment of all other keys stable.
+	 *
+	 * @return the first accepted node, or nullptr if all nodes
+	 * have been rejected
+	 */
+	template<typename P>
+	const Node *Find(std::size_t hash, P &&accept) const noexcept {
+		assert(!empty());
+
+		std::size_t slot = hash % M;
+
+		const Index first = table[slot];
+		if (accept(std::as_const(nodes[first])))
+			return &nodes[first];
+
+		std::bitset<MAX_NODES> rejected;
+		rejected.set(first);
+		std::size_t n_rejected = 1;
+
+		while (n_rejected < nodes.size()) {
+			if (++slot == M)
+				slot = 0;
+
+			const Index i = table[slot];
+			if (rejected[i])
+				continue;
+
+			if (accept(std::as_const(nodes[i])))
+				return &nodes[i];
+
+			rejected.set(i);
+			++n_rejected;
+		}
+
+		return nullptr;
+	}
+};
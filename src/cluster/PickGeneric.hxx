@@ -34,16 +34,19 @@
 
 #include "PickFailover.hxx"
 #include "PickModulo.hxx"
+#include "PickLeastOutstanding.hxx"
+#include "PickPowerOfTwo.hxx"
 #include "StickyMode.hxx"
 #include "RoundRobinBalancer.cxx"
 #include "net/SocketAddress.hxx"
 #include "util/Expiry.hxx"
 
+#include <stdlib.h>
+
 /**
  * Pick an address using the given #StickyMode.
  */
 template<typename List>
-[[gnu::pure]]
 const auto &
 PickGeneric(Expiry now, StickyMode sticky_mode,
 	    const List &list, sticky_hash_t sticky_hash) noexcept
@@ -58,6 +61,12 @@ PickGeneric(Expiry now, StickyMode sticky_mode,
 	case StickyMode::FAILOVER:
 		return PickFailover(now, list);
 
+	case StickyMode::LEAST_OUTSTANDING:
+		return PickLeastOutstanding(now, list, random());
+
+	case StickyMode::POWER_OF_TWO:
+		return PickPowerOfTwo(now, list, random());
+
 	case StickyMode::SOURCE_IP:
 	case StickyMode::HOST:
 	case StickyMode::XHOST:
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "util/Expiry.hxx"
+
+#include <iterator>
+
+#include <assert.h>
+
+/**
+ * Generic implementation of StickyMode::LEAST_OUTSTANDING: pick the
+ * non-failing address with the least number of requests in flight.
+ *
+ * @param start the index where the search begins; among nodes with
+ * the same load, the first one found wins, so passing a rotating
+ * value here distributes requests evenly while the cluster is idle
+ */
+template<typename List>
+[[gnu::pure]]
+const auto &
+PickLeastOutstanding(Expiry now, const List &list, size_t start) noexcept
+{
+	const size_t n = std::size(list);
+	assert(n >= 2);
+
+	const auto begin = std::begin(list), end = std::end(list);
+	const auto first = std::next(begin, start % n);
+
+	auto i = first;
+	decltype(&*i) best = nullptr;
+	unsigned best_outstanding = 0;
+
+	do {
+		if (list.Check(now, *i, false)) {
+			const unsigned outstanding = list.GetOutstanding(*i);
+			if (best == nullptr || outstanding < best_outstanding) {
+				best = &*i;
+				best_outstanding = outstanding;
+
+				if (outstanding == 0)
+					/* can't get any better */
+					break;
+			}
+		}
+
+		++i;
+		if (i == end)
+			i = begin;
+	} while (i != first);
+
+	if (best == nullptr)
+		/* all addresses failed */
+		return *first;
+
+	return *best;
+}
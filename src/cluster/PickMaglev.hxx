@@ -0,0 +1,84 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "util/Expiry.hxx"
+
+#include <cstddef>
+
+/**
+ * Pick a node from a #MaglevTable, skipping nodes which are known
+ * to be bad.  With bounded load, nodes which have too many requests
+ * in flight are skipped as well, as long as there are others.
+ *
+ * @param bounded_load the maximum load of a node in percent of the
+ * average load (see LbClusterConfig::sticky_bounded_load); 0
+ * disables the limit
+ * @param get_failure a function returning an object with the
+ * methods Check(Expiry) and GetOutstanding() (usually #FailureInfo)
+ * for a node
+ */
+template<typename Table, typename F>
+const auto &
+PickMaglev(const Table &table, Expiry now, std::size_t hash,
+	   unsigned bounded_load, F &&get_failure) noexcept
+{
+	if (bounded_load > 0) {
+		std::size_t total = 0;
+		for (const auto &node : table)
+			total += get_failure(node).GetOutstanding();
+
+		/* ceil(bounded_load% * average), counting the new
+		   request */
+		const std::size_t divisor = 100 * table.size();
+		const std::size_t limit =
+			((total + 1) * bounded_load + divisor - 1) / divisor;
+
+		const auto *node = table.Find(hash, [&](const auto &n) noexcept {
+			const auto &failure = get_failure(n);
+			return failure.Check(now) &&
+				failure.GetOutstanding() < limit;
+		});
+		if (node != nullptr)
+			return *node;
+	}
+
+	const auto *node = table.Find(hash, [&](const auto &n) noexcept {
+		return get_failure(n).Check(now);
+	});
+	if (node != nullptr)
+		return *node;
+
+	/* all nodes have failed */
+	return table.Pick(hash);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "PickLeastOutstanding.hxx"
+#include "util/Expiry.hxx"
+
+#include <iterator>
+
+#include <assert.h>
+
+/**
+ * Generic implementation of StickyMode::POWER_OF_TWO: pick two
+ * distinct addresses using the given random number and return the
+ * one with fewer requests in flight.  Failing addresses lose against
+ * non-failing ones.
+ *
+ * @param rnd a (pseudo-)random number
+ */
+template<typename List>
+[[gnu::pure]]
+const auto &
+PickPowerOfTwo(Expiry now, const List &list, size_t rnd) noexcept
+{
+	const size_t n = std::size(list);
+	assert(n >= 2);
+
+	/* derive two distinct indices from the random number */
+	const size_t a = rnd % n;
+	const size_t b = (a + 1 + (rnd / n) % (n - 1)) % n;
+
+	const auto &first = *std::next(std::begin(list), a);
+	const auto &second = *std::next(std::begin(list), b);
+
+	const bool first_ok = list.Check(now, first, false);
+	const bool second_ok = list.Check(now, second, false);
+	if (first_ok != second_ok)
+		return first_ok ? first : second;
+
+	if (!first_ok)
+		/* both have failed; fall back to a full scan to find
+		   one which is still alive */
+		return PickLeastOutstanding(now, list, a);
+
+	return list.GetOutstanding(second) < list.GetOutstanding(first)
+		? second
+		: first;
+}
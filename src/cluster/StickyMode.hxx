@@ -79,4 +79,17 @@ enum class StickyMode {
 	 * Tomcat with jvmRoute in cookie.
 	 */
 	JVM_ROUTE,
+
+	/**
+	 * Select the node with the least number of requests currently
+	 * in flight.
+	 */
+	LEAST_OUTSTANDING,
+
+	/**
+	 * Pick two nodes at random and select the one with fewer
+	 * requests currently in flight ("power of two choices").  This
+	 * is cheaper than #LEAST_OUTSTANDING for large clusters.
+	 */
+	POWER_OF_TWO,
 };
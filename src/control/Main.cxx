@@ -243,6 +243,21 @@ Stats(const char *server, ConstBuffer<const char *> args)
 	PrintStatsAttribute("io_buffers_brutto_size", stats.io_buffers_brutto_size);
 	PrintStatsAttribute("http_traffic_received", stats.http_traffic_received);
 	PrintStatsAttribute("http_traffic_sent", stats.http_traffic_sent);
+	PrintStatsAttribute("idle_children", stats.idle_children);
+	PrintStatsAttribute("warm_children", stats.warm_children);
+	PrintStatsAttribute("prespawned_children", stats.prespawned_children);
+	PrintStatsAttribute("translation_cache_validations_avoided", stats.translation_cache_validations_avoided);
+	PrintStatsAttribute("translation_cache_expand_hits", stats.translation_cache_expand_hits);
+	PrintStatsAttribute("translation_cache_expand_misses", stats.translation_cache_expand_misses);
+	PrintStatsAttribute("connect_waits", stats.connect_waits);
+	PrintStatsAttribute("prewarmed_connections", stats.prewarmed_connections);
+	PrintStatsAttribute("warm_connections", stats.warm_connections);
+	PrintStatsAttribute("io_buffers_small_size", stats.io_buffers_small_size);
+	PrintStatsAttribute("io_buffers_small_brutto_size", stats.io_buffers_small_brutto_size);
+	PrintStatsAttribute("io_buffers_medium_size", stats.io_buffers_medium_size);
+	PrintStatsAttribute("io_buffers_medium_brutto_size", stats.io_buffers_medium_brutto_size);
+	PrintStatsAttribute("io_buffers_large_size", stats.io_buffers_large_size);
+	PrintStatsAttribute("io_buffers_large_brutto_size", stats.io_buffers_large_brutto_size);
 }
 
 static void
@@ -290,6 +305,24 @@ DiscardSession(const char *server, ConstBuffer<const char *> args)
 	client.Send(BengProxy::ControlCommand::DISCARD_SESSION, attach_id);
 }
 
+static void
+ChildMinIdle(const char *server, ConstBuffer<const char *> args)
+{
+	if (args.empty())
+		throw Usage{"Number missing"};
+
+	const char *s = args.shift();
+
+	if (!args.empty())
+		throw Usage{"Too many arguments"};
+
+	const uint32_t min_idle = ToBE32(strtoul(s, nullptr, 10));
+
+	BengControlClient client(server);
+	client.Send(BengProxy::ControlCommand::CHILD_MIN_IDLE,
+		    {&min_idle, sizeof(min_idle)});
+}
+
 static void
 Stopwatch(const char *server, ConstBuffer<const char *> args)
 {
@@ -383,6 +416,9 @@ try {
 	} else if (StringIsEqual(command, "discard-session")) {
 		DiscardSession(server, args);
 		return EXIT_SUCCESS;
+	} else if (StringIsEqual(command, "child-min-idle")) {
+		ChildMinIdle(server, args);
+		return EXIT_SUCCESS;
 	} else if (StringIsEqual(command, "stopwatch")) {
 		Stopwatch(server, args);
 		return EXIT_SUCCESS;
@@ -407,6 +443,7 @@ try {
 		"  flush-nfs-cache\n"
 		"  flush-filter-cache [TAG]\n"
 		"  discard-session ATTACH_ID\n"
+		"  child-min-idle N\n"
 		"  stopwatch\n"
 		"\n"
 		"Names for tcache-invalidate:\n",
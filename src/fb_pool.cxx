@@ -32,48 +32,99 @@
 
 #include "fb_pool.hxx"
 #include "SlicePool.hxx"
+#include "SliceFifoBuffer.hxx"
+#include "AllocatorStats.hxx"
 
 #include <assert.h>
 
-static SlicePool *fb_pool;
+/**
+ * The number of slices per area for each #FbSize.  Smaller slices
+ * are packed more densely, so an area has roughly the same size in
+ * all classes.
+ */
+static constexpr unsigned fb_slices_per_area[FB_N_SIZES] = {
+	2048, 512, 256,
+};
+
+static SlicePool *fb_pools[FB_N_SIZES];
 
 void
 fb_pool_init()
 {
-	assert(fb_pool == nullptr);
+	assert(fb_pools[0] == nullptr);
 
-	fb_pool = new SlicePool(FB_SIZE, 256);
+	for (unsigned i = 0; i < FB_N_SIZES; ++i)
+		fb_pools[i] = new SlicePool(FbSizeBytes(FbSize(i)),
+					    fb_slices_per_area[i]);
 }
 
 void
 fb_pool_deinit(void)
 {
-	assert(fb_pool != nullptr);
+	assert(fb_pools[0] != nullptr);
 
-	delete fb_pool;
-	fb_pool = nullptr;
+	for (auto &i : fb_pools) {
+		delete i;
+		i = nullptr;
+	}
 }
 
 void
 fb_pool_fork_cow(bool inherit)
 {
-	assert(fb_pool != nullptr);
+	assert(fb_pools[0] != nullptr);
 
-	fb_pool->ForkCow(inherit);
+	for (auto *i : fb_pools)
+		i->ForkCow(inherit);
 }
 
 SlicePool &
 fb_pool_get()
 {
-	assert(fb_pool != nullptr);
+	return fb_pool_get(FbSize::LARGE);
+}
+
+SlicePool &
+fb_pool_get(FbSize size)
+{
+	assert(unsigned(size) < FB_N_SIZES);
+	assert(fb_pools[unsigned(size)] != nullptr);
+
+	return *fb_pools[unsigned(size)];
+}
+
+bool
+fb_pool_grow(SliceFifoBuffer &buffer) noexcept
+{
+	if (buffer.IsNull())
+		return false;
+
+	const size_t capacity = buffer.GetCapacity();
+	if (capacity >= FB_SIZE)
+		return false;
+
+	SliceFifoBuffer bigger(fb_pool_get(FbSize(unsigned(FbSizeFor(capacity)) + 1)));
+	bigger.ForeignFifoBuffer<uint8_t>::MoveFrom(buffer);
+	buffer.swap(bigger);
+	return true;
+}
+
+AllocatorStats
+fb_pool_get_stats()
+{
+	assert(fb_pools[0] != nullptr);
 
-	return *fb_pool;
+	auto stats = AllocatorStats::Zero();
+	for (const auto *i : fb_pools)
+		stats += i->GetStats();
+	return stats;
 }
 
 void
 fb_pool_compress(void)
 {
-	assert(fb_pool != nullptr);
+	assert(fb_pools[0] != nullptr);
 
-	fb_pool->Compress();
+	for (auto *i : fb_pools)
+		i->Compress();
 }
@@ -39,10 +39,57 @@
 
 #include <stddef.h>
 
+struct AllocatorStats;
 class SlicePool;
+class SliceFifoBuffer;
 
 static constexpr size_t FB_SIZE = 32768;
 
+/**
+ * The size classes of the buffer allocator.  Most code uses
+ * #FbSize::LARGE, which is #FB_SIZE; buffers which usually carry
+ * little data may start with a smaller class.
+ */
+enum class FbSize : unsigned {
+	SMALL,
+	MEDIUM,
+	LARGE,
+};
+
+static constexpr unsigned FB_N_SIZES = unsigned(FbSize::LARGE) + 1;
+
+static constexpr size_t
+FbSizeBytes(FbSize size) noexcept
+{
+	switch (size) {
+	case FbSize::SMALL:
+		return 4096;
+
+	case FbSize::MEDIUM:
+		return 16384;
+
+	case FbSize::LARGE:
+		break;
+	}
+
+	return FB_SIZE;
+}
+
+/**
+ * Returns the smallest size class which can hold the given number of
+ * bytes, or #FbSize::LARGE if none can.
+ */
+static constexpr FbSize
+FbSizeFor(size_t size) noexcept
+{
+	if (size <= FbSizeBytes(FbSize::SMALL))
+		return FbSize::SMALL;
+	else if (size <= FbSizeBytes(FbSize::MEDIUM))
+		return FbSize::MEDIUM;
+	else
+		return FbSize::LARGE;
+}
+
 /**
  * Global initialization.
  */
@@ -58,10 +105,35 @@ fb_pool_deinit();
 void
 fb_pool_fork_cow(bool inherit);
 
+/**
+ * Returns the #SlicePool for #FbSize::LARGE (i.e. #FB_SIZE).
+ */
 [[gnu::const]]
 SlicePool &
 fb_pool_get();
 
+[[gnu::const]]
+SlicePool &
+fb_pool_get(FbSize size);
+
+/**
+ * Move the contents of the given buffer to a new one of the next
+ * larger size class.  Per-connection buffers start with
+ * #FbSize::SMALL and call this when a read or write finds them full
+ * (or too small for the data at hand).
+ *
+ * @return false if the buffer is nulled or already has #FB_SIZE
+ */
+bool
+fb_pool_grow(SliceFifoBuffer &buffer) noexcept;
+
+/**
+ * Returns the sum of the statistics of all size classes.
+ */
+[[gnu::pure]]
+AllocatorStats
+fb_pool_get_stats();
+
 /**
  * Give free memory back to the kernel.  The library will
  * automatically do this once in a while.  This call forces immediate
@@ -31,27 +31,21 @@
  */
 
 #include "fcache.hxx"
-#include "cache.hxx"
+#include "RubberCache.hxx"
 #include "strmap.hxx"
 #include "http/ResponseHandler.hxx"
 #include "AllocatorPtr.hxx"
 #include "ResourceAddress.hxx"
 #include "ResourceLoader.hxx"
 #include "istream/UnusedPtr.hxx"
-#include "istream/istream_null.hxx"
 #include "istream/TeeIstream.hxx"
 #include "istream/RefIstream.hxx"
-#include "istream_unlock.hxx"
-#include "istream_rubber.hxx"
-#include "rubber.hxx"
-#include "SlicePool.hxx"
 #include "sink_rubber.hxx"
 #include "AllocatorStats.hxx"
 #include "pool/pool.hxx"
 #include "pool/Ptr.hxx"
 #include "pool/Holder.hxx"
 #include "event/CoarseTimerEvent.hxx"
-#include "event/FarTimerEvent.hxx"
 #include "event/Loop.hxx"
 #include "io/Logger.hxx"
 #include "http/List.hxx"
@@ -63,8 +57,6 @@
 
 #include <boost/intrusive/list.hpp>
 
-#include <unordered_map>
-
 #include <stdio.h>
 #include <unistd.h>
 
@@ -76,8 +68,6 @@ static constexpr off_t cacheable_size_limit = 512 * 1024;
  */
 static constexpr Event::Duration fcache_request_timeout = std::chrono::minutes(1);
 
-static constexpr Event::Duration fcache_compress_interval = std::chrono::minutes(10);
-
 /**
  * The default "expires" duration [s] if no expiration was given for
  * the input.
@@ -107,43 +97,20 @@ struct FilterCacheInfo {
 	FilterCacheInfo &operator=(const FilterCacheInfo &) = delete;
 };
 
-struct FilterCacheItem final : PoolHolder, CacheItem, LeakDetector {
-	using AutoUnlink =
-		boost::intrusive::link_mode<boost::intrusive::auto_unlink>;
-	using PerTagHook = boost::intrusive::list_member_hook<AutoUnlink>;
-
-	/**
-	 * A doubly linked list of cache items with the same cache tag.
-	 */
-	PerTagHook per_tag_siblings;
-
+struct FilterCacheItem final : RubberCacheItem {
 	const http_status_t status;
 	StringMap headers;
 
-	const size_t size;
-
-	const RubberAllocation body;
-
 	FilterCacheItem(PoolPtr &&_pool,
 			std::chrono::steady_clock::time_point now,
 			std::chrono::system_clock::time_point system_now,
 			http_status_t _status, const StringMap &_headers,
 			size_t _size, RubberAllocation &&_body,
 			std::chrono::system_clock::time_point _expires) noexcept
-		:PoolHolder(std::move(_pool)),
-		 CacheItem(now, system_now, _expires, pool_netto_size(pool) + _size),
-		 status(_status), headers(pool, _headers),
-		 size(_size), body(std::move(_body)) {
+		:RubberCacheItem(std::move(_pool), now, system_now, _expires,
+				 _size, std::move(_body)),
+		 status(_status), headers(GetPool(), _headers) {
 	}
-
-	using PoolHolder::GetPool;
-
-	/* virtual methods from class CacheItem */
-	void Destroy() noexcept override {
-		pool_trash(pool);
-		this->~FilterCacheItem();
-	}
-
 };
 
 class FilterCacheRequest final
@@ -235,25 +202,7 @@ private:
 class FilterCache final : LeakDetector {
 	friend class FilterCacheRequest;
 
-	PoolPtr pool;
-	SlicePool slice_pool;
-	Rubber rubber;
-	Cache cache;
-
-	using PerTagHook =
-		boost::intrusive::member_hook<FilterCacheItem,
-					      FilterCacheItem::PerTagHook,
-					      &FilterCacheItem::per_tag_siblings>;
-	using PerTagList =
-		boost::intrusive::list<FilterCacheItem, PerTagHook,
-				       boost::intrusive::constant_time_size<false>>;
-
-	/**
-	 * Lookup table to speed up FlushTag().
-	 */
-	std::unordered_map<std::string, PerTagList> per_tag;
-
-	FarTimerEvent compress_timer;
+	RubberCache cache;
 
 	ResourceLoader &resource_loader;
 
@@ -275,24 +224,24 @@ public:
 	~FilterCache() noexcept;
 
 	auto &GetEventLoop() const noexcept {
-		return compress_timer.GetEventLoop();
+		return cache.GetEventLoop();
 	}
 
 	void ForkCow(bool inherit) noexcept {
-		rubber.ForkCow(inherit);
-		slice_pool.ForkCow(inherit);
+		cache.ForkCow(inherit);
 	}
 
 	AllocatorStats GetStats() const noexcept {
-		return slice_pool.GetStats() + rubber.GetStats();
+		return cache.GetStats();
 	}
 
 	void Flush() noexcept {
 		cache.Flush();
-		Compress();
 	}
 
-	void FlushTag(const char *tag) noexcept;
+	void FlushTag(const char *tag) noexcept {
+		cache.FlushTag(tag);
+	}
 
 	void Get(struct pool &caller_pool,
 		 const StopwatchPtr &parent_stopwatch,
@@ -325,16 +274,6 @@ private:
 	void Hit(FilterCacheItem &item,
 		 struct pool &caller_pool,
 		 HttpResponseHandler &handler) noexcept;
-
-	void Compress() noexcept {
-		rubber.Compress();
-		slice_pool.Compress();
-	}
-
-	void OnCompressTimer() noexcept {
-		Compress();
-		compress_timer.Schedule(fcache_compress_interval);
-	}
 };
 
 FilterCacheRequest::FilterCacheRequest(PoolPtr &&_pool,
@@ -401,17 +340,14 @@ FilterCache::Put(const FilterCacheInfo &info,
 	else
 		expires = info.expires;
 
-	auto item = NewFromPool<FilterCacheItem>(pool_new_slice(pool, "FilterCacheItem", &slice_pool),
+	auto item = NewFromPool<FilterCacheItem>(cache.NewItemPool("FilterCacheItem"),
 						 cache.SteadyNow(),
 						 cache.SystemNow(),
 						 status, headers, size,
 						 std::move(a),
 						 expires);
 
-	if (info.tag != nullptr)
-		per_tag[info.tag].push_back(*item);
-
-	cache.Put(p_strdup(item->GetPool(), info.key), *item);
+	cache.Put(info.key, info.tag, *item);
 }
 
 static std::chrono::system_clock::time_point
@@ -610,7 +546,7 @@ FilterCacheRequest::OnHttpResponse(http_status_t status, StringMap &&headers,
 		timeout_event.Schedule(fcache_request_timeout);
 
 		sink_rubber_new(pool, std::move(tee2),
-				cache.rubber, cacheable_size_limit,
+				cache.cache.GetRubber(), cacheable_size_limit,
 				*this,
 				response.cancel_ptr);
 
@@ -637,16 +573,8 @@ FilterCacheRequest::OnHttpError(std::exception_ptr ep) noexcept
 FilterCache::FilterCache(struct pool &_pool, size_t max_size,
 			 EventLoop &_event_loop,
 			 ResourceLoader &_resource_loader)
-	:pool(pool_new_dummy(&_pool, "filter_cache")),
-	 slice_pool(1024, 65536),
-	 rubber(max_size),
-	 /* leave 12.5% of the rubber allocator empty, to increase the
-	    chances that a hole can be found for a new allocation, to
-	    reduce the pressure that rubber_compress() creates */
-	 cache(_event_loop, 65521, max_size * 7 / 8),
-	 compress_timer(_event_loop, BIND_THIS_METHOD(OnCompressTimer)),
+	:cache(_pool, "filter_cache", _event_loop, max_size),
 	 resource_loader(_resource_loader) {
-	compress_timer.Schedule(fcache_compress_interval);
 }
 
 FilterCache *
@@ -689,18 +617,6 @@ filter_cache_flush(FilterCache &cache) noexcept
 	cache.Flush();
 }
 
-void
-FilterCache::FlushTag(const char *tag) noexcept
-{
-	auto i = per_tag.find(tag);
-	if (i == per_tag.end())
-		return;
-
-	auto &list = i->second;
-	while (!list.empty())
-		cache.Remove(list.front());
-}
-
 void
 filter_cache_flush_tag(FilterCache &cache, const char *tag) noexcept
 {
@@ -719,7 +635,7 @@ FilterCache::Miss(struct pool &caller_pool,
 {
 	/* the cache request may live longer than the caller pool, so
 	   allocate a new pool for it from cache->pool */
-	auto request_pool = pool_new_linear(pool, "filter_cache_request", 8192);
+	auto request_pool = pool_new_linear(&cache.GetPool(), "filter_cache_request", 8192);
 
 	auto request = NewFromPool<FilterCacheRequest>(std::move(request_pool),
 						       caller_pool,
@@ -740,16 +656,7 @@ FilterCache::Serve(FilterCacheItem &item,
 {
 	LogConcat(4, "FilterCache", "serve ", item.GetKey());
 
-	/* XXX hold reference on item */
-
-	assert(!item.body || ((CacheItem &)item).GetSize() >= item.size);
-
-	auto response_body = item.body
-		? istream_rubber_new(caller_pool, rubber, item.body.GetId(),
-				     0, item.size, false)
-		: istream_null_new(caller_pool);
-
-	response_body = istream_unlock_new(caller_pool, std::move(response_body), item);
+	auto response_body = cache.OpenBody(caller_pool, item);
 
 	handler.InvokeResponse(item.status,
 			       StringMap(ShallowCopy(), caller_pool, item.headers),
@@ -778,8 +685,7 @@ FilterCache::Get(struct pool &caller_pool,
 	auto *info = filter_cache_request_evaluate(caller_pool, cache_tag, address,
 						   source_id, headers);
 	if (info != nullptr) {
-		FilterCacheItem *item
-			= (FilterCacheItem *)cache.Get(info->key);
+		auto *item = static_cast<FilterCacheItem *>(cache.Get(info->key));
 
 		if (item == nullptr)
 			Miss(caller_pool, parent_stopwatch,
@@ -42,6 +42,7 @@
 #include "pool/DisposablePointer.hxx"
 #include "pool/tpool.hxx"
 #include "pool/StringBuilder.hxx"
+#include "AllocatorPtr.hxx"
 #include "event/SocketEvent.hxx"
 #include "net/UniqueSocketDescriptor.hxx"
 #include "io/UniqueFileDescriptor.hxx"
@@ -100,6 +101,14 @@ public:
 
 	void FadeTag(const char *tag) noexcept;
 
+	void SetMinIdle(unsigned min_idle) noexcept {
+		child_stock.SetMinIdle(min_idle);
+	}
+
+	void AddStats(ChildStockStats &stats) const noexcept {
+		child_stock.AddStats(stats);
+	}
+
 private:
 	/* virtual methods from class StockClass */
 	void Create(CreateStockItem c, StockRequest request,
@@ -127,6 +136,13 @@ struct FcgiChildParams {
 		:executable_path(_executable_path), args(_args),
 		 options(_options) {}
 
+	/**
+	 * Make a deep copy, for ChildStock::Prewarm() (which keeps it
+	 * as long as the key is in use).
+	 */
+	FcgiChildParams(AllocatorPtr alloc,
+			const FcgiChildParams &src) noexcept;
+
 	const char *GetStockKey(struct pool &pool) const noexcept;
 };
 
@@ -190,6 +206,18 @@ private:
 	void OnSocketEvent(unsigned events) noexcept;
 };
 
+FcgiChildParams::FcgiChildParams(AllocatorPtr alloc,
+				 const FcgiChildParams &src) noexcept
+	:executable_path(alloc.Dup(src.executable_path)),
+	 options(*alloc.New<ChildOptions>(alloc, src.options))
+{
+	auto *dest = alloc.NewArray<const char *>(src.args.size);
+	for (std::size_t i = 0; i < src.args.size; ++i)
+		dest[i] = alloc.Dup(src.args[i]);
+
+	args = {dest, src.args.size};
+}
+
 const char *
 FcgiChildParams::GetStockKey(struct pool &pool) const noexcept
 {
@@ -307,9 +335,18 @@ void
 FcgiStock::Create(CreateStockItem c, StockRequest request,
 		  [[maybe_unused]] CancellablePointer &cancel_ptr)
 {
-	[[maybe_unused]] auto &params = *(FcgiChildParams *)request.get();
+	const auto &params = *(const FcgiChildParams *)request.get();
 	assert(params.executable_path != nullptr);
 
+	/* ChildStock::Prewarm() needs the parameters, but "request"
+	   will be consumed */
+	child_stock.Prewarm(c.GetStockName(), [&params](AllocatorPtr alloc){
+		auto *copy = alloc.New<FcgiChildParams>(alloc, params);
+		return std::function<StockRequest()>([copy]{
+			return ToNopPointer(copy);
+		});
+	});
+
 	auto *connection = new FcgiConnection(GetEventLoop(), c);
 
 	const char *key = c.GetStockName();
@@ -460,6 +497,18 @@ fcgi_stock_fade_tag(FcgiStock &fs, const char *tag) noexcept
 	fs.FadeTag(tag);
 }
 
+void
+fcgi_stock_set_min_idle(FcgiStock &fs, unsigned min_idle) noexcept
+{
+	fs.SetMinIdle(min_idle);
+}
+
+void
+fcgi_stock_add_stats(const FcgiStock &fs, ChildStockStats &stats) noexcept
+{
+	fs.AddStats(stats);
+}
+
 inline StockItem *
 FcgiStock::Get(const ChildOptions &options,
 	       const char *executable_path,
@@ -33,6 +33,7 @@
 #pragma once
 
 struct ChildErrorLogOptions;
+struct ChildStockStats;
 struct StockItem;
 class FcgiStock;
 struct ChildOptions;
@@ -66,6 +67,16 @@ fcgi_stock_fade_all(FcgiStock &fs) noexcept;
 void
 fcgi_stock_fade_tag(FcgiStock &fs, const char *tag) noexcept;
 
+/**
+ * Set the minimum number of idle child processes per FastCGI
+ * application.  0 disables pre-spawning.
+ */
+void
+fcgi_stock_set_min_idle(FcgiStock &fs, unsigned min_idle) noexcept;
+
+void
+fcgi_stock_add_stats(const FcgiStock &fs, ChildStockStats &stats) noexcept;
+
 /**
  * Throws exception on error.
  *
@@ -45,6 +45,7 @@
 #include <exception>
 
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 
 class ConnectFilteredSocketOperation final
 	: Cancellable, ConnectSocketHandler, BufferedSocketHandler,
@@ -89,7 +90,8 @@ public:
 	void Start(bool ip_transparent,
 		   SocketAddress bind_address,
 		   SocketAddress address,
-		   Event::Duration timeout) noexcept;
+		   Event::Duration timeout,
+		   bool fast_open) noexcept;
 
 private:
 	void OnHandshake() noexcept;
@@ -134,7 +136,8 @@ void
 ConnectFilteredSocketOperation::Start(bool ip_transparent,
 				      SocketAddress bind_address,
 				      SocketAddress address,
-				      Event::Duration timeout) noexcept
+				      Event::Duration timeout,
+				      bool fast_open) noexcept
 try {
 	const int address_family = address.GetFamily();
 	fd_type = address_family == AF_LOCAL
@@ -153,6 +156,16 @@ try {
 	if (ip_transparent && !fd.SetBoolOption(SOL_IP, IP_TRANSPARENT, true))
 		throw MakeErrno("Failed to set IP_TRANSPARENT");
 
+#ifdef TCP_FASTOPEN_CONNECT
+	/* this is only an optimization; if the kernel doesn't
+	   support it, connect normally */
+	if (fast_open &&
+	    (address_family == PF_INET || address_family == PF_INET6))
+		fd.SetBoolOption(IPPROTO_TCP, TCP_FASTOPEN_CONNECT, true);
+#else
+	(void)fast_open;
+#endif
+
 	if (!bind_address.IsNull() && bind_address.IsDefined() &&
 	    !fd.Bind(bind_address))
 		throw MakeErrno("Failed to bind socket");
@@ -265,11 +278,13 @@ ConnectFilteredSocket(EventLoop &event_loop,
 		      Event::Duration timeout,
 		      SocketFilterFactory *filter_factory,
 		      ConnectFilteredSocketHandler &handler,
-		      CancellablePointer &cancel_ptr) noexcept
+		      CancellablePointer &cancel_ptr,
+		      bool fast_open) noexcept
 {
 	auto *cfs = new ConnectFilteredSocketOperation(event_loop,
 						       filter_factory,
 						       std::move(stopwatch),
 						       handler, cancel_ptr);
-	cfs->Start(ip_transparent, bind_address, address, timeout);
+	cfs->Start(ip_transparent, bind_address, address, timeout,
+		   fast_open);
 }
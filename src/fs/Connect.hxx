@@ -50,6 +50,11 @@ public:
 	virtual void OnConnectFilteredSocketError(std::exception_ptr e) noexcept = 0;
 };
 
+/**
+ * @param fast_open use TCP Fast Open (if supported by the kernel);
+ * this is useful only if the caller is going to send data right
+ * away, because the connection is not established before that
+ */
 void
 ConnectFilteredSocket(EventLoop &event_loop,
 		      StopwatchPtr stopwatch,
@@ -59,4 +64,5 @@ ConnectFilteredSocket(EventLoop &event_loop,
 		      Event::Duration timeout,
 		      SocketFilterFactory *filter_factory,
 		      ConnectFilteredSocketHandler &handler,
-		      CancellablePointer &cancel_ptr) noexcept;
+		      CancellablePointer &cancel_ptr,
+		      bool fast_open=false) noexcept;
@@ -61,8 +61,11 @@ FilteredSocketLease::MoveSocketInput() noexcept
 
 		auto &dest = input[i];
 		if (!dest.IsDefined())
-			dest.Allocate(fb_pool_get());
+			dest.Allocate(fb_pool_get(FbSize::SMALL));
 		else if (dest.IsFull()) {
+			if (fb_pool_grow(dest))
+				continue;
+
 			++i;
 			assert(i < input.size());
 			continue;
@@ -36,6 +36,7 @@
 #include "FilteredSocket.hxx"
 #include "AllocatorPtr.hxx"
 #include "pool/DisposablePointer.hxx"
+#include "pool/PSocketAddress.hxx"
 #include "stock/Stock.hxx"
 #include "stock/GetHandler.hxx"
 #include "stock/LoggerDomain.hxx"
@@ -107,7 +108,8 @@ public:
 			cancel_ptr.Cancel();
 	}
 
-	void Start(FilteredSocketStockRequest &&request) noexcept {
+	void Start(FilteredSocketStockRequest &&request,
+		   bool fast_open) noexcept {
 		ConnectFilteredSocket(stock.GetEventLoop(),
 				      std::move(request.stopwatch),
 				      request.ip_transparent,
@@ -115,7 +117,8 @@ public:
 				      request.address,
 				      request.timeout,
 				      request.filter_factory,
-				      *this, cancel_ptr);
+				      *this, cancel_ptr,
+				      fast_open);
 	}
 
 	SocketAddress GetAddress() const noexcept {
@@ -232,10 +235,43 @@ FilteredSocketStock::Create(CreateStockItem c, StockRequest _request,
 	auto request = std::move(*(FilteredSocketStockRequest *)_request.get());
 	_request.reset();
 
+	bool prewarming;
+	if (request.filter_factory == nullptr) {
+		const StockPrewarmParams params(request.ip_transparent,
+						request.bind_address,
+						request.address,
+						request.timeout);
+		prewarming = prewarm.OnCreate(c.GetStockName(), &params);
+	} else
+		prewarming = prewarm.OnCreate(c.GetStockName(), nullptr);
+
 	auto *connection = new FilteredSocketStockConnection(c,
 							     request.address,
 							     cancel_ptr);
-	connection->Start(std::move(request));
+
+	/* no TCP Fast Open for pre-warmed connections: it would
+	   postpone the handshake until the first request */
+	connection->Start(std::move(request), fast_open && !prewarming);
+}
+
+void
+FilteredSocketStock::PrewarmGet(AllocatorPtr alloc, const char *key,
+				const StockPrewarmParams &params,
+				StockGetHandler &handler,
+				CancellablePointer &cancel_ptr) noexcept
+{
+	/* copy the addresses, because the request may be queued
+	   while StockPrewarm forgets the key */
+	auto request =
+		NewDisposablePointer<FilteredSocketStockRequest>(alloc,
+								 nullptr,
+								 params.ip_transparent,
+								 DupAddress(alloc, params.bind_address),
+								 DupAddress(alloc, params.address),
+								 params.timeout,
+								 nullptr);
+
+	stock.Get(key, std::move(request), handler, cancel_ptr);
 }
 
 bool
@@ -299,6 +335,7 @@ FilteredSocketStock::Get(AllocatorPtr alloc,
 								 timeout,
 								 filter_factory);
 
+	prewarm.OnGet(key);
 	stock.Get(key, std::move(request), handler, cancel_ptr);
 }
 
@@ -38,6 +38,7 @@
 
 #include "stock/Class.hxx"
 #include "stock/MapStock.hxx"
+#include "stock/Prewarm.hxx"
 
 struct StockItem;
 class StockGetHandler;
@@ -52,16 +53,25 @@ class AllocatorPtr;
 /**
  * A stock for TCP connections wrapped with #FilteredSocket.
  */
-class FilteredSocketStock final : StockClass {
+class FilteredSocketStock final : StockClass, StockPrewarmHandler {
 	StockMap stock;
 
+	StockPrewarm prewarm;
+
+	/**
+	 * Use TCP Fast Open for connections established for a
+	 * request?
+	 */
+	bool fast_open = false;
+
 public:
 	/**
 	 * @param limit the maximum number of connections per host
 	 */
 	FilteredSocketStock(EventLoop &event_loop, unsigned limit) noexcept
 		:stock(event_loop, *this, limit, 16,
-		       std::chrono::minutes(5)) {}
+		       std::chrono::minutes(5)),
+		 prewarm(event_loop, *this, 16) {}
 
 	EventLoop &GetEventLoop() noexcept {
 		return stock.GetEventLoop();
@@ -71,6 +81,32 @@ public:
 		stock.AddStats(data);
 	}
 
+	void AddStats(StockPrewarmStats &data) const noexcept {
+		prewarm.AddStats(data);
+	}
+
+	/**
+	 * Set the minimum number of idle connections per host.  0
+	 * disables pre-warming.  Connections with a #SocketFilter
+	 * (i.e. TLS) are not pre-warmed, because the filter factory
+	 * belongs to the request.
+	 */
+	void SetMinIdle(unsigned min_idle) noexcept {
+		prewarm.SetMinIdle(min_idle);
+	}
+
+	/**
+	 * Enable TCP Fast Open.  A connection refused by the server
+	 * is then reported only by the first write, i.e. to the user
+	 * of the lease and not to the #StockGetHandler; therefore
+	 * this must only be enabled if all users treat such errors
+	 * like connect failures (see IsHttpClientConnectFailure()),
+	 * and only for protocols where the client speaks first.
+	 */
+	void SetFastOpen(bool _fast_open) noexcept {
+		fast_open = _fast_open;
+	}
+
 	/**
 	 * @param name the MapStock name; it is auto-generated from the
 	 * #address if nullptr is passed here
@@ -91,6 +127,12 @@ private:
 	/* virtual methods from class StockClass */
 	void Create(CreateStockItem c, StockRequest request,
 		    CancellablePointer &cancel_ptr) override;
+
+	/* virtual methods from class StockPrewarmHandler */
+	void PrewarmGet(AllocatorPtr alloc, const char *key,
+			const StockPrewarmParams &params,
+			StockGetHandler &handler,
+			CancellablePointer &cancel_ptr) noexcept override;
 };
 
 [[gnu::pure]]
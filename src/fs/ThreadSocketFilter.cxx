@@ -209,8 +209,15 @@ ThreadSocketFilter::PreRun() noexcept
 {
 	{
 		const std::lock_guard<std::mutex> lock(mutex);
-		decrypted_input.AllocateIfNull(fb_pool_get());
-		encrypted_output.AllocateIfNull(fb_pool_get());
+		decrypted_input.AllocateIfNull(fb_pool_get(FbSize::SMALL));
+		encrypted_output.AllocateIfNull(fb_pool_get(FbSize::SMALL));
+
+		/* the previous run has filled these buffers; give the
+		   filter more room this time */
+		if (decrypted_input.IsFull())
+			fb_pool_grow(decrypted_input);
+		if (encrypted_output.IsFull())
+			fb_pool_grow(encrypted_output);
 	}
 
 	handler->PreRun(*this);
@@ -436,9 +443,12 @@ ThreadSocketFilter::OnData() noexcept
 	{
 		const std::lock_guard<std::mutex> lock(mutex);
 
-		encrypted_input.AllocateIfNull(fb_pool_get());
+		encrypted_input.AllocateIfNull(fb_pool_get(FbSize::SMALL));
 
 		auto w = encrypted_input.Write();
+		while (w.size < r.size && fb_pool_grow(encrypted_input))
+			w = encrypted_input.Write();
+
 		if (w.empty())
 			return BufferedResult::BLOCKING;
 
@@ -519,9 +529,12 @@ ThreadSocketFilter::LockWritePlainOutput(const void *data, size_t size) noexcept
 {
 	const std::lock_guard<std::mutex> lock(mutex);
 
-	plain_output.AllocateIfNull(fb_pool_get());
+	plain_output.AllocateIfNull(fb_pool_get(FbSize::SMALL));
 
 	auto w = plain_output.Write();
+	while (w.size < size && fb_pool_grow(plain_output))
+		w = plain_output.Write();
+
 	size_t nbytes = std::min(size, w.size);
 	memcpy(w.data, data, nbytes);
 	plain_output.Append(nbytes);
@@ -109,6 +109,28 @@ IsHttpClientRetryFailure(std::exception_ptr ep) noexcept
 	}
 }
 
+bool
+IsHttpClientConnectFailure(std::exception_ptr ep) noexcept
+{
+	try {
+		FindRetrowNested<HttpClientError>(ep);
+		return false;
+	} catch (const HttpClientError &e) {
+		if (e.GetCode() != HttpClientErrorCode::IO)
+			return false;
+	}
+
+	try {
+		FindRetrowNested<std::system_error>(ep);
+		return false;
+	} catch (const std::system_error &e) {
+		/* these can only be caused by the handshake */
+		return IsErrno(e, ECONNREFUSED) ||
+			IsErrno(e, EHOSTUNREACH) ||
+			IsErrno(e, ENETUNREACH);
+	}
+}
+
 /**
  * With a request body of this size or larger, we send "Expect:
  * 100-continue".
@@ -566,7 +588,7 @@ HttpClient::TryWriteBuckets2()
 	}
 
 	if (v.empty()) {
-		bool has_more = list.HasMore();
+		bool has_more = list.HasMore() || list.HasNonBuffer();
 		return has_more
 			? BucketResult::MORE
 			: BucketResult::DEPLETED;
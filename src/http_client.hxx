@@ -109,6 +109,16 @@ IsHttpClientServerFailure(std::exception_ptr ep) noexcept;
 bool
 IsHttpClientRetryFailure(std::exception_ptr ep) noexcept;
 
+/**
+ * Did the connection to the server fail to be established?  This can
+ * happen after the socket has been reported as connected if the
+ * handshake was postponed to the first write (TCP Fast Open); the
+ * caller should treat it like a connect failure.
+ */
+[[gnu::pure]]
+bool
+IsHttpClientConnectFailure(std::exception_ptr ep) noexcept;
+
 /**
  * Sends a HTTP request on a socket, and passes the response to the
  * handler.
@@ -165,6 +165,23 @@ HttpRequest::OnHttpResponse(http_status_t status, StringMap &&_headers,
 void
 HttpRequest::OnHttpError(std::exception_ptr ep) noexcept
 {
+	if (IsHttpClientConnectFailure(ep)) {
+		/* with TCP Fast Open, the handshake happens only with
+		   the first write; mark the server as failed like
+		   FilteredSocketBalancer does for connect errors, so
+		   the retry picks another one */
+		failure->SetConnect(event_loop.SteadyNow(),
+				    std::chrono::seconds(20));
+
+		if (retries > 0) {
+			--retries;
+			BeginConnect();
+		} else
+			Failed(ep);
+
+		return;
+	}
+
 	if (retries > 0 && IsHttpClientRetryFailure(ep)) {
 		/* the server has closed the connection prematurely, maybe
 		   because it didn't want to get any further requests on that
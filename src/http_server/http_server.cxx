@@ -38,12 +38,14 @@
 #include "pool/pool.hxx"
 #include "pool/PSocketAddress.hxx"
 #include "istream/Bucket.hxx"
+#include "istream/SendBuckets.hxx"
 #include "system/Error.hxx"
 #include "util/StringView.hxx"
 #include "util/StaticArray.hxx"
 #include "util/RuntimeError.hxx"
 
 #include <assert.h>
+#include <errno.h>
 #include <unistd.h>
 
 const Event::Duration  http_server_idle_timeout = std::chrono::seconds(30);
@@ -108,9 +110,12 @@ HttpServerConnection::TryWriteBuckets2()
 	}
 
 	StaticArray<struct iovec, 64> v;
+	bool has_file = false;
 	for (const auto &bucket : list) {
-		if (!bucket.IsBuffer())
+		if (!bucket.IsBuffer()) {
+			has_file = bucket.IsFile();
 			break;
+		}
 
 		const auto buffer = bucket.GetBuffer();
 		auto &tail = v.append();
@@ -121,13 +126,22 @@ HttpServerConnection::TryWriteBuckets2()
 			break;
 	}
 
-	if (v.empty()) {
+	if (v.empty() && !has_file) {
 		return list.HasMore()
 			? BucketResult::UNAVAILABLE
 			: BucketResult::DEPLETED;
 	}
 
-	ssize_t nbytes = socket->WriteV(v.begin(), v.size());
+	ssize_t nbytes;
+	if (has_file) {
+		/* send the response header with MSG_MORE, followed
+		   by sendfile() for the file body */
+		nbytes = SendBuckets(socket->GetSocket(), list);
+		if (nbytes < 0 && errno == EAGAIN)
+			nbytes = WRITE_BLOCKING;
+	} else
+		nbytes = socket->WriteV(v.begin(), v.size());
+
 	if (nbytes < 0) {
 		if (gcc_likely(nbytes == WRITE_BLOCKING))
 			return BucketResult::BLOCKING;
@@ -32,13 +32,31 @@
 
 #pragma once
 
+#include "io/FileDescriptor.hxx"
 #include "util/ConstBuffer.hxx"
 #include "util/StaticArray.hxx"
 
+#include <assert.h>
+#include <sys/types.h>
+
 class IstreamBucket {
 public:
 	enum class Type {
 		BUFFER,
+
+		/**
+		 * A range of a regular file which has not been read
+		 * yet.  The consumer may transfer it with sendfile()
+		 * or splice(), or read it with pread().  The file
+		 * descriptor remains owned by the #Istream.
+		 */
+		FILE,
+	};
+
+	struct File {
+		FileDescriptor fd;
+		off_t offset;
+		size_t size;
 	};
 
 private:
@@ -46,6 +64,7 @@ private:
 
 	union {
 		ConstBuffer<void> buffer;
+		File file;
 	};
 
 public:
@@ -59,16 +78,48 @@ public:
 		return type == Type::BUFFER;
 	}
 
+	bool IsFile() const noexcept {
+		return type == Type::FILE;
+	}
+
+	/**
+	 * Returns the number of bytes described by this bucket,
+	 * regardless of its type.
+	 */
+	size_t GetSize() const noexcept {
+		switch (type) {
+		case Type::BUFFER:
+			return buffer.size;
+
+		case Type::FILE:
+			return file.size;
+		}
+
+		assert(false);
+		return 0;
+	}
+
 	ConstBuffer<void> GetBuffer() const noexcept {
 		assert(type == Type::BUFFER);
 
 		return buffer;
 	}
 
+	const File &GetFile() const noexcept {
+		assert(type == Type::FILE);
+
+		return file;
+	}
+
 	void Set(ConstBuffer<void> _buffer) noexcept {
 		type = Type::BUFFER;
 		buffer = _buffer;
 	}
+
+	void SetFile(FileDescriptor fd, off_t offset, size_t size) noexcept {
+		type = Type::FILE;
+		file = {fd, offset, size};
+	}
 };
 
 class IstreamBucketList {
@@ -121,6 +172,15 @@ public:
 		list.append().Set(buffer);
 	}
 
+	void PushFile(FileDescriptor fd, off_t offset, size_t size) noexcept {
+		if (IsFull()) {
+			SetMore();
+			return;
+		}
+
+		list.append().SetFile(fd, offset, size);
+	}
+
 	List::const_iterator begin() const noexcept {
 		return list.begin();
 	}
@@ -146,9 +206,20 @@ public:
 		return size;
 	}
 
+	/**
+	 * Like GetTotalBufferSize(), but include non-buffer buckets.
+	 */
+	[[gnu::pure]]
+	size_t GetTotalSize() const noexcept {
+		size_t size = 0;
+		for (const auto &bucket : list)
+			size += bucket.GetSize();
+		return size;
+	}
+
 	[[gnu::pure]]
 	bool IsDepleted(size_t consumed) const noexcept {
-		return !HasMore() && consumed == GetTotalBufferSize();
+		return !HasMore() && consumed == GetTotalSize();
 	}
 
 	void SpliceFrom(IstreamBucketList &&src) noexcept {
@@ -74,6 +74,12 @@ class BufferedIstream final : PoolHolder, IstreamSink, Cancellable {
 	 */
 	size_t in_pipe = 0;
 
+	/**
+	 * The size class for #buffer.  If the input's length is
+	 * known, a smaller buffer may be enough to hold all of it.
+	 */
+	FbSize buffer_size = FbSize::LARGE;
+
 	/**
 	 * This event postpones the
 	 * BufferedIstreamHandler::OnBufferedIstreamReady() call to move
@@ -100,6 +106,10 @@ public:
 	}
 
 	void Start() noexcept {
+		const off_t available = input.GetAvailable(false);
+		if (available >= 0)
+			buffer_size = FbSizeFor(available);
+
 		input.Read();
 	}
 
@@ -173,7 +183,7 @@ inline ssize_t
 BufferedIstream::ReadToBuffer(int fd, size_t max_length) noexcept
 {
 	if (!buffer.IsDefined())
-		buffer = fb_pool_get().Alloc();
+		buffer = fb_pool_get(buffer_size).Alloc();
 
 	const auto w = buffer.Write();
 	if (w.empty())
@@ -203,7 +213,7 @@ BufferedIstream::OnData(const void *data, size_t length) noexcept
 	}
 
 	if (!buffer.IsDefined())
-		buffer = fb_pool_get().Alloc();
+		buffer = fb_pool_get(buffer_size).Alloc();
 
 	auto w = buffer.Write();
 	if (w.empty())
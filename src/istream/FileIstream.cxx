@@ -32,6 +32,7 @@
 
 #include "FileIstream.hxx"
 #include "istream.hxx"
+#include "Bucket.hxx"
 #include "New.hxx"
 #include "Result.hxx"
 #include "io/Buffered.hxx"
@@ -130,6 +131,9 @@ private:
 		TryRead();
 	}
 
+	void _FillBucketList(IstreamBucketList &list) override;
+	size_t _ConsumeBucketList(size_t nbytes) noexcept override;
+
 	int _AsFd() noexcept override;
 	void _Close() noexcept override {
 		Destroy();
@@ -272,6 +276,87 @@ FileIstream::_Skip(off_t length) noexcept
 	return result;
 }
 
+void
+FileIstream::_FillBucketList(IstreamBucketList &list)
+{
+	auto r = buffer.Read();
+	if (!r.empty())
+		list.Push(r.ToVoid());
+
+	if (offset >= end_offset)
+		return;
+
+	if (direct) {
+		/* the handler accepts FD_FILE: instead of copying
+		   file contents to userspace, let it transfer the
+		   range with sendfile() */
+		const size_t max_read = GetMaxRead();
+		list.PushFile(fd, offset, max_read);
+		if (end_offset - offset > off_t(max_read))
+			list.SetMore();
+		return;
+	}
+
+	if (!r.empty()) {
+		list.SetMore();
+		return;
+	}
+
+	buffer.AllocateIfNull(fb_pool_get());
+
+	auto w = buffer.Write();
+	assert(!w.empty());
+
+	if (end_offset - offset < off_t(w.size))
+		w.size = end_offset - offset;
+
+	ssize_t nbytes = pread(fd.Get(), w.data, w.size, offset);
+	if (nbytes <= 0) {
+		if (nbytes < 0 && errno == EAGAIN) {
+			/* see file_retry_timeout */
+			buffer.Free();
+			retry_event.Schedule(file_retry_timeout);
+			list.SetMore();
+			return;
+		}
+
+		const int e = errno;
+		Destroy();
+
+		if (nbytes == 0)
+			throw FormatRuntimeError("premature end of file in '%s'",
+						 path);
+		else
+			throw FormatErrno(e, "Failed to read from '%s'", path);
+	}
+
+	buffer.Append(nbytes);
+	offset += nbytes;
+
+	list.Push(buffer.Read().ToVoid());
+	if (offset < end_offset)
+		list.SetMore();
+}
+
+size_t
+FileIstream::_ConsumeBucketList(size_t nbytes) noexcept
+{
+	size_t consumed = std::min(nbytes, buffer.GetAvailable());
+	buffer.Consume(consumed);
+	nbytes -= consumed;
+
+	if (nbytes > 0 && direct) {
+		/* the rest was a FILE bucket */
+		const size_t n = std::min(nbytes, GetMaxRead());
+		offset += n;
+		consumed += n;
+	}
+
+	buffer.FreeIfEmpty();
+
+	return Consumed(consumed);
+}
+
 int
 FileIstream::_AsFd() noexcept
 {
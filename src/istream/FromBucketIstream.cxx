@@ -51,8 +51,16 @@ FromBucketIstream::_Read() noexcept
 
 	/* submit each bucket to InvokeData() */
 	for (const auto &i : list) {
-		// TODO: support more buffer types once they're implemented
-		assert(i.IsBuffer());
+		if (!i.IsBuffer()) {
+			if (total == 0) {
+				/* let the input submit the file
+				   contents to OnDirect() */
+				input.Read();
+				return;
+			}
+
+			break;
+		}
 
 		const auto buffer = i.GetBuffer();
 		size_t consumed = InvokeData(buffer.data, buffer.size);
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SendBuckets.hxx"
+#include "Bucket.hxx"
+#include "net/SocketDescriptor.hxx"
+#include "util/StaticArray.hxx"
+
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <errno.h>
+
+ssize_t
+SendBuckets(SocketDescriptor s, const IstreamBucketList &list) noexcept
+{
+	StaticArray<struct iovec, 64> v;
+	size_t buffer_size = 0;
+	const IstreamBucket::File *file = nullptr;
+
+	for (const auto &bucket : list) {
+		if (bucket.IsFile()) {
+			file = &bucket.GetFile();
+			break;
+		}
+
+		if (!bucket.IsBuffer())
+			break;
+
+		const auto buffer = bucket.GetBuffer();
+		auto &tail = v.append();
+		tail.iov_base = const_cast<void *>(buffer.data);
+		tail.iov_len = buffer.size;
+		buffer_size += buffer.size;
+
+		if (v.full())
+			break;
+	}
+
+	size_t total = 0;
+
+	if (!v.empty()) {
+		struct msghdr m{};
+		m.msg_iov = v.begin();
+		m.msg_iovlen = v.size();
+
+		int flags = MSG_DONTWAIT|MSG_NOSIGNAL;
+		if (file != nullptr)
+			/* the file contents follow immediately */
+			flags |= MSG_MORE;
+
+		ssize_t nbytes = sendmsg(s.Get(), &m, flags);
+		if (nbytes < 0 || size_t(nbytes) < buffer_size)
+			return nbytes;
+
+		total = nbytes;
+	}
+
+	if (file != nullptr) {
+		off_t offset = file->offset;
+		ssize_t nbytes = sendfile(s.Get(), file->fd.Get(),
+					  &offset, file->size);
+		if (nbytes < 0)
+			/* report the buffers which have been sent; the
+			   error will be seen again by the next call */
+			return total > 0 ? ssize_t(total) : nbytes;
+
+		if (nbytes == 0 && total == 0) {
+			/* the file was truncated after the bucket was
+			   created */
+			errno = ENODATA;
+			return -1;
+		}
+
+		total += nbytes;
+	}
+
+	return total;
+}
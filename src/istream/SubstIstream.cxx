@@ -39,7 +39,12 @@
 #include "util/DestructObserver.hxx"
 #include "util/StringView.hxx"
 
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
 #include <assert.h>
+#include <stdint.h>
 #include <string.h>
 
 /* ternary search tree */
@@ -54,14 +59,205 @@ struct SubstNode {
 	} leaf;
 };
 
+/**
+ * A state of the #SubstAutomaton; it represents the characters of a
+ * partial match consumed so far.
+ */
+struct SubstState {
+	/**
+	 * Index of the first outgoing transition in
+	 * SubstAutomaton::edge_chars and SubstAutomaton::edge_targets.
+	 */
+	uint32_t first_edge;
+
+	/**
+	 * The number of outgoing transitions.
+	 */
+	uint32_t n_edges;
+
+	/**
+	 * The number of characters consumed to get here.
+	 */
+	uint32_t depth;
+
+	/**
+	 * The failure link: the state of the longest proper suffix of
+	 * this state's partial match which is also a prefix of some
+	 * search word (0 if there is none).
+	 */
+	uint32_t fail;
+
+	/**
+	 * The length of the longest search word which is a suffix of
+	 * this state's partial match (following the failure links),
+	 * or 0 if there is none.
+	 */
+	uint32_t output;
+
+	/**
+	 * The leaf of the search word which ends here (full match),
+	 * or nullptr.
+	 */
+	const SubstNode *leaf;
+
+	/**
+	 * Any leaf whose search word begins with this state's partial
+	 * match; its "a" string is used to re-insert a mismatch into
+	 * the stream.
+	 */
+	const SubstNode *any_leaf;
+};
+
+/**
+ * A compiled (flat-array) form of the #SubstTree.  The ternary
+ * search tree is convenient for building, but walking it means
+ * pointer chasing through a binary tree at each character, which
+ * degenerates to a linked list if the search words were added in
+ * sorted order (which is common for YAML maps).  Here, the
+ * transitions of each state are stored in one contiguous array which
+ * can be scanned with memchr().
+ *
+ * The failure links (Aho-Corasick) are only used by FindFirstChar(),
+ * which finds the next match candidate in a single pass over the
+ * buffer.  Once a candidate has been found, SubstIstream follows the
+ * plain transitions and restarts with FindFirstChar() after a
+ * mismatch, because the mismatched characters need to be replayed
+ * into the output.
+ *
+ * State 0 is the initial state.
+ */
+struct SubstAutomaton {
+	static constexpr uint32_t INVALID = ~uint32_t(0);
+
+	const SubstState *states;
+
+	const char *edge_chars;
+	const uint32_t *edge_targets;
+
+	/**
+	 * Which bytes may begin a search word?  This is used to skip
+	 * quickly over input which cannot match while in the initial
+	 * state.
+	 */
+	bool first_table[256];
+
+	/**
+	 * Up to this number of transitions, FindChar() compares them
+	 * in a simple loop instead of calling memchr().
+	 */
+	static constexpr uint32_t MAX_SCAN_EDGES = 8;
+
+	[[gnu::pure]]
+	uint32_t FindChar(uint32_t state, char ch) const noexcept {
+		assert(state != INVALID);
+
+		const auto &s = states[state];
+		const char *begin = edge_chars + s.first_edge;
+
+		/* null bytes are never found because the '\0' "edge" is
+		   stored as SubstState::leaf */
+
+		if (s.n_edges <= MAX_SCAN_EDGES) {
+			/* calling memchr() is not worth it for the few
+			   edges most states have */
+			for (uint32_t i = 0; i < s.n_edges; ++i)
+				if (begin[i] == ch)
+					return edge_targets[s.first_edge + i];
+
+			return INVALID;
+		}
+
+		const char *p = (const char *)memchr(begin, ch, s.n_edges);
+		if (p == nullptr)
+			return INVALID;
+
+		return edge_targets[p - edge_chars];
+	}
+
+	/**
+	 * Like FindChar(), but follow the failure links on mismatch.
+	 * Never returns #INVALID.
+	 */
+	[[gnu::pure]]
+	uint32_t Next(uint32_t state, char ch) const noexcept {
+		while (true) {
+			const uint32_t next = FindChar(state, ch);
+			if (next != INVALID)
+				return next;
+
+			state = states[state].fail;
+			if (state == 0)
+				return first_table[(unsigned char)ch]
+					? FindChar(0, ch)
+					: 0;
+		}
+	}
+
+	/**
+	 * Skip input which cannot begin a search word.
+	 *
+	 * @return the first character which may begin a search word,
+	 * or @end if there is none
+	 */
+	[[gnu::pure]]
+	const char *SkipToFirstChar(const char *p,
+				    const char *end) const noexcept;
+
+	[[gnu::pure]]
+	const SubstNode *GetLeaf(uint32_t state) const noexcept {
+		assert(state != INVALID);
+
+		return states[state].leaf;
+	}
+
+	[[gnu::pure]]
+	const SubstNode *GetAnyLeaf(uint32_t state) const noexcept {
+		assert(state != INVALID);
+		assert(states[state].any_leaf != nullptr);
+
+		return states[state].any_leaf;
+	}
+
+	/**
+	 * Find the first position in the buffer where a search word
+	 * may begin, i.e. where either a complete search word is
+	 * found or the rest of the buffer is the beginning of a
+	 * search word.
+	 *
+	 * @return the state after the first character and a pointer
+	 * to the first character, or {INVALID, nullptr} if there is
+	 * no match
+	 */
+	[[gnu::pure]]
+	std::pair<uint32_t, const char *> FindFirstChar(const char *data,
+							size_t length) const noexcept;
+};
+
 class SubstIstream final : public FacadeIstream, DestructAnchor {
 	bool had_input, had_output;
 
 	bool send_first;
 
-	SubstTree tree;
+	/**
+	 * Keeps a shared tree alive (see istream_subst_new() overload).
+	 */
+	const std::shared_ptr<const SubstTree> shared_tree;
+
+	SubstTree own_tree;
+
+	const SubstAutomaton &automaton;
+
+	/**
+	 * The current #SubstAutomaton state in State::MATCH.
+	 */
+	uint32_t match_state;
 
+	/**
+	 * The leaf of the full match being inserted in
+	 * State::INSERT.
+	 */
 	const SubstNode *match;
+
 	StringView mismatch = nullptr;
 
 	enum class State {
@@ -79,7 +275,15 @@ class SubstIstream final : public FacadeIstream, DestructAnchor {
 
 public:
 	SubstIstream(struct pool &p, UnusedIstreamPtr &&_input, SubstTree &&_tree) noexcept
-		:FacadeIstream(p, std::move(_input)), tree(std::move(_tree)) {}
+		:FacadeIstream(p, std::move(_input)),
+		 own_tree(std::move(_tree)),
+		 automaton(own_tree.GetAutomaton()) {}
+
+	SubstIstream(struct pool &p, UnusedIstreamPtr &&_input,
+		     std::shared_ptr<const SubstTree> &&_tree) noexcept
+		:FacadeIstream(p, std::move(_input)),
+		 shared_tree(std::move(_tree)),
+		 automaton(shared_tree->GetAutomaton()) {}
 
 private:
 	/** find the first occurence of a "first character" in the buffer */
@@ -128,175 +332,83 @@ public:
  *
  */
 
-/** find a character in the tree */
-gcc_pure
-static const SubstNode *
-subst_find_char(const SubstNode *node, char ch) noexcept
-{
-	assert(node != nullptr);
-
-	if (ch == 0)
-		/* we cannot support null bytes */
-		return nullptr;
-
-	do {
-		if (node->ch == ch) {
-			assert(node->equals != nullptr);
-			return node->equals;
-		}
-
-		if (ch < node->ch)
-			node = node->left;
-		else
-			node = node->right;
-	} while (node != nullptr);
-
-	return nullptr;
-}
-
-/** find the leaf ending the current search word */
-gcc_pure
-static const SubstNode *
-subst_find_leaf(const SubstNode *node) noexcept
-{
-	assert(node != nullptr);
-
-	do {
-		if (node->ch == 0)
-			return node;
-
-		if (0 < node->ch)
-			node = node->left;
-		else
-			node = node->right;
-	} while (node != nullptr);
-
-	return nullptr;
-}
-
-/**
- * Check whether the given input can possibly be a match.
- *
- * @param match the current match (usually found with memchr() by
- * SubstTree::FindFirstChar())
- * @param input the remaining input
- * @param true if the remaining input matches so far (but may not be
- * complete yet), false if the input cannot match
- */
-gcc_pure
-static bool
-CheckMatch(const SubstNode *match, ConstBuffer<char> input) noexcept
-{
-	const char *p = input.data, *const end = p + input.size;
-
-	while (p < end) {
-		if (subst_find_leaf(match) != nullptr)
-			return true;
-
-		match = subst_find_char(match, *p++);
-		if (match == nullptr)
-			return false;
-	}
-
-	return true;
-}
-
-/** find any leaf which begins with the current partial match, used to
-    find a buffer which is partially re-inserted into the data
-    stream */
-gcc_pure
-static const SubstNode *
-subst_find_any_leaf(const SubstNode *node) noexcept
+inline const char *
+SubstAutomaton::SkipToFirstChar(const char *p,
+				const char *end) const noexcept
 {
-	while (true) {
-		assert(node != nullptr);
-
-		if (node->ch == 0)
-			return node;
-
-		node = node->equals;
+	const auto &root = states[0];
+
+	if (root.n_edges == 1) {
+		/* only one possible first character: let the
+		   (vectorized) memchr() find it */
+		p = (const char *)memchr(p, edge_chars[root.first_edge],
+					 end - p);
+		return p != nullptr ? p : end;
 	}
-}
-
-/** iterates over the current depth */
-gcc_pure
-static const SubstNode *
-subst_next_non_leaf_node(const SubstNode *node, const SubstNode *root) noexcept
-{
-	/* dive into left wing first */
-	if (node->left != nullptr && node->left->ch != 0)
-		return node->left;
-
-	/* if left does not exist, go right */
-	if (node->right != nullptr && node->right->ch != 0)
-		return node->right;
-
-	/* this subtree is finished, go up */
-	while (true) {
-		/* don't go above our root */
-		if (node == root)
-			return nullptr;
-
-		assert(node->parent != nullptr);
 
-		if (node->parent->left == node) {
-			node = node->parent;
+	while (p < end && !first_table[(unsigned char)*p])
+		++p;
 
-			/* only go to parent->right if we came from
-			   parent->left */
-			if (node->right != nullptr && node->right->ch != 0)
-				return node;
-		} else {
-			node = node->parent;
-		}
-	}
+	return p;
 }
 
-inline std::pair<const SubstNode *, const char *>
-SubstTree::FindFirstChar(const char *data, size_t length) const noexcept
+inline std::pair<uint32_t, const char *>
+SubstAutomaton::FindFirstChar(const char *data, size_t length) const noexcept
 {
 	const char *const end = data + length;
-	const SubstNode *n = root;
-	const SubstNode *match = nullptr;
-	const char *min = nullptr;
-
-	while (n != nullptr) {
-		assert(n->ch != 0);
-
-		/* loop to find all instances of this start character, until
-		   there is one where the rest also matches */
-		const char *p = data;
-		while (true) {
-			p = (const char *)memchr(p, n->ch, end - p);
-			if (p != nullptr && (min == nullptr || p < min)) {
-				if (!CheckMatch(n->equals, {p + 1, end})) {
-					/* late mismatch; continue the loop to check if
-					   there are more of the current start
-					   character */
-					++p;
-					continue;
-				}
-
-				assert(n->equals != nullptr);
-				match = n->equals;
-				min = p;
-			}
 
+	/* the earliest beginning of a complete search word found so
+	   far */
+	const char *best = nullptr;
+
+	uint32_t state = 0;
+	for (const char *p = data;; ++p) {
+		if (state == 0) {
+			p = SkipToFirstChar(p, end);
+			if (p == end)
+				break;
+
+			state = FindChar(0, *p);
+			assert(state != INVALID);
+		} else if (p == end) {
+			/* the rest of the buffer is the beginning of a
+			   search word; it is a candidate if no
+			   complete search word begins before it */
+			const char *partial = end - states[state].depth;
+			if (best == nullptr || partial < best)
+				best = partial;
 			break;
+		} else
+			state = Next(state, *p);
+
+		const auto &s = states[state];
+		if (s.output > 0) {
+			const char *start = p + 1 - s.output;
+			if (best == nullptr || start < best)
+				best = start;
 		}
 
-		/* check the next start character in the #SubstTree */
-		n = subst_next_non_leaf_node(n, root);
+		/* a search word beginning before "best" would still
+		   be part of the current partial match, and the
+		   current state is the longest one; if that begins
+		   at or after "best", we're done */
+		if (best != nullptr && p + 1 - s.depth >= best)
+			break;
 	}
 
-	return std::make_pair(match, min);
+	if (best == nullptr)
+		return {INVALID, nullptr};
+
+	const uint32_t next = FindChar(0, *best);
+	assert(next != INVALID);
+	return {next, best};
 }
 
 inline const char *
 SubstIstream::FindFirstChar(const char *data, size_t length) noexcept
 {
-	auto x = tree.FindFirstChar(data, length);
-	match = x.first;
+	auto x = automaton.FindFirstChar(data, length);
+	match_state = x.first;
 	return x.second;
 }
 
@@ -431,6 +543,7 @@ SubstIstream::Feed(const void *_data, size_t length) noexcept
 	const char *const data0 = (const char *)_data, *data = data0, *p = data0,
 		*const end = p + length, *first = nullptr;
 	const SubstNode *n;
+	uint32_t next_state;
 
 	had_input = true;
 
@@ -464,15 +577,15 @@ SubstIstream::Feed(const void *_data, size_t length) noexcept
 			/* now see if the rest matches; note that max_compare may be
 			   0, but that isn't a problem */
 
-			n = subst_find_char(match, *p);
-			if (n != nullptr) {
+			next_state = automaton.FindChar(match_state, *p);
+			if (next_state != SubstAutomaton::INVALID) {
 				/* next character matches */
 
 				++a_match;
 				++p;
-				match = n;
+				match_state = next_state;
 
-				n = subst_find_leaf(n);
+				n = automaton.GetLeaf(next_state);
 				if (n != nullptr) {
 					/* full match */
 
@@ -544,8 +657,7 @@ SubstIstream::Feed(const void *_data, size_t length) noexcept
 				if (mismatch.empty()) {
 					send_first = true;
 
-					n = subst_find_any_leaf(match);
-					assert(n != nullptr);
+					n = automaton.GetAnyLeaf(match_state);
 					assert(n->ch == 0);
 					mismatch = {n->leaf.a, a_match};
 
@@ -632,8 +744,7 @@ SubstIstream::OnEof() noexcept
 		   mismatch because we reach end of file before end of
 		   match */
 		if (mismatch.empty()) {
-			const SubstNode *n = subst_find_any_leaf(match);
-			assert(n != nullptr);
+			const SubstNode *n = automaton.GetAnyLeaf(match_state);
 			assert(n->ch == 0);
 
 			mismatch = {n->leaf.a, a_match};
@@ -866,6 +977,20 @@ UnusedIstreamPtr
 istream_subst_new(struct pool *pool, UnusedIstreamPtr input,
 		  SubstTree tree) noexcept
 {
+	if (!tree.IsCompiled())
+		tree.Compile(*pool);
+
+	return NewIstreamPtr<SubstIstream>(*pool, std::move(input),
+					   std::move(tree));
+}
+
+UnusedIstreamPtr
+istream_subst_new(struct pool *pool, UnusedIstreamPtr input,
+		  std::shared_ptr<const SubstTree> tree) noexcept
+{
+	assert(tree);
+	assert(tree->IsCompiled());
+
 	return NewIstreamPtr<SubstIstream>(*pool, std::move(input),
 					   std::move(tree));
 }
@@ -879,6 +1004,9 @@ SubstTree::Add(struct pool &pool, const char *a0, StringView b) noexcept
 	assert(a0 != nullptr);
 	assert(*a0 != 0);
 
+	/* the automaton needs to be rebuilt */
+	automaton = nullptr;
+
 	auto **pp = &root;
 	do {
 		auto *p = *pp;
@@ -930,3 +1058,145 @@ SubstTree::Add(struct pool &pool, const char *a0, StringView b) noexcept
 
 	return true;
 }
+
+/**
+ * Helper class for SubstTree::Compile().
+ */
+class SubstCompiler {
+	std::vector<SubstState> states;
+	std::vector<char> edge_chars;
+	std::vector<uint32_t> edge_targets;
+
+public:
+	/**
+	 * Add a state for the given level of the ternary search tree
+	 * (and, recursively, all of its descendants).
+	 *
+	 * @return the new state's index
+	 */
+	uint32_t AddLevel(const SubstNode *level, uint32_t depth=0) noexcept;
+
+	const SubstAutomaton *Finish(struct pool &pool) const noexcept;
+
+private:
+	/**
+	 * Collect all nodes of one level (i.e. one binary tree
+	 * linked with "left" and "right") in sorted order.
+	 */
+	static void CollectLevel(const SubstNode *node,
+				 std::vector<const SubstNode *> &edges,
+				 const SubstNode *&leaf) noexcept;
+};
+
+void
+SubstCompiler::CollectLevel(const SubstNode *node,
+			    std::vector<const SubstNode *> &edges,
+			    const SubstNode *&leaf) noexcept
+{
+	for (; node != nullptr; node = node->right) {
+		CollectLevel(node->left, edges, leaf);
+
+		if (node->ch == 0)
+			leaf = node;
+		else
+			edges.push_back(node);
+	}
+}
+
+uint32_t
+SubstCompiler::AddLevel(const SubstNode *level, uint32_t depth) noexcept
+{
+	const uint32_t i = states.size();
+	states.emplace_back();
+
+	std::vector<const SubstNode *> edges;
+	const SubstNode *leaf = nullptr;
+	CollectLevel(level, edges, leaf);
+
+	const uint32_t first_edge = edge_chars.size();
+	const uint32_t n_edges = edges.size();
+	edge_chars.resize(first_edge + n_edges);
+	edge_targets.resize(first_edge + n_edges);
+
+	for (uint32_t j = 0; j < n_edges; ++j) {
+		assert(edges[j]->equals != nullptr);
+
+		edge_chars[first_edge + j] = edges[j]->ch;
+		const uint32_t target = AddLevel(edges[j]->equals, depth + 1);
+		edge_targets[first_edge + j] = target;
+	}
+
+	auto &state = states[i];
+	state.first_edge = first_edge;
+	state.n_edges = n_edges;
+	state.depth = depth;
+	state.leaf = leaf;
+	state.any_leaf = leaf != nullptr
+		? leaf
+		: (n_edges > 0
+		   ? states[edge_targets[first_edge]].any_leaf
+		   : nullptr);
+
+	return i;
+}
+
+const SubstAutomaton *
+SubstCompiler::Finish(struct pool &pool) const noexcept
+{
+	auto *a = NewFromPool<SubstAutomaton>(pool);
+
+	auto *s = (SubstState *)
+		p_memdup(&pool, states.data(),
+			 states.size() * sizeof(states.front()));
+	a->states = s;
+	a->edge_chars = (const char *)
+		p_memdup(&pool, edge_chars.data(), edge_chars.size());
+	a->edge_targets = (const uint32_t *)
+		p_memdup(&pool, edge_targets.data(),
+			 edge_targets.size() * sizeof(edge_targets.front()));
+
+	std::fill_n(a->first_table, std::size(a->first_table), false);
+
+	const auto &root = states.front();
+	for (uint32_t j = 0; j < root.n_edges; ++j)
+		a->first_table[(unsigned char)edge_chars[root.first_edge + j]] = true;
+
+	/* calculate the failure links in breadth-first order, so the
+	   failure link of each state points to a state which has
+	   already been handled */
+
+	s[0].fail = 0;
+	s[0].output = 0;
+
+	std::vector<uint32_t> queue;
+	queue.reserve(states.size());
+	queue.push_back(0);
+
+	for (std::size_t q = 0; q < queue.size(); ++q) {
+		const uint32_t i = queue[q];
+		const auto &parent = s[i];
+
+		for (uint32_t j = 0; j < parent.n_edges; ++j) {
+			const char ch = edge_chars[parent.first_edge + j];
+			const uint32_t target = edge_targets[parent.first_edge + j];
+			auto &t = s[target];
+
+			t.fail = i == 0 ? 0 : a->Next(parent.fail, ch);
+			t.output = t.leaf != nullptr
+				? t.depth
+				: s[t.fail].output;
+
+			queue.push_back(target);
+		}
+	}
+
+	return a;
+}
+
+void
+SubstTree::Compile(struct pool &pool) noexcept
+{
+	SubstCompiler compiler;
+	compiler.AddLevel(root);
+	automaton = compiler.Finish(pool);
+}
@@ -32,6 +32,7 @@
 
 #pragma once
 
+#include <memory>
 #include <utility>
 
 #include <stddef.h>
@@ -39,28 +40,49 @@
 struct pool;
 class UnusedIstreamPtr;
 struct SubstNode;
+struct SubstAutomaton;
 struct StringView;
 
 class SubstTree {
 	SubstNode *root = nullptr;
 
+	/**
+	 * The compiled form of this tree (see Compile()); nullptr if
+	 * it has not been compiled yet.
+	 */
+	const SubstAutomaton *automaton = nullptr;
+
 public:
 	SubstTree() = default;
 
 	SubstTree(SubstTree &&src) noexcept
-		:root(std::exchange(src.root, nullptr)) {}
+		:root(std::exchange(src.root, nullptr)),
+		 automaton(std::exchange(src.automaton, nullptr)) {}
 
 	SubstTree &operator=(SubstTree &&src) noexcept {
 		using std::swap;
 		swap(root, src.root);
+		swap(automaton, src.automaton);
 		return *this;
 	}
 
 	bool Add(struct pool &pool, const char *a0, StringView b) noexcept;
 
-	[[gnu::pure]]
-	std::pair<const SubstNode *, const char *> FindFirstChar(const char *data,
-								 size_t length) const noexcept;
+	/**
+	 * Convert the tree into a flat-array automaton which is used
+	 * by #SubstIstream for matching.  This must be called after
+	 * the last Add() call; istream_subst_new() does it
+	 * automatically if it has not been done yet.
+	 */
+	void Compile(struct pool &pool) noexcept;
+
+	bool IsCompiled() const noexcept {
+		return automaton != nullptr;
+	}
+
+	const SubstAutomaton &GetAutomaton() const noexcept {
+		return *automaton;
+	}
 };
 
 /**
@@ -69,3 +91,14 @@ public:
 UnusedIstreamPtr
 istream_subst_new(struct pool *pool, UnusedIstreamPtr input,
 		  SubstTree tree) noexcept;
+
+/**
+ * Like istream_subst_new(), but share a read-only #SubstTree with
+ * other #SubstIstream instances.  The tree must be compiled already
+ * (see SubstTree::Compile()).  The tree (and the pool its nodes
+ * were allocated from) is kept alive by the #std::shared_ptr until
+ * the istream is destroyed.
+ */
+UnusedIstreamPtr
+istream_subst_new(struct pool *pool, UnusedIstreamPtr input,
+		  std::shared_ptr<const SubstTree> tree) noexcept;
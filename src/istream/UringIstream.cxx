@@ -32,6 +32,7 @@
 
 #include "UringIstream.hxx"
 #include "istream.hxx"
+#include "Bucket.hxx"
 #include "New.hxx"
 #include "io/Iovec.hxx"
 #include "io/UniqueFileDescriptor.hxx"
@@ -98,6 +99,12 @@ class UringIstream final : public Istream, Uring::Operation {
 	 */
 	const char *const path;
 
+	/**
+	 * Does the handler accept #FdType::FD_FILE?  If yes, then
+	 * FillBucketList() emits #IstreamBucket::Type::FILE buckets.
+	 */
+	bool direct = false;
+
 public:
 	UringIstream(struct pool &p, Uring::Queue &_uring,
 		     const char *_path, UniqueFileDescriptor &&_fd,
@@ -124,6 +131,10 @@ private:
 
 	/* virtual methods from class Istream */
 
+	void _SetDirect(FdTypeMask mask) noexcept override {
+		direct = (mask & FdTypeMask(FdType::FD_FILE)) != 0;
+	}
+
 	off_t _GetAvailable(bool partial) noexcept override;
 	off_t _Skip(gcc_unused off_t length) noexcept override;
 
@@ -134,7 +145,8 @@ private:
 		// TODO "direct"?
 	}
 
-	// TODO: _FillBucketList, _ConsumeBucketList
+	void _FillBucketList(IstreamBucketList &list) noexcept override;
+	size_t _ConsumeBucketList(size_t nbytes) noexcept override;
 
 	int _AsFd() noexcept override;
 	void _Close() noexcept override {
@@ -235,6 +247,49 @@ UringIstream::_Skip(off_t length) noexcept
 	return buffer_available;
 }
 
+void
+UringIstream::_FillBucketList(IstreamBucketList &list) noexcept
+{
+	auto r = buffer.Read();
+	if (!r.empty())
+		list.Push(r.ToVoid());
+
+	if (offset >= end_offset && !IsUringPending())
+		return;
+
+	if (direct && !IsUringPending()) {
+		/* no read in flight which would overlap: let the
+		   handler transfer the rest with sendfile() */
+		const size_t max_read = GetMaxRead();
+		list.PushFile(fd, offset, max_read);
+		if (end_offset - offset > off_t(max_read))
+			list.SetMore();
+		return;
+	}
+
+	if (r.empty() && !IsUringPending())
+		StartRead();
+
+	list.SetMore();
+}
+
+size_t
+UringIstream::_ConsumeBucketList(size_t nbytes) noexcept
+{
+	size_t consumed = std::min(nbytes, buffer.GetAvailable());
+	buffer.Consume(consumed);
+	nbytes -= consumed;
+
+	if (nbytes > 0 && direct && !IsUringPending()) {
+		/* the rest was a FILE bucket */
+		const size_t n = std::min(nbytes, GetMaxRead());
+		offset += n;
+		consumed += n;
+	}
+
+	return Consumed(consumed);
+}
+
 int
 UringIstream::_AsFd() noexcept
 {
@@ -34,6 +34,8 @@
 #include "SubstIstream.hxx"
 #include "UnusedPtr.hxx"
 #include "pool/pool.hxx"
+#include "pool/Ptr.hxx"
+#include "system/Error.hxx"
 #include "util/IterableSplitString.hxx"
 #include "util/RuntimeError.hxx"
 #include "util/StringView.hxx"
@@ -45,7 +47,14 @@
 #include <yaml-cpp/node/convert.h>
 #include <yaml-cpp/node/detail/impl.h>
 
+#include <iterator>
+#include <map>
+#include <string>
+
 #include <assert.h>
+#include <fcntl.h> // for AT_FDCWD
+#include <stdint.h>
+#include <sys/stat.h>
 
 static YAML::Node
 ResolveYamlPathSegment(const YAML::Node &parent, StringView segment)
@@ -160,6 +169,160 @@ LoadYamlFile(struct pool &pool, bool alt_syntax,
 							  file_path));
 	}
 
+/**
+ * A process-wide cache of #SubstTree instances loaded from YAML
+ * files.  Parsing a large YAML file and building the tree is
+ * expensive, and the result depends only on the file contents and
+ * the parameters, so it can be shared by all responses.
+ *
+ * Entries are validated with statx() on each lookup; a modified or
+ * replaced file (different inode, size or mtime) is loaded again.
+ *
+ * This class is not thread-safe; it must only be used from the main
+ * thread.
+ */
+class YamlSubstCache {
+	struct Key {
+		std::string file_path, map_path, prefix;
+		bool alt_syntax;
+
+		[[gnu::pure]]
+		bool operator<(const Key &other) const noexcept {
+			if (alt_syntax != other.alt_syntax)
+				return alt_syntax < other.alt_syntax;
+			if (int cmp = file_path.compare(other.file_path); cmp != 0)
+				return cmp < 0;
+			if (int cmp = map_path.compare(other.map_path); cmp != 0)
+				return cmp < 0;
+			return prefix < other.prefix;
+		}
+	};
+
+	/**
+	 * The tree and the pool its nodes were allocated from.
+	 */
+	struct Tree {
+		PoolPtr pool;
+		SubstTree tree;
+
+		Tree() noexcept
+			:pool(pool_new_libc(nullptr, "yaml_subst_cache")) {}
+	};
+
+	struct Item {
+		std::shared_ptr<const SubstTree> tree;
+
+		uint64_t ino;
+		uint64_t size;
+		struct statx_timestamp mtime;
+		unsigned dev_major, dev_minor;
+
+		uint_least64_t last_used;
+
+		[[gnu::pure]]
+		bool Matches(const struct statx &st) const noexcept {
+			return st.stx_ino == ino && st.stx_size == size &&
+				st.stx_dev_major == dev_major &&
+				st.stx_dev_minor == dev_minor &&
+				st.stx_mtime.tv_sec == mtime.tv_sec &&
+				st.stx_mtime.tv_nsec == mtime.tv_nsec;
+		}
+	};
+
+	/**
+	 * The maximum number of items; if exceeded, the least
+	 * recently used one is evicted.  Each distinct
+	 * SUBST_YAML_FILE/map/prefix combination occupies one item,
+	 * so this is usually never reached.
+	 */
+	static constexpr std::size_t MAX_ITEMS = 256;
+
+	std::map<Key, Item> items;
+
+	uint_least64_t counter = 0;
+
+public:
+	std::shared_ptr<const SubstTree> Get(bool alt_syntax,
+					     const char *prefix,
+					     const char *file_path,
+					     const char *map_path);
+
+	void Flush() noexcept {
+		items.clear();
+	}
+
+private:
+	void EvictOldest() noexcept;
+};
+
+std::shared_ptr<const SubstTree>
+YamlSubstCache::Get(bool alt_syntax, const char *prefix,
+		    const char *file_path, const char *map_path)
+{
+	Key key{
+		file_path,
+		map_path != nullptr ? map_path : "",
+		prefix != nullptr ? prefix : "",
+		alt_syntax,
+	};
+
+	struct statx st;
+	if (statx(AT_FDCWD, file_path, AT_STATX_SYNC_AS_STAT,
+		  STATX_INO|STATX_SIZE|STATX_MTIME, &st) < 0) {
+		items.erase(key);
+		throw FormatErrno("Failed to load YAML file '%s'", file_path);
+	}
+
+	auto i = items.find(key);
+	if (i != items.end()) {
+		if (i->second.Matches(st)) {
+			i->second.last_used = ++counter;
+			return i->second.tree;
+		}
+
+		/* the file was modified; the old tree stays alive as
+		   long as istreams are still using it */
+		items.erase(i);
+	}
+
+	auto tree = std::make_shared<Tree>();
+	tree->tree = LoadYamlFile(tree->pool, alt_syntax, prefix,
+				  file_path, map_path);
+	tree->tree.Compile(tree->pool);
+
+	if (items.size() >= MAX_ITEMS)
+		EvictOldest();
+
+	/* aliasing constructor: the SubstTree pointer keeps the
+	   whole Tree (including its pool) alive */
+	std::shared_ptr<const SubstTree> result(tree, &tree->tree);
+
+	items.emplace(std::move(key),
+		      Item{
+			      result,
+			      st.stx_ino, st.stx_size, st.stx_mtime,
+			      st.stx_dev_major, st.stx_dev_minor,
+			      ++counter,
+		      });
+
+	return result;
+}
+
+void
+YamlSubstCache::EvictOldest() noexcept
+{
+	assert(!items.empty());
+
+	auto oldest = items.begin();
+	for (auto i = std::next(oldest); i != items.end(); ++i)
+		if (i->second.last_used < oldest->second.last_used)
+			oldest = i;
+
+	items.erase(oldest);
+}
+
+static YamlSubstCache yaml_subst_cache;
+
 UnusedIstreamPtr
 NewYamlSubstIstream(struct pool &pool, UnusedIstreamPtr input,
 		    bool alt_syntax,
@@ -167,6 +330,12 @@ NewYamlSubstIstream(struct pool &pool, UnusedIstreamPtr input,
 		    const char *yaml_file, const char *yaml_map_path)
 {
 	return istream_subst_new(&pool, std::move(input),
-				 LoadYamlFile(pool, alt_syntax, prefix,
-					      yaml_file, yaml_map_path));
+				 yaml_subst_cache.Get(alt_syntax, prefix,
+						      yaml_file, yaml_map_path));
+}
+
+void
+FlushYamlSubstCache() noexcept
+{
+	yaml_subst_cache.Flush();
 }
@@ -45,9 +45,18 @@ NewYamlSubstIstream(struct pool &pool, UnusedIstreamPtr input, bool alt_syntax,
  * Substitute variables in the form "{[NAME]}" with values from the
  * given YAML file.
  *
+ * The parsed YAML map is kept in a process-wide cache and is reused
+ * as long as the file does not change.
+ *
  * Throws on error (if the YAML file could not be loaded).
  */
 UnusedIstreamPtr
 NewYamlSubstIstream(struct pool &pool, UnusedIstreamPtr input, bool alt_syntax,
 		    const char *prefix,
 		    const char *yaml_file, const char *yaml_map_path);
+
+/**
+ * Discard all cached YAML maps (see NewYamlSubstIstream()).
+ */
+void
+FlushYamlSubstCache() noexcept;
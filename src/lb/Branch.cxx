@@ -43,8 +43,10 @@ LbGotoIf::LbGotoIf(LbGotoMap &goto_map, const LbGotoIfConfig &_config)
 LbBranch::LbBranch(LbGotoMap &goto_map,
 		   const LbBranchConfig &_config)
 	:config(_config),
-	 fallback(goto_map.GetInstance(config.fallback))
+	 fallback(goto_map.GetInstance(config.fallback)),
+	 index(config.conditions)
 {
+	conditions.reserve(config.conditions.size());
 	for (const auto &i : config.conditions)
 		conditions.emplace_back(goto_map, i);
 }
@@ -34,8 +34,9 @@
 
 #include "Goto.hxx"
 #include "GotoConfig.hxx"
+#include "ConditionIndex.hxx"
 
-#include <list>
+#include <vector>
 
 class LbGotoMap;
 struct LbGotoIfConfig;
@@ -69,7 +70,9 @@ class LbBranch {
 
 	LbGoto fallback;
 
-	std::list<LbGotoIf> conditions;
+	std::vector<LbGotoIf> conditions;
+
+	LbConditionIndex index;
 
 public:
 	LbBranch(LbGotoMap &goto_map, const LbBranchConfig &_config);
@@ -81,9 +84,9 @@ public:
 	template<typename R>
 	gcc_pure
 	const LbGoto &FindRequestLeaf(const R &request) const {
-		for (const auto &i : conditions)
-			if (i.MatchRequest(request))
-				return i.GetDestination().FindRequestLeaf(request);
+		const std::size_t i = index.FindRequest(request);
+		if (i != LbConditionIndex::NONE)
+			return conditions[i].GetDestination().FindRequestLeaf(request);
 
 		return fallback.FindRequestLeaf(request);
 	}
@@ -41,7 +41,12 @@
 #include "fs/Handler.hxx"
 #include "cluster/StickyCache.hxx"
 #include "cluster/ConnectBalancer.hxx"
+#include "cluster/BalancerMap.hxx"
+#include "cluster/AddressListWrapper.hxx"
 #include "cluster/RoundRobinBalancer.cxx"
+#include "cluster/PickLeastOutstanding.hxx"
+#include "cluster/PickMaglev.hxx"
+#include "cluster/PickPowerOfTwo.hxx"
 #include "stock/GetHandler.hxx"
 #include "system/Error.hxx"
 #include "event/Loop.hxx"
@@ -56,17 +61,33 @@
 #include "lease.hxx"
 #include "stopwatch.hxx"
 
+#include <numeric>
+
+#include <stdlib.h>
+
+#ifdef HAVE_NGHTTP2
+#include "nghttp2/Stock.hxx"
+#endif
+
 #ifdef HAVE_AVAHI
 #include "avahi/Explorer.hxx"
 
 #include <net/if.h>
 #endif
 
+/* the number of static members is limited by the #AddressList
+   which LbClusterConfig::FillAddressList() builds */
+class LbCluster::StaticMaglev final
+	: public MemberMaglevTable<std::size_t, AddressList::MAX_ADDRESSES> {};
+
 #ifdef HAVE_AVAHI
 
 class LbCluster::StickyRing final
 	: public MemberHashRing<ZeroconfMemberMap::pointer> {};
 
+class LbCluster::StickyMaglev final
+	: public MemberMaglevTable<ZeroconfMemberMap::pointer> {};
+
 LbCluster::ZeroconfMember::ZeroconfMember(const std::string &_key,
 					  SocketAddress _address,
 					  ReferencedFailureInfo &_failure,
@@ -110,6 +131,9 @@ LbCluster::LbCluster(const LbClusterConfig &_config,
 	 tcp_balancer(context.tcp_balancer),
 	 fs_stock(context.fs_stock),
 	 fs_balancer(context.fs_balancer),
+#ifdef HAVE_NGHTTP2
+	 nghttp2_stock(context.nghttp2_stock),
+#endif
 	 monitors(_monitors),
 	 logger("cluster " + config.name)
 {
@@ -147,6 +171,17 @@ LbCluster::LbCluster(const LbClusterConfig &_config,
 		static_members.emplace_back(std::move(address), failure);
 	}
 
+	if (config.HasStaticMaglev()) {
+		std::vector<std::size_t> indices(static_members.size());
+		std::iota(indices.begin(), indices.end(), 0);
+
+		static_maglev = std::make_unique<StaticMaglev>();
+		BuildMemberMaglevTable(*static_maglev, indices,
+				       [this](std::size_t i) noexcept -> SocketAddress {
+					       return static_members[i].address;
+				       });
+	}
+
 	if (monitors != nullptr)
 		/* create monitors for "static" members */
 		for (const auto &member : config.members)
@@ -219,6 +254,9 @@ LbCluster::ConnectStaticHttp(AllocatorPtr alloc,
 {
 	assert(config.protocol == LbProtocol::HTTP);
 
+	sticky_hash = MapStaticStickyHash(fs_balancer.GetEventLoop().SteadyNow(),
+					  sticky_hash);
+
 	fs_balancer.Get(alloc, parent_stopwatch,
 			config.transparent_source,
 			bind_address,
@@ -239,6 +277,9 @@ LbCluster::ConnectStaticTcp(AllocatorPtr alloc,
 {
 	assert(config.protocol == LbProtocol::TCP);
 
+	sticky_hash = MapStaticStickyHash(fs_balancer.GetEventLoop().SteadyNow(),
+					  sticky_hash);
+
 	client_balancer_connect(fs_balancer.GetEventLoop(), alloc,
 				tcp_balancer,
 				failure_manager,
@@ -251,6 +292,293 @@ LbCluster::ConnectStaticTcp(AllocatorPtr alloc,
 				cancel_ptr);
 }
 
+SocketAddress
+LbCluster::PickStatic(Expiry now, sticky_hash_t sticky_hash) noexcept
+{
+	return tcp_balancer.MakeAddressListWrapper(AddressListWrapper(failure_manager,
+								      config.address_list.addresses),
+						   config.address_list.sticky_mode)
+		.Pick(now, MapStaticStickyHash(now, sticky_hash));
+}
+
+sticky_hash_t
+LbCluster::MapStaticStickyHash(Expiry now,
+			       sticky_hash_t sticky_hash) const noexcept
+{
+	if (static_maglev == nullptr || sticky_hash == 0)
+		return sticky_hash;
+
+	const std::size_t i =
+		PickMaglev(*static_maglev, now, sticky_hash,
+			   config.sticky_bounded_load,
+			   [this](std::size_t j) noexcept -> const FailureInfo & {
+				   return *static_members[j].failure;
+			   });
+
+	/* PickModulo() selects member "i"; adding the list size
+	   keeps the hash non-zero */
+	return sticky_hash_t(i + static_members.size());
+}
+
+#ifdef HAVE_NGHTTP2
+
+class LbCluster::Http2Connect final : NgHttp2::StockGetHandler, Cancellable {
+	LbCluster &cluster;
+
+	AllocatorPtr alloc;
+
+	const SocketAddress bind_address;
+	const sticky_hash_t sticky_hash;
+	const Event::Duration timeout;
+
+	LbHttp2ConnectHandler &handler;
+
+	FailurePtr failure;
+
+	CancellablePointer cancel_ptr;
+
+	/**
+	 * The number of remaining connection attempts.  We give up when
+	 * we get an error and this attribute is already zero.
+	 */
+	unsigned retries = 2;
+
+public:
+	Http2Connect(LbCluster &_cluster, AllocatorPtr _alloc,
+		     SocketAddress _bind_address,
+		     sticky_hash_t _sticky_hash,
+		     Event::Duration _timeout,
+		     LbHttp2ConnectHandler &_handler,
+		     CancellablePointer &caller_cancel_ptr) noexcept
+		:cluster(_cluster), alloc(_alloc),
+		 bind_address(_bind_address),
+		 sticky_hash(_sticky_hash),
+		 timeout(_timeout),
+		 handler(_handler)
+	{
+		caller_cancel_ptr = *this;
+	}
+
+	~Http2Connect() noexcept {
+		if (failure)
+			failure->RemoveOutstanding();
+	}
+
+	void Destroy() noexcept {
+		this->~Http2Connect();
+	}
+
+	auto &GetEventLoop() const noexcept {
+		return cluster.fs_balancer.GetEventLoop();
+	}
+
+	void Start() noexcept;
+
+private:
+	void Fail(std::exception_ptr ep) noexcept {
+		auto &_handler = handler;
+		Destroy();
+		_handler.OnHttp2Error(std::move(ep));
+	}
+
+	/* virtual methods from class NgHttp2::StockGetHandler */
+	void OnNgHttp2StockReady(NgHttp2::ClientConnection &connection) noexcept override;
+	void OnNgHttp2StockAlpn(std::unique_ptr<FilteredSocket> &&socket) noexcept override;
+	void OnNgHttp2StockError(std::exception_ptr ep) noexcept override;
+
+	/* virtual methods from class Cancellable */
+	void Cancel() noexcept override {
+		cancel_ptr.Cancel();
+		Destroy();
+	}
+};
+
+void
+LbCluster::Http2Connect::Start() noexcept
+{
+	const auto now = GetEventLoop().SteadyNow();
+
+	if (failure)
+		failure->RemoveOutstanding();
+
+	SocketAddress address = nullptr;
+	const char *name = nullptr;
+
+#ifdef HAVE_AVAHI
+	if (cluster.config.HasZeroConf()) {
+		const auto *member = cluster.PickZeroconf(now, sticky_hash);
+		if (member == nullptr) {
+			Fail(std::make_exception_ptr(HttpMessageResponse(HTTP_STATUS_SERVICE_UNAVAILABLE,
+									 "Zeroconf cluster is empty")));
+			return;
+		}
+
+		address = member->GetAddress();
+		name = member->GetLogName();
+		failure = member->GetFailureRef();
+	} else {
+#endif
+		address = cluster.PickStatic(now, sticky_hash);
+		failure = cluster.failure_manager.Make(address);
+#ifdef HAVE_AVAHI
+	}
+#endif
+
+	failure->AddOutstanding();
+
+	cluster.nghttp2_stock.Get(GetEventLoop(), alloc, nullptr,
+				  name,
+				  bind_address, address,
+				  timeout, nullptr,
+				  *this, cancel_ptr);
+}
+
+void
+LbCluster::Http2Connect::OnNgHttp2StockReady(NgHttp2::ClientConnection &connection) noexcept
+{
+	failure->UnsetConnect();
+
+	/* the "outstanding" reference is handed over to the handler
+	   which keeps it until the stream ends */
+	auto _failure = std::move(failure);
+
+	auto &_handler = handler;
+	Destroy();
+	_handler.OnHttp2Ready(connection, *_failure);
+}
+
+void
+LbCluster::Http2Connect::OnNgHttp2StockAlpn(std::unique_ptr<FilteredSocket> &&) noexcept
+{
+	/* this cannot happen because we don't use TLS, and thus no
+	   ALPN */
+	Fail(std::make_exception_ptr(std::runtime_error("Server does not support HTTP/2")));
+}
+
+void
+LbCluster::Http2Connect::OnNgHttp2StockError(std::exception_ptr ep) noexcept
+{
+	failure->SetConnect(GetEventLoop().SteadyNow(),
+			    std::chrono::seconds(20));
+
+	if (retries-- > 0) {
+		/* try the next member */
+		Start();
+		return;
+	}
+
+	Fail(std::move(ep));
+}
+
+void
+LbCluster::ConnectHttp2(AllocatorPtr alloc,
+			SocketAddress bind_address,
+			sticky_hash_t sticky_hash,
+			Event::Duration timeout,
+			LbHttp2ConnectHandler &handler,
+			CancellablePointer &cancel_ptr) noexcept
+{
+	assert(config.protocol == LbProtocol::HTTP);
+	assert(config.http2);
+
+	auto *c = alloc.New<Http2Connect>(*this, alloc,
+					  bind_address, sticky_hash,
+					  timeout, handler, cancel_ptr);
+	c->Start();
+}
+
+#endif
+
+/**
+ * The minimum number of samples before a member may be ejected as an
+ * outlier.  This avoids ejecting members because of a few slow
+ * requests.
+ */
+static constexpr unsigned OUTLIER_MIN_SAMPLES = 16;
+
+inline bool
+LbCluster::IsOutlier(const ResponseScore &score) const noexcept
+{
+	if (score.GetSamples() < OUTLIER_MIN_SAMPLES)
+		return false;
+
+	if (config.outlier_latency > Event::Duration{} &&
+	    score.GetLatency() > config.outlier_latency)
+		return true;
+
+	if (config.outlier_error_rate > 0 &&
+	    score.GetErrorRate() * 100 > config.outlier_error_rate)
+		return true;
+
+	return false;
+}
+
+unsigned
+LbCluster::CountOutliers(Expiry now) const noexcept
+{
+	unsigned n = 0;
+
+	for (const auto &member : static_members)
+		if (!member.failure->CheckOutlier(now))
+			++n;
+
+#ifdef HAVE_AVAHI
+	for (const auto &member : zeroconf_members)
+		if (!member.GetFailureInfo().CheckOutlier(now))
+			++n;
+#endif
+
+	return n;
+}
+
+void
+LbCluster::EjectMember(FailureInfo &failure, Expiry now,
+		       Event::Duration duration, const char *reason) noexcept
+{
+	if (CountOutliers(now) >= config.outlier_max_ejected) {
+		logger(4, "not ejecting ", reason,
+		       ", too many ejected members");
+		return;
+	}
+
+	char buffer[64];
+	logger(2, "ejecting ", reason, " ",
+	       ToString(buffer, sizeof(buffer),
+			failure_manager.GetAddress(failure), "?"));
+
+	failure.SetOutlier(now, duration);
+}
+
+void
+LbCluster::OnMemberResponse(FailureInfo &failure, Expiry now,
+			    Event::Duration latency, bool error,
+			    bool server_failure) noexcept
+{
+	failure.UpdateScore(latency, error);
+
+	if (config.HasPassiveHealth()) {
+		if (!server_failure)
+			failure.ResetPassiveFailures();
+		else if (failure.AddPassiveFailure(now, config.passive_window)
+			 >= config.passive_failures &&
+			 /* already ejected (by a concurrent request) */
+			 failure.CheckOutlier(now)) {
+			failure.ResetPassiveFailures();
+			EjectMember(failure, now, config.passive_ejection_time,
+				    "failing member");
+			return;
+		}
+	}
+
+	if (!config.HasOutlierDetection() ||
+	    !IsOutlier(failure.GetScore()) ||
+	    /* already ejected (by a concurrent request) */
+	    !failure.CheckOutlier(now))
+		return;
+
+	EjectMember(failure, now, config.outlier_ejection_time, "outlier");
+}
+
 #ifdef HAVE_AVAHI
 
 struct LbCluster::ZeroconfListWrapper {
@@ -276,6 +604,11 @@ struct LbCluster::ZeroconfListWrapper {
 		   bool allow_fade) const noexcept {
 		return member.GetFailureInfo().Check(now, allow_fade);
 	}
+
+	gcc_pure
+	unsigned GetOutstanding(const_reference member) const noexcept {
+		return member.GetFailureInfo().GetOutstanding();
+	}
 };
 
 LbCluster::ZeroconfMemberMap::const_reference
@@ -289,9 +622,20 @@ LbCluster::PickNextGoodZeroconf(const Expiry now) noexcept
 		   member without consulting RoundRobinBalancer */
 		return *active_zeroconf_members.front();
 
-	return round_robin_balancer.Get(now,
-					ZeroconfListWrapper{active_zeroconf_members},
-					false);
+	const ZeroconfListWrapper list{active_zeroconf_members};
+
+	switch (config.sticky_mode) {
+	case StickyMode::LEAST_OUTSTANDING:
+		return PickLeastOutstanding(now, list, random());
+
+	case StickyMode::POWER_OF_TWO:
+		return PickPowerOfTwo(now, list, random());
+
+	default:
+		break;
+	}
+
+	return round_robin_balancer.Get(now, list, false);
 }
 
 inline const LbCluster::ZeroconfMember &
@@ -317,6 +661,20 @@ LbCluster::PickZeroconfHashRing(Expiry now,
 	}
 }
 
+inline const LbCluster::ZeroconfMember &
+LbCluster::PickZeroconfMaglev(Expiry now,
+			      sticky_hash_t sticky_hash) noexcept
+{
+	assert(!active_zeroconf_members.empty());
+	assert(sticky_maglev != nullptr);
+
+	return *PickMaglev(*sticky_maglev, now, sticky_hash,
+			   config.sticky_bounded_load,
+			   [](ZeroconfMemberMap::const_pointer member) noexcept -> const FailureInfo & {
+				   return member->GetFailureInfo();
+			   });
+}
+
 const LbCluster::ZeroconfMember *
 LbCluster::PickZeroconf(const Expiry now, sticky_hash_t sticky_hash) noexcept
 {
@@ -331,6 +689,9 @@ LbCluster::PickZeroconf(const Expiry now, sticky_hash_t sticky_hash) noexcept
 	if (sticky_hash != 0) {
 		assert(config.sticky_mode != StickyMode::NONE);
 
+		if (config.sticky_maglev)
+			return &PickZeroconfMaglev(now, sticky_hash);
+
 		if (!config.sticky_cache)
 			/* use consistent hashing */
 			return &PickZeroconfHashRing(now, sticky_hash);
@@ -377,7 +738,16 @@ LbCluster::FillActive() noexcept
 	for (auto &i : zeroconf_members)
 		active_zeroconf_members.push_back(&i);
 
-	if (!config.sticky_cache) {
+	if (config.sticky_maglev) {
+		if (sticky_maglev == nullptr)
+			/* lazy allocation */
+			sticky_maglev = std::make_unique<StickyMaglev>();
+
+		BuildMemberMaglevTable(*sticky_maglev, active_zeroconf_members,
+				       [](ZeroconfMemberMap::const_pointer member) noexcept {
+					       return member->GetAddress();
+				       });
+	} else if (!config.sticky_cache) {
 		if (sticky_ring == nullptr)
 			/* lazy allocation */
 			sticky_ring = std::make_unique<StickyRing>();
@@ -432,6 +802,11 @@ public:
 		caller_cancel_ptr = *this;
 	}
 
+	~ZeroconfHttpConnect() noexcept {
+		if (failure)
+			failure->RemoveOutstanding();
+	}
+
 	void Destroy() noexcept {
 		this->~ZeroconfHttpConnect();
 	}
@@ -482,7 +857,11 @@ LbCluster::ZeroconfHttpConnect::Start() noexcept
 		return;
 	}
 
+	if (failure)
+		failure->RemoveOutstanding();
+
 	failure = member->GetFailureRef();
+	failure->AddOutstanding();
 
 	cluster.fs_stock.Get(alloc,
 			     nullptr,
@@ -46,6 +46,7 @@
 
 #include <boost/intrusive/set.hpp>
 
+#include <exception>
 #include <forward_list>
 #include <vector>
 #include <string>
@@ -67,6 +68,28 @@ class FilteredSocketBalancerHandler;
 class ConnectSocketHandler;
 class CancellablePointer;
 class AllocatorPtr;
+class Expiry;
+class FailureInfo;
+class ResponseScore;
+namespace NgHttp2 { class Stock; class ClientConnection; }
+
+#ifdef HAVE_NGHTTP2
+
+class LbHttp2ConnectHandler {
+public:
+	/**
+	 * @param failure the #FailureInfo of the member; the
+	 * handler may keep a reference to it; the request has been
+	 * counted with FailureInfo::AddOutstanding(), and the handler
+	 * is responsible for calling FailureInfo::RemoveOutstanding()
+	 * when the stream ends
+	 */
+	virtual void OnHttp2Ready(NgHttp2::ClientConnection &connection,
+				  ReferencedFailureInfo &failure) noexcept = 0;
+	virtual void OnHttp2Error(std::exception_ptr ep) noexcept = 0;
+};
+
+#endif
 
 class LbCluster final
 #ifdef HAVE_AVAHI
@@ -78,6 +101,9 @@ class LbCluster final
 	BalancerMap &tcp_balancer;
 	FilteredSocketStock &fs_stock;
 	FilteredSocketBalancer &fs_balancer;
+#ifdef HAVE_NGHTTP2
+	NgHttp2::Stock &nghttp2_stock;
+#endif
 	LbMonitorStock *const monitors;
 
 	const Logger logger;
@@ -95,6 +121,14 @@ class LbCluster final
 
 	std::vector<StaticMember> static_members;
 
+	class StaticMaglev;
+
+	/**
+	 * Maps sticky hashes to indices in #static_members.  Only
+	 * allocated if LbClusterConfig::HasStaticMaglev().
+	 */
+	std::unique_ptr<StaticMaglev> static_maglev;
+
 #ifdef HAVE_AVAHI
 	/**
 	 * This #AvahiServiceExplorer locates Zeroconf nodes.
@@ -108,6 +142,14 @@ class LbCluster final
 	 */
 	std::unique_ptr<StickyRing> sticky_ring;
 
+	class StickyMaglev;
+
+	/**
+	 * For consistent hashing with LbClusterConfig::sticky_maglev.
+	 * It is populated by FillActive().
+	 */
+	std::unique_ptr<StickyMaglev> sticky_maglev;
+
 	/**
 	 * @see LbClusterConfig::sticky_cache
 	 */
@@ -279,6 +321,36 @@ public:
 			      ConnectSocketHandler &handler,
 			      CancellablePointer &cancel_ptr) noexcept;
 
+#ifdef HAVE_NGHTTP2
+	/**
+	 * Obtain a HTTP/2 connection to a member (Zeroconf or
+	 * static).  Requires LbClusterConfig::http2.
+	 */
+	void ConnectHttp2(AllocatorPtr alloc,
+			  SocketAddress bind_address,
+			  sticky_hash_t sticky_hash,
+			  Event::Duration timeout,
+			  LbHttp2ConnectHandler &handler,
+			  CancellablePointer &cancel_ptr) noexcept;
+#endif
+
+	/**
+	 * Feed the result of a HTTP request into the member's
+	 * #ResponseScore and its passive health counter, and eject
+	 * the member temporarily if it has become an outlier or has
+	 * failed too often.
+	 *
+	 * @param latency the time between sending the request and
+	 * receiving the response headers
+	 * @param error true if the request has failed or if the
+	 * server has responded with a 5xx status
+	 * @param server_failure true if the server is to blame for the
+	 * error (5xx status, timeout, protocol error)
+	 */
+	void OnMemberResponse(FailureInfo &failure, Expiry now,
+			      Event::Duration latency, bool error,
+			      bool server_failure) noexcept;
+
 #ifdef HAVE_AVAHI
 	gcc_pure
 	size_t GetZeroconfCount() noexcept {
@@ -307,6 +379,12 @@ public:
 	const ZeroconfMember &PickZeroconfHashRing(Expiry now,
 						   sticky_hash_t sticky_hash) noexcept;
 
+	/**
+	 * Like PickZeroconfHashRing(), but use the Maglev table.
+	 */
+	const ZeroconfMember &PickZeroconfMaglev(Expiry now,
+						 sticky_hash_t sticky_hash) noexcept;
+
 	/**
 	 * Obtain a HTTP connection to a Zeroconf member.
 	 */
@@ -349,4 +427,42 @@ private:
 			      SocketAddress address) noexcept override;
 	void OnAvahiRemoveObject(const std::string &key) noexcept override;
 #endif
+
+private:
+	/**
+	 * Pick a statically configured member (not Zeroconf) using
+	 * the configured #StickyMode.
+	 */
+	SocketAddress PickStatic(Expiry now,
+				 sticky_hash_t sticky_hash) noexcept;
+
+	/**
+	 * If a Maglev table is used for static members, pick a member
+	 * with it and return a sticky hash which makes PickModulo()
+	 * select exactly that member.  Otherwise, return the given
+	 * hash unmodified.
+	 */
+	sticky_hash_t MapStaticStickyHash(Expiry now,
+					  sticky_hash_t sticky_hash) const noexcept;
+
+#ifdef HAVE_NGHTTP2
+	class Http2Connect;
+#endif
+
+	[[gnu::pure]]
+	bool IsOutlier(const ResponseScore &score) const noexcept;
+
+	/**
+	 * Count the members which are currently ejected as outliers.
+	 */
+	[[gnu::pure]]
+	unsigned CountOutliers(Expiry now) const noexcept;
+
+	/**
+	 * Eject the member as an outlier for the given duration, unless
+	 * #LbClusterConfig::outlier_max_ejected has been reached.
+	 */
+	void EjectMember(FailureInfo &failure, Expiry now,
+			 Event::Duration duration,
+			 const char *reason) noexcept;
 };
@@ -52,6 +52,24 @@ LbClusterConfig::FillAddressList()
 	}
 }
 
+bool
+LbClusterConfig::HasStaticMaglev() const noexcept
+{
+	if (!sticky_maglev || members.size() < 2)
+		return false;
+
+	switch (sticky_mode) {
+	case StickyMode::SOURCE_IP:
+	case StickyMode::HOST:
+	case StickyMode::XHOST:
+		return true;
+
+	default:
+		/* these modes have no hash or select members by index */
+		return false;
+	}
+}
+
 int
 LbClusterConfig::FindJVMRoute(const char *jvm_route) const noexcept
 {
@@ -36,6 +36,7 @@
 #include "cluster/AddressList.hxx"
 #include "cluster/StickyMode.hxx"
 #include "net/AllocatedSocketAddress.hxx"
+#include "event/Chrono.hxx"
 
 #include <string>
 #include <vector>
@@ -94,6 +95,34 @@ struct LbClusterConfig {
 
 	bool mangle_via = false;
 
+#ifdef HAVE_NGHTTP2
+	/**
+	 * Forward requests to the members via HTTP/2 (without TLS,
+	 * "prior knowledge").  Many requests are multiplexed over few
+	 * long-lived connections per member.  Only applicable to
+	 * #LbProtocol::HTTP.
+	 */
+	bool http2 = false;
+#endif
+
+	/**
+	 * Use a Maglev lookup table (#MaglevTable) for consistent
+	 * hashing, instead of #HashRing (Zeroconf) or modulo (static
+	 * members).  For static members, this applies only to sticky
+	 * modes which hash a request attribute; "cookie" and
+	 * "jvm_route" select members by index.
+	 */
+	bool sticky_maglev = false;
+
+	/**
+	 * Bounded-load consistent hashing: if the member selected by
+	 * the Maglev table has more requests in flight than this
+	 * percentage of the average, the request spills to the next
+	 * member in the table.  0 disables this.  Requires
+	 * #sticky_maglev.
+	 */
+	unsigned sticky_bounded_load = 0;
+
 #ifdef HAVE_AVAHI
 	/**
 	 * Enable the #StickyCache for Zeroconf?  By default, consistent
@@ -110,6 +139,42 @@ struct LbClusterConfig {
 
 	const LbMonitorConfig *monitor = nullptr;
 
+	/**
+	 * Members whose average response latency exceeds this value
+	 * are ejected temporarily.  Zero disables this check.
+	 */
+	Event::Duration outlier_latency{};
+
+	/**
+	 * Members whose average error rate (5xx responses and HTTP
+	 * client errors) exceeds this value [percent] are ejected
+	 * temporarily.  Zero disables this check.
+	 */
+	unsigned outlier_error_rate = 0;
+
+	/**
+	 * How long are outliers ejected?
+	 */
+	Event::Duration outlier_ejection_time = std::chrono::seconds(30);
+
+	/**
+	 * The maximum number of members which may be ejected as
+	 * outliers at the same time.
+	 */
+	unsigned outlier_max_ejected = 1;
+
+	/**
+	 * Passive health tracking: a member which fails this number of
+	 * requests (5xx responses, timeouts and other server failures)
+	 * in a row within #passive_window is ejected for
+	 * #passive_ejection_time.  Zero disables this check.
+	 */
+	unsigned passive_failures = 0;
+
+	Event::Duration passive_window = std::chrono::seconds(1);
+
+	Event::Duration passive_ejection_time = std::chrono::seconds(10);
+
 	std::vector<LbMemberConfig> members;
 
 #ifdef HAVE_AVAHI
@@ -147,6 +212,22 @@ struct LbClusterConfig {
 	[[gnu::pure]]
 	int FindJVMRoute(const char *jvm_route) const noexcept;
 
+	bool HasOutlierDetection() const noexcept {
+		return outlier_latency > Event::Duration{} ||
+			outlier_error_rate > 0;
+	}
+
+	/**
+	 * Shall the Maglev table be used to pick a static member for
+	 * the configured #sticky_mode?
+	 */
+	[[gnu::pure]]
+	bool HasStaticMaglev() const noexcept;
+
+	bool HasPassiveHealth() const noexcept {
+		return passive_failures > 0;
+	}
+
 	bool HasZeroConf() const noexcept {
 #ifdef HAVE_AVAHI
 		return !zeroconf_service.empty();
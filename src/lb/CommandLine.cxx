@@ -107,6 +107,7 @@ HandleSet(LbCmdLine &cmdline, const char *argv0,
 	  const char *name, size_t name_length, const char *value)
 {
 	static const char tcp_stock_limit[] = "tcp_stock_limit";
+	static const char tcp_stock_min_idle[] = "tcp_stock_min_idle";
 	char *endptr;
 	long l;
 
@@ -117,6 +118,14 @@ HandleSet(LbCmdLine &cmdline, const char *argv0,
 			arg_error(argv0, "Invalid value for tcp_stock_limit");
 
 		cmdline.tcp_stock_limit = l;
+	} else if (name_length == sizeof(tcp_stock_min_idle) - 1 &&
+		   memcmp(name, tcp_stock_min_idle,
+			  sizeof(tcp_stock_min_idle) - 1) == 0) {
+		l = strtol(value, &endptr, 10);
+		if (*endptr != 0 || l < 0)
+			arg_error(argv0, "Invalid value for tcp_stock_min_idle");
+
+		cmdline.tcp_stock_min_idle = l;
 	} else
 		arg_error(argv0, "Unknown variable: %.*s", (int)name_length, name);
 }
@@ -44,6 +44,12 @@ struct LbCmdLine {
 
 	unsigned tcp_stock_limit = 256;
 
+	/**
+	 * The minimum number of idle connections per upstream
+	 * server.  0 disables pre-warming.
+	 */
+	unsigned tcp_stock_min_idle = 0;
+
 	/**
 	 * If true, then the environment (e.g. the configuration file) is
 	 * checked, and the process exits.
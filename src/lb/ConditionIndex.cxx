@@ -0,0 +1,150 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ConditionIndex.hxx"
+#include "util/CharUtil.hxx"
+
+#include <algorithm>
+
+#include <string.h>
+
+std::optional<std::string>
+RegexToPrefix(const char *p) noexcept
+{
+	if (*p++ != '^')
+		return std::nullopt;
+
+	std::string prefix;
+
+	while (*p != 0) {
+		char ch = *p++;
+		if (ch == '\\') {
+			/* an escaped non-alphanumeric character is a
+			   literal; everything else (e.g. "\d") is a
+			   special sequence */
+			ch = *p++;
+			if (ch == 0 || IsAlphaNumericASCII(ch))
+				return std::nullopt;
+		} else if (ch == '.' && p[0] == '*' && p[1] == 0) {
+			/* trailing ".*" */
+			break;
+		} else if (strchr("^$.[]|()?*+{}", ch) != nullptr)
+			return std::nullopt;
+
+		prefix.push_back(ch);
+	}
+
+	return prefix;
+}
+
+void
+LbConditionIndex::Attribute::AddExact(std::string_view value,
+				      std::size_t index)
+{
+	/* emplace() keeps the existing (lower) index for duplicates */
+	exact.emplace(value, index);
+	min_index = std::min(min_index, index);
+}
+
+void
+LbConditionIndex::Attribute::AddPrefix(std::string_view value,
+				       std::size_t index)
+{
+	std::size_t node = 0;
+	for (const char ch : value) {
+		auto [i, inserted] = trie[node].children.emplace(ch, trie.size());
+		node = i->second;
+		if (inserted)
+			trie.emplace_back();
+	}
+
+	trie[node].match = std::min(trie[node].match, index);
+	min_index = std::min(min_index, index);
+}
+
+std::size_t
+LbConditionIndex::Attribute::Find(const char *s,
+				  std::size_t best) const noexcept
+{
+	if (!exact.empty()) {
+		auto i = exact.find(s);
+		if (i != exact.end())
+			best = std::min(best, i->second);
+	}
+
+	std::size_t node = 0;
+	while (true) {
+		const auto &n = trie[node];
+		best = std::min(best, n.match);
+
+		if (*s == 0)
+			break;
+
+		auto i = n.children.find(*s++);
+		if (i == n.children.end())
+			break;
+
+		node = i->second;
+	}
+
+	return best;
+}
+
+inline LbConditionIndex::Attribute &
+LbConditionIndex::MakeAttribute(const LbAttributeReference &reference)
+{
+	for (auto &i : attributes)
+		if (i.reference == reference)
+			return i;
+
+	return attributes.emplace_back(reference);
+}
+
+LbConditionIndex::LbConditionIndex(const std::list<LbGotoIfConfig> &conditions)
+{
+	std::size_t index = 0;
+	for (const auto &i : conditions) {
+		const auto &c = i.condition;
+
+		if (c.negate) {
+			residual.emplace_back(index, &c);
+		} else if (const auto *s = std::get_if<std::string>(&c.value)) {
+			MakeAttribute(c.attribute_reference).AddExact(*s, index);
+		} else if (const auto *p = std::get_if<LbConditionConfig::Prefix>(&c.value)) {
+			MakeAttribute(c.attribute_reference).AddPrefix(p->value, index);
+		} else {
+			residual.emplace_back(index, &c);
+		}
+
+		++index;
+	}
+}
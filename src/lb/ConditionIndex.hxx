@@ -0,0 +1,160 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "GotoConfig.hxx"
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * If the given regular expression matches only a literal prefix
+ * (e.g. "^/foo/" or "^/foo/.*"), return that prefix.
+ */
+std::optional<std::string>
+RegexToPrefix(const char *p) noexcept;
+
+/**
+ * A precompiled index over the conditions of a #LbBranchConfig.
+ * Equality conditions are looked up in a hash table, literal prefix
+ * conditions in a trie; only the remaining conditions (regular
+ * expressions and negations) are evaluated one by one.
+ *
+ * The result is the same as evaluating all conditions in their
+ * configured order: the lowest-numbered matching condition wins.
+ */
+class LbConditionIndex {
+public:
+	static constexpr std::size_t NONE = ~std::size_t{};
+
+private:
+	struct TrieNode {
+		std::map<char, std::size_t> children;
+
+		/**
+		 * The lowest index of all prefix conditions ending at
+		 * this node.
+		 */
+		std::size_t match = NONE;
+	};
+
+	/**
+	 * All indexed conditions on one request attribute.
+	 */
+	struct Attribute {
+		const LbAttributeReference &reference;
+
+		/**
+		 * Maps the compared string to the lowest index of all
+		 * equality conditions.  The keys point into the
+		 * #LbConditionConfig instances.
+		 */
+		std::unordered_map<std::string_view, std::size_t> exact;
+
+		/**
+		 * Element 0 is the root node.
+		 */
+		std::vector<TrieNode> trie;
+
+		/**
+		 * The lowest index of all conditions in this object.
+		 * If a better match has already been found, this
+		 * attribute can be skipped.
+		 */
+		std::size_t min_index = NONE;
+
+		explicit Attribute(const LbAttributeReference &_reference)
+			:reference(_reference), trie(1) {}
+
+		void AddExact(std::string_view value, std::size_t index);
+		void AddPrefix(std::string_view value, std::size_t index);
+
+		/**
+		 * Find the lowest matching index below #best.
+		 */
+		[[gnu::pure]]
+		std::size_t Find(const char *s, std::size_t best) const noexcept;
+	};
+
+	std::vector<Attribute> attributes;
+
+	/**
+	 * Conditions which cannot be indexed, ordered by their index.
+	 */
+	std::vector<std::pair<std::size_t, const LbConditionConfig *>> residual;
+
+public:
+	explicit LbConditionIndex(const std::list<LbGotoIfConfig> &conditions);
+
+	/**
+	 * Find the first condition which matches the given request.
+	 *
+	 * @return the index of the condition or #NONE
+	 */
+	template<typename R>
+	[[gnu::pure]]
+	std::size_t FindRequest(const R &request) const noexcept {
+		std::size_t best = NONE;
+
+		for (const auto &i : attributes) {
+			if (i.min_index >= best)
+				continue;
+
+			const char *s = i.reference.GetRequestAttribute(request);
+			if (s == nullptr)
+				s = "";
+
+			best = i.Find(s, best);
+		}
+
+		for (const auto &[index, condition] : residual) {
+			if (index >= best)
+				break;
+
+			if (condition->MatchRequest(request))
+				return index;
+		}
+
+		return best;
+	}
+
+private:
+	Attribute &MakeAttribute(const LbAttributeReference &reference);
+};
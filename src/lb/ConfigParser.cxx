@@ -32,6 +32,7 @@
 
 #include "Config.hxx"
 #include "Check.hxx"
+#include "ConditionIndex.hxx"
 #include "access_log/ConfigParser.hxx"
 #include "io/FileLineParser.hxx"
 #include "io/ConfigParser.hxx"
@@ -350,13 +351,16 @@ LbConfigParser::Monitor::ParseLine(FileLineParser &line)
 			config.type = LbMonitorConfig::Type::CONNECT;
 		else if (strcmp(value, "tcp_expect") == 0)
 			config.type = LbMonitorConfig::Type::TCP_EXPECT;
+		else if (strcmp(value, "http") == 0)
+			config.type = LbMonitorConfig::Type::HTTP;
 		else
 			throw LineParser::Error("Unknown monitor type");
 	} else if (strcmp(word, "interval") == 0) {
 		config.interval = std::chrono::seconds(line.NextPositiveInteger());
 	} else if (strcmp(word, "timeout") == 0) {
 		config.timeout = std::chrono::seconds(line.NextPositiveInteger());
-	} else if (config.type == LbMonitorConfig::Type::TCP_EXPECT &&
+	} else if ((config.type == LbMonitorConfig::Type::TCP_EXPECT ||
+		    config.type == LbMonitorConfig::Type::HTTP) &&
 		   strcmp(word, "connect_timeout") == 0) {
 		config.connect_timeout = std::chrono::seconds(line.NextPositiveInteger());
 	} else if (config.type == LbMonitorConfig::Type::TCP_EXPECT &&
@@ -368,7 +372,8 @@ LbConfigParser::Monitor::ParseLine(FileLineParser &line)
 		line.ExpectEnd();
 
 		config.send = value;
-	} else if (config.type == LbMonitorConfig::Type::TCP_EXPECT &&
+	} else if ((config.type == LbMonitorConfig::Type::TCP_EXPECT ||
+		    config.type == LbMonitorConfig::Type::HTTP) &&
 		   strcmp(word, "expect") == 0) {
 		const char *value = line.NextUnescape();
 		if (value == nullptr)
@@ -377,7 +382,8 @@ LbConfigParser::Monitor::ParseLine(FileLineParser &line)
 		line.ExpectEnd();
 
 		config.expect = value;
-	} else if (config.type == LbMonitorConfig::Type::TCP_EXPECT &&
+	} else if ((config.type == LbMonitorConfig::Type::TCP_EXPECT ||
+		    config.type == LbMonitorConfig::Type::HTTP) &&
 		   strcmp(word, "expect_graceful") == 0) {
 		const char *value = line.NextUnescape();
 		if (value == nullptr)
@@ -386,6 +392,34 @@ LbConfigParser::Monitor::ParseLine(FileLineParser &line)
 		line.ExpectEnd();
 
 		config.fade_expect = value;
+	} else if (config.type == LbMonitorConfig::Type::HTTP &&
+		   strcmp(word, "method") == 0) {
+		const char *value = line.ExpectValueAndEnd();
+		if (*value == 0 || strpbrk(value, " \t\r\n") != nullptr)
+			throw LineParser::Error("Malformed HTTP method");
+
+		config.http_method = value;
+	} else if (config.type == LbMonitorConfig::Type::HTTP &&
+		   strcmp(word, "uri") == 0) {
+		const char *value = line.ExpectValueAndEnd();
+		if (*value != '/' || strpbrk(value, " \t\r\n") != nullptr)
+			throw LineParser::Error("Malformed URI");
+
+		config.http_uri = value;
+	} else if (config.type == LbMonitorConfig::Type::HTTP &&
+		   strcmp(word, "host") == 0) {
+		const char *value = line.ExpectValueAndEnd();
+		if (strpbrk(value, " \t\r\n") != nullptr)
+			throw LineParser::Error("Malformed host");
+
+		config.http_host = value;
+	} else if (config.type == LbMonitorConfig::Type::HTTP &&
+		   strcmp(word, "expect_status") == 0) {
+		config.expect_status = line.NextPositiveInteger();
+		if (config.expect_status < 100 || config.expect_status > 599)
+			throw LineParser::Error("Malformed HTTP status");
+
+		line.ExpectEnd();
 	} else
 		throw LineParser::Error("Unknown option");
 }
@@ -511,6 +545,12 @@ validate_protocol_sticky(LbProtocol protocol, StickyMode sticky)
 		case StickyMode::COOKIE:
 		case StickyMode::JVM_ROUTE:
 			return false;
+
+		case StickyMode::LEAST_OUTSTANDING:
+		case StickyMode::POWER_OF_TWO:
+			/* TCP connections are not accounted for
+			   (yet) */
+			return false;
 		}
 	}
 
@@ -529,6 +569,8 @@ ValidateZeroconfSticky(StickyMode sticky) noexcept
 	case StickyMode::SOURCE_IP:
 	case StickyMode::HOST:
 	case StickyMode::XHOST:
+	case StickyMode::LEAST_OUTSTANDING:
+	case StickyMode::POWER_OF_TWO:
 		return true;
 
 	case StickyMode::SESSION_MODULO:
@@ -562,6 +604,10 @@ ParseStickyMode(const char *s)
 		return StickyMode::COOKIE;
 	else if (strcmp(s, "jvm_route") == 0)
 		return StickyMode::JVM_ROUTE;
+	else if (strcmp(s, "least_outstanding") == 0)
+		return StickyMode::LEAST_OUTSTANDING;
+	else if (strcmp(s, "power_of_two") == 0)
+		return StickyMode::POWER_OF_TWO;
 	else
 		throw LineParser::Error("Unknown sticky mode");
 }
@@ -582,6 +628,14 @@ LbConfigParser::Cluster::ParseLine(FileLineParser &line)
 #else
 		throw LineParser::Error("Zeroconf support is disabled at compile time");
 #endif
+	} else if (strcmp(word, "sticky_maglev") == 0) {
+		config.sticky_maglev = line.NextBool();
+		line.ExpectEnd();
+	} else if (strcmp(word, "sticky_bounded_load") == 0) {
+		config.sticky_bounded_load = line.NextPositiveInteger();
+		if (config.sticky_bounded_load < 100)
+			throw LineParser::Error("Percent value of at least 100 expected");
+		line.ExpectEnd();
 	} else if (strcmp(word, "session_cookie") == 0) {
 		config.session_cookie = line.ExpectValueAndEnd();
 	} else if (strcmp(word, "monitor") == 0) {
@@ -591,6 +645,33 @@ LbConfigParser::Cluster::ParseLine(FileLineParser &line)
 		config.monitor = parent.config.FindMonitor(line.ExpectValueAndEnd());
 		if (config.monitor == nullptr)
 			throw LineParser::Error("No such monitor");
+	} else if (strcmp(word, "outlier_latency") == 0) {
+		config.outlier_latency =
+			std::chrono::milliseconds(line.NextPositiveInteger());
+		line.ExpectEnd();
+	} else if (strcmp(word, "outlier_error_rate") == 0) {
+		config.outlier_error_rate = line.NextPositiveInteger();
+		if (config.outlier_error_rate > 100)
+			throw LineParser::Error("Percent value expected");
+		line.ExpectEnd();
+	} else if (strcmp(word, "outlier_ejection_time") == 0) {
+		config.outlier_ejection_time =
+			std::chrono::seconds(line.NextPositiveInteger());
+		line.ExpectEnd();
+	} else if (strcmp(word, "outlier_max_ejected") == 0) {
+		config.outlier_max_ejected = line.NextPositiveInteger();
+		line.ExpectEnd();
+	} else if (strcmp(word, "passive_failures") == 0) {
+		config.passive_failures = line.NextPositiveInteger();
+		line.ExpectEnd();
+	} else if (strcmp(word, "passive_window") == 0) {
+		config.passive_window =
+			std::chrono::milliseconds(line.NextPositiveInteger());
+		line.ExpectEnd();
+	} else if (strcmp(word, "passive_ejection_time") == 0) {
+		config.passive_ejection_time =
+			std::chrono::seconds(line.NextPositiveInteger());
+		line.ExpectEnd();
 	} else if (strcmp(word, "member") == 0) {
 #ifdef HAVE_AVAHI
 		if (!config.zeroconf_service.empty() ||
@@ -688,6 +769,13 @@ LbConfigParser::Cluster::ParseLine(FileLineParser &line)
 		config.mangle_via = line.NextBool();
 
 		line.ExpectEnd();
+	} else if (strcmp(word, "http2") == 0) {
+#ifdef HAVE_NGHTTP2
+		config.http2 = line.NextBool();
+		line.ExpectEnd();
+#else
+		throw LineParser::Error("HTTP/2 support is disabled at compile time");
+#endif
 	} else if (strcmp(word, "fallback") == 0) {
 		if (config.fallback.IsDefined())
 			throw LineParser::Error("Duplicate fallback");
@@ -739,12 +827,31 @@ LbConfigParser::Cluster::Finish()
 	if (!validate_protocol_sticky(config.protocol, config.sticky_mode))
 		throw LineParser::Error("The selected sticky mode not available for this protocol");
 
+	if (config.HasOutlierDetection() && config.protocol != LbProtocol::HTTP)
+		throw LineParser::Error("Outlier detection is only available for HTTP");
+
+	if (config.HasPassiveHealth() && config.protocol != LbProtocol::HTTP)
+		throw LineParser::Error("Passive health tracking is only available for HTTP");
+
+#ifdef HAVE_NGHTTP2
+	if (config.http2 && config.protocol != LbProtocol::HTTP)
+		throw LineParser::Error("HTTP/2 requires protocol \"http\"");
+#endif
+
+	if (config.sticky_bounded_load > 0 && !config.sticky_maglev)
+		throw LineParser::Error("sticky_bounded_load requires sticky_maglev");
+
 #ifdef HAVE_AVAHI
 	if (config.HasZeroConf() &&
 	    !ValidateZeroconfSticky(config.sticky_mode))
 		throw LineParser::Error("The selected sticky mode not compatible with Zeroconf");
 #endif
 
+#ifdef HAVE_AVAHI
+	if (config.sticky_maglev && config.sticky_cache)
+		throw LineParser::Error("Cannot use both sticky_maglev and sticky_cache");
+#endif
+
 	if (config.members.size() == 1)
 		/* with only one member, a sticky setting doesn't make
 		   sense */
@@ -828,9 +935,13 @@ ParseCondition(FileLineParser &line)
 	if (string == nullptr)
 		throw LineParser::Error("Regular expression expected");
 
-	if (re)
+	if (re) {
+		if (auto prefix = RegexToPrefix(string))
+			return {std::move(a), negate,
+				LbConditionConfig::Prefix{std::move(*prefix)}};
+
 		return {std::move(a), negate, UniqueRegex(string, false, false)};
-	else
+	} else
 		return {std::move(a), negate, string};
 }
 
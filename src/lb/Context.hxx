@@ -38,6 +38,7 @@ class FilteredSocketStock;
 class FilteredSocketBalancer;
 class LbMonitorManager;
 class MyAvahiClient;
+namespace NgHttp2 { class Stock; }
 
 struct LbContext {
 	FailureManager &failure_manager;
@@ -45,6 +46,9 @@ struct LbContext {
 	FilteredSocketStock &fs_stock;
 	FilteredSocketBalancer &fs_balancer;
 	LbMonitorManager &monitors;
+#ifdef HAVE_NGHTTP2
+	NgHttp2::Stock &nghttp2_stock;
+#endif
 #ifdef HAVE_AVAHI
 	MyAvahiClient &avahi_client;
 #endif
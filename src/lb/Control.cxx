@@ -40,12 +40,14 @@
 #include "net/FailureManager.hxx"
 #include "net/FailureRef.hxx"
 #include "util/Exception.hxx"
+#include "util/StringView.hxx"
 #include "util/WritableBuffer.hxx"
 
 #ifdef HAVE_LIBSYSTEMD
 #include <systemd/sd-journal.h>
 #endif
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -195,6 +197,9 @@ failure_status_to_string(FailureStatus status)
 	case FailureStatus::FADE:
 		return "fade";
 
+	case FailureStatus::OUTLIER:
+		return "outlier";
+
 	case FailureStatus::PROTOCOL:
 	case FailureStatus::CONNECT:
 	case FailureStatus::MONITOR:
@@ -208,15 +213,13 @@ static void
 node_status_response(ControlServer *server,
 		     struct pool &pool,
 		     SocketAddress address,
-		     StringView payload, const char *status)
+		     StringView payload, StringView status)
 {
-	size_t status_length = strlen(status);
-
-	size_t response_length = payload.size + 1 + status_length;
+	size_t response_length = payload.size + 1 + status.size;
 	char *response = PoolAlloc<char>(pool, response_length);
 	memcpy(response, payload.data, payload.size);
 	response[payload.size] = 0;
-	memcpy(response + payload.size + 1, status, status_length);
+	memcpy(response + payload.size + 1, status.data, status.size);
 
 	server->Reply(address,
 		      ControlCommand::NODE_STATUS,
@@ -266,12 +269,25 @@ try {
 
 	const auto with_port = node->address.WithPort(port);
 
-	auto status = instance.failure_manager.Get(GetEventLoop().SteadyNow(),
-						   with_port);
-	const char *s = failure_status_to_string(status);
+	const auto *failure = instance.failure_manager.Find(with_port);
+	const char *s = failure_status_to_string(failure != nullptr
+						 ? failure->GetStatus(GetEventLoop().SteadyNow())
+						 : FailureStatus::OK);
+
+	/* append the number of requests in flight, the average
+	   latency [ms] and the average error rate [percent],
+	   separated by null bytes */
+	char buffer[128];
+	int length = failure != nullptr
+		? snprintf(buffer, sizeof(buffer), "%s%c%u%c%u%c%u",
+			   s, 0, failure->GetOutstanding(),
+			   0, unsigned(failure->GetScore().GetLatency().count() * 1000),
+			   0, unsigned(failure->GetScore().GetErrorRate() * 100))
+		: snprintf(buffer, sizeof(buffer), "%s%c0%c0%c0",
+			   s, 0, 0, 0);
 
 	node_status_response(&control_server, tpool, address,
-			     payload, s);
+			     payload, {buffer, size_t(length)});
 } catch (...) {
 	logger(3, std::current_exception());
 }
@@ -349,6 +365,7 @@ LbControl::OnControlPacket(ControlServer &control_server,
 	case ControlCommand::FLUSH_FILTER_CACHE:
 	case ControlCommand::STOPWATCH_PIPE:
 	case ControlCommand::DISCARD_SESSION:
+	case ControlCommand::CHILD_MIN_IDLE:
 		/* not applicable */
 		break;
 	}
@@ -48,6 +48,7 @@
 #include "fs/Handler.hxx"
 #include "http/ResponseHandler.hxx"
 #include "http/Headers.hxx"
+#include "http/Status.h"
 #include "strmap.hxx"
 #include "pool/pool.hxx"
 #include "net/IPv4Address.hxx"
@@ -62,11 +63,20 @@
 #include "AllocatorPtr.hxx"
 #include "stopwatch.hxx"
 
+#ifdef HAVE_NGHTTP2
+#include "OutstandingIstream.hxx"
+#include "nghttp2/Client.hxx"
+#endif
+
 static constexpr Event::Duration LB_HTTP_CONNECT_TIMEOUT =
 	std::chrono::seconds(20);
 
 class LbRequest final
-	: LeakDetector, Cancellable, FilteredSocketBalancerHandler, HttpResponseHandler {
+	: LeakDetector, Cancellable, FilteredSocketBalancerHandler,
+#ifdef HAVE_NGHTTP2
+	  LbHttp2ConnectHandler,
+#endif
+	  HttpResponseHandler {
 
 	struct pool &pool;
 
@@ -85,6 +95,19 @@ class LbRequest final
 
 	FailurePtr failure;
 
+	/**
+	 * Does this object own an "outstanding" reference on #failure?
+	 * This is only used for HTTP/2 streams; HTTP/1.1 connections
+	 * are counted by the balancer until the #Lease is released.
+	 */
+	bool outstanding = false;
+
+	/**
+	 * The time when the request was sent to the member.  Used to
+	 * calculate the latency for LbCluster::OnMemberResponse().
+	 */
+	std::chrono::steady_clock::time_point send_time;
+
 	unsigned new_cookie = 0;
 
 public:
@@ -98,6 +121,11 @@ public:
 		_cancel_ptr = *this;
 	}
 
+	~LbRequest() noexcept {
+		if (outstanding)
+			failure->RemoveOutstanding();
+	}
+
 	EventLoop &GetEventLoop() const noexcept {
 		return connection.instance.event_loop;
 	}
@@ -133,6 +161,20 @@ private:
 
 	SocketAddress MakeBindAddress() const noexcept;
 
+	/**
+	 * Add the forwarding headers (e.g. "X-Forwarded-For" and the
+	 * client certificate) to the request headers.
+	 *
+	 * @return the request headers
+	 */
+	StringMap &ForwardRequestHeaders() noexcept;
+
+	void UpdateScore(bool error, bool server_failure) noexcept {
+		const auto now = GetEventLoop().SteadyNow();
+		cluster.OnMemberResponse(*failure, now, now - send_time,
+					 error, server_failure);
+	}
+
 	/* virtual methods from class Cancellable */
 	void Cancel() noexcept override {
 		cancel_ptr.Cancel();
@@ -146,6 +188,15 @@ private:
 				   ReferencedFailureInfo &failure) noexcept override;
 	void OnFilteredSocketError(std::exception_ptr ep) noexcept override;
 
+#ifdef HAVE_NGHTTP2
+	/* virtual methods from class LbHttp2ConnectHandler */
+	void OnHttp2Ready(NgHttp2::ClientConnection &connection,
+			  ReferencedFailureInfo &failure) noexcept override;
+	void OnHttp2Error(std::exception_ptr ep) noexcept override {
+		OnFilteredSocketError(std::move(ep));
+	}
+#endif
+
 	/* virtual methods from class HttpResponseHandler */
 	void OnHttpResponse(http_status_t status, StringMap &&headers,
 			    UnusedIstreamPtr body) noexcept override;
@@ -228,6 +279,8 @@ LbRequest::GetStickyHash() noexcept
 	switch (cluster_config.sticky_mode) {
 	case StickyMode::NONE:
 	case StickyMode::FAILOVER:
+	case StickyMode::LEAST_OUTSTANDING:
+	case StickyMode::POWER_OF_TWO:
 		/* these modes require no preparation; they are handled
 		   completely by balancer_get() */
 		return 0;
@@ -274,6 +327,9 @@ LbRequest::OnHttpResponse(http_status_t status, StringMap &&_headers,
 {
 	failure->UnsetProtocol();
 
+	const bool server_error = http_status_is_server_error(status);
+	UpdateScore(server_error, server_error);
+
 	SetForwardedTo();
 
 	HttpHeaders headers(std::move(_headers));
@@ -294,6 +350,17 @@ LbRequest::OnHttpResponse(http_status_t status, StringMap &&_headers,
 		headers.Write("set-cookie", buffer);
 	}
 
+#ifdef HAVE_NGHTTP2
+	if (outstanding && response_body) {
+		/* keep the HTTP/2 stream "outstanding" until the
+		   response body ends */
+		response_body = istream_outstanding_new(pool,
+							std::move(response_body),
+							*failure);
+		outstanding = false;
+	}
+#endif
+
 	auto &_request = request;
 	Destroy();
 
@@ -304,10 +371,13 @@ LbRequest::OnHttpResponse(http_status_t status, StringMap &&_headers,
 void
 LbRequest::OnHttpError(std::exception_ptr ep) noexcept
 {
-	if (IsHttpClientServerFailure(ep))
+	const bool server_failure = IsHttpClientServerFailure(ep);
+	if (server_failure)
 		failure->SetProtocol(GetEventLoop().SteadyNow(),
 				     std::chrono::seconds(20));
 
+	UpdateScore(true, server_failure);
+
 	SetForwardedTo();
 
 	connection.logger(2, ep);
@@ -322,14 +392,9 @@ LbRequest::OnHttpError(std::exception_ptr ep) noexcept
 		_connection.SendError(_request, ep);
 }
 
-void
-LbRequest::OnFilteredSocketReady(Lease &lease,
-				 FilteredSocket &socket,
-				 SocketAddress, const char *name,
-				 ReferencedFailureInfo &_failure) noexcept
+StringMap &
+LbRequest::ForwardRequestHeaders() noexcept
 {
-	failure = _failure;
-
 	const char *peer_subject = connection.ssl_filter != nullptr
 		? ssl_filter_get_peer_subject(*connection.ssl_filter)
 		: nullptr;
@@ -344,6 +409,19 @@ LbRequest::OnFilteredSocketReady(Lease &lease,
 				   connection.IsEncrypted(),
 				   peer_subject, peer_issuer_subject,
 				   cluster_config.mangle_via);
+	return headers;
+}
+
+void
+LbRequest::OnFilteredSocketReady(Lease &lease,
+				 FilteredSocket &socket,
+				 SocketAddress, const char *name,
+				 ReferencedFailureInfo &_failure) noexcept
+{
+	failure = _failure;
+	send_time = GetEventLoop().SteadyNow();
+
+	auto &headers = ForwardRequestHeaders();
 
 	http_client_request(pool, nullptr,
 			    socket, lease, name,
@@ -353,6 +431,35 @@ LbRequest::OnFilteredSocketReady(Lease &lease,
 			    *this, cancel_ptr);
 }
 
+#ifdef HAVE_NGHTTP2
+
+void
+LbRequest::OnHttp2Ready(NgHttp2::ClientConnection &_connection,
+			ReferencedFailureInfo &_failure) noexcept
+{
+	failure = _failure;
+	outstanding = true;
+	send_time = GetEventLoop().SteadyNow();
+
+	auto &headers = ForwardRequestHeaders();
+
+	/* connection-specific headers are forbidden in HTTP/2 (RFC
+	   7540 8.1.2.2) */
+	headers.Remove("connection");
+	headers.Remove("keep-alive");
+	headers.Remove("proxy-connection");
+	headers.Remove("transfer-encoding");
+	headers.Remove("upgrade");
+
+	_connection.SendRequest(pool, nullptr,
+				request.method, request.uri,
+				std::move(headers),
+				std::move(body),
+				*this, cancel_ptr);
+}
+
+#endif
+
 void
 LbRequest::OnFilteredSocketError(std::exception_ptr ep) noexcept
 {
@@ -402,6 +509,16 @@ LbRequest::MakeBindAddress() const noexcept
 inline void
 LbRequest::Start() noexcept
 {
+#ifdef HAVE_NGHTTP2
+	if (cluster_config.http2) {
+		cluster.ConnectHttp2(pool, MakeBindAddress(),
+				     GetStickyHash(),
+				     LB_HTTP_CONNECT_TIMEOUT,
+				     *this, cancel_ptr);
+		return;
+	}
+#endif
+
 	cluster.ConnectHttp(pool, nullptr,
 			    MakeBindAddress(),
 			    GetStickyHash(),
@@ -45,6 +45,8 @@
 #include <map>
 #include <variant>
 
+#include <string.h>
+
 struct LbAttributeReference {
 	enum class Type {
 		METHOD,
@@ -61,6 +63,11 @@ struct LbAttributeReference {
 	LbAttributeReference(Type _type, N &&_name) noexcept
 		:type(_type), name(std::forward<N>(_name)) {}
 
+	[[gnu::pure]]
+	bool operator==(const LbAttributeReference &other) const noexcept {
+		return type == other.type && name == other.name;
+	}
+
 	template<typename R>
 	[[gnu::pure]]
 	const char *GetRequestAttribute(const R &request) const noexcept {
@@ -126,11 +133,20 @@ struct LbGotoConfig {
 };
 
 struct LbConditionConfig {
+	/**
+	 * A regular expression which matches only a literal prefix
+	 * (e.g. "^/foo/"); it is evaluated with a string comparison
+	 * instead of PCRE.
+	 */
+	struct Prefix {
+		std::string value;
+	};
+
 	LbAttributeReference attribute_reference;
 
 	bool negate;
 
-	std::variant<std::string, UniqueRegex> value;
+	std::variant<std::string, UniqueRegex, Prefix> value;
 
 	LbConditionConfig(LbAttributeReference &&a, bool _negate,
 			  const char *_string) noexcept
@@ -142,6 +158,11 @@ struct LbConditionConfig {
 		:attribute_reference(std::move(a)),
 		 negate(_negate), value(std::move(_regex)) {}
 
+	LbConditionConfig(LbAttributeReference &&a, bool _negate,
+			  Prefix &&_prefix) noexcept
+		:attribute_reference(std::move(a)),
+		 negate(_negate), value(std::move(_prefix)) {}
+
 	LbConditionConfig(LbConditionConfig &&other) = default;
 
 	LbConditionConfig(const LbConditionConfig &) = delete;
@@ -173,6 +194,10 @@ private:
 		bool operator()(const UniqueRegex &v) const noexcept {
 			return v.Match(s);
 		}
+
+		bool operator()(const Prefix &v) const noexcept {
+			return strncmp(s, v.value.data(), v.value.size()) == 0;
+		}
 	};
 };
 
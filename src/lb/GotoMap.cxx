@@ -63,6 +63,9 @@ LbGotoMap::FlushCaches()
 {
 	for (auto &i : translation_handlers)
 		i.second.FlushCache();
+
+	for (auto &i : lua_handlers)
+		i.second.FlushCache();
 }
 
 void
@@ -0,0 +1,345 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "HttpMonitor.hxx"
+#include "HttpMonitorParser.hxx"
+#include "MonitorHandler.hxx"
+#include "MonitorClass.hxx"
+#include "MonitorConfig.hxx"
+#include "system/Error.hxx"
+#include "net/AllocatedSocketAddress.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "net/SocketAddress.hxx"
+#include "net/ToString.hxx"
+#include "event/net/ConnectSocket.hxx"
+#include "event/SocketEvent.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "util/Cancellable.hxx"
+
+#include <stdexcept>
+#include <string>
+
+#include <assert.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+/**
+ * Stop reading after this many bytes; the check is then evaluated
+ * with the part of the response body received so far.
+ */
+static constexpr size_t HTTP_MONITOR_MAX_RESPONSE = 64 * 1024;
+
+class HttpMonitor final : ConnectSocketHandler, Cancellable {
+	const LbMonitorConfig &config;
+
+	const AllocatedSocketAddress address;
+
+	ConnectSocket connect;
+
+	UniqueSocketDescriptor fd;
+
+	SocketEvent event;
+	CoarseTimerEvent timeout_event;
+
+	LbMonitorHandler &handler;
+
+	std::string input;
+
+	/**
+	 * Was #fd obtained from LbMonitorHandler::GetIdleSocket()?  If
+	 * the peer has closed it meanwhile, a new connection is
+	 * established.
+	 */
+	bool reused = false;
+
+public:
+	HttpMonitor(EventLoop &event_loop,
+		    const LbMonitorConfig &_config,
+		    SocketAddress _address,
+		    LbMonitorHandler &_handler) noexcept
+		:config(_config), address(_address),
+		 connect(event_loop, *this),
+		 event(event_loop, BIND_THIS_METHOD(EventCallback)),
+		 timeout_event(event_loop, BIND_THIS_METHOD(OnTimeout)),
+		 handler(_handler) {}
+
+	HttpMonitor(const HttpMonitor &other) = delete;
+
+	void Start(CancellablePointer &cancel_ptr) noexcept {
+		cancel_ptr = *this;
+
+		if (auto *idle = handler.GetIdleSocket();
+		    idle != nullptr && idle->IsDefined()) {
+			reused = true;
+			SendRequest(std::move(*idle));
+		} else
+			Connect();
+	}
+
+private:
+	void Connect() noexcept {
+		const Event::Duration zero{};
+		const auto timeout = config.connect_timeout > zero
+			? config.connect_timeout
+			: (config.timeout > zero
+			   ? config.timeout
+			   : std::chrono::seconds(30));
+
+		connect.Connect(address, timeout);
+	}
+
+	/**
+	 * The reused idle connection has failed before a response was
+	 * received; try again with a new connection.
+	 */
+	void Reconnect() noexcept {
+		assert(reused);
+
+		Close();
+		input.clear();
+		reused = false;
+		Connect();
+	}
+
+	void Close() noexcept {
+		event.ReleaseSocket();
+		timeout_event.Cancel();
+		fd.Close();
+	}
+
+	void Abort(std::exception_ptr ep) noexcept {
+		Close();
+		handler.Error(ep);
+		delete this;
+	}
+
+	void SendRequest(UniqueSocketDescriptor new_fd) noexcept;
+
+	/**
+	 * Attempt to parse the response received so far, and finish the
+	 * check (destroying this object) if it is complete.
+	 */
+	void CheckResponse(bool eof) noexcept;
+
+	void Finish(HttpMonitorResponse &&response) noexcept;
+
+	void EventCallback(unsigned events) noexcept;
+	void OnTimeout() noexcept;
+
+	/* virtual methods from class Cancellable */
+	void Cancel() noexcept override {
+		Close();
+		delete this;
+	}
+
+	/* virtual methods from class ConnectSocketHandler */
+	void OnSocketConnectSuccess(UniqueSocketDescriptor new_fd) noexcept override {
+		SendRequest(std::move(new_fd));
+	}
+
+	void OnSocketConnectTimeout() noexcept override {
+		handler.Timeout();
+		delete this;
+	}
+
+	void OnSocketConnectError(std::exception_ptr ep) noexcept override {
+		handler.Error(ep);
+		delete this;
+	}
+};
+
+void
+HttpMonitor::SendRequest(UniqueSocketDescriptor new_fd) noexcept
+{
+	fd = std::move(new_fd);
+
+	std::string host = config.http_host;
+	if (host.empty()) {
+		char buffer[256];
+		host = ToString(buffer, sizeof(buffer), address, "localhost");
+	}
+
+	std::string request = config.http_method;
+	request.push_back(' ');
+	request += config.http_uri;
+	request += " HTTP/1.1\r\nHost: ";
+	request += host;
+	request += "\r\nUser-Agent: beng-lb\r\nAccept: */*\r\n\r\n";
+
+	ssize_t nbytes = send(fd.Get(), request.data(), request.length(),
+			      MSG_DONTWAIT|MSG_NOSIGNAL);
+	if (nbytes < 0) {
+		if (reused) {
+			Reconnect();
+			return;
+		}
+
+		Abort(std::make_exception_ptr(MakeErrno("Failed to send")));
+		return;
+	}
+
+	if (size_t(nbytes) < request.length()) {
+		/* the request is small; this should never happen */
+		Abort(std::make_exception_ptr(std::runtime_error("Short send")));
+		return;
+	}
+
+	const auto response_timeout = config.timeout > Event::Duration{}
+		? config.timeout
+		: std::chrono::seconds(10);
+
+	event.Open(fd);
+	event.ScheduleRead();
+	timeout_event.Schedule(response_timeout);
+}
+
+void
+HttpMonitor::CheckResponse(bool eof) noexcept
+{
+	HttpMonitorResponse response;
+
+	try {
+		if (!HttpMonitorParseResponse(input, config.http_method == "HEAD", eof,
+				   response))
+			return;
+	} catch (...) {
+		Abort(std::current_exception());
+		return;
+	}
+
+	Finish(std::move(response));
+}
+
+void
+HttpMonitor::Finish(HttpMonitorResponse &&response) noexcept
+{
+	event.ReleaseSocket();
+	timeout_event.Cancel();
+
+	if (auto *idle = handler.GetIdleSocket();
+	    idle != nullptr && response.keep_alive)
+		*idle = std::move(fd);
+	else
+		fd.Close();
+
+	const bool status_ok = config.expect_status > 0
+		? response.status == config.expect_status
+		: response.status >= 200 && response.status < 400;
+
+	auto &_handler = handler;
+	const auto &_config = config;
+	delete this;
+
+	if (!_config.fade_expect.empty() &&
+	    response.body.find(_config.fade_expect) != std::string::npos)
+		_handler.Fade();
+	else if (!status_ok)
+		_handler.Error(std::make_exception_ptr(std::runtime_error("Unexpected HTTP status " +
+									  std::to_string(response.status))));
+	else if (!_config.expect.empty() &&
+		 response.body.find(_config.expect) == std::string::npos)
+		_handler.Error(std::make_exception_ptr(std::runtime_error("Expectation failed")));
+	else
+		_handler.Success();
+}
+
+inline void
+HttpMonitor::EventCallback(unsigned) noexcept
+{
+	while (true) {
+		char buffer[4096];
+		ssize_t nbytes = recv(fd.Get(), buffer, sizeof(buffer),
+				      MSG_DONTWAIT);
+		if (nbytes < 0) {
+			if (errno == EAGAIN)
+				break;
+
+			if (reused && input.empty()) {
+				Reconnect();
+				return;
+			}
+
+			Abort(std::make_exception_ptr(MakeErrno("Failed to receive")));
+			return;
+		}
+
+		if (nbytes == 0) {
+			if (reused && input.empty()) {
+				Reconnect();
+				return;
+			}
+
+			CheckResponse(true);
+			return;
+		}
+
+		input.append(buffer, nbytes);
+
+		if (input.size() >= HTTP_MONITOR_MAX_RESPONSE) {
+			CheckResponse(true);
+			return;
+		}
+	}
+
+	CheckResponse(false);
+}
+
+inline void
+HttpMonitor::OnTimeout() noexcept
+{
+	Close();
+	handler.Timeout();
+
+	delete this;
+}
+
+/*
+ * lb_monitor_class
+ *
+ */
+
+static void
+http_monitor_run(EventLoop &event_loop,
+		 const LbMonitorConfig &config,
+		 SocketAddress address,
+		 LbMonitorHandler &handler,
+		 CancellablePointer &cancel_ptr)
+{
+	HttpMonitor *http = new HttpMonitor(event_loop, config, address,
+					    handler);
+
+	http->Start(cancel_ptr);
+}
+
+const LbMonitorClass http_monitor_class = {
+	http_monitor_run,
+};
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "HttpMonitorParser.hxx"
+
+#include <charconv>
+#include <stdexcept>
+
+#include <strings.h>
+
+[[gnu::pure]]
+static bool
+EqualsIgnoreCase(std::string_view a, std::string_view b) noexcept
+{
+	return a.size() == b.size() &&
+		strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+[[gnu::pure]]
+static std::string_view
+Strip(std::string_view s) noexcept
+{
+	while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+		s.remove_prefix(1);
+	while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+		s.remove_suffix(1);
+	return s;
+}
+
+bool
+HttpMonitorDecodeChunked(std::string_view src, std::string &dest,
+			 std::size_t &consumed)
+{
+	dest.clear();
+
+	size_t pos = 0;
+	while (true) {
+		auto eol = src.find("\r\n", pos);
+		if (eol == src.npos)
+			return false;
+
+		size_t size;
+		auto [end, ec] = std::from_chars(src.data() + pos,
+						 src.data() + eol, size, 16);
+		if (ec != std::errc{} || end == src.data() + pos ||
+		    (end != src.data() + eol && *end != ';'))
+			throw std::runtime_error("Malformed chunk header");
+
+		pos = eol + 2;
+
+		if (size == 0) {
+			/* skip the trailer until the empty line */
+			while (true) {
+				eol = src.find("\r\n", pos);
+				if (eol == src.npos)
+					return false;
+
+				if (eol == pos) {
+					consumed = pos + 2;
+					return true;
+				}
+
+				pos = eol + 2;
+			}
+		}
+
+		/* careful: "size" may be huge */
+		if (size > src.size() - pos || src.size() - pos - size < 2)
+			return false;
+
+		dest.append(src.substr(pos, size));
+		pos += size;
+
+		if (src.substr(pos, 2) != "\r\n")
+			throw std::runtime_error("Malformed chunk");
+
+		pos += 2;
+	}
+}
+
+bool
+HttpMonitorParseResponse(std::string_view src, bool head, bool eof,
+			 HttpMonitorResponse &response)
+{
+	const auto header_end = src.find("\r\n\r\n");
+	if (header_end == src.npos) {
+		if (eof)
+			throw std::runtime_error("Incomplete response header");
+		return false;
+	}
+
+	std::string_view header = src.substr(0, header_end + 2);
+	std::string_view body = src.substr(header_end + 4);
+
+	auto eol = header.find("\r\n");
+	std::string_view line = header.substr(0, eol);
+	header.remove_prefix(eol + 2);
+
+	if (line.size() < 12 || line.substr(0, 7) != "HTTP/1." ||
+	    line[8] != ' ' || (line.size() > 12 && line[12] != ' '))
+		throw std::runtime_error("Malformed HTTP status line");
+
+	const bool http_1_1 = line[7] == '1';
+
+	auto [end, ec] = std::from_chars(line.data() + 9, line.data() + 12,
+					 response.status);
+	if (ec != std::errc{} || end != line.data() + 12 ||
+	    response.status < 100 || response.status > 599)
+		throw std::runtime_error("Malformed HTTP status");
+
+	bool chunked = false, have_length = false, close = !http_1_1;
+	size_t content_length = 0;
+
+	while (!header.empty()) {
+		eol = header.find("\r\n");
+		line = header.substr(0, eol);
+		header.remove_prefix(eol + 2);
+
+		const auto colon = line.find(':');
+		if (colon == line.npos)
+			continue;
+
+		const auto name = Strip(line.substr(0, colon));
+		const auto value = Strip(line.substr(colon + 1));
+
+		if (EqualsIgnoreCase(name, "content-length")) {
+			auto [end2, ec2] = std::from_chars(value.data(),
+							   value.data() + value.size(),
+							   content_length);
+			if (ec2 != std::errc{} ||
+			    end2 != value.data() + value.size())
+				throw std::runtime_error("Malformed Content-Length");
+
+			have_length = true;
+		} else if (EqualsIgnoreCase(name, "transfer-encoding")) {
+			chunked = EqualsIgnoreCase(value, "chunked");
+		} else if (EqualsIgnoreCase(name, "connection")) {
+			if (EqualsIgnoreCase(value, "close"))
+				close = true;
+			else if (EqualsIgnoreCase(value, "keep-alive"))
+				close = false;
+		}
+	}
+
+	if (head || response.status < 200 ||
+	    response.status == 204 || response.status == 304) {
+		/* no response body */
+		response.body.clear();
+		response.keep_alive = !close && body.empty();
+		return true;
+	}
+
+	if (chunked) {
+		size_t consumed;
+		if (HttpMonitorDecodeChunked(body, response.body, consumed)) {
+			response.keep_alive = !close &&
+				consumed == body.size();
+			return true;
+		}
+	} else if (have_length) {
+		if (body.size() >= content_length) {
+			response.body = body.substr(0, content_length);
+			response.keep_alive = !close &&
+				body.size() == content_length;
+			return true;
+		}
+	} else if (eof) {
+		/* the body ends with the connection */
+		response.body = body;
+		response.keep_alive = false;
+		return true;
+	}
+
+	if (eof) {
+		/* truncated response (or HTTP_MONITOR_MAX_RESPONSE
+		   exceeded): evaluate what we have */
+		if (!chunked)
+			response.body = body;
+		response.keep_alive = false;
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * A parsed response for #HttpMonitor.
+ */
+struct HttpMonitorResponse {
+	unsigned status;
+
+	/**
+	 * May the connection be reused for the next check?  This
+	 * requires a persistent HTTP/1.1 connection and a response
+	 * with a known length.
+	 */
+	bool keep_alive;
+
+	std::string body;
+};
+
+/**
+ * Decode a "chunked" response body.
+ *
+ * Throws on protocol error.
+ *
+ * @param consumed receives the number of raw bytes which made up the
+ * body (including the terminating chunk and the trailer)
+ * @return true if the terminating chunk has been received
+ */
+bool
+HttpMonitorDecodeChunked(std::string_view src, std::string &dest,
+			 std::size_t &consumed);
+
+/**
+ * Parse a (possibly incomplete) HTTP/1.x response.
+ *
+ * Throws on protocol error.
+ *
+ * @param head true if the request method was HEAD, i.e. there is no
+ * response body
+ * @param eof true if the peer has closed the connection or if no more
+ * data will be read
+ * @return true if the response is complete
+ */
+bool
+HttpMonitorParseResponse(std::string_view src, bool head, bool eof,
+			 HttpMonitorResponse &response);
@@ -44,6 +44,10 @@
 #include "pipe_stock.hxx"
 #include "access_log/Glue.hxx"
 
+#ifdef HAVE_NGHTTP2
+#include "nghttp2/Stock.hxx"
+#endif
+
 #include "lb_features.h"
 #ifdef ENABLE_CERTDB
 #include "ssl/Cache.hxx"
@@ -64,6 +68,9 @@ LbInstance::LbInstance(const LbCmdLine &cmdline,
 	 fs_stock(new FilteredSocketStock(event_loop,
 					  cmdline.tcp_stock_limit)),
 	 fs_balancer(new FilteredSocketBalancer(*fs_stock, failure_manager)),
+#ifdef HAVE_NGHTTP2
+	 nghttp2_stock(new NgHttp2::Stock()),
+#endif
 	 pipe_stock(new PipeStock(event_loop)),
 	 monitors(event_loop, failure_manager),
 #ifdef HAVE_AVAHI
@@ -73,12 +80,16 @@ LbInstance::LbInstance(const LbCmdLine &cmdline,
 		  {failure_manager,
 		   *balancer, *fs_stock, *fs_balancer,
 		   monitors,
+#ifdef HAVE_NGHTTP2
+		   *nghttp2_stock,
+#endif
 #ifdef HAVE_AVAHI
 		   avahi_client,
 #endif
 		  },
 		  event_loop)
 {
+	fs_stock->SetMinIdle(cmdline.tcp_stock_min_idle);
 }
 
 LbInstance::~LbInstance() noexcept
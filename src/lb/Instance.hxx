@@ -57,6 +57,7 @@ class PipeStock;
 class BalancerMap;
 class FilteredSocketStock;
 class FilteredSocketBalancer;
+namespace NgHttp2 { class Stock; }
 struct LbCmdLine;
 struct LbConfig;
 struct LbCertDatabaseConfig;
@@ -90,6 +91,14 @@ struct LbInstance final : PInstance {
 	std::unique_ptr<FilteredSocketStock> fs_stock;
 	std::unique_ptr<FilteredSocketBalancer> fs_balancer;
 
+#ifdef HAVE_NGHTTP2
+	/**
+	 * HTTP/2 connections to cluster members with
+	 * LbClusterConfig::http2.
+	 */
+	std::unique_ptr<NgHttp2::Stock> nghttp2_stock;
+#endif
+
 	std::unique_ptr<PipeStock> pipe_stock;
 
 	LbMonitorManager monitors;
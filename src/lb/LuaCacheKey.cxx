@@ -0,0 +1,137 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "LuaCacheKey.hxx"
+#include "http/IncomingRequest.hxx"
+#include "util/CharUtil.hxx"
+#include "util/RuntimeError.hxx"
+#include "util/ScopeExit.hxx"
+#include "util/StringCompare.hxx"
+
+extern "C" {
+#include <lua.h>
+}
+
+#include <algorithm>
+
+#include <string.h>
+#include <strings.h>
+
+LbLuaCacheKey
+LbLuaCacheKey::Parse(lua_State *L, const char *path)
+{
+	if (!lua_istable(L, -1))
+		throw FormatRuntimeError("'cache_key' is not a table in %s",
+					 path);
+
+	LbLuaCacheKey key;
+
+	for (int i = 1;; ++i) {
+		lua_rawgeti(L, -1, i);
+		AtScopeExit(L) { lua_pop(L, 1); };
+
+		if (lua_isnil(L, -1))
+			break;
+
+		if (lua_type(L, -1) != LUA_TSTRING)
+			throw FormatRuntimeError("Non-string in 'cache_key' in %s",
+						 path);
+
+		const char *name = lua_tostring(L, -1);
+		if (strcmp(name, "method") == 0)
+			key.method = true;
+		else if (strcmp(name, "uri") == 0)
+			key.uri = true;
+		else if (strcmp(name, "has_body") == 0)
+			key.has_body = true;
+		else if (strcmp(name, "remote_host") == 0)
+			key.remote_host = true;
+		else if (const char *header = StringAfterPrefix(name, "header:")) {
+			/* request header names are stored in lower
+			   case */
+			auto &h = key.headers.emplace_back(header);
+			std::transform(h.begin(), h.end(), h.begin(),
+				       ToLowerASCII);
+		} else
+			throw FormatRuntimeError("Unknown attribute '%s' in 'cache_key' in %s",
+						 name, path);
+	}
+
+	return key;
+}
+
+bool
+LbLuaCacheKey::HasHeader(const char *name) const noexcept
+{
+	for (const auto &i : headers)
+		if (strcasecmp(i.c_str(), name) == 0)
+			return true;
+
+	return false;
+}
+
+static void
+AppendKeyValue(std::string &key, const char *value) noexcept
+{
+	/* distinguish a missing value from an empty one; the null
+	   byte separates values, because they cannot contain one */
+	if (value == nullptr) {
+		key.push_back('\0');
+	} else {
+		key.push_back('\1');
+		key.append(value);
+		key.push_back('\0');
+	}
+}
+
+std::string
+LbLuaCacheKey::Make(const IncomingHttpRequest &request) const
+{
+	std::string key;
+
+	if (method)
+		AppendKeyValue(key, http_method_to_string(request.method));
+
+	if (uri)
+		AppendKeyValue(key, request.uri);
+
+	if (has_body)
+		AppendKeyValue(key, request.HasBody() ? "1" : "0");
+
+	if (remote_host)
+		AppendKeyValue(key, request.remote_host);
+
+	for (const auto &i : headers)
+		AppendKeyValue(key, request.headers.Get(i.c_str()));
+
+	return key;
+}
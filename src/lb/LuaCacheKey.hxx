@@ -0,0 +1,71 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct lua_State;
+struct IncomingHttpRequest;
+
+/**
+ * The request attributes a Lua handler function depends on, as
+ * declared by the global "cache_key" table in the Lua script.
+ */
+struct LbLuaCacheKey {
+	bool method = false, uri = false;
+	bool has_body = false, remote_host = false;
+
+	/**
+	 * Names of declared request headers (lower case).
+	 */
+	std::vector<std::string> headers;
+
+	/**
+	 * Parse the "cache_key" table on the top of the Lua stack.
+	 *
+	 * Throws on error.
+	 *
+	 * @param path the path of the Lua script (for error messages)
+	 */
+	static LbLuaCacheKey Parse(lua_State *L, const char *path);
+
+	/**
+	 * Was this header declared?  The name is compared
+	 * case-insensitively.
+	 */
+	[[gnu::pure]]
+	bool HasHeader(const char *name) const noexcept;
+
+	std::string Make(const IncomingHttpRequest &request) const;
+};
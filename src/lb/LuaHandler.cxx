@@ -31,6 +31,7 @@
  */
 
 #include "LuaHandler.hxx"
+#include "LuaCacheKey.hxx"
 #include "LuaGoto.hxx"
 #include "GotoConfig.hxx"
 #include "Goto.hxx"
@@ -54,11 +55,20 @@ extern "C" {
 struct LbLuaRequestData {
 	IncomingHttpRequest &request;
 	HttpResponseHandler &handler;
+
+	/**
+	 * If not nullptr, then the handler function may only access
+	 * the request attributes declared here.
+	 */
+	const LbLuaCacheKey *const cache_key;
+
 	bool stale = false;
 
 	explicit LbLuaRequestData(IncomingHttpRequest &_request,
-				  HttpResponseHandler &_handler)
-		:request(_request), handler(_handler) {}
+				  HttpResponseHandler &_handler,
+				  const LbLuaCacheKey *_cache_key)
+		:request(_request), handler(_handler),
+		 cache_key(_cache_key) {}
 };
 
 static constexpr char lua_request_class[] = "lb.http_request";
@@ -66,9 +76,10 @@ typedef Lua::Class<LbLuaRequestData, lua_request_class> LbLuaRequest;
 
 static LbLuaRequestData *
 NewLuaRequest(lua_State *L, IncomingHttpRequest &request,
-	      HttpResponseHandler &handler)
+	      HttpResponseHandler &handler,
+	      const LbLuaCacheKey *cache_key)
 {
-	return LbLuaRequest::New(L, request, handler);
+	return LbLuaRequest::New(L, request, handler, cache_key);
 }
 
 static LbLuaRequestData &
@@ -94,6 +105,9 @@ GetHeader(lua_State *L)
 
 	const char *name = lua_tostring(L, 2);
 
+	if (data.cache_key != nullptr && !data.cache_key->HasHeader(name))
+		return luaL_error(L, "Header not declared in cache_key");
+
 	const char *value = data.request.headers.Get(name);
 	if (value != nullptr) {
 		Lua::Push(L, value);
@@ -184,16 +198,30 @@ LbLuaRequestIndex(lua_State *L)
 		}
 	}
 
+	const auto *cache_key = data.cache_key;
+
 	if (strcmp(name, "uri") == 0) {
+		if (cache_key != nullptr && !cache_key->uri)
+			return luaL_error(L, "Attribute not declared in cache_key");
+
 		Lua::Push(L, data.request.uri);
 		return 1;
 	} else if (strcmp(name, "method") == 0) {
+		if (cache_key != nullptr && !cache_key->method)
+			return luaL_error(L, "Attribute not declared in cache_key");
+
 		Lua::Push(L, http_method_to_string(data.request.method));
 		return 1;
 	} else if (strcmp(name, "has_body") == 0) {
+		if (cache_key != nullptr && !cache_key->has_body)
+			return luaL_error(L, "Attribute not declared in cache_key");
+
 		Lua::Push(L, data.request.HasBody());
 		return 1;
 	} else if (strcmp(name, "remote_host") == 0) {
+		if (cache_key != nullptr && !cache_key->remote_host)
+			return luaL_error(L, "Attribute not declared in cache_key");
+
 		Lua::Push(L, data.request.remote_host);
 		return 1;
 	}
@@ -233,6 +261,14 @@ LbLuaHandler::LbLuaHandler(LuaInitHook &init_hook,
 
 	function.Set(Lua::StackIndex(-2));
 
+	lua_getglobal(L, "cache_key");
+	if (!lua_isnil(L, -1)) {
+		AtScopeExit(L) { lua_pop(L, 1); };
+		cache_key = LbLuaCacheKey::Parse(L, config.path.c_str());
+		cache = std::make_unique<Cache>();
+	} else
+		lua_pop(L, 1);
+
 	LbLuaRequest::Register(L);
 	Lua::SetTable(L, -3, "__index", LbLuaRequestIndex);
 	lua_pop(L, 1);
@@ -246,11 +282,24 @@ const LbGoto *
 LbLuaHandler::HandleRequest(IncomingHttpRequest &request,
 			    HttpResponseHandler &handler)
 {
+	std::string key;
+	if (cache) {
+		key = cache_key.Make(request);
+
+		const auto *g = cache->Get(key);
+		if (g != nullptr)
+			/* copy to the request pool, because the cache
+			   item may be evicted while the request is
+			   being handled */
+			return NewFromPool<LbGoto>(request.pool, *g);
+	}
+
 	auto *L = state.get();
 	const Lua::ScopeCheckStack check_stack(L);
 
 	function.Push();
-	auto *data = NewLuaRequest(L, request, handler);
+	auto *data = NewLuaRequest(L, request, handler,
+				   cache ? &cache_key : nullptr);
 	AtScopeExit(data) { data->stale = true; };
 
 	if (lua_pcall(L, 1, 1, 0))
@@ -262,8 +311,12 @@ LbLuaHandler::HandleRequest(IncomingHttpRequest &request,
 		return nullptr;
 
 	const auto *g = CheckLuaGoto(L, -1);
-	if (g != nullptr)
+	if (g != nullptr) {
+		if (cache && !data->stale)
+			cache->PutOrReplace(std::move(key), LbGoto(*g));
+
 		return g;
+	}
 
 	if (lua_istable(L, -1)) {
 		lua_getfield(L, -1, "resolve_connect");
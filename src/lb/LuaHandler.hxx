@@ -32,10 +32,15 @@
 
 #pragma once
 
+#include "Goto.hxx"
+#include "LuaCacheKey.hxx"
 #include "lua/State.hxx"
 #include "lua/Value.hxx"
+#include "util/Cache.hxx"
+
+#include <memory>
+#include <string>
 
-struct LbGoto;
 struct LbLuaHandlerConfig;
 struct IncomingHttpRequest;
 class HttpResponseHandler;
@@ -47,6 +52,16 @@ class LbLuaHandler final {
 	Lua::State state;
 	Lua::Value function;
 
+	LbLuaCacheKey cache_key;
+
+	/**
+	 * Memoizes the routing decisions of the handler function.
+	 * This is only allocated if the Lua script declares a
+	 * "cache_key".
+	 */
+	using Cache = ::Cache<std::string, LbGoto, 4096, 1021>;
+	std::unique_ptr<Cache> cache;
+
 public:
 	LbLuaHandler(LuaInitHook &init_hook, const LbLuaHandlerConfig &config);
 	~LbLuaHandler();
@@ -55,6 +70,11 @@ public:
 		return config;
 	}
 
+	void FlushCache() noexcept {
+		if (cache)
+			cache->Clear();
+	}
+
 	const LbGoto *HandleRequest(IncomingHttpRequest &request,
 				    HttpResponseHandler &handler);
 };
@@ -40,6 +40,9 @@
 #include "fs/Balancer.hxx"
 #include "pipe_stock.hxx"
 #include "access_log/Glue.hxx"
+#ifdef HAVE_NGHTTP2
+#include "nghttp2/Stock.hxx"
+#endif
 #include "ssl/Init.hxx"
 #include "pool/pool.hxx"
 #include "thread/Pool.hxx"
@@ -111,6 +114,10 @@ LbInstance::ShutdownCallback() noexcept
 	fs_balancer.reset();
 	fs_stock.reset();
 
+#ifdef HAVE_NGHTTP2
+	nghttp2_stock.reset();
+#endif
+
 	balancer.reset();
 
 	pipe_stock.reset();
@@ -33,6 +33,7 @@
 #pragma once
 
 #include "cluster/StickyHash.hxx"
+#include "cluster/MaglevTable.hxx"
 #include "util/HashRing.hxx"
 
 #include <cstddef>
@@ -55,3 +56,20 @@ BuildMemberHashRing(MemberHashRing<Node> &ring, C &&nodes, F &&f) noexcept
 			   return MemberAddressHash(f(node), replica);
 		   });
 }
+
+/**
+ * @param max_nodes see MaglevTable's MAX_NODES parameter
+ */
+template<typename Node, std::size_t max_nodes = 0xfffe>
+using MemberMaglevTable = MaglevTable<Node, 65537, max_nodes>;
+
+template<typename Node, std::size_t max_nodes, typename C, typename F>
+void
+BuildMemberMaglevTable(MemberMaglevTable<Node, max_nodes> &table,
+		       C &&nodes, F &&f) noexcept
+{
+	table.Build(std::forward<C>(nodes),
+		    [&f](const Node &node, std::size_t seed) noexcept {
+			    return MemberAddressHash(f(node), seed);
+		    });
+}
@@ -55,11 +55,13 @@ struct LbMonitorConfig {
 		PING,
 		CONNECT,
 		TCP_EXPECT,
+		HTTP,
 	} type = Type::NONE;
 
 	/**
 	 * The timeout for establishing a connection.  Only applicable for
-	 * #Type::TCP_EXPECT.  0 means no special setting present.
+	 * #Type::TCP_EXPECT and #Type::HTTP.  0 means no special setting
+	 * present.
 	 */
 	Event::Duration connect_timeout{};
 
@@ -72,6 +74,9 @@ struct LbMonitorConfig {
 	/**
 	 * For #Type::TCP_EXPECT: a string that is expected to be
 	 * received from the peer after the #send string has been sent.
+	 *
+	 * For #Type::HTTP: a string that is expected in the response
+	 * body.  May be empty.
 	 */
 	std::string expect;
 
@@ -79,9 +84,34 @@ struct LbMonitorConfig {
 	 * For #Type::TCP_EXPECT: if that string is received from the
 	 * peer (instead of #expect), then the node is assumed to be
 	 * shutting down gracefully, and will only get sticky requests.
+	 *
+	 * For #Type::HTTP: the same, but only the response body is
+	 * searched.
 	 */
 	std::string fade_expect;
 
+	/**
+	 * For #Type::HTTP: the request method.
+	 */
+	std::string http_method = "GET";
+
+	/**
+	 * For #Type::HTTP: the request URI.
+	 */
+	std::string http_uri = "/";
+
+	/**
+	 * For #Type::HTTP: the "Host" request header.  If empty, then
+	 * the node address is used.
+	 */
+	std::string http_host;
+
+	/**
+	 * For #Type::HTTP: the expected response status.  0 means any
+	 * 2xx or 3xx status is accepted.
+	 */
+	unsigned expect_status = 0;
+
 	explicit LbMonitorConfig(const char *_name) noexcept
 		:name(_name) {}
 
@@ -36,6 +36,7 @@
 #include "io/Logger.hxx"
 #include "event/CoarseTimerEvent.hxx"
 #include "net/AllocatedSocketAddress.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
 #include "net/FailureRef.hxx"
 #include "util/Cancellable.hxx"
 
@@ -60,6 +61,12 @@ class LbMonitorController final : public LbMonitorHandler {
 
 	CancellablePointer cancel_ptr;
 
+	/**
+	 * An idle connection kept open by the monitor between two
+	 * checks.  See LbMonitorHandler::GetIdleSocket().
+	 */
+	UniqueSocketDescriptor idle_socket;
+
 	bool state = true;
 	bool fade = false;
 
@@ -103,4 +110,8 @@ private:
 	virtual void Fade() override;
 	virtual void Timeout() override;
 	virtual void Error(std::exception_ptr e) override;
+
+	UniqueSocketDescriptor *GetIdleSocket() noexcept override {
+		return &idle_socket;
+	}
 };
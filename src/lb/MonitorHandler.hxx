@@ -34,10 +34,25 @@
 
 #include <exception>
 
+class UniqueSocketDescriptor;
+
 class LbMonitorHandler {
 public:
 	virtual void Success() = 0;
 	virtual void Fade() = 0;
 	virtual void Timeout() = 0;
 	virtual void Error(std::exception_ptr e) = 0;
+
+	/**
+	 * Returns a socket which may be used by the monitor to keep a
+	 * connection open until the next check (e.g. HTTP
+	 * keep-alive).  The monitor may take ownership of a defined
+	 * socket, and it may move a connection into it before
+	 * reporting success.
+	 *
+	 * @return nullptr if this handler cannot keep connections
+	 */
+	virtual UniqueSocketDescriptor *GetIdleSocket() noexcept {
+		return nullptr;
+	}
 };
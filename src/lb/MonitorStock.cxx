@@ -36,6 +36,7 @@
 #include "PingMonitor.hxx"
 #include "SynMonitor.hxx"
 #include "ExpectMonitor.hxx"
+#include "HttpMonitor.hxx"
 #include "MonitorConfig.hxx"
 #include "ClusterConfig.hxx"
 #include "net/SocketAddress.hxx"
@@ -60,6 +61,9 @@ LookupMonitorClass(LbMonitorConfig::Type type)
 
 	case LbMonitorConfig::Type::TCP_EXPECT:
 		return expect_monitor_class;
+
+	case LbMonitorConfig::Type::HTTP:
+		return http_monitor_class;
 	}
 
 	gcc_unreachable();
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "OutstandingIstream.hxx"
+#include "istream/ForwardIstream.hxx"
+#include "istream/UnusedPtr.hxx"
+#include "istream/New.hxx"
+#include "net/FailureInfo.hxx"
+#include "net/FailureRef.hxx"
+
+class OutstandingIstream final : public ForwardIstream {
+	const FailureRef failure;
+
+public:
+	OutstandingIstream(struct pool &p, UnusedIstreamPtr _input,
+			   ReferencedFailureInfo &_failure) noexcept
+		:ForwardIstream(p, std::move(_input)),
+		 failure(_failure) {}
+
+	~OutstandingIstream() noexcept override {
+		failure->RemoveOutstanding();
+	}
+};
+
+UnusedIstreamPtr
+istream_outstanding_new(struct pool &pool, UnusedIstreamPtr input,
+			ReferencedFailureInfo &failure) noexcept
+{
+	return NewIstreamPtr<OutstandingIstream>(pool, std::move(input),
+						 failure);
+}
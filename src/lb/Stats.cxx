@@ -48,6 +48,9 @@ LbInstance::GetStats() const noexcept
 
 	fs_stock->AddStats(tcp_stock_stats);
 
+	StockPrewarmStats prewarm_stats;
+	fs_stock->AddStats(prewarm_stats);
+
 	stats.incoming_connections = ToBE32(http_connections.size()
 					    + tcp_connections.size());
 	stats.outgoing_connections = ToBE32(tcp_stock_stats.busy
@@ -65,10 +68,33 @@ LbInstance::GetStats() const noexcept
 	stats.http_cache_brutto_size = 0;
 	stats.filter_cache_brutto_size = 0;
 	stats.nfs_cache_size = stats.nfs_cache_brutto_size = 0;
+	stats.idle_children = stats.warm_children = 0;
+	stats.prespawned_children = 0;
+	stats.translation_cache_validations_avoided = 0;
+	stats.translation_cache_expand_hits = 0;
+	stats.translation_cache_expand_misses = 0;
+	stats.connect_waits = ToBE64(prewarm_stats.waits);
+	stats.prewarmed_connections = ToBE64(prewarm_stats.prewarmed);
+	stats.warm_connections = ToBE64(prewarm_stats.warm_target);
 
-	const auto io_buffers_stats = fb_pool_get().GetStats();
+	const auto io_buffers_stats = fb_pool_get_stats();
 	stats.io_buffers_size = ToBE64(io_buffers_stats.netto_size);
 	stats.io_buffers_brutto_size = ToBE64(io_buffers_stats.brutto_size);
 
+	const auto io_buffers_small_stats =
+		fb_pool_get(FbSize::SMALL).GetStats();
+	stats.io_buffers_small_size = ToBE64(io_buffers_small_stats.netto_size);
+	stats.io_buffers_small_brutto_size = ToBE64(io_buffers_small_stats.brutto_size);
+
+	const auto io_buffers_medium_stats =
+		fb_pool_get(FbSize::MEDIUM).GetStats();
+	stats.io_buffers_medium_size = ToBE64(io_buffers_medium_stats.netto_size);
+	stats.io_buffers_medium_brutto_size = ToBE64(io_buffers_medium_stats.brutto_size);
+
+	const auto io_buffers_large_stats =
+		fb_pool_get(FbSize::LARGE).GetStats();
+	stats.io_buffers_large_size = ToBE64(io_buffers_large_stats.netto_size);
+	stats.io_buffers_large_brutto_size = ToBE64(io_buffers_large_stats.brutto_size);
+
 	return stats;
 }
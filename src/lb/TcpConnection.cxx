@@ -56,6 +56,8 @@ lb_tcp_sticky(StickyMode sticky_mode,
 	switch (sticky_mode) {
 	case StickyMode::NONE:
 	case StickyMode::FAILOVER:
+	case StickyMode::LEAST_OUTSTANDING:
+	case StickyMode::POWER_OF_TWO:
 		break;
 
 	case StickyMode::SOURCE_IP:
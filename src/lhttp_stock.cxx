@@ -80,6 +80,14 @@ public:
 
 	void FadeTag(const char *tag) noexcept;
 
+	void SetMinIdle(unsigned min_idle) noexcept {
+		child_stock.SetMinIdle(min_idle);
+	}
+
+	void AddStats(ChildStockStats &stats) const noexcept {
+		child_stock.AddStats(stats);
+	}
+
 	StockMap &GetConnectionStock() noexcept {
 		return hstock;
 	}
@@ -293,8 +301,17 @@ LhttpStock::Create(CreateStockItem c, StockRequest request,
 
 	auto *connection = new LhttpConnection(c);
 
+	const char *key = c.GetStockName();
+
+	child_stock.Prewarm(key, [address](AllocatorPtr alloc){
+		auto *copy = alloc.New<LhttpAddress>(alloc, *address);
+		return std::function<StockRequest()>([copy]{
+			return ToNopPointer(copy);
+		});
+	});
+
 	connection->Connect(mchild_stock,
-			    c.GetStockName(), std::move(request),
+			    key, std::move(request),
 			    address->concurrency);
 }
 
@@ -382,6 +399,18 @@ lhttp_stock_fade_tag(LhttpStock &ls, const char *tag) noexcept
 	ls.FadeTag(tag);
 }
 
+void
+lhttp_stock_set_min_idle(LhttpStock &ls, unsigned min_idle) noexcept
+{
+	ls.SetMinIdle(min_idle);
+}
+
+void
+lhttp_stock_add_stats(const LhttpStock &ls, ChildStockStats &stats) noexcept
+{
+	ls.AddStats(stats);
+}
+
 StockItem *
 lhttp_stock_get(LhttpStock *lhttp_stock,
 		const LhttpAddress *address)
@@ -36,6 +36,7 @@
 
 struct pool;
 struct ChildErrorLogOptions;
+struct ChildStockStats;
 class LhttpStock;
 struct StockItem;
 struct LhttpAddress;
@@ -67,6 +68,16 @@ lhttp_stock_fade_all(LhttpStock &ls) noexcept;
 void
 lhttp_stock_fade_tag(LhttpStock &ls, const char *tag) noexcept;
 
+/**
+ * Set the minimum number of idle child processes per LHTTP
+ * application.  0 disables pre-spawning.
+ */
+void
+lhttp_stock_set_min_idle(LhttpStock &ls, unsigned min_idle) noexcept;
+
+void
+lhttp_stock_add_stats(const LhttpStock &ls, ChildStockStats &stats) noexcept;
+
 /**
  * Throws exception on error.
  */
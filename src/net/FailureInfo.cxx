@@ -49,6 +49,10 @@ FailureInfo::Set(Expiry now,
 		SetProtocol(now, duration);
 		break;
 
+	case FailureStatus::OUTLIER:
+		SetOutlier(now, duration);
+		break;
+
 	case FailureStatus::CONNECT:
 		SetConnect(now, duration);
 		break;
@@ -75,6 +79,10 @@ FailureInfo::Unset(FailureStatus unset_status) noexcept
 		UnsetProtocol();
 		break;
 
+	case FailureStatus::OUTLIER:
+		UnsetOutlier();
+		break;
+
 	case FailureStatus::CONNECT:
 		UnsetConnect();
 		break;
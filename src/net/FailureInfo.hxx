@@ -33,8 +33,11 @@
 #pragma once
 
 #include "FailureStatus.hxx"
+#include "ResponseScore.hxx"
 #include "util/Expiry.hxx"
 
+#include <cassert>
+
 class FailureInfo {
 	Expiry fade_expires = Expiry::AlreadyExpired();
 
@@ -42,10 +45,39 @@ class FailureInfo {
 
 	Expiry connect_expires = Expiry::AlreadyExpired();
 
+	Expiry outlier_expires = Expiry::AlreadyExpired();
+
 	unsigned protocol_counter = 0;
 
+	/**
+	 * The end of the current "passive" health tracking window.
+	 * See AddPassiveFailure().
+	 */
+	Expiry passive_window_expires = Expiry::AlreadyExpired();
+
+	/**
+	 * The number of failed requests since the last successful one
+	 * within the current window.
+	 */
+	unsigned passive_failures = 0;
+
+	/**
+	 * The number of requests/connections currently in flight to
+	 * this address.  This is not a failure state, but since this
+	 * object is shared by all users of the same address, it is the
+	 * right place to track the load for StickyMode::LEAST_OUTSTANDING
+	 * and StickyMode::POWER_OF_TWO.
+	 */
+	unsigned outstanding = 0;
+
 	bool monitor = false;
 
+	/**
+	 * Latency and error rate statistics; this is the input for
+	 * the "outlier" ejection.
+	 */
+	ResponseScore score;
+
 public:
 	constexpr FailureStatus GetStatus(Expiry now) const noexcept {
 		if (!CheckMonitor())
@@ -54,6 +86,8 @@ public:
 			return FailureStatus::CONNECT;
 		else if (!CheckProtocol(now))
 			return FailureStatus::PROTOCOL;
+		else if (!CheckOutlier(now))
+			return FailureStatus::OUTLIER;
 		else if (!CheckFade(now))
 			return FailureStatus::FADE;
 		else
@@ -64,6 +98,7 @@ public:
 		return CheckMonitor() &&
 			CheckConnect(now) &&
 			CheckProtocol(now) &&
+			CheckOutlier(now) &&
 			(allow_fade || CheckFade(now));
 	}
 
@@ -120,6 +155,56 @@ public:
 		return connect_expires.IsExpired(now);
 	}
 
+	/**
+	 * Eject this server for the given duration because its
+	 * #ResponseScore is bad.  The score is reset, so it gets a fresh
+	 * start after the ejection expires.
+	 */
+	void SetOutlier(Expiry now,
+			std::chrono::steady_clock::duration duration) noexcept {
+		outlier_expires.Touch(now, duration);
+		score.Reset();
+	}
+
+	void UnsetOutlier() noexcept {
+		outlier_expires = Expiry::AlreadyExpired();
+	}
+
+	constexpr bool CheckOutlier(Expiry now) const noexcept {
+		return outlier_expires.IsExpired(now);
+	}
+
+	const ResponseScore &GetScore() const noexcept {
+		return score;
+	}
+
+	void UpdateScore(std::chrono::steady_clock::duration latency,
+			 bool error) noexcept {
+		score.Update(latency, error);
+	}
+
+	/**
+	 * Count a failed request for "passive" health tracking.  The
+	 * counter starts over when the window (which begins with the
+	 * first failure) has expired.
+	 *
+	 * @return the number of failures in the current window
+	 */
+	unsigned AddPassiveFailure(Expiry now,
+				   std::chrono::steady_clock::duration window) noexcept {
+		if (passive_window_expires.IsExpired(now)) {
+			passive_window_expires.Touch(now, window);
+			passive_failures = 0;
+		}
+
+		return ++passive_failures;
+	}
+
+	void ResetPassiveFailures() noexcept {
+		passive_window_expires = Expiry::AlreadyExpired();
+		passive_failures = 0;
+	}
+
 	void SetMonitor() noexcept {
 		monitor = true;
 	}
@@ -132,10 +217,24 @@ public:
 		return !monitor;
 	}
 
+	void AddOutstanding() noexcept {
+		++outstanding;
+	}
+
+	void RemoveOutstanding() noexcept {
+		assert(outstanding > 0);
+		--outstanding;
+	}
+
+	constexpr unsigned GetOutstanding() const noexcept {
+		return outstanding;
+	}
+
 	void UnsetAll() noexcept {
 		fade_expires = protocol_expires = connect_expires =
-			Expiry::AlreadyExpired();
+			outlier_expires = Expiry::AlreadyExpired();
 		protocol_counter = 0;
+		ResetPassiveFailures();
 		monitor = false;
 	}
 };
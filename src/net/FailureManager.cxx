@@ -116,6 +116,18 @@ FailureManager::GetAddress(const FailureInfo &info) const noexcept
 	return f.GetAddress();
 }
 
+const FailureInfo *
+FailureManager::Find(SocketAddress address) const noexcept
+{
+	assert(!address.IsNull());
+
+	auto i = failures.find(address, Hash(), Equal());
+	if (i == failures.end())
+		return nullptr;
+
+	return &*i;
+}
+
 FailureStatus
 FailureManager::Get(const Expiry now, SocketAddress address) const noexcept
 {
@@ -140,3 +152,15 @@ FailureManager::Check(const Expiry now, SocketAddress address,
 
 	return i->Check(now, allow_fade);
 }
+
+unsigned
+FailureManager::GetOutstanding(SocketAddress address) const noexcept
+{
+	assert(!address.IsNull());
+
+	auto i = failures.find(address, Hash(), Equal());
+	if (i == failures.end())
+		return 0;
+
+	return i->GetOutstanding();
+}
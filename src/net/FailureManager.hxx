@@ -94,10 +94,24 @@ public:
 
 	SocketAddress GetAddress(const FailureInfo &info) const noexcept;
 
+	/**
+	 * Look up an existing #FailureInfo instance.  Returns nullptr
+	 * if there is none (i.e. the address has never been used).
+	 */
+	[[gnu::pure]]
+	const FailureInfo *Find(SocketAddress address) const noexcept;
+
 	[[gnu::pure]]
 	FailureStatus Get(Expiry now, SocketAddress address) const noexcept;
 
 	[[gnu::pure]]
 	bool Check(Expiry now, SocketAddress address,
 		   bool allow_fade=false) const noexcept;
+
+	/**
+	 * Returns the number of requests currently in flight to the
+	 * given address.
+	 */
+	[[gnu::pure]]
+	unsigned GetOutstanding(SocketAddress address) const noexcept;
 };
@@ -43,6 +43,13 @@ enum class FailureStatus {
 	 */
 	FADE,
 
+	/**
+	 * The host responds, but its latency or error rate is much
+	 * worse than configured (see #ResponseScore).  It has been
+	 * ejected temporarily.
+	 */
+	OUTLIER,
+
 	/**
 	 * A server-side protocol-level failure.
 	 */
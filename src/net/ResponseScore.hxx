@@ -0,0 +1,98 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <chrono>
+
+/**
+ * Exponentially weighted moving averages of the response latency
+ * and the error rate of a server.  This is used by beng-lb to detect
+ * outliers, i.e. servers which are technically alive, but much
+ * slower or much more error-prone than expected.
+ */
+class ResponseScore {
+	/**
+	 * The weight of a new sample.  The higher this value, the
+	 * faster the averages follow changes.
+	 */
+	static constexpr float ALPHA = 0.1f;
+
+	/**
+	 * The average latency [seconds].
+	 */
+	float latency = 0;
+
+	/**
+	 * The average error rate [0..1].
+	 */
+	float error_rate = 0;
+
+	/**
+	 * The number of samples since the last Reset() call.
+	 */
+	unsigned n_samples = 0;
+
+public:
+	void Reset() noexcept {
+		latency = error_rate = 0;
+		n_samples = 0;
+	}
+
+	void Update(std::chrono::steady_clock::duration _latency,
+		    bool error) noexcept {
+		const float l =
+			std::chrono::duration_cast<std::chrono::duration<float>>(_latency).count();
+		const float e = error ? 1.0f : 0.0f;
+
+		if (n_samples++ == 0) {
+			/* the first sample initializes the averages */
+			latency = l;
+			error_rate = e;
+		} else {
+			latency += ALPHA * (l - latency);
+			error_rate += ALPHA * (e - error_rate);
+		}
+	}
+
+	constexpr unsigned GetSamples() const noexcept {
+		return n_samples;
+	}
+
+	constexpr std::chrono::duration<float> GetLatency() const noexcept {
+		return std::chrono::duration<float>(latency);
+	}
+
+	constexpr float GetErrorRate() const noexcept {
+		return error_rate;
+	}
+};
@@ -48,10 +48,12 @@
 #include <valgrind/memcheck.h>
 #endif
 
+#include <algorithm>
 #include <forward_list>
 #include <typeinfo>
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -76,6 +78,42 @@ static constexpr size_t ALIGN_MASK = ALIGN_SIZE - 1;
 static constexpr unsigned RECYCLER_MAX_POOLS = 256;
 static constexpr unsigned RECYCLER_MAX_LINEAR_AREAS = 256;
 
+/**
+ * Never keep more than this number of bytes in one size class of the
+ * linear area recycler.
+ */
+static constexpr size_t RECYCLER_MAX_LINEAR_CLASS_BYTES = 2 * 1024 * 1024;
+
+/**
+ * Linear pool areas are rounded up to a power of two between 1 kB
+ * and 128 kB; only areas of exactly one of these sizes are recycled.
+ */
+static constexpr unsigned LINEAR_AREA_CLASS_MIN_BITS = 10;
+static constexpr unsigned N_LINEAR_AREA_CLASSES = 8;
+
+static constexpr size_t
+LinearAreaClassSize(unsigned i) noexcept
+{
+	return size_t(1) << (LINEAR_AREA_CLASS_MIN_BITS + i);
+}
+
+static constexpr size_t LINEAR_AREA_CLASS_MIN_SIZE = LinearAreaClassSize(0);
+static constexpr size_t LINEAR_AREA_CLASS_MAX_SIZE =
+	LinearAreaClassSize(N_LINEAR_AREA_CLASSES - 1);
+
+/**
+ * The number of pool names whose peak size is remembered by
+ * pool_new_linear().  This is a direct-mapped table; colliding names
+ * evict each other.
+ */
+static constexpr size_t N_POOL_SIZE_HINTS = 256;
+
+/**
+ * A learned area size never exceeds this value (unless the caller
+ * asked for more).
+ */
+static constexpr size_t POOL_SIZE_HINT_MAX = 64 * 1024;
+
 #ifndef NDEBUG
 struct allocation_info {
 	typedef boost::intrusive::list_member_hook<boost::intrusive::link_mode<boost::intrusive::normal_link>> SiblingsHook;
@@ -235,10 +273,34 @@ static pool::List trash;
 static struct {
 	Recycler<struct pool, RECYCLER_MAX_POOLS> pools;
 
-	unsigned num_linear_areas;
-	struct linear_pool_area *linear_areas;
+	/**
+	 * Free linear areas, one list per size class.
+	 */
+	struct {
+		unsigned n;
+		struct linear_pool_area *head;
+	} linear_areas[N_LINEAR_AREA_CLASSES];
 } recycler;
 
+/**
+ * Remembers how much memory the pools with a certain name needed
+ * recently, to allow pool_new_linear() to allocate a first area which
+ * is large enough for the whole lifetime of the pool.  The key is the
+ * name pointer (usually a string literal), i.e. effectively the call
+ * site.
+ */
+static struct PoolSizeHint {
+	const char *name;
+
+	/**
+	 * An estimate of the peak size; it follows increases quickly
+	 * and decays slowly.
+	 */
+	size_t peak;
+} pool_size_hints[N_POOL_SIZE_HINTS];
+
+static PoolLinearStats linear_stats;
+
 static void * gcc_malloc
 xmalloc(size_t size) noexcept
 {
@@ -270,13 +332,103 @@ pool_recycler_clear(void) noexcept
 {
 	recycler.pools.Clear();
 
-	while (recycler.linear_areas != nullptr) {
-		struct linear_pool_area *linear = recycler.linear_areas;
-		recycler.linear_areas = linear->prev;
-		free(linear);
+	for (auto &c : recycler.linear_areas) {
+		while (c.head != nullptr) {
+			struct linear_pool_area *linear = c.head;
+			c.head = linear->prev;
+			free(linear);
+		}
+
+		c.n = 0;
+	}
+}
+
+/**
+ * Round the given area size up to the next size class.  Sizes outside
+ * the size class range are returned unmodified.
+ */
+static constexpr size_t
+linear_area_round_size(size_t size) noexcept
+{
+	if (size < LINEAR_AREA_CLASS_MIN_SIZE ||
+	    size > LINEAR_AREA_CLASS_MAX_SIZE)
+		return size;
+
+	size_t result = LINEAR_AREA_CLASS_MIN_SIZE;
+	while (result < size)
+		result <<= 1;
+	return result;
+}
+
+/**
+ * @return the size class index of an area with exactly this size or
+ * -1 if the size is not a size class
+ */
+static constexpr int
+linear_area_class(size_t size) noexcept
+{
+	for (unsigned i = 0; i < N_LINEAR_AREA_CLASSES; ++i)
+		if (size == LinearAreaClassSize(i))
+			return i;
+
+	return -1;
+}
+
+static constexpr unsigned
+linear_area_class_max(unsigned i) noexcept
+{
+	return std::min<size_t>(RECYCLER_MAX_LINEAR_AREAS,
+				RECYCLER_MAX_LINEAR_CLASS_BYTES / LinearAreaClassSize(i));
+}
+
+static struct PoolSizeHint &
+pool_get_size_hint(const char *name) noexcept
+{
+	/* the lowest bits of string literal addresses are often
+	   zero; discard them */
+	const auto i = (reinterpret_cast<uintptr_t>(name) >> 2) % N_POOL_SIZE_HINTS;
+	return pool_size_hints[i];
+}
+
+/**
+ * Choose the area size for a new linear pool, based on the size
+ * requested by the caller and the sizes previous pools with the same
+ * name have reached.
+ */
+gcc_pure
+static size_t
+pool_learned_area_size(const char *name, size_t initial_size) noexcept
+{
+	size_t size = initial_size;
+
+	const auto &hint = pool_get_size_hint(name);
+	if (hint.name == name && hint.peak > 0) {
+		size = std::max(hint.peak, initial_size / 4);
+		size = std::min(size, std::max(initial_size,
+					       POOL_SIZE_HINT_MAX));
 	}
 
-	recycler.num_linear_areas = 0;
+	return linear_area_round_size(size);
+}
+
+/**
+ * Remember the peak size of a linear pool which is about to be
+ * cleared, for pool_learned_area_size().
+ */
+static void
+pool_learn_size(const struct pool &pool, size_t used) noexcept
+{
+	if (used == 0)
+		return;
+
+	auto &hint = pool_get_size_hint(pool.name);
+	if (hint.name != pool.name) {
+		hint.name = pool.name;
+		hint.peak = used;
+	} else if (used > hint.peak)
+		hint.peak += (used - hint.peak + 1) / 2;
+	else
+		hint.peak -= (hint.peak - used) / 32;
 }
 
 /**
@@ -290,14 +442,22 @@ pool_recycler_put_linear(struct linear_pool_area *area) noexcept
 	assert(area->size > 0);
 	assert(area->slice_area == nullptr);
 
-	if (recycler.num_linear_areas >= RECYCLER_MAX_LINEAR_AREAS)
+	/* recycle only areas whose size is one of the size classes;
+	   this avoids poisoning the recycler with areas (e.g. for big
+	   allocations) that will probably never be used again */
+	const int i = linear_area_class(area->size);
+	if (i < 0)
+		return false;
+
+	auto &c = recycler.linear_areas[i];
+	if (c.n >= linear_area_class_max(i))
 		return false;
 
 	PoisonInaccessible(area->data, area->used);
 
-	area->prev = recycler.linear_areas;
-	recycler.linear_areas = area;
-	++recycler.num_linear_areas;
+	area->prev = c.head;
+	c.head = area;
+	++c.n;
 	return true;
 }
 
@@ -306,19 +466,19 @@ pool_recycler_get_linear(size_t size) noexcept
 {
 	assert(size > 0);
 
-	struct linear_pool_area **linear_p, *linear;
-	for (linear_p = &recycler.linear_areas, linear = *linear_p;
-	     linear != nullptr;
-	     linear_p = &linear->prev, linear = *linear_p) {
-		if (linear->size == size) {
-			assert(recycler.num_linear_areas > 0);
-			--recycler.num_linear_areas;
-			*linear_p = linear->prev;
-			return linear;
-		}
+	const int i = linear_area_class(size);
+	if (i < 0)
+		return nullptr;
+
+	auto &c = recycler.linear_areas[i];
+	struct linear_pool_area *linear = c.head;
+	if (linear != nullptr) {
+		assert(c.n > 0);
+		--c.n;
+		c.head = linear->prev;
 	}
 
-	return nullptr;
+	return linear;
 }
 
 static void
@@ -347,13 +507,8 @@ static void
 pool_dispose_linear_area(struct pool *pool,
 			 struct linear_pool_area *area) noexcept
 {
-	if (/* recycle only if the area's size is exactly as big as
-	       planned, and was not superseded by a larger allocation;
-	       this avoids poisoning the recycler with areas that will
-	       probably never be used again */
-	    area->size != pool->area_size ||
-	    (!pool_dispose_slice_area(pool->slice_pool, area) &&
-	     !pool_recycler_put_linear(area)))
+	if (!pool_dispose_slice_area(pool->slice_pool, area) &&
+	    !pool_recycler_put_linear(area))
 		pool_free_linear_area(area);
 }
 
@@ -446,6 +601,8 @@ pool_new_linear_area(struct linear_pool_area *prev, size_t size) noexcept
 
 	PoisonInaccessible(area->data, area->size);
 
+	++linear_stats.malloc_areas;
+
 	return area;
 }
 
@@ -458,6 +615,7 @@ pool_get_linear_area(struct linear_pool_area *prev, size_t size) noexcept
 	} else {
 		area->prev = prev;
 		area->used = 0;
+		++linear_stats.recycled_areas;
 	}
 	return area;
 }
@@ -480,7 +638,7 @@ pool_new_linear(struct pool *parent, const char *name,
 
 	struct pool *pool = pool_new(parent, name);
 	pool->type = POOL_LINEAR;
-	pool->area_size = initial_size;
+	pool->area_size = pool_learned_area_size(name, initial_size);
 	pool->slice_pool = nullptr;
 	pool->current_area.linear = nullptr;
 
@@ -782,6 +940,12 @@ pool_children_brutto_size(const struct pool *pool) noexcept
 	return size;
 }
 
+PoolLinearStats
+pool_linear_stats() noexcept
+{
+	return linear_stats;
+}
+
 AllocatorStats
 pool_children_stats(const struct pool &pool) noexcept
 {
@@ -909,10 +1073,25 @@ pool_clear(struct pool &pool) noexcept
 		break;
 
 	case POOL_LINEAR:
-		while (pool.current_area.linear != nullptr) {
-			struct linear_pool_area *area = pool.current_area.linear;
-			pool.current_area.linear = area->prev;
-			pool_dispose_linear_area(&pool, area);
+		{
+			size_t used = 0;
+
+			while (pool.current_area.linear != nullptr) {
+				struct linear_pool_area *area = pool.current_area.linear;
+				pool.current_area.linear = area->prev;
+
+				/* areas for big one-off allocations
+				   (see p_malloc_linear()) do not
+				   say anything about the size the
+				   next pool needs */
+				if (area->size <= pool.area_size)
+					used += area->used;
+
+				pool_dispose_linear_area(&pool, area);
+			}
+
+			if (pool.slice_pool == nullptr)
+				pool_learn_size(pool, used);
 		}
 		break;
 	}
@@ -989,9 +1168,11 @@ p_malloc_linear(struct pool *pool, const size_t original_size
 			/* put the special large area after the current one */
 			area = pool_new_linear_area(area->prev, size);
 			pool->current_area.linear->prev = area;
+			++linear_stats.grown;
 		}
 	} else if (gcc_unlikely(area == nullptr || area->used + size > area->size)) {
 		if (area != nullptr) {
+			++linear_stats.grown;
 			logger.Format(5, "growing linear pool '%s'", pool->name);
 #ifdef DEBUG_POOL_GROW
 			pool_dump_allocations(*pool);
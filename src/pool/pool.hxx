@@ -67,6 +67,15 @@ pool_new_dummy(struct pool *parent, const char *name) noexcept;
 PoolPtr
 pool_new_libc(struct pool *parent, const char *name) noexcept;
 
+/**
+ * Create a new pool which allocates from large memory areas.
+ *
+ * @param name the pool name; this should be a string literal,
+ * because its address is used as a key for remembering how large
+ * pools with this name grew in the past
+ * @param initial_size the size of the first area; the actual size
+ * may be adjusted to what pools with the same name needed recently
+ */
 PoolPtr
 pool_new_linear(struct pool *parent, const char *name,
 		size_t initial_size) noexcept;
@@ -140,6 +149,31 @@ pool_children_brutto_size(const struct pool *pool) noexcept;
 AllocatorStats
 pool_children_stats(const struct pool &pool) noexcept;
 
+/**
+ * Counters describing how linear pools obtained their memory areas.
+ */
+struct PoolLinearStats {
+	/**
+	 * The number of areas allocated from the libc heap.
+	 */
+	size_t malloc_areas = 0;
+
+	/**
+	 * The number of areas taken from the recycler.
+	 */
+	size_t recycled_areas = 0;
+
+	/**
+	 * The number of times a linear pool had to chain another area
+	 * because its first one was full.
+	 */
+	size_t grown = 0;
+};
+
+gcc_pure
+PoolLinearStats
+pool_linear_stats() noexcept;
+
 void
 pool_dump_tree(const struct pool &pool) noexcept;
 
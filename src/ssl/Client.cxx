@@ -31,6 +31,7 @@
  */
 
 #include "Client.hxx"
+#include "ClientSessionCache.hxx"
 #include "Config.hxx"
 #include "Filter.hxx"
 #include "AlpnProtos.hxx"
@@ -43,6 +44,7 @@
 #include "util/RuntimeError.hxx"
 
 #include <map>
+#include <string>
 
 class SslClientCerts {
 	struct X509NameCompare {
@@ -74,6 +76,13 @@ public:
 	}
 };
 
+static void
+FreeSessionKey(void *, void *ptr, CRYPTO_EX_DATA *, int, long,
+	       void *) noexcept
+{
+	delete (std::string *)ptr;
+}
+
 inline int
 SslClientFactory::ClientCertCallback_(SSL *ssl, X509 **x509,
 				      EVP_PKEY **pkey) noexcept
@@ -151,14 +160,47 @@ SslClientCerts::Find(X509_NAME &name,
 	return true;
 }
 
+inline int
+SslClientFactory::NewSessionCallback_(SSL *ssl,
+				      SSL_SESSION *session) noexcept
+{
+	const auto *key = (const std::string *)
+		SSL_get_ex_data(ssl, session_key_idx);
+	if (key == nullptr)
+		/* not eligible for session reuse */
+		return 0;
+
+	sessions->Put(*key, session);
+	return 1;
+}
+
+int
+SslClientFactory::NewSessionCallback(SSL *ssl, SSL_SESSION *session) noexcept
+{
+	return GetFactory(ssl).NewSessionCallback_(ssl, session);
+}
+
 SslClientFactory::SslClientFactory(const SslClientConfig &config)
-	:ctx(CreateBasicSslCtx(false))
+	:ctx(CreateBasicSslCtx(false)),
+	 sessions(std::make_unique<SslClientSessionCache>())
 {
 	if (idx < 0)
 		idx = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL);
 
+	if (session_key_idx < 0)
+		session_key_idx = SSL_get_ex_new_index(0, NULL, NULL, NULL,
+						       FreeSessionKey);
+
 	SSL_CTX_set_ex_data(ctx.get(), idx, this);
 
+	/* remember sessions in SslClientSessionCache (OpenSSL's
+	   internal cache is for servers only), so reconnects to the
+	   same server can skip the full handshake */
+	SSL_CTX_set_session_cache_mode(ctx.get(),
+				       SSL_SESS_CACHE_CLIENT|
+				       SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx.get(), NewSessionCallback);
+
 	if (!config.cert_key.empty()) {
 		certs = std::make_unique<SslClientCerts>(config.cert_key);
 		SSL_CTX_set_client_cert_cb(ctx.get(), ClientCertCallback);
@@ -206,6 +248,20 @@ SslClientFactory::Create(EventLoop &event_loop,
 
 		SSL_use_PrivateKey(ssl.get(), c->second.get());
 		SSL_use_certificate(ssl.get(), c->first.get());
+	} else if (hostname != nullptr) {
+		/* sessions are cached per server name and ALPN setting;
+		   connections with an explicitly selected client
+		   certificate are not eligible, to avoid resuming a
+		   session with a different identity */
+		auto key = std::make_unique<std::string>(hostname);
+		key->push_back('\n');
+		key->push_back(char('0' + unsigned(alpn)));
+
+		if (auto session = sessions->Get(*key))
+			SSL_set_session(ssl.get(), session.get());
+
+		if (SSL_set_ex_data(ssl.get(), session_key_idx, key.get()))
+			key.release();
 	}
 
 	auto f = ssl_filter_new(std::move(ssl));
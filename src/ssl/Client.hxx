@@ -45,13 +45,26 @@
 struct SslClientConfig;
 class EventLoop;
 class SslClientCerts;
+class SslClientSessionCache;
 
 class SslClientFactory {
 	SslCtx ctx;
 	std::unique_ptr<SslClientCerts> certs;
 
+	/**
+	 * TLS sessions of previous connections, to be resumed by new
+	 * connections to the same server, saving a full handshake.
+	 */
+	std::unique_ptr<SslClientSessionCache> sessions;
+
 	static inline int idx = -1;
 
+	/**
+	 * The SSL ex_data index which points to the session cache key
+	 * (a std::string) of connections whose session may be stored.
+	 */
+	static inline int session_key_idx = -1;
+
 public:
 	explicit SslClientFactory(const SslClientConfig &config);
 	~SslClientFactory() noexcept;
@@ -82,4 +95,8 @@ private:
 				EVP_PKEY **pkey) noexcept;
 	static int ClientCertCallback(SSL *ssl, X509 **x509,
 				      EVP_PKEY **pkey) noexcept;
+
+	int NewSessionCallback_(SSL *ssl, SSL_SESSION *session) noexcept;
+	static int NewSessionCallback(SSL *ssl,
+				      SSL_SESSION *session) noexcept;
 };
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ClientSessionCache.hxx"
+
+SslClientSessionCache::UniqueSession
+SslClientSessionCache::Get(const std::string &key) noexcept
+{
+	const std::lock_guard<std::mutex> lock(mutex);
+
+	auto i = map.find(key);
+	if (i == map.end())
+		return nullptr;
+
+	auto &item = i->second;
+	if (!SSL_SESSION_is_resumable(item.session.get())) {
+		Erase(i);
+		return nullptr;
+	}
+
+	/* move to the end of the LRU list */
+	lru.erase(lru.iterator_to(item));
+	lru.push_back(item);
+
+	SSL_SESSION_up_ref(item.session.get());
+	return UniqueSession(item.session.get());
+}
+
+void
+SslClientSessionCache::Put(const std::string &key,
+			   SSL_SESSION *session) noexcept
+{
+	UniqueSession s(session);
+
+	const std::lock_guard<std::mutex> lock(mutex);
+
+	if (auto i = map.find(key); i != map.end()) {
+		auto &item = i->second;
+		item.session = std::move(s);
+
+		lru.erase(lru.iterator_to(item));
+		lru.push_back(item);
+		return;
+	}
+
+	if (map.size() >= max_sessions && !lru.empty())
+		Erase(map.find(*lru.front().key));
+
+	auto i = map.emplace(key, std::move(s)).first;
+	i->second.key = &i->first;
+	lru.push_back(i->second);
+}
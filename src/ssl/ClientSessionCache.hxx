@@ -0,0 +1,133 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <boost/intrusive/list.hpp>
+
+#include <openssl/ssl.h>
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * A cache of TLS client sessions, to be resumed by new connections
+ * to the same server.  When it is full, the least recently used
+ * session is evicted.
+ *
+ * This class is thread-safe, because new sessions are received by
+ * the #ThreadSocketFilter worker threads.
+ */
+class SslClientSessionCache {
+	struct SessionDeleter {
+		void operator()(SSL_SESSION *session) const noexcept {
+			SSL_SESSION_free(session);
+		}
+	};
+
+public:
+	using UniqueSession = std::unique_ptr<SSL_SESSION, SessionDeleter>;
+
+private:
+	struct Item final
+		: boost::intrusive::list_base_hook<boost::intrusive::link_mode<boost::intrusive::normal_link>>
+	{
+		/**
+		 * The key of this item in #map (for eviction).
+		 */
+		const std::string *key;
+
+		UniqueSession session;
+
+		explicit Item(UniqueSession &&_session) noexcept
+			:session(std::move(_session)) {}
+	};
+
+	/**
+	 * Bound the memory usage.
+	 */
+	const std::size_t max_sessions;
+
+	/**
+	 * Protects all following attributes.
+	 */
+	std::mutex mutex;
+
+	std::map<std::string, Item, std::less<>> map;
+
+	/**
+	 * All items, the least recently used one first.
+	 */
+	boost::intrusive::list<Item,
+			       boost::intrusive::constant_time_size<false>> lru;
+
+public:
+	explicit SslClientSessionCache(std::size_t _max_sessions=1024) noexcept
+		:max_sessions(_max_sessions) {}
+
+	~SslClientSessionCache() noexcept {
+		lru.clear();
+	}
+
+	SslClientSessionCache(const SslClientSessionCache &) = delete;
+	SslClientSessionCache &operator=(const SslClientSessionCache &) = delete;
+
+	std::size_t GetSize() noexcept {
+		const std::lock_guard<std::mutex> lock(mutex);
+		return map.size();
+	}
+
+	/**
+	 * Look up a session and mark it as recently used.
+	 *
+	 * @return a new reference to a resumable session or nullptr
+	 */
+	UniqueSession Get(const std::string &key) noexcept;
+
+	/**
+	 * Add or replace a session.  If the cache is full, the least
+	 * recently used session is evicted.
+	 *
+	 * @param session a reference which is owned by this object
+	 * from now on
+	 */
+	void Put(const std::string &key, SSL_SESSION *session) noexcept;
+
+private:
+	void Erase(std::map<std::string, Item, std::less<>>::iterator i) noexcept {
+		lru.erase(lru.iterator_to(i->second));
+		map.erase(i);
+	}
+};
@@ -236,8 +236,13 @@ void
 SslFilter::PreRun(ThreadSocketFilterInternal &f) noexcept
 {
 	if (f.IsIdle()) {
-		decrypted_input.AllocateIfNull(fb_pool_get());
-		encrypted_output.AllocateIfNull(fb_pool_get());
+		decrypted_input.AllocateIfNull(fb_pool_get(FbSize::SMALL));
+		encrypted_output.AllocateIfNull(fb_pool_get(FbSize::SMALL));
+
+		if (decrypted_input.IsFull())
+			fb_pool_grow(decrypted_input);
+		if (encrypted_output.IsFull())
+			fb_pool_grow(encrypted_output);
 	}
 }
 
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+/**
+ * The adaptive number of idle items to be kept for one stock key.
+ * Each request which had to wait for a new item (a "miss") raises
+ * the target at the next Adapt() call; without misses, it decays
+ * slowly back to the configured minimum.
+ *
+ * The target never exceeds the stock's "max_idle" setting, because
+ * the #StockMap would discard the excess idle items right away,
+ * only to have them created again.
+ */
+class AdaptiveIdleTarget {
+	/**
+	 * The number of idle items to be kept.
+	 */
+	unsigned target;
+
+	/**
+	 * The number of items which had to be created for a request
+	 * since the last Adapt() call.
+	 */
+	unsigned misses = 0;
+
+public:
+	constexpr AdaptiveIdleTarget(unsigned min_idle,
+				     unsigned max_idle) noexcept
+		:target(std::min(min_idle, max_idle)) {}
+
+	constexpr unsigned Get() const noexcept {
+		return target;
+	}
+
+	constexpr void AddMiss() noexcept {
+		++misses;
+	}
+
+	/**
+	 * Adapt the target to the misses since the last call.  This
+	 * is supposed to be called periodically.
+	 *
+	 * @return false if there was no recent demand and the target
+	 * is back at the minimum, i.e. this object may be discarded
+	 */
+	constexpr bool Adapt(unsigned min_idle, unsigned max_idle) noexcept {
+		min_idle = std::min(min_idle, max_idle);
+
+		if (misses > 0) {
+			target = std::min(target + misses, max_idle);
+			misses = 0;
+			return true;
+		}
+
+		if (target > min_idle) {
+			--target;
+			return true;
+		}
+
+		target = min_idle;
+		return false;
+	}
+};
@@ -0,0 +1,293 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "Prewarm.hxx"
+#include "stock/Item.hxx"
+#include "pool/pool.hxx"
+#include "AllocatorPtr.hxx"
+#include "io/Logger.hxx"
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * How often is the idle target of each key adapted to the recent
+ * demand?  This also refreshes the idle connections, so it must be
+ * shorter than the stocks' idle timeout.
+ */
+static constexpr Event::Duration STOCK_PREWARM_ADAPT_INTERVAL =
+	std::chrono::seconds(30);
+
+/**
+ * Keys which have not been requested for this duration are not
+ * pre-warmed anymore.
+ */
+static constexpr Event::Duration STOCK_PREWARM_EXPIRY =
+	std::chrono::minutes(5);
+
+StockPrewarmParams::StockPrewarmParams(bool _ip_transparent,
+				       SocketAddress _bind_address,
+				       SocketAddress _address,
+				       Event::Duration _timeout) noexcept
+	:bind_address(_bind_address), address(_address),
+	 timeout(_timeout), ip_transparent(_ip_transparent) {}
+
+StockPrewarm::Connect::Connect(StockPrewarm &_prewarm,
+			       const char *_key) noexcept
+	:prewarm(_prewarm),
+	 pool(pool_new_libc(nullptr, "stock_prewarm")),
+	 key(_key) {}
+
+StockPrewarm::Connect::~Connect() noexcept
+{
+	if (cancel_ptr)
+		cancel_ptr.Cancel();
+}
+
+void
+StockPrewarm::Connect::Start(const StockPrewarmParams &params) noexcept
+{
+	starting = true;
+	prewarm.handler.PrewarmGet(*pool, key.c_str(), params,
+				   *this, cancel_ptr);
+	starting = false;
+}
+
+void
+StockPrewarm::Connect::OnStockItemReady(StockItem &_item) noexcept
+{
+	cancel_ptr = nullptr;
+	prewarm.OnConnectItem(*this, _item);
+}
+
+void
+StockPrewarm::Connect::OnStockItemError(std::exception_ptr ep) noexcept
+{
+	cancel_ptr = nullptr;
+	prewarm.OnConnectError(*this, std::move(ep));
+}
+
+StockPrewarm::StockPrewarm(EventLoop &event_loop,
+			   StockPrewarmHandler &_handler,
+			   unsigned _max_idle) noexcept
+	:handler(_handler), max_idle(_max_idle),
+	 adapt_timer(event_loop, BIND_THIS_METHOD(OnAdaptTimer)),
+	 refill_event(event_loop, BIND_THIS_METHOD(OnDeferredRefill))
+{
+}
+
+StockPrewarm::~StockPrewarm() noexcept
+{
+	connects.clear_and_dispose([](Connect *c){ delete c; });
+}
+
+void
+StockPrewarm::SetMinIdle(unsigned _min_idle) noexcept
+{
+	/* more idle connections would be closed by the #StockMap
+	   right away */
+	min_idle = std::min(_min_idle, max_idle);
+
+	/* start over with the new setting */
+	keys.clear();
+	adapt_timer.Cancel();
+	refill_event.Cancel();
+}
+
+void
+StockPrewarm::OnGet(const char *key) noexcept
+{
+	if (keys.empty())
+		return;
+
+	if (auto i = keys.find(key); i != keys.end())
+		i->second.last_used = GetEventLoop().SteadyNow();
+}
+
+bool
+StockPrewarm::OnCreate(const char *key,
+		       const StockPrewarmParams *params) noexcept
+{
+	if (prewarming) {
+		++stats.prewarmed;
+		return true;
+	}
+
+	++stats.waits;
+
+	if (min_idle > 0 && params != nullptr) {
+		/* this request has to wait for the connect; count
+		   the miss for the next OnAdaptTimer() and top up
+		   the idle connections right away */
+		auto &state = keys.try_emplace(key, *params,
+					       min_idle, max_idle,
+					       GetEventLoop().SteadyNow())
+			.first->second;
+		state.target.AddMiss();
+		state.refill = true;
+
+		refill_event.Schedule();
+
+		if (!adapt_timer.IsPending())
+			adapt_timer.Schedule(STOCK_PREWARM_ADAPT_INTERVAL);
+	}
+
+	return false;
+}
+
+void
+StockPrewarm::Refill(const char *key, KeyState &state) noexcept
+{
+	state.refill = false;
+
+	if (state.connecting >= state.target.Get())
+		return;
+
+	/* each Connect borrows one item: an idle connection if
+	   there is one left (resetting its idle timeout), else a new
+	   one; all are returned to the stock as soon as they are
+	   ready */
+	const unsigned n = state.target.Get() - state.connecting;
+	std::vector<Connect *> batch;
+	batch.reserve(n);
+
+	prewarming = true;
+
+	for (unsigned i = 0; i < n; ++i) {
+		auto *c = new Connect(*this, key);
+		connects.push_back(*c);
+		batch.push_back(c);
+		c->Start(state.params);
+	}
+
+	prewarming = false;
+
+	for (auto *c : batch) {
+		if (!c->done) {
+			/* still connecting; OnConnectItem() will
+			   return the item */
+			++state.connecting;
+			continue;
+		}
+
+		if (c->item != nullptr)
+			c->item->Put(false);
+
+		connects.erase(connects.iterator_to(*c));
+		delete c;
+	}
+}
+
+void
+StockPrewarm::OnConnectItem(Connect &c, StockItem &item) noexcept
+{
+	if (c.starting) {
+		/* called synchronously by Refill(); keep the item
+		   borrowed, or else the next Get() would return the
+		   same one */
+		c.item = &item;
+		c.done = true;
+		return;
+	}
+
+	if (auto i = keys.find(c.key); i != keys.end() &&
+	    i->second.connecting > 0)
+		--i->second.connecting;
+
+	item.Put(false);
+
+	connects.erase(connects.iterator_to(c));
+	delete &c;
+}
+
+void
+StockPrewarm::OnConnectError(Connect &c, std::exception_ptr ep) noexcept
+{
+	LogConcat(2, c.key.c_str(), "Failed to pre-connect: ", ep);
+
+	if (c.starting) {
+		c.done = true;
+		return;
+	}
+
+	if (auto i = keys.find(c.key); i != keys.end() &&
+	    i->second.connecting > 0)
+		--i->second.connecting;
+
+	connects.erase(connects.iterator_to(c));
+	delete &c;
+}
+
+void
+StockPrewarm::OnDeferredRefill() noexcept
+{
+	for (auto &[key, state] : keys)
+		if (state.refill)
+			Refill(key.c_str(), state);
+}
+
+void
+StockPrewarm::OnAdaptTimer() noexcept
+{
+	const auto now = GetEventLoop().SteadyNow();
+
+	for (auto i = keys.begin(); i != keys.end();) {
+		auto &state = i->second;
+
+		if (now - state.last_used >= STOCK_PREWARM_EXPIRY) {
+			i = keys.erase(i);
+			continue;
+		}
+
+		/* unlike ChildStock, keys at the minimum are kept
+		   until they expire, because their idle connections
+		   are refreshed here */
+		state.target.Adapt(min_idle, max_idle);
+
+		/* replace idle connections which were closed by the
+		   peer, and reset the idle timeout of the others */
+		Refill(i->first.c_str(), state);
+		++i;
+	}
+
+	if (!keys.empty())
+		adapt_timer.Schedule(STOCK_PREWARM_ADAPT_INTERVAL);
+}
+
+void
+StockPrewarm::AddStats(StockPrewarmStats &data) const noexcept
+{
+	data.waits += stats.waits;
+	data.prewarmed += stats.prewarmed;
+
+	for (const auto &[key, state] : keys)
+		data.warm_target += state.target.Get();
+}
@@ -0,0 +1,291 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "AdaptiveIdleTarget.hxx"
+#include "net/AllocatedSocketAddress.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "event/DeferEvent.hxx"
+#include "event/Chrono.hxx"
+#include "stock/GetHandler.hxx"
+#include "pool/Ptr.hxx"
+#include "util/Cancellable.hxx"
+
+#include <boost/intrusive/list.hpp>
+
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <string>
+
+struct StockItem;
+class AllocatorPtr;
+class SocketAddress;
+class EventLoop;
+
+/**
+ * The parameters needed to establish a new connection for a
+ * #StockMap key.  #StockPrewarm keeps a copy of them, because the
+ * request which submitted them is gone when the connection is
+ * established in the background.
+ */
+struct StockPrewarmParams {
+	AllocatedSocketAddress bind_address, address;
+
+	Event::Duration timeout;
+
+	bool ip_transparent;
+
+	StockPrewarmParams(bool _ip_transparent,
+			   SocketAddress _bind_address,
+			   SocketAddress _address,
+			   Event::Duration _timeout) noexcept;
+};
+
+class StockPrewarmHandler {
+public:
+	/**
+	 * Obtain an item for the given key from the stock, creating a
+	 * new one if no idle item is available.
+	 *
+	 * @param alloc an allocator which lives until the handler is
+	 * invoked (or the operation is canceled)
+	 */
+	virtual void PrewarmGet(AllocatorPtr alloc, const char *key,
+				const StockPrewarmParams &params,
+				StockGetHandler &handler,
+				CancellablePointer &cancel_ptr) noexcept = 0;
+};
+
+struct StockPrewarmStats {
+	/**
+	 * The number of connections which had to be established
+	 * while a request was waiting for it.
+	 */
+	uint64_t waits = 0;
+
+	/**
+	 * The number of connections which were established in advance.
+	 */
+	uint64_t prewarmed = 0;
+
+	/**
+	 * The sum of the adaptive idle targets of all keys with
+	 * recent demand.
+	 */
+	unsigned warm_target = 0;
+};
+
+/**
+ * Keeps a minimum number of idle connections per #StockMap key, and
+ * raises this number temporarily when requests have to wait for a
+ * new connection.  The connections are established in the
+ * background, so the next burst of requests finds them ready.
+ *
+ * This is the connection counterpart of ChildStock::Prewarm(), but
+ * since connect parameters are cheap to copy, it can also replenish
+ * connections which were closed by the peer or by the idle timeout.
+ */
+class StockPrewarm {
+	StockPrewarmHandler &handler;
+
+	/**
+	 * The configured minimum number of idle connections per
+	 * key.  0 disables pre-warming.
+	 */
+	unsigned min_idle = 0;
+
+	/**
+	 * The upper bound for the adaptive idle target.  More idle
+	 * connections would be closed by the #StockMap anyway.
+	 */
+	const unsigned max_idle;
+
+	struct KeyState {
+		StockPrewarmParams params;
+
+		/**
+		 * The number of idle connections to be kept.
+		 */
+		AdaptiveIdleTarget target;
+
+		/**
+		 * The number of background connects in progress.
+		 */
+		unsigned connecting = 0;
+
+		/**
+		 * When was this key last requested?  Keys which have
+		 * not been requested for a while are forgotten, and
+		 * their connections are left to the idle timeout.
+		 */
+		Event::TimePoint last_used;
+
+		/**
+		 * Shall OnDeferredRefill() top up this key?
+		 */
+		bool refill = false;
+
+		KeyState(const StockPrewarmParams &_params,
+			 unsigned min_idle, unsigned max_idle,
+			 Event::TimePoint now) noexcept
+			:params(_params), target(min_idle, max_idle),
+			 last_used(now) {}
+	};
+
+	std::map<std::string, KeyState, std::less<>> keys;
+
+	/**
+	 * Periodically adapts KeyState::target to the recent demand
+	 * and refreshes the idle connections of all keys.
+	 */
+	CoarseTimerEvent adapt_timer;
+
+	/**
+	 * Tops up keys which have just seen a miss, outside of the
+	 * stock's Create() method.
+	 */
+	DeferEvent refill_event;
+
+	/**
+	 * A background connect; it borrows one item from the stock
+	 * and returns it as soon as it is ready.
+	 */
+	class Connect final
+		: public boost::intrusive::list_base_hook<boost::intrusive::link_mode<boost::intrusive::normal_link>>,
+		  StockGetHandler
+	{
+		StockPrewarm &prewarm;
+
+		const PoolPtr pool;
+
+	public:
+		const std::string key;
+
+		CancellablePointer cancel_ptr;
+
+		/**
+		 * The item which was obtained while Start() was
+		 * still running; Refill() returns it to the stock
+		 * after it has borrowed all items.
+		 */
+		StockItem *item = nullptr;
+
+		/**
+		 * Is Start() currently running?
+		 */
+		bool starting = false;
+
+		/**
+		 * Was the result delivered while Start() was still
+		 * running?
+		 */
+		bool done = false;
+
+		Connect(StockPrewarm &_prewarm, const char *_key) noexcept;
+		~Connect() noexcept;
+
+		void Start(const StockPrewarmParams &params) noexcept;
+
+	private:
+		/* virtual methods from class StockGetHandler */
+		void OnStockItemReady(StockItem &item) noexcept override;
+		void OnStockItemError(std::exception_ptr ep) noexcept override;
+	};
+
+	using ConnectList =
+		boost::intrusive::list<Connect,
+				       boost::intrusive::constant_time_size<false>>;
+
+	/**
+	 * Background connects which are still in progress; they are
+	 * canceled by the destructor.
+	 */
+	ConnectList connects;
+
+	StockPrewarmStats stats;
+
+	/**
+	 * Is Refill() currently running?  Used by OnCreate() to
+	 * distinguish pre-warmed connections from those established
+	 * for a request.
+	 */
+	bool prewarming = false;
+
+public:
+	StockPrewarm(EventLoop &event_loop, StockPrewarmHandler &_handler,
+		     unsigned _max_idle) noexcept;
+	~StockPrewarm() noexcept;
+
+	StockPrewarm(const StockPrewarm &) = delete;
+	StockPrewarm &operator=(const StockPrewarm &) = delete;
+
+	EventLoop &GetEventLoop() const noexcept {
+		return adapt_timer.GetEventLoop();
+	}
+
+	/**
+	 * Set the minimum number of idle connections per key.  0
+	 * disables pre-warming.
+	 */
+	void SetMinIdle(unsigned _min_idle) noexcept;
+
+	/**
+	 * A request for the given key is about to be submitted to
+	 * the stock.
+	 */
+	void OnGet(const char *key) noexcept;
+
+	/**
+	 * The stock is about to create a new connection for the given
+	 * key.
+	 *
+	 * @param params the connect parameters; nullptr if
+	 * connections for this key cannot be established in the
+	 * background
+	 * @return true if this connection is being pre-warmed (and
+	 * no request is waiting for it)
+	 */
+	bool OnCreate(const char *key,
+		      const StockPrewarmParams *params) noexcept;
+
+	void AddStats(StockPrewarmStats &data) const noexcept;
+
+private:
+	void Refill(const char *key, KeyState &state) noexcept;
+	void OnConnectItem(Connect &connect, StockItem &item) noexcept;
+	void OnConnectError(Connect &connect,
+			    std::exception_ptr ep) noexcept;
+
+	void OnDeferredRefill() noexcept;
+	void OnAdaptTimer() noexcept;
+};
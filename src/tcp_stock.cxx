@@ -33,6 +33,7 @@
 #include "tcp_stock.hxx"
 #include "AllocatorPtr.hxx"
 #include "pool/DisposablePointer.hxx"
+#include "pool/PSocketAddress.hxx"
 #include "stock/Stock.hxx"
 #include "stock/Item.hxx"
 #include "stock/LoggerDomain.hxx"
@@ -208,6 +209,12 @@ TcpStock::Create(CreateStockItem c,
 	auto request = std::move(*(TcpStockRequest *)_request.get());
 	_request.reset();
 
+	const StockPrewarmParams params(request.ip_transparent,
+					request.bind_address,
+					request.address,
+					request.timeout);
+	prewarm.OnCreate(c.GetStockName(), &params);
+
 	auto *connection = new TcpStockConnection(c,
 						  request.address,
 						  cancel_ptr);
@@ -223,6 +230,24 @@ TcpStock::Create(CreateStockItem c,
 			  connection->cancel_ptr);
 }
 
+void
+TcpStock::PrewarmGet(AllocatorPtr alloc, const char *key,
+		     const StockPrewarmParams &params,
+		     StockGetHandler &handler,
+		     CancellablePointer &cancel_ptr) noexcept
+{
+	/* copy the addresses, because the request may be queued
+	   while StockPrewarm forgets the key */
+	auto request = NewDisposablePointer<TcpStockRequest>(alloc, alloc,
+							     nullptr, key,
+							     params.ip_transparent,
+							     DupAddress(alloc, params.bind_address),
+							     DupAddress(alloc, params.address),
+							     params.timeout);
+
+	stock.Get(key, std::move(request), handler, cancel_ptr);
+}
+
 TcpStockConnection::~TcpStockConnection() noexcept
 {
 	if (cancel_ptr)
@@ -271,6 +296,7 @@ TcpStock::Get(AllocatorPtr alloc, const StopwatchPtr &parent_stopwatch,
 							     bind_address, address,
 							     timeout);
 
+	prewarm.OnGet(name);
 	stock.Get(name, std::move(request), handler, cancel_ptr);
 }
 
@@ -38,6 +38,7 @@
 
 #include "stock/Class.hxx"
 #include "stock/MapStock.hxx"
+#include "stock/Prewarm.hxx"
 #include "event/Chrono.hxx"
 
 class AllocatorPtr;
@@ -52,9 +53,11 @@ class StopwatchPtr;
  *
  * @return the new TCP connections stock (this function cannot fail)
  */
-class TcpStock final : StockClass {
+class TcpStock final : StockClass, StockPrewarmHandler {
 	StockMap stock;
 
+	StockPrewarm prewarm;
+
 public:
 	/**
 	 * @param limit the maximum number of connections per host
@@ -62,7 +65,8 @@ public:
 	TcpStock(EventLoop &event_loop, unsigned limit) noexcept
 		:stock(event_loop, *this, limit, 16,
 		       /* each TcpStockConnection has its own timer */
-		       Event::Duration::zero()) {}
+		       Event::Duration::zero()),
+		 prewarm(event_loop, *this, 16) {}
 
 	EventLoop &GetEventLoop() const noexcept {
 		return stock.GetEventLoop();
@@ -72,6 +76,18 @@ public:
 		stock.AddStats(data);
 	}
 
+	void AddStats(StockPrewarmStats &data) const noexcept {
+		prewarm.AddStats(data);
+	}
+
+	/**
+	 * Set the minimum number of idle connections per host.  0
+	 * disables pre-warming.
+	 */
+	void SetMinIdle(unsigned min_idle) noexcept {
+		prewarm.SetMinIdle(min_idle);
+	}
+
 	/**
 	 * @param name the MapStock name; it is auto-generated from the
 	 * #address if nullptr is passed here
@@ -90,6 +106,12 @@ private:
 	/* virtual methods from class StockClass */
 	void Create(CreateStockItem c, StockRequest request,
 		    CancellablePointer &cancel_ptr) override;
+
+	/* virtual methods from class StockPrewarmHandler */
+	void PrewarmGet(AllocatorPtr alloc, const char *key,
+			const StockPrewarmParams &params,
+			StockGetHandler &handler,
+			CancellablePointer &cancel_ptr) noexcept override;
 };
 
 [[gnu::pure]]
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "BaseIndex.hxx"
+
+#include <algorithm>
+
+#include <assert.h>
+
+void
+TranslationBaseIndex::Add(std::string_view key)
+{
+	assert(!key.empty());
+
+	Node *node = &root;
+
+	while (!key.empty()) {
+		auto i = node->children.find(key.front());
+		if (i == node->children.end()) {
+			auto child = std::make_unique<Node>(key);
+			child->count = 1;
+			node->children.emplace(key.front(), std::move(child));
+			return;
+		}
+
+		Node &child = *i->second;
+
+		const auto common = std::mismatch(child.label.begin(),
+						  child.label.end(),
+						  key.begin(), key.end()).first
+			- child.label.begin();
+
+		if (std::size_t(common) < child.label.size()) {
+			/* split the edge: insert an intermediate node
+			   holding the common part of the label */
+			auto middle = std::make_unique<Node>(std::string_view{child.label}.substr(0, common));
+			auto old = std::move(i->second);
+			old->label.erase(0, common);
+			middle->children.emplace(old->label.front(),
+						 std::move(old));
+			i->second = std::move(middle);
+		}
+
+		node = i->second.get();
+		key.remove_prefix(common);
+	}
+
+	++node->count;
+}
+
+void
+TranslationBaseIndex::Remove(Node &parent, std::string_view key) noexcept
+{
+	auto i = parent.children.find(key.front());
+	if (i == parent.children.end())
+		return;
+
+	Node &child = *i->second;
+	if (!key.starts_with(child.label))
+		return;
+
+	key.remove_prefix(child.label.size());
+
+	if (key.empty()) {
+		assert(child.count > 0);
+		--child.count;
+	} else
+		Remove(child, key);
+
+	if (child.count > 0)
+		return;
+
+	if (child.children.empty()) {
+		/* prune the leaf */
+		parent.children.erase(i);
+	} else if (child.children.size() == 1) {
+		/* merge the only grandchild into this edge */
+		auto grandchild = std::move(child.children.begin()->second);
+		grandchild->label.insert(0, child.label);
+		i->second = std::move(grandchild);
+	}
+}
+
+void
+TranslationBaseIndex::Remove(std::string_view key) noexcept
+{
+	assert(!key.empty());
+
+	Remove(root, key);
+}
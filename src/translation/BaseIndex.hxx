@@ -0,0 +1,122 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/**
+ * A compressed radix trie of translation cache keys which belong to
+ * BASE responses.  It allows finding all stored keys which are a
+ * prefix of a given key with one walk, instead of probing the cache
+ * hash table once for each slash in the URI.
+ *
+ * Each key has a reference counter, because more than one cache item
+ * (differing in VARY) may be stored with the same key.
+ */
+class TranslationBaseIndex {
+	struct Node {
+		/**
+		 * The label of the edge from the parent to this node.
+		 */
+		std::string label;
+
+		std::map<char, std::unique_ptr<Node>> children;
+
+		/**
+		 * The number of cache items with the key ending at
+		 * this node.
+		 */
+		unsigned count = 0;
+
+		Node() = default;
+
+		explicit Node(std::string_view _label) noexcept
+			:label(_label) {}
+
+		[[gnu::pure]]
+		const Node *FindChild(char ch) const noexcept {
+			auto i = children.find(ch);
+			return i != children.end() ? i->second.get() : nullptr;
+		}
+	};
+
+	Node root;
+
+public:
+	bool IsEmpty() const noexcept {
+		return root.children.empty();
+	}
+
+	void Add(std::string_view key);
+	void Remove(std::string_view key) noexcept;
+
+	void Clear() noexcept {
+		root.children.clear();
+	}
+
+	/**
+	 * Invoke the given function for each stored key which is a
+	 * proper prefix of the given key, passing the prefix length.
+	 * The longest prefix is visited first.  If the function
+	 * returns true, the walk stops.
+	 *
+	 * @return true if the function has returned true
+	 */
+	template<typename F>
+	bool FindPrefixes(std::string_view key, F &&f) const {
+		return FindPrefixes(root, key, 0, f);
+	}
+
+private:
+	template<typename F>
+	static bool FindPrefixes(const Node &node, std::string_view key,
+				 std::size_t position, F &f) {
+		if (position < key.size()) {
+			const Node *child = node.FindChild(key[position]);
+			if (child != nullptr &&
+			    key.substr(position).starts_with(child->label) &&
+			    FindPrefixes(*child, key,
+					 position + child->label.size(), f))
+				return true;
+
+			if (node.count > 0 && f(position))
+				return true;
+		}
+
+		return false;
+	}
+
+	static void Remove(Node &parent, std::string_view key) noexcept;
+};
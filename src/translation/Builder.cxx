@@ -32,6 +32,7 @@
 
 #include "Builder.hxx"
 #include "Stock.hxx"
+#include "Multiplex.hxx"
 #include "Cache.hxx"
 #include "net/SocketAddress.hxx"
 #include "util/ConstBuffer.hxx"
@@ -62,8 +63,9 @@ SocketAddressCompare::operator()(SocketAddress a,
 	return a.GetSize() < b.GetSize();
 }
 
-TranslationStockBuilder::TranslationStockBuilder(unsigned _limit) noexcept
-	:limit(_limit)
+TranslationStockBuilder::TranslationStockBuilder(unsigned _limit,
+						 bool _multiplex) noexcept
+	:limit(_limit), multiplex(_multiplex)
 {
 }
 
@@ -74,9 +76,14 @@ TranslationStockBuilder::Get(SocketAddress address,
 			     EventLoop &event_loop) noexcept
 {
 	auto e = m.emplace(address, nullptr);
-	if (e.second)
-		e.first->second = std::make_shared<TranslationStock>
-			(event_loop, address, limit);
+	if (e.second) {
+		if (multiplex)
+			e.first->second = std::make_shared<TranslationMultiplexer>
+				(event_loop, address, limit);
+		else
+			e.first->second = std::make_shared<TranslationStock>
+				(event_loop, address, limit);
+	}
 
 	return e.first->second;
 }
@@ -109,6 +116,17 @@ TranslationCacheBuilder::GetStats() const noexcept
 	return stats;
 }
 
+TranslationCacheCounters
+TranslationCacheBuilder::GetCounters() const noexcept
+{
+	TranslationCacheCounters counters;
+
+	for (const auto &i : m)
+		counters += i.second->GetCounters();
+
+	return counters;
+}
+
 void
 TranslationCacheBuilder::Flush() noexcept
 {
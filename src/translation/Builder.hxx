@@ -44,6 +44,7 @@
 
 template<typename T> struct ConstBuffer;
 struct AllocatorStats;
+struct TranslationCacheCounters;
 class EventLoop;
 class SocketAddress;
 class TranslationStock;
@@ -65,11 +66,18 @@ public:
 class TranslationStockBuilder final : public TranslationServiceBuilder {
 	const unsigned limit;
 
-	std::map<SocketAddress, std::shared_ptr<TranslationStock>,
+	/**
+	 * Create #TranslationMultiplexer instances instead of
+	 * #TranslationStock?
+	 */
+	const bool multiplex;
+
+	std::map<SocketAddress, std::shared_ptr<TranslationService>,
 		 SocketAddressCompare> m;
 
 public:
-	explicit TranslationStockBuilder(unsigned _limit) noexcept;
+	explicit TranslationStockBuilder(unsigned _limit,
+					 bool _multiplex=false) noexcept;
 	~TranslationStockBuilder() noexcept;
 
 	std::shared_ptr<TranslationService> Get(SocketAddress address,
@@ -96,6 +104,8 @@ public:
 
 	AllocatorStats GetStats() const noexcept;
 
+	TranslationCacheCounters GetCounters() const noexcept;
+
 	void Flush() noexcept;
 
 	void Invalidate(const TranslateRequest &request,
@@ -31,7 +31,10 @@
  */
 
 #include "Cache.hxx"
+#include "CacheLease.hxx"
 #include "Layout.hxx"
+#include "BaseIndex.hxx"
+#include "MtimeWatch.hxx"
 #include "translation/Handler.hxx"
 #include "translation/Request.hxx"
 #include "translation/Response.hxx"
@@ -57,11 +60,13 @@
 #include <boost/intrusive/list.hpp>
 #include <boost/intrusive/unordered_set.hpp>
 
+#include <list>
+#include <string>
+#include <string_view>
+
 #include <time.h>
 #include <string.h>
 #include <stdlib.h>
-#include <sys/stat.h>
-#include <errno.h>
 
 static constexpr std::size_t MAX_CACHE_LAYOUT = 256;
 #define MAX_CACHE_CHECK 256
@@ -73,9 +78,180 @@ static constexpr size_t MAX_FILE_NOT_FOUND = 256;
 static constexpr size_t MAX_DIRECTORY_INDEX = 256;
 static constexpr size_t MAX_READ_FILE = 256;
 
+/**
+ * The total size of all #TranslateCacheExpandMemo entries of one
+ * cache.
+ */
+static constexpr std::size_t MAX_EXPAND_MEMO_SIZE = 16 * 1024 * 1024;
+
 struct TranslateCachePerHost;
 struct TranslateCachePerSite;
 
+/**
+ * A small per-item cache of expanded responses, keyed by the inputs
+ * of the regex expansion.  This saves the PCRE match and all
+ * expansions when the same URI below an expandable BASE is requested
+ * again.
+ */
+class TranslateCacheExpandMemo {
+	static constexpr std::size_t MAX_ENTRIES = 32;
+	static constexpr std::size_t MAX_SIZE = 32 * 1024;
+
+	using LinkMode =
+		boost::intrusive::link_mode<boost::intrusive::normal_link>;
+	using Hook = boost::intrusive::list_member_hook<LinkMode>;
+
+	struct Entry {
+		TranslateCacheExpandMemo &memo;
+
+		/**
+		 * Links into #TranslateCacheExpandMemo::entries.
+		 */
+		Hook memo_hook;
+
+		/**
+		 * Links into #Budget::entries.
+		 */
+		Hook budget_hook;
+
+		const std::string key;
+
+		const PoolPtr pool;
+
+		/**
+		 * The expanded response, allocated from #pool.  Its
+		 * "base" attribute has been cleared, so
+		 * TranslateResponse::CacheLoad() copies it verbatim.
+		 */
+		const TranslateResponse &response;
+
+		const std::size_t size;
+
+		Entry(TranslateCacheExpandMemo &_memo,
+		      std::string &&_key, PoolPtr &&_pool,
+		      const TranslateResponse &_response) noexcept
+			:memo(_memo),
+			 key(std::move(_key)), pool(std::move(_pool)),
+			 response(_response),
+			 size(pool_netto_size(pool)) {}
+	};
+
+	template<Hook Entry::*hook>
+	using EntryList =
+		boost::intrusive::list<Entry,
+				       boost::intrusive::member_hook<Entry, Hook,
+								     hook>,
+				       boost::intrusive::constant_time_size<true>>;
+
+public:
+	/**
+	 * Limits the memory of all memos of one cache.  Memo entries
+	 * are not accounted in the item count limited by
+	 * "translate_cache_size", so without this limit, each item
+	 * could hold #MAX_SIZE bytes on top of its response.  When
+	 * the budget is exhausted, the least recently used entries
+	 * of all items are evicted.
+	 */
+	class Budget {
+		friend class TranslateCacheExpandMemo;
+
+		const std::size_t max_size;
+
+		std::size_t size = 0;
+
+		/**
+		 * Most recently used first.
+		 */
+		EntryList<&Entry::budget_hook> entries;
+
+	public:
+		explicit Budget(std::size_t _max_size) noexcept
+			:max_size(_max_size) {}
+
+		~Budget() noexcept {
+			assert(entries.empty());
+		}
+
+		Budget(const Budget &) = delete;
+		Budget &operator=(const Budget &) = delete;
+
+		std::size_t GetSize() const noexcept {
+			return size;
+		}
+	};
+
+private:
+	Budget &budget;
+
+	/**
+	 * Most recently used first.
+	 */
+	EntryList<&Entry::memo_hook> entries;
+
+	std::size_t size = 0;
+
+public:
+	explicit TranslateCacheExpandMemo(Budget &_budget) noexcept
+		:budget(_budget) {}
+
+	~TranslateCacheExpandMemo() noexcept {
+		while (!entries.empty())
+			Remove(entries.back());
+	}
+
+	TranslateCacheExpandMemo(const TranslateCacheExpandMemo &) = delete;
+	TranslateCacheExpandMemo &operator=(const TranslateCacheExpandMemo &) = delete;
+
+	const TranslateResponse *Get(std::string_view key) noexcept {
+		for (auto &entry : entries) {
+			if (entry.key == key) {
+				entries.erase(entries.iterator_to(entry));
+				entries.push_front(entry);
+				budget.entries.erase(budget.entries.iterator_to(entry));
+				budget.entries.push_front(entry);
+				return &entry.response;
+			}
+		}
+
+		return nullptr;
+	}
+
+	const TranslateResponse &Put(std::string &&key, PoolPtr &&pool,
+				     const TranslateResponse &response) {
+		auto *entry = new Entry(*this, std::move(key),
+					std::move(pool), response);
+		entries.push_front(*entry);
+		budget.entries.push_front(*entry);
+		size += entry->size;
+		budget.size += entry->size;
+
+		/* evict the least recently used entries, but never
+		   the new one */
+		while (entries.size() > 1 &&
+		       (entries.size() > MAX_ENTRIES || size > MAX_SIZE))
+			Remove(entries.back());
+
+		while (budget.size > budget.max_size &&
+		       &budget.entries.back() != entry)
+			budget.entries.back().memo.Remove(budget.entries.back());
+
+		return response;
+	}
+
+private:
+	void Remove(Entry &entry) noexcept {
+		assert(&entry.memo == this);
+		assert(size >= entry.size);
+		assert(budget.size >= entry.size);
+
+		entries.erase(entries.iterator_to(entry));
+		budget.entries.erase(budget.entries.iterator_to(entry));
+		size -= entry.size;
+		budget.size -= entry.size;
+		delete &entry;
+	}
+};
+
 struct TranslateCacheItem final : PoolHolder, CacheItem {
 	using LinkMode =
 		boost::intrusive::link_mode<boost::intrusive::normal_link>;
@@ -99,6 +275,26 @@ struct TranslateCacheItem final : PoolHolder, CacheItem {
 	SiblingsHook per_site_siblings;
 	TranslateCachePerSite *per_site = nullptr;
 
+	/**
+	 * If this is a BASE response, then it has been added to this
+	 * index with the given key.  Check base_index!=nullptr to
+	 * check whether this item lives in the index.
+	 */
+	TranslationBaseIndex *base_index = nullptr;
+	const char *base_index_key;
+
+	/**
+	 * Registered at #tcache::mtime_watch if the response contains
+	 * VALIDATE_MTIME.
+	 */
+	mutable TranslationMtimeWatch::Handle mtime_watch;
+
+	/**
+	 * Only used if the response is expandable.  This is
+	 * destroyed together with the item.
+	 */
+	TranslateCacheExpandMemo expand_memo;
+
 	struct {
 		const char *param;
 		ConstBuffer<void> session;
@@ -126,9 +322,11 @@ struct TranslateCacheItem final : PoolHolder, CacheItem {
 
 	TranslateCacheItem(PoolPtr &&_pool,
 			   std::chrono::steady_clock::time_point now,
-			   std::chrono::seconds max_age)
+			   std::chrono::seconds max_age,
+			   TranslateCacheExpandMemo::Budget &expand_memo_budget)
 		:PoolHolder(std::move(_pool)),
-		 CacheItem(now, max_age, 1) {}
+		 CacheItem(now, max_age, 1),
+		 expand_memo(expand_memo_budget) {}
 
 	TranslateCacheItem(const TranslateCacheItem &) = delete;
 
@@ -357,6 +555,30 @@ struct tcache {
 	PerSiteSet::bucket_type per_site_buckets[N_BUCKETS];
 	PerSiteSet per_site;
 
+	/**
+	 * All keys of cached BASE responses.  This allows
+	 * tcache_lookup() to find BASE candidates without probing the
+	 * #Cache once for each URI segment.
+	 *
+	 * This must be declared before #cache, because destroying
+	 * cache items accesses it.
+	 */
+	TranslationBaseIndex base_index;
+
+	/**
+	 * Watches the VALIDATE_MTIME paths of all items.  This must be
+	 * declared before #cache, because cache items unregister from
+	 * it.
+	 */
+	TranslationMtimeWatch mtime_watch;
+
+	/**
+	 * The memory limit for the #TranslateCacheExpandMemo of all
+	 * items.  This must be declared before #cache, because cache
+	 * items release their memo entries.
+	 */
+	TranslateCacheExpandMemo::Budget expand_memo_budget;
+
 	Cache cache;
 
 	TranslationService &next;
@@ -368,6 +590,8 @@ struct tcache {
 	 */
 	bool active;
 
+	uint64_t expand_hits = 0, expand_misses = 0;
+
 	tcache(struct pool &_pool, EventLoop &event_loop,
 	       TranslationService &_next, unsigned max_size,
 	       bool handshake_cacheable);
@@ -1030,29 +1254,23 @@ tcache_lookup(AllocatorPtr alloc, struct tcache &tcache,
 
 	/* no match - look for matching BASE responses */
 
-	char *uri = alloc.Dup(key);
-	char *slash = strrchr(uri, '/');
+	if (tcache.base_index.IsEmpty())
+		return nullptr;
 
-	if (slash != nullptr && slash[1] == 0) {
-		/* if the URI already ends with a slash, don't repeat the
-		   original lookup - cut off this slash, and try again */
-		*slash = 0;
-		slash = strrchr(uri, '/');
-	}
+	/* the index visits the longest BASE first, i.e. the most
+	   specific one wins */
 
-	while (slash != nullptr) {
-		/* truncate string after slash */
-		slash[1] = 0;
+	char *uri = alloc.Dup(key);
 
-		item = tcache_get(tcache, request, uri, true);
-		if (item != nullptr)
-			return item;
+	tcache.base_index.FindPrefixes(key, [&](std::size_t length){
+		/* truncate string after the slash */
+		uri[length] = 0;
 
-		*slash = 0;
-		slash = strrchr(uri, '/');
-	}
+		item = tcache_get(tcache, request, uri, true);
+		return item != nullptr;
+	});
 
-	return nullptr;
+	return item;
 }
 
 struct TranslationCacheInvalidate {
@@ -1194,7 +1412,8 @@ tcache_store(TranslateCacheRequest &tcr, const TranslateResponse &response)
 	auto item = NewFromPool<TranslateCacheItem>(pool_new_slice(tcr.tcache->pool, "tcache_item",
 								   &tcr.tcache->slice_pool),
 						    tcr.tcache->cache.SteadyNow(),
-						    max_age);
+						    max_age,
+						    tcr.tcache->expand_memo_budget);
 
 	const AllocatorPtr alloc(item->GetPool());
 
@@ -1287,6 +1506,19 @@ tcache_store(TranslateCacheRequest &tcr, const TranslateResponse &response)
 	if (response.site != nullptr)
 		tcache_add_per_site(*tcr.tcache, item);
 
+	if (item->response.base != nullptr) {
+		const size_t key_length = strlen(key);
+		if (key_length > 0 && key[key_length - 1] == '/') {
+			tcr.tcache->base_index.Add(key);
+			item->base_index = &tcr.tcache->base_index;
+			item->base_index_key = key;
+		}
+	}
+
+	if (item->response.validate_mtime.path != nullptr)
+		tcr.tcache->mtime_watch.Register(item->mtime_watch,
+						 item->response.validate_mtime.path);
+
 	TranslateCacheMatchContext match_ctx{tcr.request, tcr.find_base};
 	tcr.tcache->cache.PutMatch(key, *item, tcache_item_match, &match_ctx);
 	return item;
@@ -1344,32 +1576,134 @@ TranslateCacheRequest::OnTranslateError(std::exception_ptr ep) noexcept
 	handler->OnTranslateError(ep);
 }
 
+/**
+ * Can the cached response be handed out as-is, without copying it
+ * to the caller's pool?  This is only possible if
+ * TranslateResponse::CacheLoad() would not modify it, i.e. if there
+ * is neither a BASE nor anything to expand.
+ */
+gcc_pure
+static bool
+tcache_can_share(const TranslateResponse &response) noexcept
+{
+	return response.base == nullptr && !response.IsExpandable();
+}
+
+/**
+ * Build the key for TranslateCacheExpandMemo: all inputs of
+ * TranslateResponse::CacheLoad() and tcache_expand_response() which
+ * vary between requests.
+ */
+static std::string
+tcache_expand_memo_key(const TranslateResponse &response,
+		       const char *uri, const char *host,
+		       const char *user) noexcept
+{
+	std::string key(uri);
+
+	if (response.regex_on_host_uri) {
+		key.push_back('\n');
+		if (host != nullptr)
+			key.append(host);
+	}
+
+	if (response.regex_on_user_uri) {
+		key.push_back('\n');
+		if (user != nullptr)
+			key.append(user);
+	}
+
+	return key;
+}
+
+/**
+ * Look up the expanded response in the item's
+ * #TranslateCacheExpandMemo; on a miss, expand it and add it.
+ *
+ * Throws on error.
+ */
+static const TranslateResponse &
+tcache_expand_memo(struct tcache &tcache, TranslateCacheItem &item,
+		   const char *uri, const char *host, const char *user,
+		   gcc_unused const char *key)
+{
+	const TranslateResponse &cached = item.response;
+
+	auto memo_key = tcache_expand_memo_key(cached,
+					       uri, host, user);
+	if (const auto *expanded = item.expand_memo.Get(memo_key)) {
+		LogConcat(5, "TranslationCache", "expand hit ", key);
+		++tcache.expand_hits;
+		return *expanded;
+	}
+
+	++tcache.expand_misses;
+
+	auto pool = pool_new_linear(item.GetPool(), "tcache_expand", 1024);
+	const AllocatorPtr memo_alloc(pool);
+
+	auto *expanded = memo_alloc.New<TranslateResponse>();
+	expanded->CacheLoad(memo_alloc, cached, uri);
+	tcache_expand_response(memo_alloc, *expanded, item.regex,
+			       uri, host, user);
+
+	/* the BASE has already been applied; clear it so the
+	   CacheLoad() call in tcache_hit() doesn't apply it again */
+	expanded->base = nullptr;
+
+	return item.expand_memo.Put(std::move(memo_key), std::move(pool),
+				    *expanded);
+}
+
 static void
-tcache_hit(AllocatorPtr alloc,
+tcache_hit(AllocatorPtr alloc, struct tcache &tcache,
 	   const char *uri, const char *host, const char *user,
+	   TranslationCacheLease *lease,
 	   gcc_unused const char *key,
-	   const TranslateCacheItem &item,
+	   TranslateCacheItem &item,
 	   TranslateHandler &handler)
 {
+	/* the cached response is never modified; all responses
+	   handed out are copies, except for shared hits */
+	const TranslateResponse &cached = item.response;
+
+	if (lease != nullptr && !lease->IsFull() &&
+	    tcache_can_share(cached)) {
+		LogConcat(4, "TranslationCache", "shared hit ", key);
+
+		/* the lease keeps the item (and its pool) alive; the
+		   caller has promised not to modify the response, but
+		   TranslateHandler takes a non-const reference */
+		lease->Add(item);
+		handler.OnTranslateResponse(const_cast<TranslateResponse &>(cached));
+		return;
+	}
+
 	auto response = alloc.New<TranslateResponse>();
 
 	LogConcat(4, "TranslationCache", "hit ", key);
 
-	try {
-		response->CacheLoad(alloc, item.response, uri);
-	} catch (...) {
-		handler.OnTranslateError(std::current_exception());
-		return;
-	}
-
-	if (uri != nullptr && response->IsExpandable()) {
+	if (uri != nullptr && cached.IsExpandable()) {
 		try {
-			tcache_expand_response(alloc, *response, item.regex,
-					       uri, host, user);
+			const auto &expanded =
+				tcache_expand_memo(tcache, item,
+						   uri, host, user, key);
+			response->CacheLoad(alloc, expanded, uri);
 		} catch (...) {
 			handler.OnTranslateError(std::current_exception());
 			return;
 		}
+
+		response->base = alloc.CheckDup(cached.base);
+		handler.OnTranslateResponse(*response);
+		return;
+	}
+
+	try {
+		response->CacheLoad(alloc, cached, uri);
+	} catch (...) {
+		handler.OnTranslateError(std::current_exception());
+		return;
 	}
 
 	handler.OnTranslateResponse(*response);
@@ -1395,55 +1729,6 @@ tcache_miss(AllocatorPtr alloc, struct tcache &tcache,
 				*tcr, cancel_ptr);
 }
 
-gcc_pure
-static bool
-tcache_validate_mtime(const TranslateResponse &response,
-		      gcc_unused const char *key)
-{
-	if (response.validate_mtime.path == nullptr)
-		return true;
-
-	LogConcat(6, "TranslationCache", "[", key,
-		  "] validate_mtime ", response.validate_mtime.mtime,
-		  " ", response.validate_mtime.path);
-
-	struct stat st;
-	if (lstat(response.validate_mtime.path, &st) < 0) {
-		if (errno == ENOENT && response.validate_mtime.mtime == 0) {
-			/* the special value 0 matches when the file does not
-			   exist */
-			LogConcat(6, "TranslationCache", "[", key,
-				  "] validate_mtime enoent ",
-				  response.validate_mtime.path);
-			return true;
-		}
-
-		LogConcat(3, "TranslationCache", "[", key,
-			  "] failed to stat '", response.validate_mtime.path,
-			  "': ", strerror(errno));
-		return false;
-	}
-
-	if (!S_ISREG(st.st_mode)) {
-		LogConcat(3, "TranslationCache", "[", key,
-			  "] not a regular file: ", response.validate_mtime.path);
-		return false;
-	}
-
-	if (st.st_mtime == (time_t)response.validate_mtime.mtime) {
-		LogConcat(6, "TranslationCache", "[", key,
-			  "] validate_mtime unmodified ",
-			  response.validate_mtime.path);
-		return true;
-	} else {
-		LogConcat(5, "TranslationCache", "[", key,
-			  "] validate_mtime modified ",
-			  response.validate_mtime.path);
-		return false;
-	}
-}
-
-
 /*
  * cache class
  *
@@ -1452,7 +1737,10 @@ tcache_validate_mtime(const TranslateResponse &response,
 bool
 TranslateCacheItem::Validate() const noexcept
 {
-	return tcache_validate_mtime(response, GetKey());
+	if (response.validate_mtime.path == nullptr)
+		return true;
+
+	return mtime_watch.Validate(response.validate_mtime.mtime, GetKey());
 }
 
 void
@@ -1464,6 +1752,9 @@ TranslateCacheItem::Destroy() noexcept
 	if (per_site != nullptr)
 		per_site->Erase(*this);
 
+	if (base_index != nullptr)
+		base_index->Remove(base_index_key);
+
 	pool_trash(pool);
 	this->~TranslateCacheItem();
 }
@@ -1481,6 +1772,8 @@ tcache::tcache(struct pool &_pool, EventLoop &event_loop,
 	 slice_pool(4096, 32768),
 	 per_host(PerHostSet::bucket_traits(per_host_buckets, N_BUCKETS)),
 	 per_site(PerSiteSet::bucket_traits(per_site_buckets, N_BUCKETS)),
+	 mtime_watch(event_loop),
+	 expand_memo_budget(MAX_EXPAND_MEMO_SIZE),
 	 cache(event_loop, 65521, max_size),
 	 next(_next), active(handshake_cacheable)
 {
@@ -1510,6 +1803,16 @@ TranslationCache::GetStats() const noexcept
 	return pool_children_stats(cache->pool);
 }
 
+TranslationCacheCounters
+TranslationCache::GetCounters() const noexcept
+{
+	TranslationCacheCounters counters;
+	counters.validations_avoided = cache->mtime_watch.GetValidationsAvoided();
+	counters.expand_hits = cache->expand_hits;
+	counters.expand_misses = cache->expand_misses;
+	return counters;
+}
+
 void
 TranslationCache::Flush() noexcept
 {
@@ -1536,7 +1839,8 @@ TranslationCache::SendRequest(AllocatorPtr alloc,
 		? tcache_lookup(alloc, *cache, request, key)
 		: nullptr;
 	if (item != nullptr)
-		tcache_hit(alloc, request.uri, request.host, request.user, key,
+		tcache_hit(alloc, *cache, request.uri, request.host, request.user,
+			   request.cache_lease, key,
 			   *item, handler);
 	else
 		tcache_miss(alloc, *cache, request, key, cacheable,
@@ -34,6 +34,7 @@
 
 #include "Service.hxx"
 
+#include <cstdint>
 #include <memory>
 
 enum class TranslationCommand : uint16_t;
@@ -43,6 +44,30 @@ template<typename T> struct ConstBuffer;
 
 struct tcache;
 
+/**
+ * Counters about the translation cache's shortcuts.
+ */
+struct TranslationCacheCounters {
+	/**
+	 * VALIDATE_MTIME checks which were answered without a
+	 * system call.
+	 */
+	uint64_t validations_avoided = 0;
+
+	/**
+	 * Hits on expandable responses which were served from (or
+	 * added to) the memoized expansion results.
+	 */
+	uint64_t expand_hits = 0, expand_misses = 0;
+
+	TranslationCacheCounters &operator+=(const TranslationCacheCounters &other) noexcept {
+		validations_avoided += other.validations_avoided;
+		expand_hits += other.expand_hits;
+		expand_misses += other.expand_misses;
+		return *this;
+	}
+};
+
 /**
  * Cache for translation server responses.
  */
@@ -65,6 +90,9 @@ public:
 	[[gnu::pure]]
 	AllocatorStats GetStats() const noexcept;
 
+	[[gnu::pure]]
+	TranslationCacheCounters GetCounters() const noexcept;
+
 	/**
 	 * Flush all items from the cache.
 	 */
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "cache.hxx"
+
+#include <array>
+
+#include <assert.h>
+
+/**
+ * Keeps #TranslationCache items locked while their #TranslateResponse
+ * is being used.  If a #TranslateRequest refers to a lease (see
+ * TranslateRequest::cache_lease), the cache may hand out the cached
+ * response itself instead of copying it to the caller's pool.
+ *
+ * The caller must not modify such a response, and it must keep the
+ * lease alive for as long as any pointer into the response exists.
+ */
+class TranslationCacheLease {
+	/**
+	 * The number of items which can be locked at a time.  Further
+	 * cache hits will be copied as usual.
+	 */
+	static constexpr std::size_t MAX_ITEMS = 4;
+
+	std::array<CacheItem *, MAX_ITEMS> items;
+
+	std::size_t n_items = 0;
+
+public:
+	TranslationCacheLease() noexcept = default;
+
+	~TranslationCacheLease() noexcept {
+		Release();
+	}
+
+	TranslationCacheLease(const TranslationCacheLease &) = delete;
+	TranslationCacheLease &operator=(const TranslationCacheLease &) = delete;
+
+	bool IsFull() const noexcept {
+		return n_items >= items.size();
+	}
+
+	void Add(CacheItem &item) noexcept {
+		assert(!IsFull());
+
+		item.Lock();
+		items[n_items++] = &item;
+	}
+
+	/**
+	 * Unlock all items.  Afterwards, responses obtained with this
+	 * lease must not be used anymore.
+	 */
+	void Release() noexcept {
+		while (n_items > 0)
+			items[--n_items]->Unlock();
+	}
+};
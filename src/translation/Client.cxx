@@ -49,8 +49,6 @@
 #include <assert.h>
 #include <string.h>
 
-static const uint8_t PROTOCOL_VERSION = 3;
-
 class TranslateClient final : BufferedSocketHandler, Cancellable {
 	const StopwatchPtr stopwatch;
 
@@ -264,7 +262,7 @@ try {
 	       (!request.content_type_lookup.IsNull() &&
 		request.suffix != nullptr));
 
-	GrowingBuffer gb = MarshalTranslateRequest(PROTOCOL_VERSION,
+	GrowingBuffer gb = MarshalTranslateRequest(TRANSLATE_PROTOCOL_VERSION,
 						   request);
 
 	auto *client = alloc.New<TranslateClient>(alloc, event_loop,
@@ -88,11 +88,15 @@ TranslationMarshaller::WriteOptional(TranslationCommand command,
 
 GrowingBuffer
 MarshalTranslateRequest(uint8_t PROTOCOL_VERSION,
-			const TranslateRequest &request)
+			const TranslateRequest &request,
+			uint32_t request_id)
 {
 	TranslationMarshaller m;
 
 	m.WriteT(TranslationCommand::BEGIN, PROTOCOL_VERSION);
+	if (request_id != 0)
+		m.WriteT(TRANSLATE_REQUEST_ID, request_id);
+
 	m.WriteOptional(TranslationCommand::ERROR_DOCUMENT,
 			request.error_document);
 
@@ -94,6 +94,29 @@ public:
 	}
 };
 
+/**
+ * The protocol version sent in the #TranslationCommand::BEGIN
+ * packet.
+ */
+static constexpr uint8_t TRANSLATE_PROTOCOL_VERSION = 3;
+
+/**
+ * Protocol extension: the payload is a 32 bit request id (host byte
+ * order) which allows multiple concurrent requests on one
+ * connection; see #TranslationMultiplexer.  It follows
+ * #TranslationCommand::BEGIN in both request and response.
+ *
+ * This command is not (yet) part of the #TranslationCommand
+ * enum, therefore it is allocated from the private range.
+ */
+static constexpr TranslationCommand TRANSLATE_REQUEST_ID =
+	TranslationCommand(0xff00);
+
+/**
+ * @param request_id if non-zero, then a #TRANSLATE_REQUEST_ID packet
+ * is emitted
+ */
 GrowingBuffer
 MarshalTranslateRequest(uint8_t PROTOCOL_VERSION,
-			const TranslateRequest &request);
+			const TranslateRequest &request,
+			uint32_t request_id=0);
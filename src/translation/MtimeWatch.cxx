@@ -0,0 +1,442 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "MtimeWatch.hxx"
+#include "event/Loop.hxx"
+#include "thread/Pool.hxx"
+#include "thread/Queue.hxx"
+#include "net/SocketDescriptor.hxx"
+#include "io/Logger.hxx"
+
+#include <cassert>
+#include <tuple>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+
+/**
+ * Does the given path live on a filesystem where inotify does not
+ * see modifications made by other hosts?
+ */
+static bool
+IsRemoteFilesystem(const char *path) noexcept
+{
+	constexpr long NFS_MAGIC = 0x6969;
+	constexpr long SMB_MAGIC = 0x517b;
+	constexpr long CIFS_MAGIC = 0xff534d42;
+	constexpr long SMB2_MAGIC = 0xfe534d42;
+	constexpr long FUSE_MAGIC = 0x65735546;
+	constexpr long CEPH_MAGIC = 0x00c36400;
+
+	struct statfs st;
+	if (statfs(path, &st) < 0)
+		/* can't tell; better don't watch it */
+		return true;
+
+	switch ((long)st.f_type) {
+	case NFS_MAGIC:
+	case SMB_MAGIC:
+	case CIFS_MAGIC:
+	case SMB2_MAGIC:
+	case FUSE_MAGIC:
+	case CEPH_MAGIC:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static UniqueFileDescriptor
+CreateInotify() noexcept
+{
+	const int fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+	if (fd < 0) {
+		/* not fatal; all paths will be checked with lstat() */
+		LogConcat(2, "TranslationCache", "inotify_init1() failed: ",
+			  strerror(errno));
+		return UniqueFileDescriptor{};
+	}
+
+	return UniqueFileDescriptor(fd);
+}
+
+TranslationMtimeWatch::TranslationMtimeWatch(EventLoop &_event_loop) noexcept
+	:event_loop(_event_loop),
+	 queue(thread_pool_get_queue(event_loop)),
+	 inotify_fd(CreateInotify()),
+	 inotify_event(event_loop, BIND_THIS_METHOD(OnInotifyReady),
+		       SocketDescriptor::FromFileDescriptor(inotify_fd))
+{
+	if (inotify_fd.IsDefined())
+		inotify_event.ScheduleRead();
+}
+
+TranslationMtimeWatch::~TranslationMtimeWatch() noexcept
+{
+	inotify_event.Cancel();
+
+	for (auto &i : paths) {
+		Path &path = i.second;
+		path.handles.clear_and_dispose([](Handle *handle){
+			handle->path = nullptr;
+			handle->modified = true;
+		});
+
+		if (path.probe != nullptr && !CancelProbe(path))
+			/* the thread pool has been joined, but Done()
+			   has not been invoked yet; let it free the
+			   probe */
+			path.probe->path = nullptr;
+	}
+}
+
+void
+TranslationMtimeWatch::Probe::Run() noexcept
+{
+	if (inotify_fd >= 0 && !IsRemoteFilesystem(path_name.c_str())) {
+		/* watch the path itself and not a symlink target,
+		   just like lstat(); the watch is added before
+		   lstat() so no modification can slip in between
+		   (modifications of parent directories are only
+		   seen by the periodic lstat(), see #watched_ttl) */
+		wd = inotify_add_watch(inotify_fd, path_name.c_str(),
+				       IN_MODIFY|IN_ATTRIB|IN_CLOSE_WRITE|
+				       IN_MOVE_SELF|IN_DELETE_SELF|
+				       IN_DONT_FOLLOW);
+		if (wd < 0)
+			watch_error = errno;
+	}
+
+	struct stat st;
+	if (lstat(path_name.c_str(), &st) < 0) {
+		snapshot.error = errno;
+		snapshot.regular = false;
+		snapshot.mtime = 0;
+	} else {
+		snapshot.error = 0;
+		snapshot.regular = S_ISREG(st.st_mode);
+		snapshot.mtime = st.st_mtime;
+	}
+}
+
+void
+TranslationMtimeWatch::Probe::Done() noexcept
+{
+	if (path == nullptr) {
+		/* the TranslationMtimeWatch is gone */
+		delete this;
+		return;
+	}
+
+	path->watch.OnProbeDone(*this);
+}
+
+const TranslationMtimeWatch::Snapshot *
+TranslationMtimeWatch::Path::GetSnapshot() noexcept
+{
+	if (!have_snapshot)
+		return nullptr;
+
+	const auto ttl = wd >= 0 ? watched_ttl : fallback_ttl;
+	const auto now = watch.event_loop.SteadyNow();
+	if (now < checked + ttl)
+		++watch.validations_avoided;
+	else if (probe == nullptr)
+		/* refresh in the background and use the old
+		   snapshot until then */
+		watch.StartProbe(*this, false);
+
+	return &snapshot;
+}
+
+void
+TranslationMtimeWatch::Handle::Unregister() noexcept
+{
+	if (path == nullptr)
+		return;
+
+	Path &p = *path;
+	path = nullptr;
+	unlink();
+
+	if (p.handles.empty())
+		p.watch.Dispose(p);
+}
+
+bool
+TranslationMtimeWatch::Handle::Validate(uint64_t mtime,
+					[[maybe_unused]] const char *key) noexcept
+{
+	if (path == nullptr) {
+		if (modified)
+			LogConcat(5, "TranslationCache", "[", key,
+				  "] validate_mtime modified (inotify)");
+		return !modified;
+	}
+
+	LogConcat(6, "TranslationCache", "[", key,
+		  "] validate_mtime ", mtime, " ", path->path);
+
+	const auto *snapshot = path->GetSnapshot();
+	if (snapshot == nullptr) {
+		/* the file has not been checked yet; the
+		   translation server has just obtained this mtime,
+		   so trust it */
+		LogConcat(6, "TranslationCache", "[", key,
+			  "] validate_mtime pending ", path->path);
+		return true;
+	}
+
+	if (snapshot->error != 0) {
+		if (snapshot->error == ENOENT && mtime == 0) {
+			/* the special value 0 matches when the file does not
+			   exist */
+			LogConcat(6, "TranslationCache", "[", key,
+				  "] validate_mtime enoent ", path->path);
+			return true;
+		}
+
+		LogConcat(3, "TranslationCache", "[", key,
+			  "] failed to stat '", path->path,
+			  "': ", strerror(snapshot->error));
+		return false;
+	}
+
+	if (!snapshot->regular) {
+		LogConcat(3, "TranslationCache", "[", key,
+			  "] not a regular file: ", path->path);
+		return false;
+	}
+
+	if (snapshot->mtime == (time_t)mtime) {
+		LogConcat(6, "TranslationCache", "[", key,
+			  "] validate_mtime unmodified ", path->path);
+		return true;
+	} else {
+		LogConcat(5, "TranslationCache", "[", key,
+			  "] validate_mtime modified ", path->path);
+		return false;
+	}
+}
+
+TranslationMtimeWatch::Path &
+TranslationMtimeWatch::MakePath(const char *path) noexcept
+{
+	auto [i, inserted] =
+		paths.emplace(std::piecewise_construct,
+			      std::forward_as_tuple(path),
+			      std::forward_as_tuple(*this, std::string(path)));
+	Path &p = i->second;
+	if (inserted)
+		StartProbe(p, inotify_fd.IsDefined());
+	return p;
+}
+
+void
+TranslationMtimeWatch::StartProbe(Path &path, bool add_watch) noexcept
+{
+	assert(path.probe == nullptr);
+
+	path.probe = new Probe(path, add_watch ? inotify_fd.Get() : -1);
+	++n_probes;
+	if (add_watch)
+		++n_watch_probes;
+
+	queue.Add(*path.probe);
+}
+
+bool
+TranslationMtimeWatch::CancelProbe(Path &path) noexcept
+{
+	assert(path.probe != nullptr);
+
+	Probe *probe = path.probe;
+	if (!queue.Cancel(*probe))
+		return false;
+
+	assert(n_probes > 0);
+	--n_probes;
+
+	if (probe->IsAddingWatch()) {
+		assert(n_watch_probes > 0);
+		--n_watch_probes;
+	}
+
+	path.probe = nullptr;
+	delete probe;
+	return true;
+}
+
+void
+TranslationMtimeWatch::OnProbeDone(Probe &probe) noexcept
+{
+	Path &p = *probe.path;
+	assert(p.probe == &probe);
+	p.probe = nullptr;
+
+	assert(n_probes > 0);
+	--n_probes;
+
+	p.snapshot = probe.snapshot;
+	p.checked = event_loop.SteadyNow();
+	p.have_snapshot = true;
+
+	bool missed = probe.stale;
+
+	if (probe.IsAddingWatch()) {
+		assert(n_watch_probes > 0);
+		--n_watch_probes;
+
+		if (probe.wd >= 0) {
+			if (unclaimed_wds.erase(probe.wd) > 0)
+				/* an event arrived before we knew
+				   this watch descriptor */
+				missed = true;
+
+			/* another path (hard link) may refer to the
+			   same inode and own this watch; fall back to
+			   lstat() for this one */
+			if (by_wd.emplace(probe.wd, &p).second)
+				p.wd = probe.wd;
+		} else if (probe.watch_error != 0 &&
+			   probe.watch_error != ENOENT)
+			LogConcat(4, "TranslationCache",
+				  "Failed to watch '", p.path, "': ",
+				  strerror(probe.watch_error));
+
+		if (n_watch_probes == 0)
+			unclaimed_wds.clear();
+	}
+
+	delete &probe;
+
+	if (p.handles.empty())
+		/* all handles were unregistered while the probe was
+		   running */
+		Dispose(p);
+	else if (missed)
+		Invalidate(p);
+}
+
+void
+TranslationMtimeWatch::Register(Handle &handle, const char *path) noexcept
+{
+	assert(path != nullptr);
+
+	handle.Unregister();
+
+	Path &p = MakePath(path);
+	p.handles.push_back(handle);
+	handle.path = &p;
+	handle.modified = false;
+}
+
+void
+TranslationMtimeWatch::Invalidate(Path &path) noexcept
+{
+	path.handles.clear_and_dispose([](Handle *handle){
+		handle->path = nullptr;
+		handle->modified = true;
+	});
+
+	Dispose(path);
+}
+
+void
+TranslationMtimeWatch::Dispose(Path &path) noexcept
+{
+	assert(path.handles.empty());
+
+	if (path.probe != nullptr && !CancelProbe(path))
+		/* OnProbeDone() will dispose it */
+		return;
+
+	if (path.wd >= 0) {
+		inotify_rm_watch(inotify_fd.Get(), path.wd);
+		by_wd.erase(path.wd);
+	}
+
+	paths.erase(paths.find(path.path));
+}
+
+void
+TranslationMtimeWatch::OnInotifyReady(unsigned) noexcept
+{
+	alignas(struct inotify_event) char buffer[4096];
+
+	while (true) {
+		const ssize_t nbytes = read(inotify_fd.Get(),
+					    buffer, sizeof(buffer));
+		if (nbytes <= 0) {
+			if (nbytes < 0 && errno != EAGAIN)
+				LogConcat(2, "TranslationCache",
+					  "Failed to read inotify events: ",
+					  strerror(errno));
+			break;
+		}
+
+		for (const char *p = buffer, *end = buffer + nbytes; p < end;) {
+			const auto &event = *(const struct inotify_event *)p;
+			p += sizeof(event) + event.len;
+
+			if (event.mask & IN_Q_OVERFLOW) {
+				/* events were lost; invalidate
+				   everything we watch or are about
+				   to watch */
+				for (auto i = paths.begin(); i != paths.end();) {
+					Path &path = (i++)->second;
+					if (path.probe != nullptr &&
+					    path.probe->IsAddingWatch())
+						path.probe->stale = true;
+					else if (path.wd < 0)
+						continue;
+
+					Invalidate(path);
+				}
+
+				continue;
+			}
+
+			/* any event means the file was modified (or
+			   deleted or replaced); invalidate all items
+			   depending on it */
+			if (auto i = by_wd.find(event.wd); i != by_wd.end())
+				Invalidate(*i->second);
+			else if (n_watch_probes > 0)
+				unclaimed_wds.emplace(event.wd);
+		}
+	}
+}
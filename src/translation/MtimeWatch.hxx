@@ -0,0 +1,328 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "event/SocketEvent.hxx"
+#include "event/Chrono.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+#include "thread/Job.hxx"
+#include "util/IntrusiveList.hxx"
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+#include <time.h>
+
+class ThreadQueue;
+
+/**
+ * Validates the VALIDATE_MTIME paths of translation cache items
+ * without calling lstat() on every cache hit.
+ *
+ * Paths on local filesystems are watched with inotify; any event on
+ * such a path invalidates all items which depend on it, and cache
+ * hits need no system call at all.  The watch only covers the final
+ * inode, so replacing an intermediate directory or symlink is not
+ * seen by inotify; therefore, watched paths are still checked with
+ * lstat() in the background every #watched_ttl.  Paths which cannot
+ * be watched (network filesystems, exhausted inotify limits,
+ * nonexistent files) share one lstat() result per path for up to
+ * #fallback_ttl.
+ *
+ * All system calls which resolve the path (statfs(), lstat(),
+ * inotify_add_watch()) run in the thread pool, because they may
+ * block on a slow filesystem.  Until a new result arrives, the
+ * previous one is used.
+ *
+ * This object must be destroyed after thread_pool_join().
+ */
+class TranslationMtimeWatch {
+	/**
+	 * Unwatched paths are checked again after this duration.
+	 * Network filesystems cache attributes for at least this long
+	 * anyway.
+	 */
+	static constexpr Event::Duration fallback_ttl = std::chrono::seconds(1);
+
+	/**
+	 * Watched paths are checked again after this duration, to
+	 * notice modifications of parent directories and symlinks
+	 * which inotify does not report.
+	 */
+	static constexpr Event::Duration watched_ttl = std::chrono::seconds(3);
+
+	struct Path;
+	class Probe;
+
+public:
+	/**
+	 * The registration of one cache item.  It is unregistered
+	 * automatically when destroyed.
+	 */
+	class Handle : public IntrusiveListHook {
+		friend class TranslationMtimeWatch;
+
+		Path *path = nullptr;
+
+		/**
+		 * Set when the path was modified after this handle
+		 * had been registered.
+		 */
+		bool modified = false;
+
+	public:
+		Handle() = default;
+		Handle(const Handle &) = delete;
+		Handle &operator=(const Handle &) = delete;
+
+		~Handle() noexcept {
+			Unregister();
+		}
+
+		void Unregister() noexcept;
+
+		/**
+		 * Check whether the file still has the given
+		 * modification time.  The special value 0 matches
+		 * when the file does not exist.
+		 *
+		 * @param key the cache key (for logging)
+		 */
+		bool Validate(uint64_t mtime, const char *key) noexcept;
+	};
+
+private:
+	struct Snapshot {
+		/**
+		 * The lstat() errno, or 0 on success.
+		 */
+		int error;
+
+		bool regular;
+
+		time_t mtime;
+	};
+
+	struct Path {
+		TranslationMtimeWatch &watch;
+
+		const std::string path;
+
+		IntrusiveList<Handle> handles;
+
+		/**
+		 * The inotify watch descriptor, or -1 if this path
+		 * is not being watched.
+		 */
+		int wd = -1;
+
+		/**
+		 * When was #snapshot obtained?
+		 */
+		Event::TimePoint checked;
+
+		Snapshot snapshot;
+
+		bool have_snapshot = false;
+
+		/**
+		 * The #Probe which is currently running in the thread
+		 * pool, or nullptr.  While it is set, this object
+		 * stays in #paths even if there are no more handles.
+		 */
+		Probe *probe = nullptr;
+
+		Path(TranslationMtimeWatch &_watch, std::string &&_path) noexcept
+			:watch(_watch), path(std::move(_path)) {}
+
+		/**
+		 * Returns the most recent #Snapshot and refreshes
+		 * it in the background if it is too old.  Returns
+		 * nullptr if the first #Probe has not finished yet.
+		 */
+		const Snapshot *GetSnapshot() noexcept;
+	};
+
+	/**
+	 * Obtains a #Snapshot (and optionally an inotify watch) in a
+	 * worker thread.
+	 */
+	class Probe final : public ThreadJob {
+		friend class TranslationMtimeWatch;
+
+		/**
+		 * The #Path which has started this probe.  It is
+		 * cleared when the #TranslationMtimeWatch is
+		 * destroyed while a worker thread owns this object;
+		 * Done() then only frees it.
+		 */
+		Path *path;
+
+		const std::string path_name;
+
+		/**
+		 * The inotify file descriptor if a watch shall be
+		 * added, or -1.
+		 */
+		const int inotify_fd;
+
+		/**
+		 * Set when events may have been lost while this probe
+		 * was running (#IN_Q_OVERFLOW).
+		 */
+		bool stale = false;
+
+		Snapshot snapshot;
+
+		/**
+		 * The new inotify watch descriptor, or -1.
+		 */
+		int wd = -1;
+
+		/**
+		 * The inotify_add_watch() errno, or 0.
+		 */
+		int watch_error = 0;
+
+	public:
+		Probe(Path &_path, int _inotify_fd) noexcept
+			:path(&_path), path_name(_path.path),
+			 inotify_fd(_inotify_fd) {}
+
+		bool IsAddingWatch() const noexcept {
+			return inotify_fd >= 0;
+		}
+
+	private:
+		/* virtual methods from class ThreadJob */
+		void Run() noexcept override;
+		void Done() noexcept override;
+	};
+
+	EventLoop &event_loop;
+
+	ThreadQueue &queue;
+
+	UniqueFileDescriptor inotify_fd;
+	SocketEvent inotify_event;
+
+	std::map<std::string, Path, std::less<>> paths;
+
+	std::unordered_map<int, Path *> by_wd;
+
+	/**
+	 * The number of running #Probe instances.
+	 */
+	unsigned n_probes = 0;
+
+	/**
+	 * The number of running #Probe instances which add an
+	 * inotify watch.
+	 */
+	unsigned n_watch_probes = 0;
+
+	/**
+	 * Watch descriptors of inotify events which arrived while
+	 * #n_watch_probes was non-zero and which were not (yet)
+	 * found in #by_wd.  A #Probe which has obtained one of these
+	 * may have missed a modification.
+	 */
+	std::set<int> unclaimed_wds;
+
+	/**
+	 * The number of cache hits which were validated without a
+	 * system call.
+	 */
+	uint64_t validations_avoided = 0;
+
+public:
+	explicit TranslationMtimeWatch(EventLoop &_event_loop) noexcept;
+	~TranslationMtimeWatch() noexcept;
+
+	TranslationMtimeWatch(const TranslationMtimeWatch &) = delete;
+	TranslationMtimeWatch &operator=(const TranslationMtimeWatch &) = delete;
+
+	uint64_t GetValidationsAvoided() const noexcept {
+		return validations_avoided;
+	}
+
+	/**
+	 * Are no probes running in the thread pool?
+	 */
+	bool IsIdle() const noexcept {
+		return n_probes == 0;
+	}
+
+	/**
+	 * Register a cache item which depends on the given path.
+	 */
+	void Register(Handle &handle, const char *path) noexcept;
+
+private:
+	Path &MakePath(const char *path) noexcept;
+
+	/**
+	 * Submit a new #Probe for the given path to the thread pool.
+	 *
+	 * @param add_watch true to attempt to watch the path with
+	 * inotify
+	 */
+	void StartProbe(Path &path, bool add_watch) noexcept;
+
+	/**
+	 * Cancel the #Probe of the given path.
+	 *
+	 * @return false if a worker thread owns it; the path must
+	 * then stay until it is done
+	 */
+	bool CancelProbe(Path &path) noexcept;
+
+	void OnProbeDone(Probe &probe) noexcept;
+
+	/**
+	 * Detach all handles from the given path (marking them
+	 * modified) and forget about it.
+	 */
+	void Invalidate(Path &path) noexcept;
+
+	/**
+	 * Forget about the given path which has no more handles.
+	 * If a worker thread is still working on its #Probe, this
+	 * is postponed until the probe is done.
+	 */
+	void Dispose(Path &path) noexcept;
+
+	void OnInotifyReady(unsigned events) noexcept;
+};
@@ -0,0 +1,776 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Multiplex.hxx"
+#include "Marshal.hxx"
+#include "Connect.hxx"
+#include "translation/Parser.hxx"
+#include "translation/Protocol.hxx"
+#include "translation/Request.hxx"
+#include "translation/Response.hxx"
+#include "translation/Handler.hxx"
+#include "event/net/BufferedSocket.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "pool/LeakDetector.hxx"
+#include "system/Error.hxx"
+#include "util/Cancellable.hxx"
+#include "util/Exception.hxx"
+#include "util/Compiler.h"
+#include "stopwatch.hxx"
+#include "AllocatorPtr.hxx"
+#include "GrowingBuffer.hxx"
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+#include <assert.h>
+#include <string.h>
+
+static constexpr auto translate_read_timeout = std::chrono::minutes(1);
+static constexpr auto translate_write_timeout = std::chrono::seconds(10);
+
+/**
+ * The maximum number of requests in flight on one multiplexed
+ * connection.
+ */
+static constexpr std::size_t MAX_INFLIGHT = 256;
+
+class TranslationMultiplexer::Request final
+	: public boost::intrusive::list_base_hook<boost::intrusive::link_mode<boost::intrusive::normal_link>>,
+	  Cancellable, PoolLeakDetector
+{
+	TranslationMultiplexer &multiplexer;
+
+	StopwatchPtr stopwatch;
+
+	TranslateHandler &handler;
+
+public:
+	const TranslateRequest &request;
+
+	TranslateParser parser;
+
+	/**
+	 * The connection this request was sent on; nullptr while it
+	 * is waiting in TranslationMultiplexer::waiting.
+	 */
+	Connection *connection = nullptr;
+
+	uint32_t id = 0;
+
+	Request(TranslationMultiplexer &_multiplexer, AllocatorPtr alloc,
+		const TranslateRequest &_request,
+		const StopwatchPtr &parent_stopwatch,
+		TranslateHandler &_handler,
+		CancellablePointer &cancel_ptr) noexcept
+		:PoolLeakDetector(alloc),
+		 multiplexer(_multiplexer),
+		 stopwatch(parent_stopwatch, "translate",
+			   _request.GetDiagnosticName()),
+		 handler(_handler),
+		 request(_request),
+		 parser(alloc, _request, *alloc.New<TranslateResponse>())
+	{
+		cancel_ptr = *this;
+	}
+
+	void Response() noexcept {
+		stopwatch.RecordEvent("response");
+
+		auto &_handler = handler;
+		auto &response = parser.GetResponse();
+		Destroy();
+		_handler.OnTranslateResponse(response);
+	}
+
+	void Error(std::exception_ptr ep) noexcept {
+		stopwatch.RecordEvent("error");
+
+		auto &_handler = handler;
+		Destroy();
+		_handler.OnTranslateError(ep);
+	}
+
+private:
+	void Destroy() noexcept {
+		this->~Request();
+	}
+
+	/* virtual methods from class Cancellable */
+	void Cancel() noexcept override;
+};
+
+class TranslationMultiplexer::Connection final
+	: public IntrusiveListHook, BufferedSocketHandler
+{
+	TranslationMultiplexer &multiplexer;
+
+	BufferedSocket socket;
+
+	/**
+	 * Marshalled requests which have not been sent yet.
+	 */
+	GrowingBuffer output;
+
+	enum class Mode {
+		/**
+		 * The first request has been sent, and we don't
+		 * know yet whether the server supports
+		 * #TRANSLATE_REQUEST_ID.
+		 */
+		NEGOTIATING,
+
+		/**
+		 * The server supports #TRANSLATE_REQUEST_ID.
+		 */
+		MULTIPLEX,
+
+		/**
+		 * The server does not support #TRANSLATE_REQUEST_ID;
+		 * send only one request at a time.
+		 */
+		SERIAL,
+	} mode;
+
+	/**
+	 * All requests which have been submitted on this connection
+	 * and whose response has not been received yet.  The value is
+	 * nullptr if the request has been canceled; its response will
+	 * be discarded.
+	 */
+	using RequestMap = std::map<uint32_t, Request *>;
+	RequestMap requests;
+
+	/**
+	 * The request whose response is currently being received.
+	 * Only valid if #receiving is true.
+	 */
+	RequestMap::iterator current;
+
+	bool receiving = false;
+
+	/**
+	 * While discarding a canceled response: the number of
+	 * payload bytes of the current packet which still need to be
+	 * skipped.
+	 */
+	size_t discard_remaining = 0;
+
+public:
+	Connection(TranslationMultiplexer &_multiplexer,
+		   UniqueSocketDescriptor &&fd,
+		   bool try_multiplex) noexcept
+		:multiplexer(_multiplexer),
+		 socket(_multiplexer.event_loop),
+		 mode(try_multiplex ? Mode::NEGOTIATING : Mode::SERIAL)
+	{
+		socket.Init(fd.Release(), FdType::FD_SOCKET,
+			    translate_read_timeout,
+			    translate_write_timeout,
+			    *this);
+		socket.ScheduleReadNoTimeout(false);
+	}
+
+	~Connection() noexcept {
+#ifndef NDEBUG
+		/* only canceled requests may be left */
+		for (const auto &i : requests)
+			assert(i.second == nullptr);
+#endif
+
+		if (socket.IsConnected())
+			socket.Close();
+
+		socket.Destroy();
+	}
+
+	bool IsNegotiating() const noexcept {
+		return mode == Mode::NEGOTIATING;
+	}
+
+	/**
+	 * Can this connection accept another request right now?
+	 */
+	[[gnu::pure]]
+	bool CanSend() const noexcept {
+		switch (mode) {
+		case Mode::NEGOTIATING:
+		case Mode::SERIAL:
+			return requests.empty();
+
+		case Mode::MULTIPLEX:
+			return requests.size() < MAX_INFLIGHT;
+		}
+
+		assert(false);
+		gcc_unreachable();
+	}
+
+	/**
+	 * Marshal the request and schedule sending it.
+	 *
+	 * Throws on error.
+	 */
+	void Send(Request &request);
+
+	/**
+	 * The request has been canceled; discard its response.
+	 */
+	void Cancel(Request &request) noexcept {
+		auto i = requests.find(request.id);
+		assert(i != requests.end());
+		assert(i->second == &request);
+
+		i->second = nullptr;
+	}
+
+private:
+	/**
+	 * Fail all pending requests and destroy this connection.
+	 */
+	void Fail(std::exception_ptr ep) noexcept;
+
+	/**
+	 * Move all pending requests back to the front of the
+	 * multiplexer's queue, so they are sent again on another
+	 * connection, and destroy this connection.
+	 */
+	void Requeue() noexcept;
+
+	/**
+	 * Begin receiving a response: find out which request it
+	 * belongs to.
+	 *
+	 * Throws on protocol error.
+	 *
+	 * @return false if more data is needed
+	 */
+	bool BeginResponse(ConstBuffer<uint8_t> r);
+
+	/**
+	 * Feed data into the parser of the #current request.
+	 *
+	 * Throws on protocol error.
+	 *
+	 * @return the number of bytes consumed
+	 */
+	size_t FeedResponse(ConstBuffer<uint8_t> r);
+
+	/**
+	 * Skip data of a canceled response.
+	 *
+	 * @return the number of bytes consumed
+	 */
+	size_t DiscardResponse(ConstBuffer<uint8_t> r) noexcept;
+
+	/**
+	 * The response for the #current request is complete.
+	 */
+	void EndResponse() noexcept;
+
+	BufferedResult ProcessInput();
+
+	void ScheduleRead() noexcept {
+		if (requests.empty())
+			socket.ScheduleReadNoTimeout(false);
+		else
+			socket.ScheduleReadTimeout(true, translate_read_timeout);
+	}
+
+	/* virtual methods from class BufferedSocketHandler */
+	BufferedResult OnBufferedData() override {
+		try {
+			return ProcessInput();
+		} catch (...) {
+			Fail(std::current_exception());
+			return BufferedResult::CLOSED;
+		}
+	}
+
+	bool OnBufferedClosed() noexcept override;
+
+	bool OnBufferedWrite() override;
+
+	void OnBufferedError(std::exception_ptr ep) noexcept override {
+		Fail(NestException(ep,
+				   std::runtime_error("Translation server connection failed")));
+	}
+};
+
+void
+TranslationMultiplexer::Request::Cancel() noexcept
+{
+	stopwatch.RecordEvent("cancel");
+
+	if (connection != nullptr)
+		connection->Cancel(*this);
+	else
+		multiplexer.waiting.erase(multiplexer.waiting.iterator_to(*this));
+
+	Destroy();
+}
+
+void
+TranslationMultiplexer::Connection::Send(Request &request)
+{
+	assert(CanSend());
+	assert(request.connection == nullptr);
+
+	const uint32_t id = multiplexer.MakeRequestId();
+	output.AppendMoveFrom(MarshalTranslateRequest(TRANSLATE_PROTOCOL_VERSION,
+						      request.request,
+						      mode == Mode::SERIAL
+						      ? 0 : id));
+
+	request.connection = this;
+	request.id = id;
+	requests.emplace(id, &request);
+
+	/* don't write now; this allows sending several requests
+	   with one system call */
+	socket.ScheduleWrite();
+	ScheduleRead();
+}
+
+void
+TranslationMultiplexer::Connection::Fail(std::exception_ptr ep) noexcept
+{
+	auto _requests = std::move(requests);
+	requests.clear();
+
+	multiplexer.RemoveConnection(*this);
+
+	for (auto &i : _requests)
+		if (i.second != nullptr)
+			i.second->Error(ep);
+}
+
+void
+TranslationMultiplexer::Connection::Requeue() noexcept
+{
+	assert(!receiving);
+
+	auto _requests = std::move(requests);
+	requests.clear();
+
+	/* insert in reverse order, so the oldest request ends up
+	   first */
+	for (auto i = _requests.rbegin(); i != _requests.rend(); ++i) {
+		if (auto *request = i->second) {
+			request->connection = nullptr;
+			request->id = 0;
+			multiplexer.waiting.push_front(*request);
+		}
+	}
+
+	multiplexer.RemoveConnection(*this);
+}
+
+bool
+TranslationMultiplexer::Connection::BeginResponse(ConstBuffer<uint8_t> r)
+{
+	assert(!receiving);
+
+	/* we need the BEGIN packet and the header of the following
+	   packet */
+
+	TranslationHeader begin;
+	if (r.size < sizeof(begin))
+		return false;
+
+	memcpy(&begin, r.data, sizeof(begin));
+	if (begin.command != TranslationCommand::BEGIN)
+		throw std::runtime_error("Malformed translation response: BEGIN expected");
+
+	const size_t begin_size = sizeof(begin) + begin.length;
+
+	TranslationHeader next;
+	if (r.size < begin_size + sizeof(next))
+		return false;
+
+	memcpy(&next, r.data + begin_size, sizeof(next));
+
+	if (next.command == TRANSLATE_REQUEST_ID) {
+		uint32_t id;
+		if (next.length != sizeof(id))
+			throw std::runtime_error("Malformed TRANSLATE_REQUEST_ID packet");
+
+		if (r.size < begin_size + sizeof(next) + sizeof(id))
+			return false;
+
+		if (mode == Mode::SERIAL)
+			throw std::runtime_error("Unexpected TRANSLATE_REQUEST_ID packet");
+
+		memcpy(&id, r.data + begin_size + sizeof(next), sizeof(id));
+
+		current = requests.find(id);
+		if (current == requests.end())
+			throw std::runtime_error("Unknown translation request id");
+
+		if (mode == Mode::NEGOTIATING) {
+			mode = Mode::MULTIPLEX;
+			multiplexer.DispatchWaiting();
+		}
+	} else {
+		if (mode == Mode::MULTIPLEX)
+			throw std::runtime_error("TRANSLATE_REQUEST_ID missing in translation response");
+
+		if (requests.empty())
+			throw std::runtime_error("Unexpected translation response");
+
+		assert(requests.size() == 1);
+		current = requests.begin();
+
+		if (mode == Mode::NEGOTIATING) {
+			/* the server has ignored TRANSLATE_REQUEST_ID;
+			   continue with one request at a time, and
+			   let waiting requests open more
+			   connections */
+			mode = Mode::SERIAL;
+			multiplexer.multiplex_unsupported = true;
+			multiplexer.DispatchWaiting();
+		}
+	}
+
+	receiving = true;
+	discard_remaining = 0;
+
+	/* the BEGIN packet goes to the parser; the
+	   TRANSLATE_REQUEST_ID packet is consumed here, because
+	   the parser doesn't know it */
+	const size_t skip = next.command == TRANSLATE_REQUEST_ID
+		? sizeof(next) + next.length
+		: 0;
+
+	if (current->second != nullptr) {
+		size_t consumed = 0;
+		while (consumed < begin_size) {
+			size_t nbytes = current->second->parser.Feed(r.data + consumed,
+								     begin_size - consumed);
+			assert(nbytes > 0);
+			consumed += nbytes;
+
+			/* BEGIN alone cannot complete a response */
+			if (current->second->parser.Process() != TranslateParser::Result::MORE)
+				throw std::runtime_error("Malformed translation response");
+		}
+	}
+
+	socket.DisposeConsumed(begin_size + skip);
+	return true;
+}
+
+size_t
+TranslationMultiplexer::Connection::FeedResponse(ConstBuffer<uint8_t> r)
+{
+	assert(receiving);
+	assert(current->second != nullptr);
+
+	auto &parser = current->second->parser;
+
+	size_t consumed = 0;
+	while (consumed < r.size) {
+		size_t nbytes = parser.Feed(r.data + consumed,
+					    r.size - consumed);
+		if (nbytes == 0)
+			/* need more data */
+			break;
+
+		consumed += nbytes;
+
+		if (parser.Process() == TranslateParser::Result::DONE) {
+			socket.DisposeConsumed(consumed);
+			EndResponse();
+			return consumed;
+		}
+	}
+
+	socket.DisposeConsumed(consumed);
+	return consumed;
+}
+
+size_t
+TranslationMultiplexer::Connection::DiscardResponse(ConstBuffer<uint8_t> r) noexcept
+{
+	assert(receiving);
+	assert(current->second == nullptr);
+
+	size_t consumed = 0;
+
+	while (true) {
+		if (discard_remaining > 0) {
+			size_t nbytes = std::min(discard_remaining,
+						 r.size - consumed);
+			if (nbytes == 0)
+				break;
+
+			discard_remaining -= nbytes;
+			consumed += nbytes;
+			continue;
+		}
+
+		TranslationHeader header;
+		if (r.size - consumed < sizeof(header))
+			break;
+
+		memcpy(&header, r.data + consumed, sizeof(header));
+		consumed += sizeof(header);
+
+		if (header.command == TranslationCommand::END) {
+			socket.DisposeConsumed(consumed);
+			EndResponse();
+			return consumed;
+		}
+
+		discard_remaining = header.length;
+	}
+
+	socket.DisposeConsumed(consumed);
+	return consumed;
+}
+
+void
+TranslationMultiplexer::Connection::EndResponse() noexcept
+{
+	assert(receiving);
+
+	Request *request = current->second;
+	requests.erase(current);
+	receiving = false;
+
+	ScheduleRead();
+
+	if (CanSend())
+		multiplexer.DispatchWaiting();
+
+	if (request != nullptr)
+		request->Response();
+}
+
+BufferedResult
+TranslationMultiplexer::Connection::ProcessInput()
+{
+	while (true) {
+		auto r = ConstBuffer<uint8_t>::FromVoid(socket.ReadBuffer());
+		if (r.empty())
+			return BufferedResult::OK;
+
+		if (!receiving) {
+			if (requests.empty())
+				throw std::runtime_error("Unexpected data from translation server");
+
+			if (!BeginResponse(r))
+				return BufferedResult::MORE;
+
+			continue;
+		}
+
+		const size_t nbytes = current->second != nullptr
+			? FeedResponse(r)
+			: DiscardResponse(r);
+		if (nbytes == 0)
+			return BufferedResult::MORE;
+	}
+}
+
+bool
+TranslationMultiplexer::Connection::OnBufferedClosed() noexcept
+{
+	if (requests.empty()) {
+		/* the server has closed an idle connection */
+		multiplexer.RemoveConnection(*this);
+		return false;
+	}
+
+	if (mode == Mode::NEGOTIATING) {
+		/* maybe the server closed the connection because it
+		   does not understand TRANSLATE_REQUEST_ID; don't try
+		   again, and retry the request on a new (serial)
+		   connection, which fails it if this happens again */
+		multiplexer.multiplex_unsupported = true;
+		Requeue();
+		return false;
+	}
+
+	Fail(std::make_exception_ptr(std::runtime_error("Translation server closed the connection")));
+	return false;
+}
+
+bool
+TranslationMultiplexer::Connection::OnBufferedWrite()
+{
+	auto src = output.Read();
+	if (src.empty()) {
+		socket.UnscheduleWrite();
+		return true;
+	}
+
+	ssize_t nbytes = socket.Write(src.data, src.size);
+	if (gcc_unlikely(nbytes < 0)) {
+		if (gcc_likely(nbytes == WRITE_BLOCKING))
+			return true;
+
+		Fail(std::make_exception_ptr(MakeErrno("write error to translation server")));
+		return false;
+	}
+
+	output.Consume(nbytes);
+	if (output.IsEmpty())
+		socket.UnscheduleWrite();
+	else
+		socket.ScheduleWrite();
+
+	return true;
+}
+
+TranslationMultiplexer::TranslationMultiplexer(EventLoop &_event_loop,
+					       SocketAddress _address,
+					       unsigned _limit) noexcept
+	:event_loop(_event_loop), address(_address), limit(_limit)
+{
+}
+
+TranslationMultiplexer::~TranslationMultiplexer() noexcept
+{
+	assert(waiting.empty());
+
+	connections.clear_and_dispose([](Connection *c){
+		delete c;
+	});
+}
+
+inline uint32_t
+TranslationMultiplexer::MakeRequestId() noexcept
+{
+	/* 0 is reserved for "no request id" */
+	if (++last_id == 0)
+		++last_id;
+
+	return last_id;
+}
+
+TranslationMultiplexer::Connection *
+TranslationMultiplexer::GetConnection()
+{
+	bool negotiating = false;
+	for (auto &c : connections) {
+		if (c.CanSend())
+			return &c;
+
+		if (c.IsNegotiating())
+			negotiating = true;
+	}
+
+	if (negotiating)
+		/* wait until we know whether the server supports
+		   multiplexing, instead of opening lots of
+		   connections */
+		return nullptr;
+
+	if (limit > 0 && n_connections >= limit)
+		return nullptr;
+
+	auto *c = new Connection(*this,
+				 CreateConnectStreamSocket(address),
+				 !multiplex_unsupported);
+	connections.push_back(*c);
+	++n_connections;
+	return c;
+}
+
+void
+TranslationMultiplexer::DispatchWaiting() noexcept
+{
+	while (!waiting.empty()) {
+		Connection *c;
+		try {
+			c = GetConnection();
+		} catch (...) {
+			FailWaiting(std::current_exception());
+			return;
+		}
+
+		if (c == nullptr)
+			break;
+
+		auto &request = waiting.front();
+		waiting.pop_front();
+
+		try {
+			c->Send(request);
+		} catch (...) {
+			/* this request cannot be marshalled; fail
+			   only this one (Send() has not modified the
+			   connection) */
+			request.Error(std::current_exception());
+		}
+	}
+}
+
+void
+TranslationMultiplexer::FailWaiting(std::exception_ptr ep) noexcept
+{
+	while (!waiting.empty()) {
+		auto &request = waiting.front();
+		waiting.pop_front();
+		request.Error(ep);
+	}
+}
+
+void
+TranslationMultiplexer::RemoveConnection(Connection &connection) noexcept
+{
+	connections.erase(connections.iterator_to(connection));
+	--n_connections;
+	delete &connection;
+
+	/* a connection slot has become available */
+	DispatchWaiting();
+}
+
+void
+TranslationMultiplexer::SendRequest(AllocatorPtr alloc,
+				    const TranslateRequest &request,
+				    const StopwatchPtr &parent_stopwatch,
+				    TranslateHandler &handler,
+				    CancellablePointer &cancel_ptr) noexcept
+{
+	auto *r = alloc.New<Request>(*this, alloc, request,
+				     parent_stopwatch,
+				     handler, cancel_ptr);
+
+	/* enqueue and dispatch, so requests which have been waiting
+	   longer are submitted first */
+	waiting.push_back(*r);
+	DispatchWaiting();
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "Service.hxx"
+#include "net/AllocatedSocketAddress.hxx"
+#include "util/IntrusiveList.hxx"
+
+#include <boost/intrusive/list.hpp>
+
+#include <cstdint>
+#include <exception>
+
+class EventLoop;
+
+/**
+ * A #TranslationService which sends many concurrent requests over a
+ * few connections.  Each request carries a #TRANSLATE_REQUEST_ID
+ * packet, and the server may send the responses in any order.
+ *
+ * Support for this protocol extension is negotiated with the first
+ * request on each connection: a server which implements it echoes
+ * the #TRANSLATE_REQUEST_ID packet after #TranslationCommand::BEGIN.
+ * If it does not, the connection falls back to one request at a
+ * time, just like #TranslationStock.
+ */
+class TranslationMultiplexer final : public TranslationService {
+	class Connection;
+	class Request;
+
+	using RequestList =
+		boost::intrusive::list<Request,
+				       boost::intrusive::base_hook<boost::intrusive::list_base_hook<boost::intrusive::link_mode<boost::intrusive::normal_link>>>,
+				       boost::intrusive::constant_time_size<false>>;
+
+	EventLoop &event_loop;
+
+	const AllocatedSocketAddress address;
+
+	/**
+	 * The maximum number of connections; 0 means no limit.
+	 */
+	const unsigned limit;
+
+	IntrusiveList<Connection> connections;
+	unsigned n_connections = 0;
+
+	/**
+	 * Requests waiting for a connection which is able to accept
+	 * another request.
+	 */
+	RequestList waiting;
+
+	uint32_t last_id = 0;
+
+	/**
+	 * Set after the server was found not to support the protocol
+	 * extension; new connections will not attempt to use it.
+	 */
+	bool multiplex_unsupported = false;
+
+public:
+	TranslationMultiplexer(EventLoop &_event_loop, SocketAddress _address,
+			       unsigned _limit) noexcept;
+	~TranslationMultiplexer() noexcept;
+
+	/* virtual methods from class TranslationService */
+	void SendRequest(AllocatorPtr alloc,
+			 const TranslateRequest &request,
+			 const StopwatchPtr &parent_stopwatch,
+			 TranslateHandler &handler,
+			 CancellablePointer &cancel_ptr) noexcept override;
+
+private:
+	uint32_t MakeRequestId() noexcept;
+
+	/**
+	 * Find a connection which is able to accept another request
+	 * right now, or create a new one if the limit allows it.
+	 *
+	 * Throws on connect error.
+	 *
+	 * @return nullptr if the request needs to wait
+	 */
+	Connection *GetConnection();
+
+	/**
+	 * Submit as many waiting requests as possible.
+	 */
+	void DispatchWaiting() noexcept;
+
+	void FailWaiting(std::exception_ptr ep) noexcept;
+
+	void RemoveConnection(Connection &connection) noexcept;
+};
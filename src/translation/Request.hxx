@@ -47,6 +47,7 @@
 
 enum class TranslationCommand : uint16_t;
 struct TranslationLayoutItem;
+class TranslationCacheLease;
 
 struct TranslateRequest {
 	const char *listener_tag = nullptr;
@@ -91,6 +92,15 @@ struct TranslateRequest {
 	 */
 	const TranslationLayoutItem *layout_item = nullptr;
 
+	/**
+	 * If set, then the #TranslationCache may hand out a cached
+	 * #TranslateResponse without copying it, locking the cache item
+	 * in this lease; the response must then be treated as
+	 * read-only.  This is not transmitted to the translation
+	 * server.
+	 */
+	TranslationCacheLease *cache_lease = nullptr;
+
 	/**
 	 * The payload of the #TRANSLATE_INTERNAL_REDIRECT packet.  If
 	 * ConstBuffer::IsNull(), then no #TRANSLATE_INTERNAL_REDIRECT
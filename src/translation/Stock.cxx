@@ -34,14 +34,13 @@
 #include "translation/Handler.hxx"
 #include "translation/Request.hxx"
 #include "Client.hxx"
+#include "Connect.hxx"
 #include "stock/Item.hxx"
 #include "stock/GetHandler.hxx"
 #include "lease.hxx"
 #include "pool/pool.hxx"
 #include "pool/LeakDetector.hxx"
-#include "system/Error.hxx"
 #include "net/UniqueSocketDescriptor.hxx"
-#include "net/ToString.hxx"
 #include "event/SocketEvent.hxx"
 #include "io/Logger.hxx"
 #include "stopwatch.hxx"
@@ -50,23 +49,6 @@
 #include <string.h>
 #include <errno.h>
 
-static UniqueSocketDescriptor
-CreateConnectStreamSocket(const SocketAddress address)
-{
-	UniqueSocketDescriptor fd;
-	if (!fd.CreateNonBlock(address.GetFamily(), SOCK_STREAM, 0))
-		throw MakeErrno("Failed to create socket");
-
-	if (!fd.Connect(address)) {
-		const int e = errno;
-		char buffer[256];
-		ToString(buffer, sizeof(buffer), address);
-		throw FormatErrno(e, "Failed to connect to %s", buffer);
-	}
-
-	return fd;
-}
-
 class TranslationStock::Connection final : public StockItem {
 	UniqueSocketDescriptor s;
 
@@ -40,6 +40,7 @@
 class EventLoop;
 class ResourceLoader;
 class WidgetRegistry;
+class WidgetFragmentCache;
 class StringMap;
 class SessionManager;
 class SessionLease;
@@ -56,6 +57,11 @@ struct WidgetContext {
 
 	WidgetRegistry *widget_registry;
 
+	/**
+	 * The cache for inline widget fragments.  nullptr if disabled.
+	 */
+	WidgetFragmentCache *fragment_cache = nullptr;
+
 	const char *site_name;
 
 	/**
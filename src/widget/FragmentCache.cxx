@@ -0,0 +1,433 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FragmentCache.hxx"
+#include "Widget.hxx"
+#include "Class.hxx"
+#include "View.hxx"
+#include "Context.hxx"
+#include "RubberCache.hxx"
+#include "ResourceAddress.hxx"
+#include "translation/Transformation.hxx"
+#include "istream/UnusedPtr.hxx"
+#include "istream/TeeIstream.hxx"
+#include "sink_rubber.hxx"
+#include "AllocatorPtr.hxx"
+#include "AllocatorStats.hxx"
+#include "pool/pool.hxx"
+#include "pool/Ptr.hxx"
+#include "pool/Holder.hxx"
+#include "event/Loop.hxx"
+#include "io/Logger.hxx"
+#include "util/Cancellable.hxx"
+#include "util/LeakDetector.hxx"
+
+#include <boost/intrusive/list.hpp>
+
+#include <assert.h>
+
+/**
+ * Fragments larger than this are not cached.
+ */
+static constexpr size_t cacheable_size_limit = 256 * 1024;
+
+/**
+ * Copies a fragment into a #Rubber allocation and adds it to the
+ * cache when it is complete.
+ */
+class WidgetFragmentCacheStore final
+	: PoolHolder, RubberSinkHandler, LeakDetector
+{
+public:
+	static constexpr auto link_mode = boost::intrusive::auto_unlink;
+	using LinkMode = boost::intrusive::link_mode<link_mode>;
+	using SiblingsHook = boost::intrusive::list_member_hook<LinkMode>;
+	SiblingsHook siblings;
+
+private:
+	WidgetFragmentCache &cache;
+
+	const char *const key;
+	const char *const tag;
+
+	const std::chrono::system_clock::time_point expires;
+
+	/**
+	 * A handle to abort the sink_rubber that copies the fragment
+	 * into a new rubber allocation.
+	 */
+	CancellablePointer cancel_ptr;
+
+public:
+	WidgetFragmentCacheStore(PoolPtr &&_pool, WidgetFragmentCache &_cache,
+				 const char *_key, const char *_tag,
+				 std::chrono::system_clock::time_point _expires) noexcept
+		:PoolHolder(std::move(_pool)), cache(_cache),
+		 key(p_strdup(pool, _key)),
+		 tag(_tag != nullptr ? p_strdup(pool, _tag) : nullptr),
+		 expires(_expires) {}
+
+	void Start(UnusedIstreamPtr input, Rubber &rubber) noexcept {
+		sink_rubber_new(pool, std::move(input),
+				rubber, cacheable_size_limit,
+				*this, cancel_ptr);
+	}
+
+	void Destroy() noexcept {
+		this->~WidgetFragmentCacheStore();
+	}
+
+	/**
+	 * Cancel storing the fragment.
+	 */
+	void Cancel() noexcept {
+		assert(cancel_ptr);
+
+		cancel_ptr.CancelAndClear();
+		Destroy();
+	}
+
+private:
+	/* virtual methods from class RubberSinkHandler */
+	void RubberDone(RubberAllocation &&a, size_t size) noexcept override;
+	void RubberOutOfMemory() noexcept override;
+	void RubberTooLarge() noexcept override;
+	void RubberError(std::exception_ptr ep) noexcept override;
+};
+
+class WidgetFragmentCache final : LeakDetector {
+	friend class WidgetFragmentCacheStore;
+
+	RubberCache cache;
+
+	/**
+	 * A list of fragments which are currently being copied to a
+	 * #Rubber allocation.  We keep track of them so we can cancel
+	 * them on shutdown.
+	 */
+	boost::intrusive::list<WidgetFragmentCacheStore,
+			       boost::intrusive::member_hook<WidgetFragmentCacheStore,
+							     WidgetFragmentCacheStore::SiblingsHook,
+							     &WidgetFragmentCacheStore::siblings>,
+			       boost::intrusive::constant_time_size<false>> stores;
+
+public:
+	WidgetFragmentCache(struct pool &_pool, EventLoop &_event_loop,
+			    size_t max_size) noexcept;
+
+	~WidgetFragmentCache() noexcept {
+		stores.clear_and_dispose([](WidgetFragmentCacheStore *s){
+			s->Cancel();
+		});
+	}
+
+	auto &GetEventLoop() const noexcept {
+		return cache.GetEventLoop();
+	}
+
+	void ForkCow(bool inherit) noexcept {
+		cache.ForkCow(inherit);
+	}
+
+	AllocatorStats GetStats() const noexcept {
+		return cache.GetStats();
+	}
+
+	void Flush() noexcept {
+		cache.Flush();
+	}
+
+	void FlushTag(const char *tag) noexcept {
+		cache.FlushTag(tag);
+	}
+
+	UnusedIstreamPtr Get(struct pool &caller_pool,
+			     const char *key) noexcept;
+
+	UnusedIstreamPtr Put(struct pool &caller_pool, const char *key,
+			     const char *tag,
+			     std::chrono::system_clock::time_point expires,
+			     UnusedIstreamPtr body) noexcept;
+
+private:
+	void Add(const char *key, const char *tag,
+		 std::chrono::system_clock::time_point expires,
+		 RubberAllocation &&a, size_t size) noexcept;
+};
+
+/*
+ * RubberSinkHandler
+ *
+ */
+
+void
+WidgetFragmentCacheStore::RubberDone(RubberAllocation &&a,
+				     size_t size) noexcept
+{
+	cancel_ptr = nullptr;
+
+	cache.Add(key, tag, expires, std::move(a), size);
+	Destroy();
+}
+
+void
+WidgetFragmentCacheStore::RubberOutOfMemory() noexcept
+{
+	cancel_ptr = nullptr;
+
+	LogConcat(4, "WidgetFragmentCache", "nocache oom ", key);
+	Destroy();
+}
+
+void
+WidgetFragmentCacheStore::RubberTooLarge() noexcept
+{
+	cancel_ptr = nullptr;
+
+	LogConcat(4, "WidgetFragmentCache", "nocache too large ", key);
+	Destroy();
+}
+
+void
+WidgetFragmentCacheStore::RubberError(std::exception_ptr ep) noexcept
+{
+	cancel_ptr = nullptr;
+
+	LogConcat(4, "WidgetFragmentCache", "body_abort ", key, ": ", ep);
+	Destroy();
+}
+
+/*
+ * WidgetFragmentCache
+ *
+ */
+
+WidgetFragmentCache::WidgetFragmentCache(struct pool &_pool,
+					 EventLoop &_event_loop,
+					 size_t max_size) noexcept
+	:cache(_pool, "widget_fragment_cache", _event_loop, max_size)
+{
+}
+
+void
+WidgetFragmentCache::Add(const char *key, const char *tag,
+			 std::chrono::system_clock::time_point expires,
+			 RubberAllocation &&a, size_t size) noexcept
+{
+	LogConcat(4, "WidgetFragmentCache", "put ", key);
+
+	auto item = NewFromPool<RubberCacheItem>(cache.NewItemPool("WidgetFragmentCacheItem"),
+						 cache.SteadyNow(),
+						 cache.SystemNow(),
+						 expires,
+						 size, std::move(a));
+
+	cache.Put(key, tag, *item);
+}
+
+UnusedIstreamPtr
+WidgetFragmentCache::Get(struct pool &caller_pool, const char *key) noexcept
+{
+	auto *item = cache.Get(key);
+	if (item == nullptr)
+		return nullptr;
+
+	LogConcat(4, "WidgetFragmentCache", "hit ", key);
+
+	return cache.OpenBody(caller_pool, *item);
+}
+
+UnusedIstreamPtr
+WidgetFragmentCache::Put(struct pool &caller_pool, const char *key,
+			 const char *tag,
+			 std::chrono::system_clock::time_point expires,
+			 UnusedIstreamPtr body) noexcept
+{
+	assert(body);
+
+	if (body.GetAvailable(false) > (off_t)cacheable_size_limit)
+		return body;
+
+	/* tee the fragment: one goes to the template, and one goes
+	   into the cache */
+	auto tee1 = NewTeeIstream(caller_pool, std::move(body),
+				  GetEventLoop(),
+				  false,
+				  /* just in case the processor closes the
+				     fragment without looking at it: defer
+				     an Istream::Read() call for the Rubber
+				     sink */
+				  true);
+
+	/* the second one is weak, because the fragment is worthless
+	   for the cache once the template is gone */
+	auto tee2 = AddTeeIstream(tee1, true);
+
+	auto store = NewFromPool<WidgetFragmentCacheStore>(pool_new_linear(&cache.GetPool(), "WidgetFragmentCacheStore", 1024),
+							   *this, key, tag,
+							   expires);
+	stores.push_front(*store);
+	store->Start(std::move(tee2), cache.GetRubber());
+
+	return tee1;
+}
+
+/*
+ * public API
+ *
+ */
+
+WidgetFragmentCache *
+widget_fragment_cache_new(struct pool &pool, EventLoop &event_loop,
+			  size_t max_size) noexcept
+{
+	assert(max_size > 0);
+
+	return new WidgetFragmentCache(pool, event_loop, max_size);
+}
+
+void
+widget_fragment_cache_close(WidgetFragmentCache *cache) noexcept
+{
+	delete cache;
+}
+
+void
+widget_fragment_cache_fork_cow(WidgetFragmentCache &cache,
+			       bool inherit) noexcept
+{
+	cache.ForkCow(inherit);
+}
+
+AllocatorStats
+widget_fragment_cache_get_stats(const WidgetFragmentCache &cache) noexcept
+{
+	return cache.GetStats();
+}
+
+void
+widget_fragment_cache_flush(WidgetFragmentCache &cache) noexcept
+{
+	cache.Flush();
+}
+
+void
+widget_fragment_cache_flush_tag(WidgetFragmentCache &cache,
+				const char *tag) noexcept
+{
+	cache.FlushTag(tag);
+}
+
+const char *
+widget_fragment_cache_key(AllocatorPtr alloc, const WidgetContext &ctx,
+			  const Widget &widget) noexcept
+{
+	assert(widget.cls != nullptr);
+
+	if (widget.cls->stateful)
+		/* the response may depend on the session */
+		return nullptr;
+
+	if (widget.from_request.method != HTTP_METHOD_GET ||
+	    widget.from_request.body || widget.for_focused != nullptr ||
+	    widget.HasFocus() || widget.DescendantHasFocus())
+		/* this request was submitted by the client */
+		return nullptr;
+
+	if (widget.IsContainer())
+		/* the fragment contains child widgets which may not be
+		   cacheable */
+		return nullptr;
+
+	const WidgetView *view = widget.GetTransformationView();
+	if (view == nullptr)
+		return nullptr;
+
+	/* the processor rewrites URIs relative to the template's URI,
+	   therefore it is part of the key */
+	const char *template_uri = ctx.absolute_uri != nullptr
+		? ctx.absolute_uri
+		: ctx.uri;
+	if (template_uri == nullptr)
+		return nullptr;
+
+	return alloc.Concat(ctx.site_name != nullptr ? ctx.site_name : "",
+			    '|', ctx.user != nullptr ? ctx.user : "",
+			    '|', template_uri,
+			    '|', widget.class_name,
+			    '|', widget.id_path != nullptr ? widget.id_path : "",
+			    '|', view->name != nullptr ? view->name : "",
+			    '|', widget.GetAddress().GetId(alloc));
+}
+
+UnusedIstreamPtr
+widget_fragment_cache_get(WidgetFragmentCache &cache,
+			  struct pool &caller_pool,
+			  const char *key) noexcept
+{
+	return cache.Get(caller_pool, key);
+}
+
+/**
+ * Determine the cache tag of a widget fragment: the tag of the first
+ * filter in the view's transformation chain which has one.
+ */
+[[gnu::pure]]
+static const char *
+GetCacheTag(const WidgetView &view) noexcept
+{
+	for (const auto &t : view.transformations)
+		if (t.type == Transformation::Type::FILTER &&
+		    t.u.filter.cache_tag != nullptr)
+			return t.u.filter.cache_tag;
+
+	return nullptr;
+}
+
+UnusedIstreamPtr
+widget_fragment_cache_put(WidgetFragmentCache &cache,
+			  struct pool &caller_pool, const char *key,
+			  const Widget &widget,
+			  UnusedIstreamPtr body) noexcept
+{
+	assert(key != nullptr);
+
+	if (widget.from_response.expires == std::chrono::system_clock::from_time_t(-1))
+		/* the widget server's response is not cacheable */
+		return body;
+
+	const WidgetView *view = widget.GetTransformationView();
+	assert(view != nullptr);
+
+	return cache.Put(caller_pool, key, GetCacheTag(*view),
+			 widget.from_response.expires, std::move(body));
+}
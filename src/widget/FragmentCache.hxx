@@ -0,0 +1,113 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * A cache for the (processed and charset-converted) HTML fragments
+ * of inline widgets.  With this cache, a template which embeds many
+ * cacheable widgets needs no round trip to the widget servers, and
+ * the processor does not need to run again.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+struct pool;
+struct AllocatorStats;
+struct WidgetContext;
+class AllocatorPtr;
+class EventLoop;
+class UnusedIstreamPtr;
+class Widget;
+class WidgetFragmentCache;
+
+WidgetFragmentCache *
+widget_fragment_cache_new(struct pool &pool, EventLoop &event_loop,
+			  size_t max_size) noexcept;
+
+void
+widget_fragment_cache_close(WidgetFragmentCache *cache) noexcept;
+
+void
+widget_fragment_cache_fork_cow(WidgetFragmentCache &cache,
+			       bool inherit) noexcept;
+
+[[gnu::pure]]
+AllocatorStats
+widget_fragment_cache_get_stats(const WidgetFragmentCache &cache) noexcept;
+
+void
+widget_fragment_cache_flush(WidgetFragmentCache &cache) noexcept;
+
+/**
+ * Remove all fragments of widgets whose view contains a filter with
+ * the given cache tag.
+ */
+void
+widget_fragment_cache_flush_tag(WidgetFragmentCache &cache,
+				const char *tag) noexcept;
+
+/**
+ * Build the cache key for the given widget.  Only widgets which do
+ * not depend on the session or on the HTTP request may be cached.
+ *
+ * @return the key or nullptr if the widget must not be cached,
+ * e.g. because it is stateful, focused or a container
+ */
+[[gnu::pure]]
+const char *
+widget_fragment_cache_key(AllocatorPtr alloc, const WidgetContext &ctx,
+			  const Widget &widget) noexcept;
+
+/**
+ * Look up a fragment.
+ *
+ * @return the fragment or a nullptr object on cache miss
+ */
+UnusedIstreamPtr
+widget_fragment_cache_get(WidgetFragmentCache &cache,
+			  struct pool &caller_pool,
+			  const char *key) noexcept;
+
+/**
+ * Copy a fragment into the cache while it is being sent to the
+ * caller.  The expiry is taken from Widget::from_response, and the
+ * first filter cache tag of the widget's view is used for
+ * widget_fragment_cache_flush_tag().
+ *
+ * @return the istream to be used by the caller instead of #body
+ */
+UnusedIstreamPtr
+widget_fragment_cache_put(WidgetFragmentCache &cache,
+			  struct pool &caller_pool, const char *key,
+			  const Widget &widget,
+			  UnusedIstreamPtr body) noexcept;
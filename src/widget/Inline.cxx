@@ -32,6 +32,7 @@
 
 #include "Inline.hxx"
 #include "Request.hxx"
+#include "FragmentCache.hxx"
 #include "Error.hxx"
 #include "Widget.hxx"
 #include "Context.hxx"
@@ -39,6 +40,7 @@
 #include "http/HeaderUtil.hxx"
 #include "http/ResponseHandler.hxx"
 #include "strmap.hxx"
+#include "AllocatorPtr.hxx"
 #include "istream_html_escape.hxx"
 #include "istream/ConcatIstream.hxx"
 #include "istream/DelayedIstream.hxx"
@@ -85,6 +87,12 @@ class InlineWidget final : PoolLeakDetector, HttpResponseHandler, Cancellable {
 
 	CancellablePointer cancel_ptr;
 
+	/**
+	 * The key in the #WidgetFragmentCache; nullptr if the widget
+	 * cannot be cached.
+	 */
+	const char *fragment_cache_key = nullptr;
+
 public:
 	InlineWidget(struct pool &_pool, SharedPoolPtr<WidgetContext> &&_ctx,
 		     const StopwatchPtr &_parent_stopwatch,
@@ -253,6 +261,11 @@ InlineWidget::OnHttpResponse(http_status_t status, StringMap &&headers,
 			Fail(std::current_exception());
 			return;
 		}
+
+		if (fragment_cache_key != nullptr)
+			body = widget_fragment_cache_put(*ctx->fragment_cache,
+							 pool, fragment_cache_key,
+							 widget, std::move(body));
 	} else
 		body = istream_null_new(pool);
 
@@ -308,6 +321,21 @@ try {
 				  StringFormat<256>("No such view: %s",
 						    widget.from_template.view_name));
 
+	if (ctx->fragment_cache != nullptr) {
+		fragment_cache_key = widget_fragment_cache_key(pool, *ctx, widget);
+		if (fragment_cache_key != nullptr) {
+			auto body = widget_fragment_cache_get(*ctx->fragment_cache,
+							      pool,
+							      fragment_cache_key);
+			if (body) {
+				auto &_delayed = delayed;
+				Destroy();
+				_delayed.Set(std::move(body));
+				return;
+			}
+		}
+	}
+
 	if (widget.session_sync_pending) {
 		auto session = ctx->GetRealmSession();
 		if (session)
@@ -46,6 +46,7 @@
 #include "bp/session/Lease.hxx"
 #include "bp/session/Session.hxx"
 #include "http/CookieClient.hxx"
+#include "http/Date.hxx"
 #include "ResourceLoader.hxx"
 #include "bp/Global.hxx"
 #include "translation/Transformation.hxx"
@@ -59,12 +60,15 @@
 #include "pool/pool.hxx"
 #include "pool/LeakDetector.hxx"
 #include "pool/SharedPtr.hxx"
+#include "event/Loop.hxx"
 #include "AllocatorPtr.hxx"
 #include "util/Cancellable.hxx"
+#include "util/IterableSplitString.hxx"
 #include "util/StringFormat.hxx"
 #include "stopwatch.hxx"
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 class WidgetRequest final
@@ -226,6 +230,14 @@ private:
 	 */
 	void UpdateView(StringMap &headers);
 
+	/**
+	 * Check whether the widget server's response may be stored in
+	 * the inline widget fragment cache and update
+	 * Widget::from_response.
+	 */
+	void EvaluateFragmentCache(http_status_t status,
+				   const StringMap &headers) noexcept;
+
 	/* virtual methods from class Cancellable */
 	void Cancel() noexcept override {
 		widget.Cancel();
@@ -639,6 +651,86 @@ WidgetRequest::UpdateView(StringMap &headers)
 	}
 }
 
+/**
+ * Determine until when the widget server's response is fresh.
+ * Unlike the HTTP cache, the fragment cache never revalidates, so
+ * only responses with an explicit expiry qualify.
+ *
+ * @return the expiry or from_time_t(-1) if the response is not
+ * cacheable
+ */
+[[gnu::pure]]
+static std::chrono::system_clock::time_point
+GetFragmentExpires(std::chrono::system_clock::time_point now,
+		   http_status_t status, const StringMap &headers) noexcept
+{
+	const auto never = std::chrono::system_clock::from_time_t(-1);
+
+	if (status != HTTP_STATUS_OK)
+		return never;
+
+	if (headers.Contains("set-cookie") || headers.Contains("set-cookie2") ||
+	    headers.Contains("vary"))
+		/* the response is specific to this client */
+		return never;
+
+	const char *p = headers.Get("cache-control");
+	if (p != nullptr) {
+		for (auto s : IterableSplitString(p, ',')) {
+			s.Strip();
+
+			if (s.StartsWith("private") ||
+			    s.Equals("no-cache") || s.Equals("no-store"))
+				return never;
+
+			if (s.StartsWith("max-age=")) {
+				char value[16];
+				StringView param(s.data + 8, s.size - 8);
+				if (param.size >= sizeof(value))
+					continue;
+
+				memcpy(value, param.data, param.size);
+				value[param.size] = 0;
+
+				int seconds = atoi(value);
+				if (seconds > 0)
+					return now + std::chrono::seconds(seconds);
+
+				return never;
+			}
+		}
+	}
+
+	p = headers.Get("expires");
+	if (p == nullptr)
+		return never;
+
+	auto expires = http_date_parse(p);
+	if (expires == never)
+		return never;
+
+	/* adjust the "Expires" time stamp by the difference between
+	   our clock and the widget server's clock */
+	p = headers.Get("date");
+	if (p != nullptr) {
+		const auto date = http_date_parse(p);
+		if (date != never)
+			expires += now - date;
+	}
+
+	return expires > now ? expires : never;
+}
+
+void
+WidgetRequest::EvaluateFragmentCache(http_status_t status,
+				     const StringMap &headers) noexcept
+{
+	widget.from_response.expires = ctx->fragment_cache != nullptr
+		? GetFragmentExpires(ctx->event_loop.SystemNow(),
+				     status, headers)
+		: std::chrono::system_clock::from_time_t(-1);
+}
+
 void
 WidgetRequest::OnHttpResponse(http_status_t status, StringMap &&headers,
 			      UnusedIstreamPtr body) noexcept
@@ -646,7 +738,9 @@ WidgetRequest::OnHttpResponse(http_status_t status, StringMap &&headers,
 	if (previous_status != http_status_t(0)) {
 		status = ApplyFilterStatus(previous_status, status, !!body);
 		previous_status = http_status_t(0);
-	}
+	} else
+		/* this is the widget server's response, not a filter's */
+		EvaluateFragmentCache(status, headers);
 
 	if (widget.cls->dump_headers) {
 		widget.logger(4, "response headers from widget");
@@ -39,6 +39,7 @@
 #include "util/IntrusiveForwardList.hxx"
 #include "util/StringView.hxx"
 
+#include <chrono>
 #include <cstdint>
 #include <memory>
 
@@ -268,6 +269,20 @@ public:
 			 method(_method) {}
 	} *for_focused = nullptr;
 
+	/**
+	 * Attributes of the widget server's response, evaluated by
+	 * widget_http_request().
+	 */
+	struct {
+		/**
+		 * Until when may the (processed) response be stored in
+		 * the inline widget fragment cache?  from_time_t(-1)
+		 * means it is not cacheable.
+		 */
+		std::chrono::system_clock::time_point expires =
+			std::chrono::system_clock::from_time_t(-1);
+	} from_response;
+
 private:
 	/**
 	 * Cached attributes that will be initialized lazily.
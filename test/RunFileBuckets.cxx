@@ -0,0 +1,203 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark for sending small files with #IstreamBucket::Type::FILE:
+ * each iteration opens the file, prepends a HTTP response header
+ * and sends both to a socket the way the HTTP server does.
+ *
+ * Run it with "strace -c -f" (or "perf stat -e raw_syscalls:sys_enter")
+ * and divide by the number of requests to get the system calls per
+ * request; pass "--copy" to compare with the pread()/sendmsg() path.
+ */
+
+#include "istream/Sink.hxx"
+#include "istream/Bucket.hxx"
+#include "istream/SendBuckets.hxx"
+#include "istream/ConcatIstream.hxx"
+#include "istream/OpenFileIstream.hxx"
+#include "istream/istream_string.hxx"
+#include "istream/UnusedPtr.hxx"
+#include "system/Error.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "util/PrintException.hxx"
+#include "util/ScopeExit.hxx"
+#include "fb_pool.hxx"
+#include "PInstance.hxx"
+#include "pool/pool.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include <sys/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static constexpr char header[] =
+	"HTTP/1.1 200 OK\r\n"
+	"content-type: text/plain\r\n"
+	"content-length: 4096\r\n"
+	"\r\n";
+
+struct BenchSink final : IstreamSink {
+	size_t sent = 0;
+
+	template<typename I>
+	explicit BenchSink(I &&_input, FdTypeMask direct)
+		:IstreamSink(std::forward<I>(_input)) {
+		input.SetDirect(direct);
+	}
+
+	void Run(SocketDescriptor s) {
+		while (input.IsDefined()) {
+			IstreamBucketList list;
+			input.FillBucketList(list);
+
+			ssize_t nbytes = SendBuckets(s, list);
+			if (nbytes < 0)
+				throw MakeErrno("Failed to send");
+
+			sent += nbytes;
+
+			size_t consumed = input.ConsumeBucketList(nbytes);
+			if (list.IsDepleted(consumed))
+				CloseInput();
+		}
+	}
+
+	/* virtual methods from class IstreamHandler */
+
+	size_t OnData(const void *, size_t) noexcept override {
+		return 0;
+	}
+
+	void OnEof() noexcept override {
+		ClearInput();
+	}
+
+	void OnError(std::exception_ptr ep) noexcept override {
+		ClearInput();
+		PrintException(ep);
+	}
+};
+
+static void
+Drain(SocketDescriptor s, size_t length)
+{
+	static char buffer[65536];
+
+	while (length > 0) {
+		ssize_t nbytes = s.Read(buffer, std::min(length, sizeof(buffer)));
+		if (nbytes <= 0)
+			throw MakeErrno("Failed to receive");
+
+		length -= nbytes;
+	}
+}
+
+static std::string
+CreateTestFile()
+{
+	char path[] = "/tmp/RunFileBuckets.XXXXXX";
+	UniqueFileDescriptor fd(mkstemp(path));
+	if (!fd.IsDefined())
+		throw MakeErrno("Failed to create temporary file");
+
+	char data[4096];
+	memset(data, 'x', sizeof(data));
+	if (fd.Write(data, sizeof(data)) != (ssize_t)sizeof(data))
+		throw MakeErrno("Failed to write temporary file");
+
+	return path;
+}
+
+int
+main(int argc, char **argv)
+try {
+	bool copy = false;
+	unsigned n = 100000;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--copy") == 0)
+			copy = true;
+		else if (unsigned value = strtoul(argv[i], nullptr, 10); value > 0)
+			n = value;
+		else {
+			fprintf(stderr, "Usage: %s [--copy] [COUNT]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	const std::string path = CreateTestFile();
+	AtScopeExit(&path) { unlink(path.c_str()); };
+
+	int sv[2];
+	if (socketpair(AF_LOCAL, SOCK_STREAM, 0, sv) < 0)
+		throw MakeErrno("Failed to create socket pair");
+
+	UniqueSocketDescriptor a(sv[0]), b(sv[1]);
+
+	const ScopeFbPoolInit fb_pool_init;
+	PInstance instance;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (unsigned i = 0; i < n; ++i) {
+		auto pool = pool_new_linear(instance.root_pool, "request", 8192);
+
+		BenchSink sink(istream_cat_new(pool,
+					       istream_string_new(pool, header),
+					       OpenFileIstream(instance.event_loop,
+							       pool,
+							       path.c_str())),
+			       copy ? FdTypeMask(0) : FdTypeMask(FdType::FD_FILE));
+		sink.Run(a);
+
+		Drain(b, sink.sent);
+	}
+
+	const std::chrono::duration<double> duration =
+		std::chrono::steady_clock::now() - start;
+
+	printf("%u requests in %.3fs (%.2f us/request, %s)\n",
+	       n, duration.count(), duration.count() * 1e6 / n,
+	       copy ? "pread+sendmsg" : "sendmsg+sendfile");
+
+	return EXIT_SUCCESS;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
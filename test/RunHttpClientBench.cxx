@@ -0,0 +1,250 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark for the memory allocations of a HTTP request: run many
+ * requests through http_client and http_server connected with a
+ * socket pair (like t_http_client) and print the number of linear
+ * pool areas and malloc() calls per request.
+ */
+
+#include "DemoHttpServerConnection.hxx"
+#include "http_client.hxx"
+#include "http/ResponseHandler.hxx"
+#include "lease.hxx"
+#include "strmap.hxx"
+#include "istream/Sink.hxx"
+#include "istream/UnusedPtr.hxx"
+#include "fs/FilteredSocket.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "net/SocketAddress.hxx"
+#include "io/SpliceSupport.hxx"
+#include "system/Error.hxx"
+#include "system/SetupProcess.hxx"
+#include "fb_pool.hxx"
+#include "PInstance.hxx"
+#include "pool/pool.hxx"
+#include "pool/UniquePtr.hxx"
+#include "util/Cancellable.hxx"
+#include "util/PrintException.hxx"
+#include "stopwatch.hxx"
+
+#include <chrono>
+#include <memory>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#ifdef __GLIBC__
+
+static std::size_t n_malloc;
+
+extern "C" void *__libc_malloc(size_t size) noexcept;
+
+/**
+ * Count all malloc() calls, including those from operator new.
+ */
+extern "C" void *
+malloc(size_t size) noexcept
+{
+	++n_malloc;
+	return __libc_malloc(size);
+}
+
+#else
+
+static constexpr std::size_t n_malloc = 0;
+
+#endif
+
+class Server final : DemoHttpServerConnection {
+public:
+	using DemoHttpServerConnection::DemoHttpServerConnection;
+
+	static auto New(struct pool &pool, EventLoop &event_loop, Mode mode) {
+		UniqueSocketDescriptor client_socket, server_socket;
+		if (!UniqueSocketDescriptor::CreateSocketPair(AF_LOCAL, SOCK_STREAM, 0,
+							      client_socket, server_socket))
+			throw MakeErrno("socketpair() failed");
+
+		auto server = std::make_unique<Server>(pool, event_loop,
+						       UniquePoolPtr<FilteredSocket>::Make(pool,
+											   event_loop,
+											   std::move(server_socket),
+											   FdType::FD_SOCKET),
+						       nullptr,
+						       mode);
+		return std::make_pair(std::move(server), std::move(client_socket));
+	}
+};
+
+class Client final : Lease, HttpResponseHandler, IstreamSink {
+	EventLoop &event_loop;
+
+	FilteredSocket socket;
+
+	CancellablePointer cancel_ptr;
+
+	bool released, done;
+
+public:
+	Client(EventLoop &_event_loop, UniqueSocketDescriptor fd) noexcept
+		:event_loop(_event_loop),
+		 socket(_event_loop, std::move(fd), FdType::FD_SOCKET) {}
+
+	~Client() noexcept {
+		socket.Close();
+		socket.Destroy();
+	}
+
+	/**
+	 * Send one request and wait until the response body has been
+	 * consumed and the socket was released.
+	 */
+	void Request(struct pool &pool) noexcept {
+		released = done = false;
+
+		http_client_request(pool, nullptr, socket, *this,
+				    "localhost",
+				    HTTP_METHOD_GET, "/", {}, {},
+				    nullptr, false,
+				    *this, cancel_ptr);
+
+		while (!done || !released) {
+			if (HasInput()) {
+				input.Read();
+				event_loop.LoopOnceNonBlock();
+			} else
+				event_loop.LoopOnce();
+		}
+	}
+
+private:
+	/* virtual methods from class Lease */
+	void ReleaseLease(bool reuse) noexcept override {
+		if (!reuse) {
+			fprintf(stderr, "Connection was not reused\n");
+			exit(EXIT_FAILURE);
+		}
+
+		released = true;
+	}
+
+	/* virtual methods from class HttpResponseHandler */
+	void OnHttpResponse(http_status_t, StringMap &&,
+			    UnusedIstreamPtr body) noexcept override {
+		if (body)
+			SetInput(std::move(body));
+		else
+			done = true;
+	}
+
+	void OnHttpError(std::exception_ptr ep) noexcept override {
+		PrintException(ep);
+		exit(EXIT_FAILURE);
+	}
+
+	/* virtual methods from class IstreamHandler */
+	size_t OnData(const void *, size_t length) noexcept override {
+		return length;
+	}
+
+	void OnEof() noexcept override {
+		ClearInput();
+		done = true;
+	}
+
+	void OnError(std::exception_ptr ep) noexcept override {
+		ClearInput();
+		PrintException(ep);
+		exit(EXIT_FAILURE);
+	}
+};
+
+static void
+RunRequests(PInstance &instance, Client &client, const char *label,
+	    unsigned n)
+{
+	const auto stats_before = pool_linear_stats();
+	const std::size_t malloc_before = n_malloc;
+	const auto start = std::chrono::steady_clock::now();
+
+	for (unsigned i = 0; i < n; ++i) {
+		auto pool = pool_new_linear(instance.root_pool,
+					    "bench_request", 8192);
+		client.Request(pool);
+		pool.reset();
+		pool_commit();
+	}
+
+	const std::chrono::duration<double> duration =
+		std::chrono::steady_clock::now() - start;
+	const auto stats = pool_linear_stats();
+
+	printf("%-8s %u requests in %.3f s: "
+	       "%.2f new areas, %.2f recycled areas, %.2f grown, "
+	       "%.2f malloc() calls per request\n",
+	       label, n, duration.count(),
+	       double(stats.malloc_areas - stats_before.malloc_areas) / n,
+	       double(stats.recycled_areas - stats_before.recycled_areas) / n,
+	       double(stats.grown - stats_before.grown) / n,
+	       double(n_malloc - malloc_before) / n);
+}
+
+int
+main(int argc, char **argv)
+try {
+	const unsigned n = argc > 1
+		? strtoul(argv[1], nullptr, 10)
+		: 100000;
+
+	SetupProcess();
+	direct_global_init();
+
+	const ScopeFbPoolInit fb_pool_init;
+	PInstance instance;
+
+	auto server = Server::New(instance.root_pool, instance.event_loop,
+				  DemoHttpServerConnection::Mode::FIXED);
+	Client client(instance.event_loop, std::move(server.second));
+
+	/* the first requests allow the pools to learn their sizes
+	   and fill the recycler */
+	RunRequests(instance, client, "warmup", 100);
+	RunRequests(instance, client, "steady", n);
+
+	return EXIT_SUCCESS;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark for the branch condition index: compare a linear scan
+ * over all conditions with LbConditionIndex.
+ */
+
+#include "lb/ConditionIndex.hxx"
+#include "lb/GotoConfig.hxx"
+#include "http/Method.h"
+
+#include <chrono>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+struct FakeHeaders {
+	const char *host;
+
+	const char *Get(const char *name) const noexcept {
+		return strcmp(name, "host") == 0 ? host : nullptr;
+	}
+};
+
+struct FakeRequest {
+	http_method_t method = HTTP_METHOD_GET;
+	const char *uri;
+	FakeHeaders headers;
+};
+
+}
+
+using Type = LbAttributeReference::Type;
+
+/* prevent the compiler from optimizing the lookups away */
+static volatile std::size_t result;
+
+/**
+ * Build a rule set like a large hosting setup: many virtual hosts,
+ * many URI prefixes and a few regular expressions.
+ */
+static std::list<LbGotoIfConfig>
+MakeRules(unsigned n)
+{
+	std::list<LbGotoIfConfig> rules;
+
+	for (unsigned i = 0; i < n; ++i) {
+		const std::string s = std::to_string(i);
+
+		switch (i % 5) {
+		case 0:
+		case 1:
+			rules.emplace_back(LbConditionConfig{
+					{Type::HEADER, "host"}, false,
+					("host" + s + ".example.com").c_str()},
+				LbGotoConfig{});
+			break;
+
+		case 2:
+		case 3:
+			rules.emplace_back(LbConditionConfig{
+					{Type::URI}, false,
+					LbConditionConfig::Prefix{"/app" + s + "/"}},
+				LbGotoConfig{});
+			break;
+
+		case 4:
+			rules.emplace_back(LbConditionConfig{
+					{Type::URI}, false,
+					UniqueRegex(("\\.x" + s + "$").c_str(),
+						    false, false)},
+				LbGotoConfig{});
+			break;
+		}
+	}
+
+	return rules;
+}
+
+static std::size_t
+FindLinear(const std::list<LbGotoIfConfig> &rules,
+	   const FakeRequest &request) noexcept
+{
+	std::size_t index = 0;
+	for (const auto &i : rules) {
+		if (i.condition.MatchRequest(request))
+			return index;
+		++index;
+	}
+
+	return LbConditionIndex::NONE;
+}
+
+template<typename F>
+static void
+Measure(const char *label, std::size_t n, F &&f)
+{
+	const auto start = std::chrono::steady_clock::now();
+	f();
+	const std::chrono::duration<double> duration =
+		std::chrono::steady_clock::now() - start;
+
+	printf("%-12s %.3f us/request\n", label,
+	       duration.count() * 1e6 / n);
+}
+
+int
+main(int argc, char **argv)
+{
+	const unsigned n_rules = argc > 1
+		? strtoul(argv[1], nullptr, 10)
+		: 1000;
+	const unsigned n_requests = 100000;
+
+	const auto rules = MakeRules(n_rules);
+	const LbConditionIndex index(rules);
+
+	std::vector<std::string> hosts, uris;
+	for (unsigned i = 0; i < n_requests; ++i) {
+		const unsigned r = random() % (n_rules * 2);
+		hosts.emplace_back("host" + std::to_string(r) + ".example.com");
+		uris.emplace_back("/app" + std::to_string(random() % (n_rules * 2)) +
+				  "/index.html");
+	}
+
+	std::vector<FakeRequest> requests;
+	requests.reserve(n_requests);
+	for (unsigned i = 0; i < n_requests; ++i)
+		requests.push_back({HTTP_METHOD_GET, uris[i].c_str(),
+				    {hosts[i].c_str()}});
+
+	for (const auto &i : requests) {
+		if (FindLinear(rules, i) != index.FindRequest(i)) {
+			fprintf(stderr, "Mismatch for host=%s uri=%s\n",
+				i.headers.host, i.uri);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("%u rules, %u requests\n", n_rules, n_requests);
+
+	Measure("linear", n_requests, [&]{
+		for (const auto &i : requests)
+			result = FindLinear(rules, i);
+	});
+
+	Measure("index", n_requests, [&]{
+		for (const auto &i : requests)
+			result = index.FindRequest(i);
+	});
+
+	return EXIT_SUCCESS;
+}
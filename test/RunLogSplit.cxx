@@ -0,0 +1,199 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Benchmark for log-split's file cache: replay a synthetic stream of
+ * log lines from many sites, once with the old strategy (keep only
+ * the last file open, one write() per line) and once with
+ * #LogFileCache.
+ */
+
+#include "access_log/FileCache.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static constexpr unsigned N_SITES = 10000;
+static constexpr unsigned N_LINES = 500000;
+
+struct Line {
+	unsigned site;
+	std::string text;
+};
+
+/**
+ * Generate a reproducible stream where a few sites produce most of
+ * the traffic, interleaved with a long tail of small sites.
+ */
+static std::vector<Line>
+MakeStream()
+{
+	std::vector<double> weights;
+	weights.reserve(N_SITES);
+	for (unsigned i = 0; i < N_SITES; ++i)
+		weights.push_back(1.0 / (i + 1));
+
+	std::mt19937 rng(42);
+	std::discrete_distribution<unsigned> pick_site(weights.begin(),
+						       weights.end());
+
+	std::vector<Line> stream;
+	stream.reserve(N_LINES);
+
+	for (unsigned i = 0; i < N_LINES; ++i) {
+		const unsigned site = pick_site(rng);
+		char buffer[256];
+		snprintf(buffer, sizeof(buffer),
+			 "site%u 192.0.2.%u - - [18/Oct/2026:12:00:00 +0000]"
+			 " \"GET /index.html?%u HTTP/1.1\" 200 %u \"-\" \"-\" 0\n",
+			 site, i % 256, i, 1000 + i % 5000);
+		stream.push_back({site, buffer});
+	}
+
+	return stream;
+}
+
+static std::string
+MakePath(const char *directory, const char *variant, unsigned site)
+{
+	return std::string(directory) + "/" + variant + "/site" +
+		std::to_string(site) + "/access.log";
+}
+
+static void
+CreateDirectories(const char *directory, const char *variant)
+{
+	const std::string base = std::string(directory) + "/" + variant;
+	mkdir(base.c_str(), 0777);
+
+	for (unsigned i = 0; i < N_SITES; ++i)
+		mkdir((base + "/site" + std::to_string(i)).c_str(), 0777);
+}
+
+/**
+ * The strategy used by log-split before #LogFileCache.
+ */
+static void
+ReplaySingleFd(const char *directory, const std::vector<Line> &stream)
+{
+	UniqueFileDescriptor fd;
+	unsigned current_site = ~0U;
+
+	for (const auto &line : stream) {
+		if (line.site != current_site) {
+			fd.Close();
+			const auto path = MakePath(directory, "single", line.site);
+			if (!fd.Open(path.c_str(), O_CREAT|O_APPEND|O_WRONLY, 0666)) {
+				perror("open");
+				exit(EXIT_FAILURE);
+			}
+
+			current_site = line.site;
+		}
+
+		(void)fd.Write(line.text.data(), line.text.size());
+	}
+}
+
+static void
+ReplayCache(const char *directory, const char *variant,
+	    const LogFileCache::Options &options,
+	    const std::vector<Line> &stream)
+{
+	LogFileCache files(options);
+
+	for (const auto &line : stream) {
+		const auto path = MakePath(directory, variant, line.site);
+		files.Append(path.c_str(), line.text);
+		files.FlushExpired();
+	}
+}
+
+template<typename F>
+static void
+Measure(const char *name, F &&f)
+{
+	const auto start = std::chrono::steady_clock::now();
+	f();
+	const auto duration = std::chrono::steady_clock::now() - start;
+
+	printf("%-12s %8.1f ms\n", name,
+	       std::chrono::duration<double, std::milli>(duration).count());
+}
+
+int
+main(int argc, char **argv)
+try {
+	bool uring = false;
+	int argi = 1;
+	if (argi < argc && strcmp(argv[argi], "--io-uring") == 0) {
+		uring = true;
+		++argi;
+	}
+
+	if (argi + 1 != argc) {
+		fprintf(stderr, "Usage: RunLogSplit [--io-uring] DIRECTORY\n");
+		return EXIT_FAILURE;
+	}
+
+	const char *const directory = argv[argi];
+
+	const auto stream = MakeStream();
+
+	CreateDirectories(directory, "single");
+	CreateDirectories(directory, "cache");
+
+	Measure("single fd", [&]{
+		ReplaySingleFd(directory, stream);
+	});
+
+	LogFileCache::Options options;
+	options.max_files = 1024;
+	options.uring = uring;
+
+	Measure("file cache", [&]{
+		ReplayCache(directory, "cache", options, stream);
+	});
+
+	return EXIT_SUCCESS;
+} catch (const std::exception &e) {
+	fprintf(stderr, "%s\n", e.what());
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark for #OpenFileCache: create many small files in a
+ * temporary directory and "serve" each of them repeatedly, once with
+ * open(base)+openat()+statx() for each request and once with the
+ * cache.  This is the same sequence as Request::HandleFileAddress()
+ * with a BASE address: on a hit, the base directory is not opened.
+ */
+
+#include "bp/OpenFileCache.hxx"
+#include "PInstance.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+#include "util/PrintException.hxx"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr unsigned N_FILES = 10000;
+static constexpr unsigned N_ROUNDS = 20;
+
+static std::vector<std::string>
+CreateFiles(const char *dir)
+{
+	std::vector<std::string> names;
+	names.reserve(N_FILES);
+
+	for (unsigned i = 0; i < N_FILES; ++i) {
+		char name[32];
+		snprintf(name, sizeof(name), "%04u.txt", i);
+
+		const std::string path = std::string(dir) + "/" + name;
+		int fd = open(path.c_str(), O_WRONLY|O_CREAT|O_EXCL, 0600);
+		if (fd < 0)
+			throw std::runtime_error("Failed to create " + path);
+
+		static constexpr char data[] = "Hello world\n";
+		if (write(fd, data, sizeof(data) - 1) < 0) {
+			close(fd);
+			throw std::runtime_error("Failed to write " + path);
+		}
+
+		close(fd);
+		names.emplace_back(name);
+	}
+
+	return names;
+}
+
+static void
+RemoveFiles(const char *dir, const std::vector<std::string> &names) noexcept
+{
+	for (const auto &name : names)
+		unlink((std::string(dir) + "/" + name).c_str());
+
+	rmdir(dir);
+}
+
+static UniqueFileDescriptor
+OpenAndStat(const char *base_path, const char *path,
+	    struct statx &st) noexcept
+{
+	UniqueFileDescriptor base(open(base_path,
+				       O_PATH|O_DIRECTORY|O_CLOEXEC));
+	if (!base.IsDefined())
+		return base;
+
+	UniqueFileDescriptor fd(openat(base.Get(), path,
+				       O_RDONLY|O_NOCTTY|O_CLOEXEC));
+	if (fd.IsDefined() &&
+	    statx(fd.Get(), "", AT_EMPTY_PATH,
+		  STATX_TYPE|STATX_MTIME|STATX_INO|STATX_SIZE, &st) < 0)
+		fd.Close();
+
+	return fd;
+}
+
+template<typename F>
+static void
+Measure(const char *label, F &&f)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	unsigned n = 0;
+	for (unsigned round = 0; round < N_ROUNDS; ++round)
+		n += f();
+
+	const std::chrono::duration<double> duration =
+		std::chrono::steady_clock::now() - start;
+
+	printf("%-8s %u files in %.3f s, %.0f files/s\n",
+	       label, n, duration.count(), n / duration.count());
+}
+
+int
+main(int, char **)
+try {
+	/* the cache keeps all files open */
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	char dir[] = "/tmp/RunOpenFileCache.XXXXXX";
+	if (mkdtemp(dir) == nullptr)
+		throw std::runtime_error("mkdtemp() failed");
+
+	const auto names = CreateFiles(dir);
+
+	PInstance instance;
+
+	Measure("direct", [&]{
+		unsigned n = 0;
+		for (const auto &name : names) {
+			struct statx st;
+			n += OpenAndStat(dir, name.c_str(), st).IsDefined();
+		}
+		return n;
+	});
+
+	OpenFileCache cache(instance.event_loop, N_FILES,
+			    std::chrono::hours(1));
+
+	Measure("cached", [&]{
+		unsigned n = 0;
+		for (const auto &name : names) {
+			struct statx st;
+			auto fd = cache.Get(dir, name.c_str(), st);
+			if (!fd.IsDefined()) {
+				fd = OpenAndStat(dir, name.c_str(), st);
+				if (fd.IsDefined())
+					cache.Put(dir, name.c_str(), fd, st);
+			}
+
+			n += fd.IsDefined();
+		}
+		return n;
+	});
+
+	cache.Flush();
+	RemoveFiles(dir, names);
+	return EXIT_SUCCESS;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
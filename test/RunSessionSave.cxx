@@ -0,0 +1,233 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark for session persistence: compare the event loop stall of
+ * rewriting the whole session file with the journal, and measure the
+ * startup time of loading the snapshot and replaying the journal.
+ */
+
+#include "bp/session/Save.hxx"
+#include "bp/session/Journal.hxx"
+#include "bp/session/Manager.hxx"
+#include "bp/session/Session.hxx"
+#include "bp/session/Lease.hxx"
+#include "bp/session/Write.hxx"
+#include "bp/session/File.hxx"
+#include "thread/Pool.hxx"
+#include "event/Loop.hxx"
+#include "io/BufferedOutputStream.hxx"
+#include "io/FdOutputStream.hxx"
+#include "io/FileWriter.hxx"
+#include "util/PrintException.hxx"
+#include "random.hxx"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static constexpr std::chrono::seconds idle_timeout = std::chrono::hours(1);
+
+template<typename F>
+static void
+Measure(const char *label, F &&f)
+{
+	const auto start = std::chrono::steady_clock::now();
+	f();
+	const std::chrono::duration<double> duration =
+		std::chrono::steady_clock::now() - start;
+
+	printf("%-24s %.3f s\n", label, duration.count());
+}
+
+static std::vector<SessionId>
+Populate(SessionManager &manager, unsigned n)
+{
+	std::vector<SessionId> ids;
+	ids.reserve(n);
+
+	static constexpr char translate[] = "0123456789abcdef0123456789abcdef";
+
+	for (unsigned i = 0; i < n; ++i) {
+		SessionId id;
+		id.Generate();
+
+		auto *session = new Session(id);
+		session->expires.Touch(idle_timeout);
+		session->SetTranslate({translate, sizeof(translate) - 1});
+		manager.Insert(*session);
+
+		ids.push_back(id);
+	}
+
+	return ids;
+}
+
+/**
+ * The old implementation: rewrite the whole file synchronously.
+ */
+static void
+SaveFull(SessionManager &manager, const char *path)
+{
+	FileWriter fw(path);
+	FdOutputStream fos(fw.GetFileDescriptor());
+
+	{
+		BufferedOutputStream bos(fos);
+		session_write_file_header(bos);
+		manager.Visit([](const Session *session, void *ctx){
+			auto &os = *(BufferedOutputStream *)ctx;
+			session_write_magic(os, MAGIC_SESSION);
+			session_write(os, session);
+			return true;
+		}, &bos);
+		session_write_file_tail(bos);
+		bos.Flush();
+	}
+
+	fw.Commit();
+}
+
+static void
+StopThreads() noexcept
+{
+	thread_pool_stop();
+	thread_pool_join();
+}
+
+int
+main(int argc, char **argv)
+try {
+	const unsigned n_sessions = argc > 1
+		? strtoul(argv[1], nullptr, 10)
+		: 1000000;
+	const unsigned n_modified = n_sessions / 100;
+	const unsigned n_deleted = n_modified / 10;
+
+	random_seed();
+
+	char dir[] = "/tmp/RunSessionSave.XXXXXX";
+	if (mkdtemp(dir) == nullptr)
+		throw std::runtime_error("mkdtemp() failed");
+
+	const std::string path = std::string(dir) + "/sessions";
+	const std::string journal_path =
+		SessionJournal::MakeJournalPath(path.c_str());
+	const std::string compact_path = std::string(dir) + "/compact";
+
+	EventLoop event_loop;
+
+	std::vector<SessionId> ids;
+
+	{
+		SessionManager manager(event_loop, idle_timeout, 0, 0);
+		ids = Populate(manager, n_sessions);
+
+		printf("%u sessions, %u modified, %u deleted\n",
+		       n_sessions, n_modified, n_deleted);
+
+		Measure("full rewrite stall", [&]{
+			SaveFull(manager, path.c_str());
+		});
+
+		/* compaction serializes in small batches on the event
+		   loop; without a running loop, Close() serializes the
+		   rest in one go */
+		auto *journal = new SessionJournal(event_loop,
+						   compact_path.c_str(), 0);
+		Measure("compaction start", [&]{
+			journal->Compact(manager);
+		});
+
+		StopThreads();
+		Measure("compaction finish", [&]{
+			if (journal->Close())
+				delete journal;
+		});
+		thread_pool_deinit();
+	}
+
+	{
+		SessionManager manager(event_loop, idle_timeout, 0, 0);
+
+		Measure("load snapshot", [&]{
+			session_save_init(event_loop, manager, path.c_str());
+		});
+
+		for (unsigned i = 0; i < n_modified; ++i)
+			SessionLease lease(manager, ids[i]);
+
+		for (unsigned i = 0; i < n_deleted; ++i)
+			manager.EraseAndDispose(ids[n_modified + i]);
+
+		Measure("journal flush stall", [&]{
+			session_save(manager);
+		});
+
+		StopThreads();
+
+		Measure("shutdown", [&]{
+			session_save_deinit(manager);
+		});
+
+		thread_pool_deinit();
+	}
+
+	{
+		SessionManager manager(event_loop, idle_timeout, 0, 0);
+
+		Measure("load and replay", [&]{
+			session_save_init(event_loop, manager, path.c_str());
+		});
+
+		printf("%u sessions loaded\n", manager.Count());
+
+		StopThreads();
+		session_save_deinit(manager);
+		thread_pool_deinit();
+	}
+
+	unlink(path.c_str());
+	unlink(journal_path.c_str());
+	unlink(compact_path.c_str());
+	unlink(SessionJournal::MakeJournalPath(compact_path.c_str()).c_str());
+	rmdir(dir);
+
+	return EXIT_SUCCESS;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,315 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark for #TranslationMultiplexer versus #TranslationStock.  A
+ * mock translation server runs in a separate thread; it answers all
+ * requests it has received so far (in reverse order) after an
+ * artificial latency.
+ *
+ * Usage: RunTranslationBench [--multiplex] [--old-server]
+ *        [CONCURRENCY [COUNT [LATENCY_MS]]]
+ */
+
+#include "translation/Stock.hxx"
+#include "translation/Multiplex.hxx"
+#include "translation/Marshal.hxx"
+#include "translation/Handler.hxx"
+#include "translation/Request.hxx"
+#include "translation/Protocol.hxx"
+#include "fb_pool.hxx"
+#include "pool/pool.hxx"
+#include "PInstance.hxx"
+#include "net/AllocatedSocketAddress.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "system/Error.hxx"
+#include "util/Cancellable.hxx"
+#include "util/PrintException.hxx"
+#include "AllocatorPtr.hxx"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct MockServerConfig {
+	std::chrono::milliseconds latency{1};
+
+	/**
+	 * Emulate a server which doesn't know
+	 * #TRANSLATE_REQUEST_ID (and ignores it).
+	 */
+	bool old_server = false;
+};
+
+static void
+AppendPacket(std::vector<uint8_t> &dest, TranslationCommand command,
+	     const void *payload=nullptr, size_t size=0)
+{
+	TranslationHeader header;
+	header.length = size;
+	header.command = command;
+
+	const auto *h = (const uint8_t *)&header;
+	dest.insert(dest.end(), h, h + sizeof(header));
+
+	const auto *p = (const uint8_t *)payload;
+	dest.insert(dest.end(), p, p + size);
+}
+
+/**
+ * Serve one connection with blocking I/O: collect all requests which
+ * have arrived, "process" them for #latency, then send all responses
+ * at once.
+ */
+static void
+MockServeConnection(UniqueSocketDescriptor s, MockServerConfig config)
+{
+	std::vector<uint8_t> input;
+	uint8_t buffer[65536];
+
+	while (true) {
+		ssize_t nbytes = s.Read(buffer, sizeof(buffer));
+		if (nbytes <= 0)
+			return;
+
+		input.insert(input.end(), buffer, buffer + nbytes);
+
+		/* parse all complete requests */
+		std::vector<uint32_t> ids;
+		size_t consumed = 0, position = 0;
+		uint32_t id = 0;
+		while (input.size() - position >= sizeof(TranslationHeader)) {
+			TranslationHeader header;
+			memcpy(&header, input.data() + position, sizeof(header));
+			const size_t packet_size = sizeof(header) + header.length;
+			if (input.size() - position < packet_size)
+				break;
+
+			if (header.command == TranslationCommand::BEGIN)
+				id = 0;
+			else if (header.command == TRANSLATE_REQUEST_ID &&
+				 header.length == sizeof(id))
+				memcpy(&id, input.data() + position + sizeof(header),
+				       sizeof(id));
+
+			position += packet_size;
+
+			if (header.command == TranslationCommand::END) {
+				ids.push_back(id);
+				consumed = position;
+			}
+		}
+
+		input.erase(input.begin(), input.begin() + consumed);
+
+		if (ids.empty())
+			continue;
+
+		std::this_thread::sleep_for(config.latency);
+
+		std::vector<uint8_t> output;
+		for (auto i = ids.rbegin(); i != ids.rend(); ++i) {
+			AppendPacket(output, TranslationCommand::BEGIN);
+			if (*i != 0 && !config.old_server)
+				AppendPacket(output, TRANSLATE_REQUEST_ID,
+					     &*i, sizeof(*i));
+
+			static constexpr uint16_t status = 200;
+			AppendPacket(output, TranslationCommand::STATUS,
+				     &status, sizeof(status));
+			AppendPacket(output, TranslationCommand::END);
+		}
+
+		if (s.Write(output.data(), output.size()) != (ssize_t)output.size())
+			return;
+	}
+}
+
+static void
+MockServer(UniqueSocketDescriptor listener, MockServerConfig config)
+{
+	while (true) {
+		UniqueSocketDescriptor s(accept(listener.Get(), nullptr, nullptr));
+		if (!s.IsDefined())
+			return;
+
+		std::thread(MockServeConnection, std::move(s), config).detach();
+	}
+}
+
+struct BenchContext final : PInstance {
+	TranslationService *service;
+
+	TranslateRequest request;
+
+	unsigned remaining, running = 0, errors = 0;
+
+	struct Client final : TranslateHandler {
+		BenchContext &context;
+
+		PoolPtr pool;
+
+		CancellablePointer cancel_ptr;
+
+		explicit Client(BenchContext &_context) noexcept
+			:context(_context) {}
+
+		void Start() noexcept {
+			pool = pool_new_linear(context.root_pool, "request", 8192);
+			context.service->SendRequest(AllocatorPtr(pool),
+						     context.request,
+						     nullptr, *this,
+						     cancel_ptr);
+		}
+
+		void OnTranslateResponse(TranslateResponse &) noexcept override {
+			context.OnDone(*this);
+		}
+
+		void OnTranslateError(std::exception_ptr ep) noexcept override {
+			PrintException(ep);
+			++context.errors;
+			context.OnDone(*this);
+		}
+	};
+
+	std::vector<std::unique_ptr<Client>> clients;
+
+	void OnDone(Client &client) noexcept {
+		client.pool.reset();
+
+		if (remaining > 0) {
+			--remaining;
+			client.Start();
+		} else if (--running == 0)
+			event_loop.Break();
+	}
+
+	void Run(unsigned concurrency) noexcept {
+		for (unsigned i = 0; i < concurrency && remaining > 0; ++i) {
+			--remaining;
+			++running;
+			clients.emplace_back(std::make_unique<Client>(*this));
+			clients.back()->Start();
+		}
+
+		event_loop.Dispatch();
+	}
+};
+
+int
+main(int argc, char **argv)
+try {
+	bool multiplex = false;
+	MockServerConfig server_config;
+	unsigned concurrency = 256, count = 100000;
+
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-'; ++i) {
+		if (strcmp(argv[i], "--multiplex") == 0)
+			multiplex = true;
+		else if (strcmp(argv[i], "--old-server") == 0)
+			server_config.old_server = true;
+		else {
+			fprintf(stderr, "Unknown option: %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (i < argc)
+		concurrency = strtoul(argv[i++], nullptr, 10);
+	if (i < argc)
+		count = strtoul(argv[i++], nullptr, 10);
+	if (i < argc)
+		server_config.latency = std::chrono::milliseconds(strtoul(argv[i++], nullptr, 10));
+
+	char name[64];
+	snprintf(name, sizeof(name), "@RunTranslationBench-%d", (int)getpid());
+
+	AllocatedSocketAddress address;
+	address.SetLocal(name);
+
+	UniqueSocketDescriptor listener;
+	if (!listener.Create(AF_LOCAL, SOCK_STREAM, 0))
+		throw MakeErrno("Failed to create socket");
+
+	if (!listener.Bind(address))
+		throw MakeErrno("Failed to bind");
+
+	if (!listener.Listen(64))
+		throw MakeErrno("Failed to listen");
+
+	std::thread(MockServer, std::move(listener), server_config).detach();
+
+	const ScopeFbPoolInit fb_pool_init;
+	BenchContext context;
+
+	/* the default "translate_stock_limit" */
+	static constexpr unsigned limit = 64;
+
+	std::unique_ptr<TranslationService> service;
+	if (multiplex)
+		service = std::make_unique<TranslationMultiplexer>(context.event_loop,
+								   address, limit);
+	else
+		service = std::make_unique<TranslationStock>(context.event_loop,
+							     address, limit);
+
+	context.service = service.get();
+	context.request.uri = "/";
+	context.remaining = count;
+
+	const auto start = std::chrono::steady_clock::now();
+	context.Run(concurrency);
+	const std::chrono::duration<double> duration =
+		std::chrono::steady_clock::now() - start;
+
+	printf("%u requests (%u errors) in %.3fs: %.0f requests/s (%s)\n",
+	       count, context.errors, duration.count(),
+	       count / duration.count(),
+	       multiplex ? "multiplex" : "stock");
+
+	context.clients.clear();
+	service.reset();
+
+	return context.errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
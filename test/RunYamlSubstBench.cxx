@@ -0,0 +1,159 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark for NewYamlSubstIstream(): pipe the given input file
+ * through a YAML substitution COUNT times and print the request rate.
+ * With "--no-cache", the YAML map cache is flushed before each
+ * iteration, i.e. the file is parsed every time.
+ */
+
+#include "istream/UnusedPtr.hxx"
+#include "istream/YamlSubstIstream.hxx"
+#include "istream/StringSink.hxx"
+#include "istream/istream_string.hxx"
+#include "fb_pool.hxx"
+#include "PInstance.hxx"
+#include "pool/pool.hxx"
+#include "util/Cancellable.hxx"
+#include "util/ConstBuffer.hxx"
+#include "util/PrintException.hxx"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct Usage {};
+
+struct BenchSinkHandler final : StringSinkHandler {
+	std::size_t size;
+	bool done;
+
+	void OnStringSinkSuccess(std::string &&value) noexcept override {
+		size = value.size();
+		done = true;
+	}
+
+	void OnStringSinkError(std::exception_ptr error) noexcept override {
+		PrintException(error);
+		exit(EXIT_FAILURE);
+	}
+};
+
+static std::string
+LoadTextFile(const char *path)
+{
+	std::ifstream f(path);
+	if (!f)
+		throw std::runtime_error(std::string("Failed to open ") + path);
+
+	std::stringstream s;
+	s << f.rdbuf();
+	return s.str();
+}
+
+int
+main(int argc, char **argv)
+try {
+	ConstBuffer<const char *> args(argv + 1, argc - 1);
+
+	bool use_cache = true;
+	if (!args.empty() && strcmp(args.front(), "--no-cache") == 0) {
+		args.shift();
+		use_cache = false;
+	}
+
+	if (args.size() < 3 || args.size() > 5)
+		throw Usage();
+
+	const char *const prefix = args.shift();
+	const char *const yaml_file = args.shift();
+	const std::string input = LoadTextFile(args.shift());
+	const unsigned count = args.empty() ? 1000 : strtoul(args.shift(), nullptr, 10);
+	const char *const yaml_map_path = args.empty() ? nullptr : args.shift();
+
+	const ScopeFbPoolInit fb_pool_init;
+	PInstance instance;
+
+	std::size_t output_size = 0;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (unsigned i = 0; i < count; ++i) {
+		if (!use_cache)
+			FlushYamlSubstCache();
+
+		auto pool = pool_new_linear(instance.root_pool, "request", 8192);
+
+		BenchSinkHandler handler;
+		handler.done = false;
+
+		CancellablePointer cancel_ptr;
+		auto &sink = NewStringSink(pool,
+					   NewYamlSubstIstream(pool,
+							       istream_string_new(pool, input.c_str()),
+							       true,
+							       prefix, yaml_file,
+							       yaml_map_path),
+					   handler, cancel_ptr);
+
+		while (!handler.done)
+			ReadStringSink(sink);
+
+		output_size = handler.size;
+	}
+
+	const std::chrono::duration<double> duration =
+		std::chrono::steady_clock::now() - start;
+
+	FlushYamlSubstCache();
+	pool_commit();
+
+	printf("%u requests in %.3f s (%.0f requests/s, cache %s), %zu bytes output\n",
+	       count, duration.count(), count / duration.count(),
+	       use_cache ? "enabled" : "disabled",
+	       output_size);
+
+	return EXIT_SUCCESS;
+} catch (Usage) {
+	fprintf(stderr, "usage: %s [--no-cache] PREFIX DATA.yaml INPUT [COUNT [MAP_PATH]]\n",
+		argv[0]);
+	return EXIT_FAILURE;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
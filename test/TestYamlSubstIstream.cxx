@@ -35,12 +35,23 @@
 #include "istream/istream_string.hxx"
 #include "istream/istream.hxx"
 #include "istream/UnusedPtr.hxx"
+#include "istream/StringSink.hxx"
+#include "TestPool.hxx"
+#include "util/Cancellable.hxx"
 #include "util/StringView.hxx"
 
 #include <yaml-cpp/node/parse.h>
 #include <yaml-cpp/node/node.h>
 #include <yaml-cpp/node/impl.h>
 
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
 static constexpr char yaml[] =
 	"top: level\n"
 	"child:\n"
@@ -74,3 +85,89 @@ public:
 
 INSTANTIATE_TYPED_TEST_CASE_P(YamlSubst, IstreamFilterTest,
 			      IstreamYamlSubstTestTraits);
+
+struct CollectSinkHandler final : StringSinkHandler {
+	std::string value;
+	std::exception_ptr error;
+	bool done = false;
+
+	void OnStringSinkSuccess(std::string &&_value) noexcept override {
+		value = std::move(_value);
+		done = true;
+	}
+
+	void OnStringSinkError(std::exception_ptr _error) noexcept override {
+		error = std::move(_error);
+		done = true;
+	}
+};
+
+static std::string
+SubstYamlFile(struct pool &pool, const char *yaml_file, const char *input)
+{
+	CollectSinkHandler handler;
+	CancellablePointer cancel_ptr;
+	auto &sink = NewStringSink(pool,
+				   NewYamlSubstIstream(pool,
+						       istream_string_new(pool, input),
+						       true, nullptr,
+						       yaml_file, nullptr),
+				   handler, cancel_ptr);
+
+	while (!handler.done)
+		ReadStringSink(sink);
+
+	if (handler.error)
+		std::rethrow_exception(handler.error);
+
+	return std::move(handler.value);
+}
+
+static void
+WriteYamlFile(const char *path, const char *contents, time_t mtime)
+{
+	FILE *file = fopen(path, "w");
+	ASSERT_NE(file, nullptr);
+	fputs(contents, file);
+	fclose(file);
+
+	const struct timespec times[2]{{mtime, 0}, {mtime, 0}};
+	ASSERT_EQ(utimensat(AT_FDCWD, path, times, 0), 0);
+}
+
+/**
+ * The cache used by NewYamlSubstIstream() must reload a file after
+ * its modification time has changed.
+ */
+TEST(YamlSubstCache, Mtime)
+{
+	char path[] = "/tmp/TestYamlSubstIstream.XXXXXX";
+	const int fd = mkstemp(path);
+	ASSERT_GE(fd, 0);
+	close(fd);
+
+	{
+		TestPool pool;
+
+		WriteYamlFile(path, "greeting: hello\n", 1000000000);
+		EXPECT_EQ(SubstYamlFile(pool, path, "{[greeting]}!"), "hello!");
+
+		/* same inode and size, but a different mtime */
+		WriteYamlFile(path, "greeting: world\n", 1000000001);
+		EXPECT_EQ(SubstYamlFile(pool, path, "{[greeting]}!"), "world!");
+
+		/* the cache does not look at the contents: if inode,
+		   size and mtime are unchanged, the cached map is
+		   used */
+		WriteYamlFile(path, "greeting: again\n", 1000000001);
+		EXPECT_EQ(SubstYamlFile(pool, path, "{[greeting]}!"), "world!");
+
+		/* after a flush, the file is loaded again */
+		FlushYamlSubstCache();
+		EXPECT_EQ(SubstYamlFile(pool, path, "{[greeting]}!"), "again!");
+
+		FlushYamlSubstCache();
+	}
+
+	unlink(path);
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark for istream_subst_new(): generate a text with variable
+ * references and pipe it through a #SubstIstream with 10, 100 and
+ * 1000 search words (or the numbers given on the command line),
+ * printing the throughput.
+ */
+
+#include "istream/SubstIstream.hxx"
+#include "istream/Sink.hxx"
+#include "istream/UnusedPtr.hxx"
+#include "istream/istream_string.hxx"
+#include "fb_pool.hxx"
+#include "PInstance.hxx"
+#include "pool/pool.hxx"
+#include "util/PrintException.hxx"
+#include "util/StringView.hxx"
+
+#include <chrono>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+class CountSink final : IstreamSink {
+public:
+	std::size_t size = 0;
+	bool done = false;
+
+	explicit CountSink(UnusedIstreamPtr &&_input) noexcept
+		:IstreamSink(std::move(_input)) {}
+
+	void Run() noexcept {
+		while (!done)
+			input.Read();
+	}
+
+private:
+	/* virtual methods from class IstreamHandler */
+
+	size_t OnData(const void *, size_t length) noexcept override {
+		size += length;
+		return length;
+	}
+
+	void OnEof() noexcept override {
+		ClearInput();
+		done = true;
+	}
+
+	void OnError(std::exception_ptr ep) noexcept override {
+		ClearInput();
+		PrintException(ep);
+		exit(EXIT_FAILURE);
+	}
+};
+
+static std::string
+MakeName(unsigned i)
+{
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "{[key%u]}", i);
+	return buffer;
+}
+
+/**
+ * Generate a text of about the given size which contains a variable
+ * reference (and an opening brace which does not start a reference)
+ * every few dozen bytes.
+ */
+static std::string
+MakeInput(unsigned n_words, std::size_t size)
+{
+	static constexpr char filler[] =
+		"<p>Lorem ipsum dolor sit amet, consectetur {adipiscing} elit.</p>\n";
+
+	std::string s;
+	s.reserve(size + 256);
+
+	for (unsigned i = 0; s.size() < size; ++i) {
+		s += filler;
+		s += MakeName((i * 7919) % n_words);
+	}
+
+	return s;
+}
+
+static void
+RunBench(PInstance &instance, unsigned n_words)
+{
+	static constexpr std::size_t INPUT_SIZE = 16 * 1024 * 1024;
+
+	const std::string input = MakeInput(n_words, INPUT_SIZE);
+
+	auto pool = pool_new_libc(instance.root_pool, "bench");
+
+	SubstTree tree;
+	for (unsigned i = 0; i < n_words; ++i) {
+		const auto name = MakeName(i);
+		tree.Add(pool, p_strdup(pool, name.c_str()), "value");
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+
+	CountSink sink(istream_subst_new(pool,
+					 istream_string_new(pool, input.c_str()),
+					 std::move(tree)));
+	sink.Run();
+
+	const std::chrono::duration<double> duration =
+		std::chrono::steady_clock::now() - start;
+
+	printf("%5u words: %zu -> %zu bytes in %.3f s, %.1f MB/s\n",
+	       n_words, input.size(), sink.size, duration.count(),
+	       input.size() / duration.count() / (1024 * 1024));
+}
+
+int
+main(int argc, char **argv)
+try {
+	const ScopeFbPoolInit fb_pool_init;
+	PInstance instance;
+
+	if (argc > 1) {
+		for (int i = 1; i < argc; ++i)
+			RunBench(instance, strtoul(argv[i], nullptr, 10));
+	} else {
+		for (unsigned n_words : {10, 100, 1000})
+			RunBench(instance, n_words);
+	}
+
+	pool_commit();
+
+	return EXIT_SUCCESS;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stock/AdaptiveIdleTarget.hxx"
+
+#include <gtest/gtest.h>
+
+TEST(AdaptiveIdleTarget, Basic)
+{
+	AdaptiveIdleTarget t(2, 8);
+	ASSERT_EQ(t.Get(), 2u);
+
+	/* misses raise the target */
+	t.AddMiss();
+	t.AddMiss();
+	t.AddMiss();
+	ASSERT_TRUE(t.Adapt(2, 8));
+	ASSERT_EQ(t.Get(), 5u);
+
+	/* without misses, it decays by one per call */
+	ASSERT_TRUE(t.Adapt(2, 8));
+	ASSERT_EQ(t.Get(), 4u);
+	ASSERT_TRUE(t.Adapt(2, 8));
+	ASSERT_TRUE(t.Adapt(2, 8));
+	ASSERT_EQ(t.Get(), 2u);
+
+	/* back at the minimum: may be discarded */
+	ASSERT_FALSE(t.Adapt(2, 8));
+	ASSERT_EQ(t.Get(), 2u);
+}
+
+TEST(AdaptiveIdleTarget, ClampMaxIdle)
+{
+	AdaptiveIdleTarget t(2, 4);
+
+	for (unsigned i = 0; i < 100; ++i)
+		t.AddMiss();
+
+	ASSERT_TRUE(t.Adapt(2, 4));
+	ASSERT_EQ(t.Get(), 4u);
+}
+
+TEST(AdaptiveIdleTarget, MinAboveMaxIdle)
+{
+	/* a minimum above "max_idle" must not make the target
+	   exceed it, or else the stock would discard the excess
+	   idle items and create them again in a loop */
+	AdaptiveIdleTarget t(10, 4);
+	ASSERT_EQ(t.Get(), 4u);
+
+	t.AddMiss();
+	ASSERT_TRUE(t.Adapt(10, 4));
+	ASSERT_EQ(t.Get(), 4u);
+
+	ASSERT_FALSE(t.Adapt(10, 4));
+	ASSERT_EQ(t.Get(), 4u);
+}
+
+TEST(AdaptiveIdleTarget, MinLowered)
+{
+	AdaptiveIdleTarget t(4, 8);
+
+	/* the minimum was lowered at runtime: decay to the new
+	   one */
+	ASSERT_TRUE(t.Adapt(1, 8));
+	ASSERT_EQ(t.Get(), 3u);
+	ASSERT_TRUE(t.Adapt(1, 8));
+	ASSERT_TRUE(t.Adapt(1, 8));
+	ASSERT_EQ(t.Get(), 1u);
+	ASSERT_FALSE(t.Adapt(1, 8));
+}
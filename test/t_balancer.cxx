@@ -31,15 +31,20 @@
  */
 
 #include "TestPool.hxx"
+#include "lb/OutstandingIstream.hxx"
 #include "cluster/BalancerMap.hxx"
 #include "cluster/AddressList.hxx"
 #include "cluster/AddressListWrapper.hxx"
 #include "AllocatorPtr.hxx"
 #include "event/Loop.hxx"
+#include "istream/istream_string.hxx"
+#include "istream/StringSink.hxx"
+#include "istream/UnusedPtr.hxx"
 #include "net/Resolver.hxx"
 #include "net/AddressInfo.hxx"
 #include "net/FailureManager.hxx"
 #include "net/FailureRef.hxx"
+#include "util/Cancellable.hxx"
 #include "util/Compiler.h"
 #include "util/Expiry.hxx"
 
@@ -116,6 +121,15 @@ FailureRemove(FailureManager &fm, const char *host_and_port,
 	fm.Make(Resolve(host_and_port, 80, nullptr).front()).Unset(status);
 }
 
+static void
+OutstandingAdd(FailureManager &fm, const char *host_and_port,
+	       unsigned n=1)
+{
+	auto &info = fm.Make(Resolve(host_and_port, 80, nullptr).front());
+	for (unsigned i = 0; i < n; ++i)
+		info.AddOutstanding();
+}
+
 TEST(BalancerTest, Failure)
 {
 	FailureManager fm;
@@ -246,6 +260,55 @@ TEST(BalancerTest, Failed)
 	ASSERT_EQ(al.Find(result), 0);
 }
 
+TEST(BalancerTest, Outlier)
+{
+	FailureManager fm;
+	EventLoop event_loop;
+	MyBalancer balancer(fm);
+
+	TestPool pool;
+	AddressListBuilder al(pool);
+	al.Add("192.168.0.1");
+	al.Add("192.168.0.2");
+	al.Add("192.168.0.3");
+
+	FailureAdd(fm, "192.168.0.2", FailureStatus::OUTLIER);
+	ASSERT_EQ(FailureGet(fm, "192.168.0.2"), FailureStatus::OUTLIER);
+
+	SocketAddress result = balancer.Get(al);
+	ASSERT_EQ(al.Find(result), 0);
+
+	result = balancer.Get(al);
+	ASSERT_EQ(al.Find(result), 2);
+
+	result = balancer.Get(al);
+	ASSERT_EQ(al.Find(result), 0);
+
+	FailureRemove(fm, "192.168.0.2", FailureStatus::OUTLIER);
+	ASSERT_EQ(FailureGet(fm, "192.168.0.2"), FailureStatus::OK);
+}
+
+TEST(BalancerTest, PassiveFailures)
+{
+	FailureManager fm;
+	auto &info = fm.Make(Resolve("192.168.0.1", 80, nullptr).front());
+
+	const auto window = std::chrono::seconds(1);
+	const auto now = Expiry::Now();
+
+	ASSERT_EQ(info.AddPassiveFailure(now, window), 1u);
+	ASSERT_EQ(info.AddPassiveFailure(now, window), 2u);
+
+	/* a successful request starts over */
+	info.ResetPassiveFailures();
+	ASSERT_EQ(info.AddPassiveFailure(now, window), 1u);
+	ASSERT_EQ(info.AddPassiveFailure(now, window), 2u);
+
+	/* so does an expired window */
+	const auto later = Expiry::Touched(now, std::chrono::seconds(2));
+	ASSERT_EQ(info.AddPassiveFailure(later, window), 1u);
+}
+
 TEST(BalancerTest, StickyFailover)
 {
 	FailureManager fm;
@@ -449,3 +512,148 @@ TEST(BalancerTest, StickyCookie)
 	ASSERT_NE(result, nullptr);
 	ASSERT_EQ(al.Find(result), 2);
 }
+
+TEST(BalancerTest, LeastOutstanding)
+{
+	FailureManager fm;
+	EventLoop event_loop;
+	MyBalancer balancer(fm);
+
+	TestPool pool;
+	AddressListBuilder al(pool, StickyMode::LEAST_OUTSTANDING);
+	al.Add("192.168.0.1");
+	al.Add("192.168.0.2");
+	al.Add("192.168.0.3");
+
+	OutstandingAdd(fm, "192.168.0.1", 2);
+	OutstandingAdd(fm, "192.168.0.3", 1);
+
+	/* the idle node is always preferred */
+
+	for (unsigned i = 0; i < 16; ++i) {
+		SocketAddress result = balancer.Get(al);
+		ASSERT_NE(result, nullptr);
+		ASSERT_EQ(al.Find(result), 1);
+	}
+
+	/* .. unless it fails */
+
+	FailureAdd(fm, "192.168.0.2");
+
+	for (unsigned i = 0; i < 16; ++i) {
+		SocketAddress result = balancer.Get(al);
+		ASSERT_NE(result, nullptr);
+		ASSERT_EQ(al.Find(result), 2);
+	}
+
+	/* the sticky hash is ignored */
+
+	SocketAddress result = balancer.Get(al, 1);
+	ASSERT_NE(result, nullptr);
+	ASSERT_EQ(al.Find(result), 2);
+}
+
+TEST(BalancerTest, PowerOfTwo)
+{
+	FailureManager fm;
+	EventLoop event_loop;
+	MyBalancer balancer(fm);
+
+	TestPool pool;
+	AddressListBuilder al(pool, StickyMode::POWER_OF_TWO);
+	al.Add("192.168.0.1");
+	al.Add("192.168.0.2");
+	al.Add("192.168.0.3");
+
+	OutstandingAdd(fm, "192.168.0.1", 8);
+
+	/* the busy node loses against every other node */
+
+	for (unsigned i = 0; i < 64; ++i) {
+		SocketAddress result = balancer.Get(al);
+		ASSERT_NE(result, nullptr);
+		ASSERT_NE(al.Find(result), 0);
+	}
+
+	/* when both idle nodes fail, the busy node is the only one
+	   left */
+
+	FailureAdd(fm, "192.168.0.2");
+	FailureAdd(fm, "192.168.0.3");
+
+	for (unsigned i = 0; i < 64; ++i) {
+		SocketAddress result = balancer.Get(al);
+		ASSERT_NE(result, nullptr);
+		ASSERT_EQ(al.Find(result), 0);
+	}
+}
+
+/**
+ * An HTTP/2 stream on a beng-lb cluster member stays "outstanding"
+ * until its response body ends or is aborted.
+ */
+TEST(BalancerTest, Http2StreamOutstanding)
+{
+	FailureManager fm;
+	EventLoop event_loop;
+	MyBalancer balancer(fm);
+
+	TestPool pool;
+	AddressListBuilder al(pool, StickyMode::LEAST_OUTSTANDING);
+	al.Add("192.168.0.1");
+	al.Add("192.168.0.2");
+
+	/* counted by LbCluster::Http2Connect and handed over to the
+	   request */
+	auto &info = fm.Make(Resolve("192.168.0.1", 80, nullptr).front());
+	info.AddOutstanding();
+
+	auto body = istream_outstanding_new(pool,
+					    istream_string_new(pool, "foo"),
+					    info);
+
+	/* while the response body is pending, the other member is
+	   preferred */
+
+	ASSERT_EQ(info.GetOutstanding(), 1U);
+
+	for (unsigned i = 0; i < 16; ++i) {
+		SocketAddress result = balancer.Get(al);
+		ASSERT_NE(result, nullptr);
+		ASSERT_EQ(al.Find(result), 1);
+	}
+
+	/* the end of the response body ends the stream */
+
+	struct Handler final : StringSinkHandler {
+		std::string value;
+		bool done = false;
+
+		void OnStringSinkSuccess(std::string &&_value) noexcept override {
+			value = std::move(_value);
+			done = true;
+		}
+
+		void OnStringSinkError(std::exception_ptr) noexcept override {
+			done = true;
+		}
+	} handler;
+
+	CancellablePointer cancel_ptr;
+	ReadStringSink(NewStringSink(pool, std::move(body),
+				     handler, cancel_ptr));
+	ASSERT_TRUE(handler.done);
+	ASSERT_EQ(handler.value, "foo");
+	ASSERT_EQ(info.GetOutstanding(), 0U);
+
+	/* an aborted response body ends the stream as well */
+
+	info.AddOutstanding();
+	body = istream_outstanding_new(pool,
+				       istream_string_new(pool, "bar"),
+				       info);
+	ASSERT_EQ(info.GetOutstanding(), 1U);
+
+	body.Clear();
+	ASSERT_EQ(info.GetOutstanding(), 0U);
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "SliceFifoBuffer.hxx"
+#include "fb_pool.hxx"
+#include "SlicePool.hxx"
+#include "AllocatorStats.hxx"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+static void
+Fill(SliceFifoBuffer &buffer, unsigned &seed) noexcept
+{
+	auto w = buffer.Write();
+	for (size_t i = 0; i < w.size; ++i)
+		w.data[i] = (uint8_t)seed++;
+	buffer.Append(w.size);
+}
+
+TEST(FbPoolTest, SizeClasses)
+{
+	const ScopeFbPoolInit fb_pool_init;
+
+	ASSERT_EQ(FbSizeFor(0), FbSize::SMALL);
+	ASSERT_EQ(FbSizeFor(300), FbSize::SMALL);
+	ASSERT_EQ(FbSizeFor(4096), FbSize::SMALL);
+	ASSERT_EQ(FbSizeFor(4097), FbSize::MEDIUM);
+	ASSERT_EQ(FbSizeFor(FB_SIZE), FbSize::LARGE);
+	ASSERT_EQ(FbSizeFor(FB_SIZE * 2), FbSize::LARGE);
+
+	for (unsigned i = 0; i < FB_N_SIZES; ++i)
+		ASSERT_EQ(fb_pool_get(FbSize(i)).GetSliceSize(),
+			  FbSizeBytes(FbSize(i)));
+
+	ASSERT_EQ(&fb_pool_get(), &fb_pool_get(FbSize::LARGE));
+
+	auto small = fb_pool_get(FbSize::SMALL).Alloc();
+	auto large = fb_pool_get(FbSize::LARGE).Alloc();
+	ASSERT_EQ(small.size, FbSizeBytes(FbSize::SMALL));
+	ASSERT_EQ(large.size, FB_SIZE);
+
+	ASSERT_EQ(fb_pool_get(FbSize::SMALL).GetStats().netto_size,
+		  FbSizeBytes(FbSize::SMALL));
+	ASSERT_EQ(fb_pool_get(FbSize::MEDIUM).GetStats().netto_size, 0u);
+	ASSERT_EQ(fb_pool_get_stats().netto_size,
+		  FbSizeBytes(FbSize::SMALL) + FB_SIZE);
+}
+
+TEST(FbPoolTest, Grow)
+{
+	const ScopeFbPoolInit fb_pool_init;
+
+	SliceFifoBuffer buffer;
+	ASSERT_FALSE(fb_pool_grow(buffer));
+
+	buffer.Allocate(fb_pool_get(FbSize::SMALL));
+	ASSERT_EQ(buffer.GetCapacity(), FbSizeBytes(FbSize::SMALL));
+
+	/* the buffer grows one class at a time, and its data is
+	   preserved */
+	unsigned seed = 0;
+	Fill(buffer, seed);
+	buffer.Consume(1);
+	ASSERT_TRUE(fb_pool_grow(buffer));
+	ASSERT_EQ(buffer.GetCapacity(), FbSizeBytes(FbSize::MEDIUM));
+	ASSERT_EQ(buffer.GetAvailable(), FbSizeBytes(FbSize::SMALL) - 1);
+	ASSERT_EQ(fb_pool_get(FbSize::SMALL).GetStats().netto_size, 0u);
+
+	Fill(buffer, seed);
+	ASSERT_TRUE(fb_pool_grow(buffer));
+	ASSERT_EQ(buffer.GetCapacity(), FB_SIZE);
+	ASSERT_EQ(fb_pool_get(FbSize::MEDIUM).GetStats().netto_size, 0u);
+
+	Fill(buffer, seed);
+	ASSERT_FALSE(fb_pool_grow(buffer));
+	ASSERT_EQ(buffer.GetCapacity(), FB_SIZE);
+	ASSERT_TRUE(buffer.IsFull());
+
+	const auto r = buffer.Read();
+	ASSERT_EQ(r.size, FB_SIZE);
+	for (size_t i = 0; i < r.size; ++i)
+		ASSERT_EQ(r.data[i], (uint8_t)(i + 1));
+
+	buffer.Free();
+}
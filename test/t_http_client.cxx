@@ -51,6 +51,7 @@
 #include "pool/UniquePtr.hxx"
 #include "istream/UnusedPtr.hxx"
 #include "stopwatch.hxx"
+#include "util/Exception.hxx"
 
 #include <memory>
 
@@ -310,6 +311,42 @@ test_no_keepalive(Context<Connection> &c)
 	assert(c.body_error == nullptr);
 }
 
+/**
+ * A refused TCP Fast Open connection is reported by the first write;
+ * IsHttpClientConnectFailure() must recognize it.
+ */
+static void
+test_connect_failure()
+{
+	const auto refused =
+		NestException(std::make_exception_ptr(MakeErrno(ECONNREFUSED,
+								"Send failed")),
+			      HttpClientError(HttpClientErrorCode::IO,
+					      "HTTP client socket error"));
+	assert(IsHttpClientConnectFailure(refused));
+
+	const auto unreachable =
+		NestException(std::make_exception_ptr(MakeErrno(EHOSTUNREACH,
+								"Receive failed")),
+			      HttpClientError(HttpClientErrorCode::IO,
+					      "HTTP client socket error"));
+	assert(IsHttpClientConnectFailure(unreachable));
+
+	/* an established connection which was reset is not a
+	   connect failure */
+	const auto reset =
+		NestException(std::make_exception_ptr(MakeErrno(ECONNRESET,
+								"Receive failed")),
+			      HttpClientError(HttpClientErrorCode::IO,
+					      "HTTP client socket error"));
+	assert(!IsHttpClientConnectFailure(reset));
+
+	assert(!IsHttpClientConnectFailure(std::make_exception_ptr(HttpClientError(HttpClientErrorCode::REFUSED,
+										   "Server closed the socket without sending any response data"))));
+	assert(!IsHttpClientConnectFailure(std::make_exception_ptr(MakeErrno(ECONNREFUSED,
+									     "Failed to connect"))));
+}
+
 /*
  * main
  *
@@ -325,4 +362,6 @@ main(int, char **)
 
 	run_all_tests<Connection>();
 	run_test<Connection>(test_no_keepalive);
+
+	test_connect_failure();
 }
@@ -62,3 +62,72 @@ public:
 
 INSTANTIATE_TYPED_TEST_CASE_P(Subst, IstreamFilterTest,
                               IstreamSubstTestTraits);
+
+/**
+ * More than one different first character (so the #first_table path
+ * is used), search words sharing
+ * prefixes, and partial matches overlapping with full ones.  The
+ * shortest search word wins, therefore "foobar" is never replaced.
+ */
+class IstreamSubstManyTestTraits {
+public:
+    static constexpr const char *expected_result =
+        "fo1 14 3 ba5 6 quux bax zz";
+
+    static constexpr bool call_available = true;
+    static constexpr bool got_data_assert = true;
+    static constexpr bool enable_blocking = true;
+    static constexpr bool enable_abort_istream = true;
+
+    UnusedIstreamPtr CreateInput(struct pool &pool) const noexcept {
+        return istream_string_new(pool, "fofoo foobar fox babaz qux quux bax zz");
+    }
+
+    UnusedIstreamPtr CreateTest(EventLoop &, struct pool &pool,
+                                UnusedIstreamPtr input) const noexcept {
+        SubstTree tree;
+        tree.Add(pool, "foo", "1");
+        tree.Add(pool, "foobar", "2");
+        tree.Add(pool, "fox", "3");
+        tree.Add(pool, "bar", "4");
+        tree.Add(pool, "baz", "5");
+        tree.Add(pool, "qux", "6");
+        tree.Add(pool, "zap", "7");
+
+        return UnusedIstreamPtr(istream_subst_new(&pool, std::move(input), std::move(tree)));
+    }
+};
+
+INSTANTIATE_TYPED_TEST_CASE_P(SubstMany, IstreamFilterTest,
+                              IstreamSubstManyTestTraits);
+
+/**
+ * Search words which begin inside other (partial) search words, so
+ * SubstAutomaton::FindFirstChar() needs to follow the failure links.
+ */
+class IstreamSubstOverlapTestTraits {
+public:
+    static constexpr const char *expected_result = "a2x 1 2d a3 aa";
+
+    static constexpr bool call_available = true;
+    static constexpr bool got_data_assert = true;
+    static constexpr bool enable_blocking = true;
+    static constexpr bool enable_abort_istream = true;
+
+    UnusedIstreamPtr CreateInput(struct pool &pool) const noexcept {
+        return istream_string_new(pool, "abcx abcd bcd aaab aa");
+    }
+
+    UnusedIstreamPtr CreateTest(EventLoop &, struct pool &pool,
+                                UnusedIstreamPtr input) const noexcept {
+        SubstTree tree;
+        tree.Add(pool, "abcd", "1");
+        tree.Add(pool, "bc", "2");
+        tree.Add(pool, "aab", "3");
+
+        return UnusedIstreamPtr(istream_subst_new(&pool, std::move(input), std::move(tree)));
+    }
+};
+
+INSTANTIATE_TYPED_TEST_CASE_P(SubstOverlap, IstreamFilterTest,
+                              IstreamSubstOverlapTestTraits);
@@ -0,0 +1,251 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "lb/ConditionIndex.hxx"
+#include "lb/GotoConfig.hxx"
+#include "http/Method.h"
+
+#include <gtest/gtest.h>
+
+#include <list>
+
+#include <string.h>
+
+namespace {
+
+struct FakeHeaders {
+	const char *host;
+
+	const char *Get(const char *name) const noexcept {
+		return strcmp(name, "host") == 0 ? host : nullptr;
+	}
+};
+
+struct FakeRequest {
+	http_method_t method = HTTP_METHOD_GET;
+	const char *uri;
+	FakeHeaders headers;
+};
+
+using Type = LbAttributeReference::Type;
+
+class Rules {
+	std::list<LbGotoIfConfig> rules;
+
+public:
+	Rules &Exact(Type type, const char *value, bool negate=false) {
+		LbAttributeReference a = type == Type::HEADER
+			? LbAttributeReference{type, "host"}
+			: LbAttributeReference{type};
+		rules.emplace_back(LbConditionConfig{std::move(a), negate, value},
+				   LbGotoConfig{});
+		return *this;
+	}
+
+	Rules &Prefix(const char *value, bool negate=false) {
+		rules.emplace_back(LbConditionConfig{
+				{Type::URI}, negate,
+				LbConditionConfig::Prefix{value}},
+			LbGotoConfig{});
+		return *this;
+	}
+
+	Rules &Regex(const char *value, bool negate=false) {
+		rules.emplace_back(LbConditionConfig{
+				{Type::URI}, negate,
+				UniqueRegex(value, false, false)},
+			LbGotoConfig{});
+		return *this;
+	}
+
+	/**
+	 * Look up the request with #LbConditionIndex and verify that
+	 * a linear scan yields the same result.
+	 */
+	std::size_t Find(const char *uri, const char *host) const {
+		const FakeRequest request{HTTP_METHOD_GET, uri, {host}};
+
+		std::size_t linear = LbConditionIndex::NONE, index = 0;
+		for (const auto &i : rules) {
+			if (i.condition.MatchRequest(request)) {
+				linear = index;
+				break;
+			}
+
+			++index;
+		}
+
+		const std::size_t result =
+			LbConditionIndex{rules}.FindRequest(request);
+		EXPECT_EQ(result, linear);
+		return result;
+	}
+};
+
+}
+
+static constexpr std::size_t NONE = LbConditionIndex::NONE;
+
+TEST(LbConditionIndex, RegexToPrefix)
+{
+	EXPECT_EQ(RegexToPrefix("^/foo/"), "/foo/");
+	EXPECT_EQ(RegexToPrefix("^/foo/.*"), "/foo/");
+	EXPECT_EQ(RegexToPrefix("^"), "");
+	EXPECT_EQ(RegexToPrefix("^.*"), "");
+	EXPECT_EQ(RegexToPrefix("^/a-b_c~d/"), "/a-b_c~d/");
+
+	/* escaped punctuation is a literal */
+	EXPECT_EQ(RegexToPrefix("^/a\\.b"), "/a.b");
+	EXPECT_EQ(RegexToPrefix("^/a\\/b\\*"), "/a/b*");
+	EXPECT_EQ(RegexToPrefix("^/a\\.*"), std::nullopt);
+
+	/* not anchored at the start, or anchored at the end */
+	EXPECT_EQ(RegexToPrefix("/foo/"), std::nullopt);
+	EXPECT_EQ(RegexToPrefix(""), std::nullopt);
+	EXPECT_EQ(RegexToPrefix("^/foo$"), std::nullopt);
+	EXPECT_EQ(RegexToPrefix("^/foo/.*$"), std::nullopt);
+
+	/* escape sequences and a trailing backslash */
+	EXPECT_EQ(RegexToPrefix("^/a\\d"), std::nullopt);
+	EXPECT_EQ(RegexToPrefix("^/a\\w"), std::nullopt);
+	EXPECT_EQ(RegexToPrefix("^/a\\"), std::nullopt);
+
+	/* metacharacters */
+	EXPECT_EQ(RegexToPrefix("^/a.b"), std::nullopt);
+	EXPECT_EQ(RegexToPrefix("^/a.*b"), std::nullopt);
+	EXPECT_EQ(RegexToPrefix("^/a.*.*"), std::nullopt);
+	EXPECT_EQ(RegexToPrefix("^/a*"), std::nullopt);
+	EXPECT_EQ(RegexToPrefix("^/a+"), std::nullopt);
+	EXPECT_EQ(RegexToPrefix("^/a?"), std::nullopt);
+	EXPECT_EQ(RegexToPrefix("^/a|/b"), std::nullopt);
+	EXPECT_EQ(RegexToPrefix("^/(a)"), std::nullopt);
+	EXPECT_EQ(RegexToPrefix("^/[ab]"), std::nullopt);
+	EXPECT_EQ(RegexToPrefix("^/a{2}"), std::nullopt);
+	EXPECT_EQ(RegexToPrefix("^/a^"), std::nullopt);
+}
+
+TEST(LbConditionIndex, Empty)
+{
+	const Rules rules;
+	EXPECT_EQ(rules.Find("/", "a"), NONE);
+}
+
+TEST(LbConditionIndex, FirstMatch)
+{
+	Rules rules;
+	rules.Exact(Type::HEADER, "a")
+		.Prefix("/")
+		.Exact(Type::HEADER, "b")
+		.Exact(Type::HEADER, "a");
+
+	EXPECT_EQ(rules.Find("/", "a"), 0u);
+	EXPECT_EQ(rules.Find("/", "b"), 1u);
+	EXPECT_EQ(rules.Find("", "b"), 2u);
+	EXPECT_EQ(rules.Find("", "c"), NONE);
+}
+
+TEST(LbConditionIndex, Prefix)
+{
+	Rules rules;
+	rules.Prefix("/a/b")
+		.Prefix("/a")
+		.Exact(Type::URI, "/a/x")
+		.Prefix("/a/b/c")
+		.Exact(Type::URI, "/z")
+		.Prefix("");
+
+	EXPECT_EQ(rules.Find("/a/b/c", nullptr), 0u);
+	EXPECT_EQ(rules.Find("/a/b", nullptr), 0u);
+	EXPECT_EQ(rules.Find("/a/x", nullptr), 1u);
+	EXPECT_EQ(rules.Find("/a", nullptr), 1u);
+	EXPECT_EQ(rules.Find("/", nullptr), 5u);
+	EXPECT_EQ(rules.Find("/z", nullptr), 4u);
+}
+
+TEST(LbConditionIndex, Negate)
+{
+	Rules rules;
+	rules.Prefix("/x")
+		.Prefix("/y", true)
+		.Exact(Type::HEADER, "a", true)
+		.Exact(Type::URI, "/y");
+
+	EXPECT_EQ(rules.Find("/x", "a"), 0u);
+	EXPECT_EQ(rules.Find("/z", "a"), 1u);
+	EXPECT_EQ(rules.Find("/y", "b"), 2u);
+	EXPECT_EQ(rules.Find("/y", nullptr), 2u);
+	EXPECT_EQ(rules.Find("/y", "a"), 3u);
+	EXPECT_EQ(rules.Find("/y/1", "a"), NONE);
+}
+
+TEST(LbConditionIndex, NegateBeforeIndexed)
+{
+	/* a negated condition which precedes all indexed ones wins
+	   whenever it matches */
+	Rules rules;
+	rules.Exact(Type::HEADER, "a", true)
+		.Exact(Type::URI, "/")
+		.Prefix("/")
+		.Exact(Type::METHOD, "GET");
+
+	EXPECT_EQ(rules.Find("/", "a"), 1u);
+	EXPECT_EQ(rules.Find("/", "b"), 0u);
+	EXPECT_EQ(rules.Find("/x", "a"), 2u);
+	EXPECT_EQ(rules.Find("x", "a"), 3u);
+}
+
+TEST(LbConditionIndex, Regex)
+{
+	Rules rules;
+	rules.Regex("\\.php$")
+		.Prefix("/static/")
+		.Regex("^/static/.*\\.css$", true)
+		.Regex("\\.css$");
+
+	EXPECT_EQ(rules.Find("/a.php", nullptr), 0u);
+	EXPECT_EQ(rules.Find("/static/a.php", nullptr), 0u);
+	EXPECT_EQ(rules.Find("/static/a.css", nullptr), 1u);
+	EXPECT_EQ(rules.Find("/a.html", nullptr), 2u);
+	EXPECT_EQ(rules.Find("/a.css", nullptr), 2u);
+}
+
+TEST(LbConditionIndex, MissingHeader)
+{
+	/* a missing header compares like an empty string */
+	Rules rules;
+	rules.Exact(Type::HEADER, "a")
+		.Exact(Type::HEADER, "");
+
+	EXPECT_EQ(rules.Find("/", nullptr), 1u);
+	EXPECT_EQ(rules.Find("/", "a"), 0u);
+	EXPECT_EQ(rules.Find("/", "b"), NONE);
+}
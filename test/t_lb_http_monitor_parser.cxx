@@ -0,0 +1,204 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "lb/HttpMonitorParser.hxx"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+
+using std::string_view_literals::operator""sv;
+
+static bool
+Parse(std::string_view src, bool eof, HttpMonitorResponse &response,
+      bool head=false)
+{
+	return HttpMonitorParseResponse(src, head, eof, response);
+}
+
+TEST(HttpMonitorParser, ContentLength)
+{
+	constexpr auto src = "HTTP/1.1 200 OK\r\n"
+		"Content-Length: 5\r\n"
+		"\r\n"
+		"hello"sv;
+
+	HttpMonitorResponse response;
+	ASSERT_TRUE(Parse(src, false, response));
+	ASSERT_EQ(response.status, 200u);
+	ASSERT_EQ(response.body, "hello");
+	ASSERT_TRUE(response.keep_alive);
+
+	/* HTTP/1.0 closes the connection by default */
+	ASSERT_TRUE(Parse("HTTP/1.0 200 OK\r\n"
+			  "Content-Length: 0\r\n"
+			  "\r\n"sv, false, response));
+	ASSERT_FALSE(response.keep_alive);
+
+	/* HEAD responses have no body */
+	ASSERT_TRUE(Parse("HTTP/1.1 200 OK\r\n"
+			  "Content-Length: 5\r\n"
+			  "\r\n"sv, false, response, true));
+	ASSERT_TRUE(response.body.empty());
+	ASSERT_TRUE(response.keep_alive);
+}
+
+TEST(HttpMonitorParser, Truncated)
+{
+	HttpMonitorResponse response;
+
+	/* incomplete header: wait for more data, fail on EOF */
+	constexpr auto header = "HTTP/1.1 200 OK\r\nContent-Le"sv;
+	ASSERT_FALSE(Parse(header, false, response));
+	ASSERT_THROW(Parse(header, true, response), std::runtime_error);
+
+	/* a truncated body is evaluated, but the connection is not
+	   reused */
+	constexpr auto body = "HTTP/1.1 200 OK\r\n"
+		"Content-Length: 10\r\n"
+		"\r\n"
+		"hello"sv;
+	ASSERT_FALSE(Parse(body, false, response));
+	ASSERT_TRUE(Parse(body, true, response));
+	ASSERT_EQ(response.body, "hello");
+	ASSERT_FALSE(response.keep_alive);
+
+	/* a truncated chunked body */
+	constexpr auto chunked = "HTTP/1.1 200 OK\r\n"
+		"Transfer-Encoding: chunked\r\n"
+		"\r\n"
+		"5\r\nhello\r\n"
+		"3\r\nwo"sv;
+	ASSERT_FALSE(Parse(chunked, false, response));
+	ASSERT_TRUE(Parse(chunked, true, response));
+	ASSERT_EQ(response.body, "hello");
+	ASSERT_FALSE(response.keep_alive);
+
+	/* without length, the body ends with the connection */
+	constexpr auto unknown = "HTTP/1.1 200 OK\r\n"
+		"\r\n"
+		"hello"sv;
+	ASSERT_FALSE(Parse(unknown, false, response));
+	ASSERT_TRUE(Parse(unknown, true, response));
+	ASSERT_EQ(response.body, "hello");
+	ASSERT_FALSE(response.keep_alive);
+}
+
+TEST(HttpMonitorParser, Chunked)
+{
+	constexpr auto src = "HTTP/1.1 200 OK\r\n"
+		"Transfer-Encoding: chunked\r\n"
+		"\r\n"
+		"5;ext=1\r\nhello\r\n"
+		"A\r\n, world!!!\r\n"
+		"0\r\n"
+		"Trailer: x\r\n"
+		"\r\n"sv;
+
+	HttpMonitorResponse response;
+	ASSERT_TRUE(Parse(src, false, response));
+	ASSERT_EQ(response.body, "hello, world!!!");
+	ASSERT_TRUE(response.keep_alive);
+
+	/* trailing garbage prevents reusing the connection */
+	ASSERT_TRUE(Parse(std::string(src) + "x", false, response));
+	ASSERT_FALSE(response.keep_alive);
+}
+
+TEST(HttpMonitorParser, MalformedChunkSize)
+{
+	std::string body;
+	std::size_t consumed;
+
+	ASSERT_THROW(HttpMonitorDecodeChunked("x\r\n"sv, body, consumed),
+		     std::runtime_error);
+	ASSERT_THROW(HttpMonitorDecodeChunked("\r\n"sv, body, consumed),
+		     std::runtime_error);
+	ASSERT_THROW(HttpMonitorDecodeChunked("5x\r\nhello\r\n"sv, body, consumed),
+		     std::runtime_error);
+	ASSERT_THROW(HttpMonitorDecodeChunked("-1\r\n"sv, body, consumed),
+		     std::runtime_error);
+
+	/* overflows size_t */
+	ASSERT_THROW(HttpMonitorDecodeChunked("10000000000000000000\r\n"sv,
+					      body, consumed),
+		     std::runtime_error);
+
+	/* a huge (but valid) size must not wrap around */
+	ASSERT_FALSE(HttpMonitorDecodeChunked("ffffffffffffffff\r\nhello\r\n"sv,
+					      body, consumed));
+	ASSERT_FALSE(HttpMonitorDecodeChunked("fffffffffffffffe\r\nhello\r\n"sv,
+					      body, consumed));
+
+	/* the chunk is longer than announced */
+	ASSERT_THROW(HttpMonitorDecodeChunked("3\r\nhello\r\n"sv, body, consumed),
+		     std::runtime_error);
+}
+
+TEST(HttpMonitorParser, MalformedStatus)
+{
+	HttpMonitorResponse response;
+
+	ASSERT_THROW(Parse("HTTP/2.0 200 OK\r\n\r\n"sv, false, response),
+		     std::runtime_error);
+	ASSERT_THROW(Parse("HTTP/1.1 20 OK\r\n\r\n"sv, false, response),
+		     std::runtime_error);
+	ASSERT_THROW(Parse("HTTP/1.1 2000 OK\r\n\r\n"sv, false, response),
+		     std::runtime_error);
+	ASSERT_THROW(Parse("HTTP/1.1 999 OK\r\n\r\n"sv, false, response),
+		     std::runtime_error);
+	ASSERT_THROW(Parse("HTTP/1.1 200 OK\r\n"
+			   "Content-Length: 5x\r\n"
+			   "\r\n"sv, false, response),
+		     std::runtime_error);
+
+	/* the reason phrase is optional */
+	ASSERT_TRUE(Parse("HTTP/1.1 204\r\n\r\n"sv, false, response));
+	ASSERT_EQ(response.status, 204u);
+}
+
+/**
+ * HttpMonitor stops reading after HTTP_MONITOR_MAX_RESPONSE bytes
+ * and parses with eof=true; a header which does not fit fails the
+ * check.
+ */
+TEST(HttpMonitorParser, OversizedHeader)
+{
+	std::string src = "HTTP/1.1 200 OK\r\n";
+	while (src.size() < 64 * 1024)
+		src += "X-Padding: xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\r\n";
+
+	HttpMonitorResponse response;
+	ASSERT_FALSE(Parse(src, false, response));
+	ASSERT_THROW(Parse(src, true, response), std::runtime_error);
+}
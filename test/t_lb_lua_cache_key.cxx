@@ -0,0 +1,146 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "lb/LuaCacheKey.hxx"
+#include "http/IncomingRequest.hxx"
+#include "http/Headers.hxx"
+#include "pool/RootPool.hxx"
+#include "pool/pool.hxx"
+#include "lua/State.hxx"
+#include "AllocatorPtr.hxx"
+#include "istream/UnusedPtr.hxx"
+
+extern "C" {
+#include <lauxlib.h>
+}
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+
+using std::string_view_literals::operator""sv;
+
+struct MyIncomingRequest final : IncomingHttpRequest {
+	MyIncomingRequest(struct pool &parent, http_method_t _method,
+			  const char *_uri, const char *_remote_host) noexcept
+		:IncomingHttpRequest(pool_new_linear(&parent, "request", 8192),
+				     nullptr, nullptr, nullptr,
+				     _remote_host,
+				     _method, _uri) {}
+
+	void AddHeader(const char *name, const char *value) noexcept {
+		headers.Add(AllocatorPtr(pool), name, value);
+	}
+
+	void SendResponse(http_status_t, HttpHeaders &&,
+			  UnusedIstreamPtr) noexcept override {}
+};
+
+/**
+ * Evaluate the given Lua expression and parse the resulting table.
+ */
+static LbLuaCacheKey
+Parse(const char *table)
+{
+	const Lua::State state(luaL_newstate());
+	auto *L = state.get();
+
+	std::string code = "return ";
+	code += table;
+	if (luaL_dostring(L, code.c_str()))
+		throw std::runtime_error(lua_tostring(L, -1));
+
+	return LbLuaCacheKey::Parse(L, "test.lua");
+}
+
+TEST(LbLuaCacheKey, Parse)
+{
+	const auto key = Parse("{'uri', 'remote_host', 'header:Host', 'header:X-Foo'}");
+	EXPECT_TRUE(key.uri);
+	EXPECT_TRUE(key.remote_host);
+	EXPECT_FALSE(key.method);
+	EXPECT_FALSE(key.has_body);
+
+	/* header names are lowercased */
+	ASSERT_EQ(key.headers.size(), 2u);
+	EXPECT_EQ(key.headers[0], "host");
+	EXPECT_EQ(key.headers[1], "x-foo");
+}
+
+TEST(LbLuaCacheKey, Reject)
+{
+	EXPECT_THROW(Parse("'uri'"), std::runtime_error);
+	EXPECT_THROW(Parse("{'uri', 42}"), std::runtime_error);
+	EXPECT_THROW(Parse("{'uri', 'foo'}"), std::runtime_error);
+	EXPECT_THROW(Parse("{'header'}"), std::runtime_error);
+}
+
+TEST(LbLuaCacheKey, HasHeader)
+{
+	const auto key = Parse("{'header:X-Foo'}");
+	EXPECT_TRUE(key.HasHeader("x-foo"));
+	EXPECT_TRUE(key.HasHeader("X-Foo"));
+	EXPECT_FALSE(key.HasHeader("x-bar"));
+	EXPECT_FALSE(key.HasHeader("host"));
+
+	const auto empty = Parse("{'uri'}");
+	EXPECT_FALSE(empty.HasHeader("x-foo"));
+}
+
+TEST(LbLuaCacheKey, Make)
+{
+	RootPool root;
+
+	const auto key = Parse("{'method', 'uri', 'header:X-Foo'}");
+
+	MyIncomingRequest a(root, HTTP_METHOD_GET, "/a", "192.0.2.1");
+	a.AddHeader("x-foo", "bar");
+
+	EXPECT_EQ(key.Make(a), "\1GET\0\1/a\0\1bar\0"sv);
+
+	/* an attribute which is not part of the key does not affect
+	   it */
+	MyIncomingRequest b(root, HTTP_METHOD_GET, "/a", "192.0.2.2");
+	b.AddHeader("x-foo", "bar");
+	EXPECT_EQ(key.Make(a), key.Make(b));
+
+	/* a missing header differs from an empty one */
+	MyIncomingRequest c(root, HTTP_METHOD_GET, "/a", "192.0.2.1");
+	MyIncomingRequest d(root, HTTP_METHOD_GET, "/a", "192.0.2.1");
+	d.AddHeader("x-foo", "");
+	EXPECT_EQ(key.Make(c), "\1GET\0\1/a\0\0"sv);
+	EXPECT_NE(key.Make(c), key.Make(d));
+
+	MyIncomingRequest e(root, HTTP_METHOD_POST, "/a", "192.0.2.1");
+	e.AddHeader("x-foo", "bar");
+	EXPECT_NE(key.Make(a), key.Make(e));
+}
@@ -0,0 +1,268 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cluster/MaglevTable.hxx"
+#include "cluster/PickMaglev.hxx"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <stdio.h>
+
+/* a small prime keeps the tests fast */
+using TestTable = MaglevTable<unsigned, 4099>;
+
+static constexpr uint64_t
+SplitMix64(uint64_t x) noexcept
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+static std::size_t
+NodeHash(unsigned node, std::size_t seed) noexcept
+{
+	return SplitMix64(node * 2 + seed);
+}
+
+static std::vector<unsigned>
+MakeNodes(unsigned first, unsigned last) noexcept
+{
+	std::vector<unsigned> nodes;
+	for (unsigned i = first; i < last; ++i)
+		nodes.push_back(i);
+	return nodes;
+}
+
+static constexpr unsigned N_KEYS = 100000;
+
+TEST(MaglevTable, Spread)
+{
+	constexpr unsigned N = 10;
+
+	TestTable table;
+	table.Build(MakeNodes(0, N), NodeHash);
+	ASSERT_EQ(table.size(), N);
+
+	std::vector<unsigned> count(N);
+	for (unsigned i = 0; i < N_KEYS; ++i)
+		++count[table.Pick(SplitMix64(~uint64_t(i)))];
+
+	const auto [min, max] = std::minmax_element(count.begin(), count.end());
+	fprintf(stderr, "spread: min=%u max=%u average=%u\n",
+		*min, *max, N_KEYS / N);
+
+	/* each node owns (almost) the same number of slots */
+	EXPECT_GT(*min, N_KEYS / N * 9 / 10);
+	EXPECT_LT(*max, N_KEYS / N * 11 / 10);
+}
+
+TEST(MaglevTable, Movement)
+{
+	constexpr unsigned N = 10;
+
+	TestTable before, after;
+	before.Build(MakeNodes(0, N), NodeHash);
+	/* remove node 0 */
+	after.Build(MakeNodes(1, N), NodeHash);
+
+	unsigned moved = 0, moved_modulo = 0, lost = 0;
+	for (unsigned i = 0; i < N_KEYS; ++i) {
+		const std::size_t hash = SplitMix64(~uint64_t(i));
+
+		const unsigned a = before.Pick(hash), b = after.Pick(hash);
+		if (a == 0)
+			++lost;
+		else if (a != b)
+			++moved;
+
+		if (hash % N != hash % (N - 1) + 1)
+			++moved_modulo;
+	}
+
+	fprintf(stderr, "movement: lost=%u moved=%u modulo=%u of %u\n",
+		lost, moved, moved_modulo, N_KEYS);
+
+	/* only a small fraction of the keys of surviving nodes
+	   moves; with modulo, almost all of them move */
+	EXPECT_LT(moved, N_KEYS / 20);
+	EXPECT_GT(moved_modulo, N_KEYS / 2);
+}
+
+TEST(MaglevTable, Find)
+{
+	TestTable table;
+	table.Build(MakeNodes(0, 4), NodeHash);
+
+	const std::size_t hash = 42;
+	const unsigned first = table.Pick(hash);
+
+	auto *node = table.Find(hash, [](unsigned) { return true; });
+	ASSERT_NE(node, nullptr);
+	EXPECT_EQ(*node, first);
+
+	node = table.Find(hash, [first](unsigned n) { return n != first; });
+	ASSERT_NE(node, nullptr);
+	EXPECT_NE(*node, first);
+
+	node = table.Find(hash, [](unsigned) { return false; });
+	EXPECT_EQ(node, nullptr);
+}
+
+TEST(MaglevTable, FindFull)
+{
+	/* a table filled up to its node limit; Find() must visit
+	   every node exactly once */
+	MaglevTable<unsigned, 4099, 16> table;
+	table.Build(MakeNodes(0, 16), NodeHash);
+
+	for (std::size_t hash = 0; hash < 100; ++hash) {
+		std::vector<unsigned> visited;
+		auto *node = table.Find(hash, [&](unsigned n) {
+			visited.push_back(n);
+			return false;
+		});
+		EXPECT_EQ(node, nullptr);
+
+		std::sort(visited.begin(), visited.end());
+		EXPECT_EQ(visited, MakeNodes(0, 16));
+	}
+
+	const unsigned last = 15;
+	auto *node = table.Find(7, [last](unsigned n) { return n == last; });
+	ASSERT_NE(node, nullptr);
+	EXPECT_EQ(*node, last);
+}
+
+/**
+ * A stand-in for #FailureInfo.
+ */
+struct FakeFailure {
+	unsigned outstanding = 0;
+	bool ok = true;
+
+	bool Check(Expiry) const noexcept {
+		return ok;
+	}
+
+	unsigned GetOutstanding() const noexcept {
+		return outstanding;
+	}
+};
+
+TEST(PickMaglev, Failed)
+{
+	constexpr unsigned N = 4;
+
+	TestTable table;
+	table.Build(MakeNodes(0, N), NodeHash);
+
+	std::vector<FakeFailure> failures(N);
+	const auto get_failure = [&failures](unsigned n) noexcept -> const FakeFailure & {
+		return failures[n];
+	};
+
+	const Expiry now = std::chrono::steady_clock::now();
+	const std::size_t hash = 42;
+	const unsigned first = table.Pick(hash);
+
+	EXPECT_EQ(PickMaglev(table, now, hash, 0, get_failure), first);
+
+	/* a failed node is skipped */
+	failures[first].ok = false;
+	const unsigned second = PickMaglev(table, now, hash, 0, get_failure);
+	EXPECT_NE(second, first);
+
+	/* if all nodes have failed, the regular pick is used */
+	for (auto &i : failures)
+		i.ok = false;
+	EXPECT_EQ(PickMaglev(table, now, hash, 0, get_failure), first);
+}
+
+TEST(PickMaglev, BoundedLoad)
+{
+	constexpr unsigned N = 8;
+	constexpr unsigned N_REQUESTS = 8000;
+	constexpr unsigned LOAD_FACTOR = 125;
+
+	TestTable table;
+	table.Build(MakeNodes(0, N), NodeHash);
+
+	std::vector<FakeFailure> failures(N);
+	const auto get_failure = [&failures](unsigned n) noexcept -> const FakeFailure & {
+		return failures[n];
+	};
+
+	const Expiry now = std::chrono::steady_clock::now();
+
+	/* half of all requests have the same (hot) key; the
+	   requests stay in flight */
+	for (unsigned i = 0; i < N_REQUESTS; ++i) {
+		const std::size_t hash = i % 2 == 0
+			? 12345
+			: SplitMix64(i);
+
+		++failures[PickMaglev(table, now, hash, LOAD_FACTOR,
+				      get_failure)].outstanding;
+	}
+
+	unsigned max = 0;
+	for (const auto &i : failures)
+		max = std::max(max, i.outstanding);
+
+	fprintf(stderr, "bounded load: max=%u average=%u\n",
+		max, N_REQUESTS / N);
+
+	EXPECT_LE(max, N_REQUESTS / N * LOAD_FACTOR / 100 + 1);
+
+	/* without the limit, the hot key's node gets (at least)
+	   half of the requests */
+	for (auto &i : failures)
+		i.outstanding = 0;
+
+	for (unsigned i = 0; i < N_REQUESTS; ++i) {
+		const std::size_t hash = i % 2 == 0
+			? 12345
+			: SplitMix64(i);
+
+		++failures[PickMaglev(table, now, hash, 0,
+				      get_failure)].outstanding;
+	}
+
+	EXPECT_GE(failures[table.Pick(12345)].outstanding, N_REQUESTS / 2);
+}
@@ -108,3 +108,79 @@ TEST(PoolTest, Linear)
 #endif
 	ASSERT_EQ(size_t(2 * 1024 + 32 + 16 + 32), pool_netto_size(pool));
 }
+
+static void
+FillPool(struct pool &pool, size_t n, size_t size)
+{
+	for (size_t i = 0; i < n; ++i)
+		ASSERT_NE(p_malloc(&pool, size), nullptr);
+}
+
+TEST(PoolTest, LinearLearn)
+{
+	static constexpr char name[] = "learn";
+
+	RootPool root_pool;
+
+	const auto before = pool_linear_stats();
+
+	/* the first pool of this name needs to grow */
+	auto pool = pool_new_linear(root_pool, name, 1024);
+	FillPool(*pool, 50, 100);
+	ASSERT_EQ(size_t(50 * 100), pool_netto_size(pool));
+
+	const auto first = pool_linear_stats();
+	ASSERT_GT(first.grown, before.grown);
+	pool.reset();
+
+	/* the second one has learned the size and gets one area
+	   which is large enough */
+	pool = pool_new_linear(root_pool, name, 1024);
+	FillPool(*pool, 50, 100);
+#ifdef NDEBUG
+	ASSERT_EQ(size_t(8192), pool_brutto_size(pool));
+#endif
+
+	const auto second = pool_linear_stats();
+	ASSERT_EQ(second.grown, first.grown);
+	pool.reset();
+
+	/* the third one reuses the second one's area from the
+	   recycler */
+	pool = pool_new_linear(root_pool, name, 1024);
+	FillPool(*pool, 50, 100);
+
+	const auto third = pool_linear_stats();
+	ASSERT_EQ(third.grown, second.grown);
+	ASSERT_EQ(third.malloc_areas, second.malloc_areas);
+	ASSERT_EQ(third.recycled_areas, second.recycled_areas + 1);
+}
+
+TEST(PoolTest, LinearLearnBigAllocation)
+{
+	static constexpr char small_name[] = "learn_small";
+	static constexpr char big_name[] = "learn_big";
+
+	RootPool root_pool;
+
+	/* a pool which has never seen a big allocation */
+	auto pool = pool_new_linear(root_pool, small_name, 1024);
+	FillPool(*pool, 10, 100);
+	pool.reset();
+
+	pool = pool_new_linear(root_pool, small_name, 1024);
+	FillPool(*pool, 10, 100);
+	const size_t expected = pool_brutto_size(pool);
+	pool.reset();
+
+	/* one big allocation gets its own area, which must not be
+	   learned */
+	pool = pool_new_linear(root_pool, big_name, 1024);
+	FillPool(*pool, 10, 100);
+	ASSERT_NE(p_malloc(pool, 256 * 1024), nullptr);
+	pool.reset();
+
+	pool = pool_new_linear(root_pool, big_name, 1024);
+	FillPool(*pool, 10, 100);
+	ASSERT_EQ(pool_brutto_size(pool), expected);
+}
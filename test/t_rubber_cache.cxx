@@ -0,0 +1,184 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "RubberCache.hxx"
+#include "TestPool.hxx"
+#include "AllocatorStats.hxx"
+#include "istream/UnusedPtr.hxx"
+#include "istream/StringSink.hxx"
+#include "pool/pool.hxx"
+#include "event/Loop.hxx"
+#include "util/Cancellable.hxx"
+
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <string>
+
+#include <string.h>
+
+namespace {
+
+struct MyStringSinkHandler final : StringSinkHandler {
+	std::string value;
+	bool finished = false;
+
+	void OnStringSinkSuccess(std::string &&_value) noexcept override {
+		value = std::move(_value);
+		finished = true;
+	}
+
+	void OnStringSinkError(std::exception_ptr) noexcept override {
+		finished = true;
+	}
+};
+
+struct Context {
+	EventLoop event_loop;
+	TestPool pool;
+	RubberCache cache{pool, "rubber_cache", event_loop, 256 * 1024};
+
+	void Put(const char *key, const char *tag, const char *value) noexcept {
+		const size_t size = strlen(value);
+
+		RubberAllocation body;
+		if (size > 0) {
+			auto &rubber = cache.GetRubber();
+			unsigned id = rubber.Add(size);
+			memcpy(rubber.Write(id), value, size);
+			body = {rubber, id};
+		}
+
+		auto *item = NewFromPool<RubberCacheItem>(cache.NewItemPool("item"),
+							  cache.SteadyNow(),
+							  cache.SystemNow(),
+							  cache.SystemNow() + std::chrono::hours(1),
+							  size, std::move(body));
+		cache.Put(key, tag, *item);
+	}
+
+	/**
+	 * Look up the item and read its body; returns std::nullopt
+	 * on miss.
+	 */
+	std::optional<std::string> Get(const char *key) noexcept {
+		auto *item = cache.Get(key);
+		if (item == nullptr)
+			return std::nullopt;
+
+		TestPool caller_pool;
+		MyStringSinkHandler handler;
+		CancellablePointer cancel_ptr;
+
+		auto &sink = NewStringSink(caller_pool,
+					   cache.OpenBody(caller_pool, *item),
+					   handler, cancel_ptr);
+		while (!handler.finished)
+			ReadStringSink(sink);
+
+		return std::move(handler.value);
+	}
+};
+
+}
+
+TEST(RubberCache, Basic)
+{
+	Context c;
+
+	EXPECT_FALSE(c.Get("a"));
+
+	c.Put("a", nullptr, "foo");
+	c.Put("b", nullptr, "");
+
+	auto a = c.Get("a");
+	ASSERT_TRUE(a);
+	EXPECT_EQ(*a, "foo");
+
+	auto b = c.Get("b");
+	ASSERT_TRUE(b);
+	EXPECT_EQ(*b, "");
+
+	EXPECT_GT(c.cache.GetStats().netto_size, 0u);
+}
+
+TEST(RubberCache, Replace)
+{
+	Context c;
+
+	c.Put("a", nullptr, "foo");
+	c.Put("a", nullptr, "bar");
+
+	auto a = c.Get("a");
+	ASSERT_TRUE(a);
+	EXPECT_EQ(*a, "bar");
+}
+
+TEST(RubberCache, FlushTag)
+{
+	Context c;
+
+	c.Put("a", "x", "1");
+	c.Put("b", "y", "2");
+	c.Put("c", "x", "3");
+	c.Put("d", nullptr, "4");
+
+	c.cache.FlushTag("x");
+	EXPECT_FALSE(c.Get("a"));
+	EXPECT_FALSE(c.Get("c"));
+	EXPECT_TRUE(c.Get("b"));
+	EXPECT_TRUE(c.Get("d"));
+
+	/* unknown tags and tags whose items are gone are no-ops */
+	c.cache.FlushTag("z");
+	c.cache.FlushTag("x");
+	EXPECT_TRUE(c.Get("b"));
+
+	/* a replaced item is no longer in the old tag's list */
+	c.Put("b", nullptr, "5");
+	c.cache.FlushTag("y");
+	auto b = c.Get("b");
+	ASSERT_TRUE(b);
+	EXPECT_EQ(*b, "5");
+}
+
+TEST(RubberCache, Flush)
+{
+	Context c;
+
+	c.Put("a", "x", "1");
+	c.Put("b", nullptr, "2");
+
+	c.cache.Flush();
+	EXPECT_FALSE(c.Get("a"));
+	EXPECT_FALSE(c.Get("b"));
+}
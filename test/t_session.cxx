@@ -33,10 +33,16 @@
 #include "bp/session/Lease.hxx"
 #include "bp/session/Session.hxx"
 #include "bp/session/Manager.hxx"
+#include "bp/session/Save.hxx"
+#include "bp/session/Journal.hxx"
+#include "thread/Pool.hxx"
 #include "event/Loop.hxx"
 
 #include <gtest/gtest.h>
 
+#include <string>
+
+#include <stdlib.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -54,3 +60,103 @@ TEST(SessionTest, Basic)
 	ASSERT_TRUE(session);
 	ASSERT_EQ(session->id, session_id);
 }
+
+static void
+StopSessionSave(SessionManager &session_manager) noexcept
+{
+	thread_pool_stop();
+	thread_pool_join();
+	session_save_deinit(session_manager);
+	thread_pool_deinit();
+}
+
+TEST(SessionTest, Journal)
+{
+	char dir[] = "/tmp/t_session.XXXXXX";
+	ASSERT_NE(mkdtemp(dir), nullptr);
+	const std::string path = std::string(dir) + "/sessions";
+
+	EventLoop event_loop;
+
+	SessionId kept_id, modified_id, deleted_id;
+
+	{
+		SessionManager session_manager(event_loop,
+					       std::chrono::minutes(30),
+					       0, 0);
+		session_save_init(event_loop, session_manager, path.c_str());
+
+		kept_id = session_manager.CreateSession()->id;
+		modified_id = session_manager.CreateSession()->id;
+		deleted_id = session_manager.CreateSession()->id;
+
+		/* write the journal */
+		session_save(session_manager);
+
+		{
+			SessionLease session{session_manager, modified_id};
+			ASSERT_TRUE(session);
+			session->cookie_received = true;
+		}
+
+		session_manager.EraseAndDispose(deleted_id);
+
+		StopSessionSave(session_manager);
+	}
+
+	/* there is no snapshot yet, only the journal */
+	ASSERT_NE(access(path.c_str(), F_OK), 0);
+
+	{
+		SessionManager session_manager(event_loop,
+					       std::chrono::minutes(30),
+					       0, 0);
+		session_save_init(event_loop, session_manager, path.c_str());
+
+		ASSERT_EQ(session_manager.Count(), 2u);
+		ASSERT_TRUE(SessionLease(session_manager, kept_id));
+		ASSERT_FALSE(SessionLease(session_manager, deleted_id));
+
+		{
+			SessionLease session{session_manager, modified_id};
+			ASSERT_TRUE(session);
+			ASSERT_TRUE(session->cookie_received);
+		}
+
+		/* modify a session while the compaction is in
+		   progress */
+		{
+			SessionLease session{session_manager, kept_id};
+			ASSERT_TRUE(session);
+			session->cookie_received = true;
+		}
+
+		session_save(session_manager);
+
+		/* this finishes the snapshot which was scheduled by
+		   replaying the journal */
+		StopSessionSave(session_manager);
+	}
+
+	ASSERT_EQ(access(path.c_str(), F_OK), 0);
+
+	{
+		SessionManager session_manager(event_loop,
+					       std::chrono::minutes(30),
+					       0, 0);
+		session_save_init(event_loop, session_manager, path.c_str());
+		ASSERT_EQ(session_manager.Count(), 2u);
+
+		{
+			SessionLease session{session_manager, kept_id};
+			ASSERT_TRUE(session);
+			ASSERT_TRUE(session->cookie_received);
+		}
+
+		StopSessionSave(session_manager);
+	}
+
+	unlink(path.c_str());
+	unlink(SessionJournal::MakeJournalPath(path.c_str()).c_str());
+	rmdir(dir);
+}
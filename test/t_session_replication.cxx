@@ -0,0 +1,311 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Two session "nodes" replicating to each other over loopback UDP.
+ */
+
+#include "bp/session/Replication.hxx"
+#include "bp/session/Lease.hxx"
+#include "bp/session/Session.hxx"
+#include "bp/session/Manager.hxx"
+#include "event/Loop.hxx"
+#include "event/FineTimerEvent.hxx"
+#include "net/IPv4Address.hxx"
+#include "net/StaticSocketAddress.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "system/Error.hxx"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+
+static UniqueSocketDescriptor
+CreateLoopbackSocket()
+{
+	UniqueSocketDescriptor fd;
+	if (!fd.CreateNonBlock(AF_INET, SOCK_DGRAM, 0))
+		throw MakeErrno("Failed to create socket");
+
+	if (!fd.Bind(IPv4Address(127, 0, 0, 1, 0)))
+		throw MakeErrno("Failed to bind socket");
+
+	return fd;
+}
+
+/**
+ * Wait for a datagram on the given socket and return it.
+ */
+static std::vector<std::byte>
+ReceiveDatagram(SocketDescriptor fd)
+{
+	struct pollfd pfd{fd.Get(), POLLIN, 0};
+	if (poll(&pfd, 1, 2000) <= 0)
+		throw std::runtime_error("No datagram received");
+
+	std::vector<std::byte> buffer(65536);
+	const auto nbytes = recv(fd.Get(), buffer.data(), buffer.size(), 0);
+	if (nbytes < 0)
+		throw MakeErrno("Failed to receive");
+
+	buffer.resize(nbytes);
+	return buffer;
+}
+
+static void
+SendDatagram(SocketDescriptor fd, SocketAddress address,
+	     const std::vector<std::byte> &datagram)
+{
+	if (sendto(fd.Get(), datagram.data(), datagram.size(), 0,
+		   address.GetAddress(), address.GetSize()) < 0)
+		throw MakeErrno("Failed to send");
+}
+
+static constexpr char SECRET[] = "0123456789abcdef";
+
+struct Node {
+	SessionManager manager;
+	SessionReplicator replicator;
+	SessionReplicationReceiver receiver;
+
+	Node(EventLoop &event_loop, UniqueSocketDescriptor fd,
+	     SocketAddress peer, const char *secret=SECRET)
+		:manager(event_loop, std::chrono::minutes(30), 0, 0),
+		 replicator(event_loop, SessionReplicationKey(secret)),
+		 receiver(event_loop, std::move(fd), manager,
+			  SessionReplicationKey(secret))
+	{
+		replicator.AddPeer(peer);
+		receiver.AddPeer(peer);
+		manager.SetReplicator(&replicator);
+	}
+
+	~Node() noexcept {
+		manager.SetReplicator(nullptr);
+	}
+};
+
+/**
+ * Run the #EventLoop until the given predicate returns true (or
+ * until a timeout expires).
+ */
+template<typename P>
+class RunUntil {
+	EventLoop &event_loop;
+	P predicate;
+	FineTimerEvent timer;
+	unsigned remaining = 200;
+
+public:
+	RunUntil(EventLoop &_event_loop, P _predicate) noexcept
+		:event_loop(_event_loop), predicate(_predicate),
+		 timer(event_loop, BIND_THIS_METHOD(OnTimer))
+	{
+		timer.Schedule(std::chrono::milliseconds(1));
+		event_loop.Run();
+	}
+
+	operator bool() const noexcept {
+		return predicate();
+	}
+
+private:
+	void OnTimer() noexcept {
+		if (predicate() || --remaining == 0)
+			event_loop.Break();
+		else
+			timer.Schedule(std::chrono::milliseconds(10));
+	}
+};
+
+TEST(SessionReplication, Loopback)
+{
+	EventLoop event_loop;
+
+	auto fd_a = CreateLoopbackSocket(), fd_b = CreateLoopbackSocket();
+	const auto address_a = fd_a.GetLocalAddress();
+	const auto address_b = fd_b.GetLocalAddress();
+
+	Node a(event_loop, std::move(fd_a), address_b);
+	Node b(event_loop, std::move(fd_b), address_a);
+
+	/* a new session on node A is replicated to node B */
+	const auto id = a.manager.CreateSession()->id;
+	a.replicator.Flush();
+
+	ASSERT_TRUE(RunUntil(event_loop, [&b]{
+		return b.manager.Count() == 1;
+	}));
+
+	{
+		SessionLease session{b.manager, id};
+		ASSERT_TRUE(session);
+		ASSERT_FALSE(session->cookie_received);
+
+		/* node B takes over and modifies the session */
+		session->cookie_received = true;
+	}
+
+	b.replicator.Flush();
+
+	ASSERT_TRUE(RunUntil(event_loop, [&a, id]{
+		SessionLease session{a.manager, id};
+		return session && session->cookie_received;
+	}));
+
+	/* deleting on node A deletes on node B */
+	a.manager.EraseAndDispose(id);
+	a.replicator.Flush();
+
+	ASSERT_TRUE(RunUntil(event_loop, [&b]{
+		return b.manager.Count() == 0;
+	}));
+	ASSERT_EQ(a.manager.Count(), 0u);
+}
+
+TEST(SessionReplication, BadMac)
+{
+	EventLoop event_loop;
+
+	auto fd_a = CreateLoopbackSocket(), fd_b = CreateLoopbackSocket();
+	auto fd_c = CreateLoopbackSocket();
+	const auto address_a = fd_a.GetLocalAddress();
+	const auto address_b = fd_b.GetLocalAddress();
+
+	Node a(event_loop, std::move(fd_a), address_b);
+	Node b(event_loop, std::move(fd_b), address_a);
+
+	/* node C uses the wrong secret */
+	Node c(event_loop, std::move(fd_c), address_b, "wrong secret 123");
+
+	const auto bad_id = c.manager.CreateSession()->id;
+	c.replicator.Flush();
+
+	const auto good_id = a.manager.CreateSession()->id;
+	a.replicator.Flush();
+
+	ASSERT_TRUE(RunUntil(event_loop, [&b, good_id]{
+		return bool(SessionLease{b.manager, good_id});
+	}));
+
+	/* the datagram from C was rejected */
+	ASSERT_FALSE(SessionLease(b.manager, bad_id));
+	ASSERT_EQ(b.manager.Count(), 1u);
+}
+
+TEST(SessionReplication, ReadOnly)
+{
+	EventLoop event_loop;
+
+	auto fd_a = CreateLoopbackSocket(), fd_b = CreateLoopbackSocket();
+	const auto address_a = fd_a.GetLocalAddress();
+	const auto address_b = fd_b.GetLocalAddress();
+
+	Node a(event_loop, std::move(fd_a), address_b);
+	Node b(event_loop, std::move(fd_b), address_a);
+
+	const auto id = a.manager.CreateSession()->id;
+	a.replicator.Flush();
+
+	ASSERT_TRUE(RunUntil(event_loop, [&b]{
+		return b.manager.Count() == 1;
+	}));
+
+	/* delete the replica on node B only */
+	b.manager.SetReplicator(nullptr);
+	b.manager.EraseAndDispose(id);
+	ASSERT_EQ(b.manager.Count(), 0u);
+
+	/* using the session on node A without modifying it does not
+	   replicate it again */
+	ASSERT_TRUE(SessionLease(a.manager, id));
+	a.replicator.Flush();
+
+	/* a modified session is replicated */
+	const auto id2 = a.manager.CreateSession()->id;
+	a.replicator.Flush();
+
+	ASSERT_TRUE(RunUntil(event_loop, [&b, id2]{
+		return bool(SessionLease{b.manager, id2});
+	}));
+
+	ASSERT_FALSE(SessionLease(b.manager, id));
+}
+
+TEST(SessionReplication, Replay)
+{
+	EventLoop event_loop;
+
+	/* node A sends to this socket, and the test forwards the
+	   datagrams to node B */
+	auto fd_a = CreateLoopbackSocket(), fd_b = CreateLoopbackSocket();
+	auto fd_s = CreateLoopbackSocket();
+	const auto address_b = fd_b.GetLocalAddress();
+	const auto address_s = fd_s.GetLocalAddress();
+
+	Node a(event_loop, std::move(fd_a), address_s);
+	Node b(event_loop, std::move(fd_b), address_s);
+	b.manager.SetReplicator(nullptr);
+
+	const auto id = a.manager.CreateSession()->id;
+	a.replicator.Flush();
+	const auto datagram = ReceiveDatagram(fd_s);
+
+	SendDatagram(fd_s, address_b, datagram);
+	ASSERT_TRUE(RunUntil(event_loop, [&b]{
+		return b.manager.Count() == 1;
+	}));
+
+	/* delete the replica on node B, then replay the datagram */
+	b.manager.EraseAndDispose(id);
+	ASSERT_EQ(b.manager.Count(), 0u);
+
+	SendDatagram(fd_s, address_b, datagram);
+
+	/* a new datagram is accepted (and is received after the
+	   replayed one) */
+	const auto id2 = a.manager.CreateSession()->id;
+	a.replicator.Flush();
+	SendDatagram(fd_s, address_b, ReceiveDatagram(fd_s));
+
+	ASSERT_TRUE(RunUntil(event_loop, [&b, id2]{
+		return bool(SessionLease{b.manager, id2});
+	}));
+
+	/* the replayed datagram was rejected */
+	ASSERT_FALSE(SessionLease(b.manager, id));
+	ASSERT_EQ(b.manager.Count(), 1u);
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ssl/ClientSessionCache.hxx"
+
+#include <gtest/gtest.h>
+
+static SSL_SESSION *
+MakeSession(unsigned char id) noexcept
+{
+	SSL_SESSION *session = SSL_SESSION_new();
+	const unsigned char session_id[] = {id, 0x42};
+	SSL_SESSION_set1_id(session, session_id, sizeof(session_id));
+	return session;
+}
+
+[[gnu::pure]]
+static unsigned char
+GetSessionId(const SSL_SESSION &session) noexcept
+{
+	unsigned length;
+	return SSL_SESSION_get_id(&session, &length)[0];
+}
+
+TEST(SslClientSessionCache, Basic)
+{
+	SslClientSessionCache cache;
+
+	ASSERT_EQ(cache.Get("a"), nullptr);
+
+	cache.Put("a", MakeSession(1));
+	auto s = cache.Get("a");
+	ASSERT_NE(s, nullptr);
+	ASSERT_EQ(GetSessionId(*s), 1);
+
+	/* replace */
+	cache.Put("a", MakeSession(2));
+	s = cache.Get("a");
+	ASSERT_NE(s, nullptr);
+	ASSERT_EQ(GetSessionId(*s), 2);
+	ASSERT_EQ(cache.GetSize(), 1u);
+}
+
+TEST(SslClientSessionCache, NotResumable)
+{
+	SslClientSessionCache cache;
+
+	/* a session without id and ticket cannot be resumed; it is
+	   discarded by Get() */
+	cache.Put("a", SSL_SESSION_new());
+	ASSERT_EQ(cache.Get("a"), nullptr);
+	ASSERT_EQ(cache.GetSize(), 0u);
+}
+
+TEST(SslClientSessionCache, EvictLeastRecentlyUsed)
+{
+	SslClientSessionCache cache(3);
+
+	/* keys are inserted in reverse lexicographic order, so the
+	   least recently used one is not the smallest key */
+	cache.Put("c", MakeSession(3));
+	cache.Put("b", MakeSession(2));
+	cache.Put("a", MakeSession(1));
+
+	/* use "c" again, which makes "b" the least recently used
+	   one */
+	ASSERT_NE(cache.Get("c"), nullptr);
+
+	cache.Put("d", MakeSession(4));
+	ASSERT_EQ(cache.GetSize(), 3u);
+	ASSERT_EQ(cache.Get("b"), nullptr);
+	ASSERT_NE(cache.Get("a"), nullptr);
+	ASSERT_NE(cache.Get("c"), nullptr);
+	ASSERT_NE(cache.Get("d"), nullptr);
+
+	/* now "a" is the least recently used one; replacing an
+	   existing key does not evict anything */
+	cache.Put("c", MakeSession(5));
+	ASSERT_EQ(cache.GetSize(), 3u);
+	ASSERT_NE(cache.Get("a"), nullptr);
+
+	cache.Put("e", MakeSession(6));
+	ASSERT_EQ(cache.Get("d"), nullptr);
+	ASSERT_NE(cache.Get("a"), nullptr);
+
+	auto s = cache.Get("c");
+	ASSERT_NE(s, nullptr);
+	ASSERT_EQ(GetSessionId(*s), 5);
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stock/Prewarm.hxx"
+#include "stock/MapStock.hxx"
+#include "stock/Class.hxx"
+#include "stock/GetHandler.hxx"
+#include "stock/Item.hxx"
+#include "event/Loop.hxx"
+#include "net/IPv4Address.hxx"
+#include "util/Cancellable.hxx"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+
+struct MyStockItem final : StockItem {
+	explicit MyStockItem(CreateStockItem c) noexcept
+		:StockItem(c) {}
+
+	/* virtual methods from class StockItem */
+	bool Borrow() noexcept override {
+		return true;
+	}
+
+	bool Release() noexcept override {
+		return true;
+	}
+};
+
+class MyStock final : StockClass, StockPrewarmHandler {
+	StockMap map;
+
+public:
+	StockPrewarm prewarm;
+
+	const StockPrewarmParams params{
+		false, nullptr,
+		IPv4Address(127, 0, 0, 1, 80),
+		std::chrono::seconds(10),
+	};
+
+	unsigned n_created = 0, n_prewarmed = 0;
+
+	explicit MyStock(EventLoop &event_loop) noexcept
+		:map(event_loop, *this, 0, 4, Event::Duration::zero()),
+		 prewarm(event_loop, *this, 4) {}
+
+	void Get(const char *key, StockGetHandler &handler,
+		 CancellablePointer &cancel_ptr) noexcept {
+		prewarm.OnGet(key);
+		map.Get(key, nullptr, handler, cancel_ptr);
+	}
+
+private:
+	/* virtual methods from class StockClass */
+	void Create(CreateStockItem c, StockRequest,
+		    CancellablePointer &) override {
+		++n_created;
+		if (prewarm.OnCreate(c.GetStockName(), &params))
+			++n_prewarmed;
+
+		auto *item = new MyStockItem(c);
+		item->InvokeCreateSuccess();
+	}
+
+	/* virtual methods from class StockPrewarmHandler */
+	void PrewarmGet(AllocatorPtr, const char *key,
+			const StockPrewarmParams &,
+			StockGetHandler &handler,
+			CancellablePointer &cancel_ptr) noexcept override {
+		map.Get(key, nullptr, handler, cancel_ptr);
+	}
+};
+
+struct MyGetHandler final : StockGetHandler {
+	std::vector<StockItem *> items;
+
+	void PutAll() noexcept {
+		for (auto *i : items)
+			i->Put(false);
+		items.clear();
+	}
+
+	/* virtual methods from class StockGetHandler */
+	void OnStockItemReady(StockItem &item) noexcept override {
+		items.push_back(&item);
+	}
+
+	void OnStockItemError(std::exception_ptr) noexcept override {
+		FAIL();
+	}
+};
+
+} // anonymous namespace
+
+TEST(StockPrewarm, Disabled)
+{
+	EventLoop event_loop;
+	MyStock stock(event_loop);
+	MyGetHandler handler;
+	CancellablePointer cancel_ptr;
+
+	stock.Get("a", handler, cancel_ptr);
+	event_loop.LoopNonBlock();
+	ASSERT_EQ(stock.n_created, 1u);
+	ASSERT_EQ(stock.n_prewarmed, 0u);
+
+	handler.PutAll();
+}
+
+TEST(StockPrewarm, Refill)
+{
+	EventLoop event_loop;
+	MyStock stock(event_loop);
+	stock.prewarm.SetMinIdle(2);
+
+	MyGetHandler handler;
+	CancellablePointer cancel_ptr;
+
+	/* the first request has to wait for a new connection */
+	stock.Get("a", handler, cancel_ptr);
+	ASSERT_EQ(handler.items.size(), 1u);
+	ASSERT_EQ(stock.n_created, 1u);
+
+	/* ... which tops up the idle connections in the background */
+	event_loop.LoopNonBlock();
+	ASSERT_EQ(stock.n_created, 3u);
+	ASSERT_EQ(stock.n_prewarmed, 2u);
+
+	StockPrewarmStats stats;
+	stock.prewarm.AddStats(stats);
+	ASSERT_EQ(stats.waits, 1u);
+	ASSERT_EQ(stats.prewarmed, 2u);
+	ASSERT_EQ(stats.warm_target, 2u);
+
+	/* the next two requests find idle connections */
+	stock.Get("a", handler, cancel_ptr);
+	stock.Get("a", handler, cancel_ptr);
+	ASSERT_EQ(handler.items.size(), 3u);
+	ASSERT_EQ(stock.n_created, 3u);
+
+	handler.PutAll();
+}
+
+TEST(StockPrewarm, ClampMaxIdle)
+{
+	EventLoop event_loop;
+	MyStock stock(event_loop);
+
+	/* more than the stock's "max_idle" would be closed right
+	   away */
+	stock.prewarm.SetMinIdle(100);
+
+	MyGetHandler handler;
+	CancellablePointer cancel_ptr;
+
+	stock.Get("a", handler, cancel_ptr);
+	event_loop.LoopNonBlock();
+	ASSERT_EQ(stock.n_prewarmed, 4u);
+
+	StockPrewarmStats stats;
+	stock.prewarm.AddStats(stats);
+	ASSERT_EQ(stats.warm_target, 4u);
+
+	handler.PutAll();
+}
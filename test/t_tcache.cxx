@@ -34,6 +34,7 @@
 #include "tprint.hxx"
 #include "RecordingTranslateHandler.hxx"
 #include "translation/Cache.hxx"
+#include "translation/CacheLease.hxx"
 #include "translation/Stock.hxx"
 #include "translation/Handler.hxx"
 #include "translation/Request.hxx"
@@ -55,6 +56,12 @@
 
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+
 class MyTranslationService final : public TranslationService {
 public:
 	/* virtual methods from class TranslationService */
@@ -397,6 +404,47 @@ CachedError(struct pool &parent_pool, TranslationService &service,
 
 }
 
+/**
+ * A #TranslateHandler which remembers the response pointer without
+ * copying the response.
+ */
+struct PointerTranslateHandler final : TranslateHandler {
+	const TranslateResponse *response = nullptr;
+
+	/* virtual methods from TranslateHandler */
+	void OnTranslateResponse(TranslateResponse &_response) noexcept override {
+		response = &_response;
+	}
+
+	void OnTranslateError(std::exception_ptr) noexcept override {
+	}
+};
+
+/**
+ * Send a request which is expected to hit the cache.
+ *
+ * @return the number of bytes allocated from the caller's pool
+ */
+static size_t
+MeasureHit(struct pool &parent_pool, TranslationService &service,
+	   const TranslateRequest &request,
+	   const TranslateResponse **response_r=nullptr) noexcept
+{
+	auto pool = pool_new_libc(&parent_pool, "MeasureHit");
+	PointerTranslateHandler handler;
+	CancellablePointer cancel_ptr;
+
+	next_response = nullptr;
+	service.SendRequest(AllocatorPtr{pool}, request, nullptr,
+			    handler, cancel_ptr);
+
+	EXPECT_NE(handler.response, nullptr);
+	if (response_r != nullptr)
+		*response_r = handler.response;
+
+	return pool_netto_size(pool);
+}
+
 TEST(TranslationCache, Basic)
 {
 	Instance instance;
@@ -835,6 +883,44 @@ TEST(TranslationCache, Expand)
 				   "/a/d=e")));
 }
 
+/**
+ * Repeated hits on an expandable response are served from the
+ * memoized expansion results.
+ */
+TEST(TranslationCache, ExpandMemo)
+{
+	Instance instance;
+	struct pool &pool = instance.root_pool;
+	auto &cache = instance.cache;
+
+	Feed(pool, cache, MakeRequest("/regex-memo/b=c"),
+	     MakeResponse(pool)
+	     .Base("/regex-memo/").Regex("^/regex-memo/(.+=.+)$")
+	     .Cgi(MakeCgiAddress(pool, "/usr/lib/cgi-bin/foo.cgi").ExpandPathInfo("/a/\\1")),
+	     MakeResponse(pool)
+	     .Base("/regex-memo/").Regex("^/regex-memo/(.+=.+)$")
+	     .Cgi(MakeCgiAddress(pool, "/usr/lib/cgi-bin/foo.cgi", nullptr,
+				 "/a/b=c")));
+
+	for (unsigned i = 0; i < 2; ++i) {
+		Cached(pool, cache, MakeRequest("/regex-memo/d=e"),
+		       MakeResponse(pool)
+		       .Base("/regex-memo/").Regex("^/regex-memo/(.+=.+)$")
+		       .Cgi(MakeCgiAddress(pool, "/usr/lib/cgi-bin/foo.cgi", nullptr,
+					   "/a/d=e")));
+
+		Cached(pool, cache, MakeRequest("/regex-memo/f=g"),
+		       MakeResponse(pool)
+		       .Base("/regex-memo/").Regex("^/regex-memo/(.+=.+)$")
+		       .Cgi(MakeCgiAddress(pool, "/usr/lib/cgi-bin/foo.cgi", nullptr,
+					   "/a/f=g")));
+	}
+
+	const auto counters = cache.GetCounters();
+	EXPECT_EQ(counters.expand_misses, 2U);
+	EXPECT_EQ(counters.expand_hits, 2U);
+}
+
 TEST(TranslationCache, ExpandLocal)
 {
 	Instance instance;
@@ -1167,3 +1253,125 @@ TEST(TranslationCache, ExpandBindMount)
 		    .BindMount("/home/bar", "/mnt")
 		    .BindMount("/etc", "/etc")));
 }
+
+/**
+ * Cache hits with a #TranslationCacheLease hand out the cached
+ * response without copying it.
+ */
+TEST(TranslationCache, Lease)
+{
+	Instance instance;
+	struct pool &pool = instance.root_pool;
+	auto &cache = instance.cache;
+
+	const auto response1 = MakeResponse(pool)
+		.File("/var/www/index.html");
+	Feed(pool, cache, MakeRequest("/"), response1);
+
+	/* without a lease, the response is copied */
+	const size_t copy_size = MeasureHit(pool, cache, MakeRequest("/"));
+
+	TranslationCacheLease lease;
+	auto request = MakeRequest("/");
+	request.cache_lease = &lease;
+
+	const TranslateResponse *shared1, *shared2;
+	const size_t shared_size = MeasureHit(pool, cache, request, &shared1);
+	MeasureHit(pool, cache, request, &shared2);
+
+	EXPECT_LT(shared_size, copy_size);
+	EXPECT_EQ(shared1, shared2);
+
+	/* the lease keeps the response alive even after it has been
+	   removed from the cache */
+	cache.Flush();
+	EXPECT_EQ(*shared1, response1);
+	lease.Release();
+
+	CachedError(pool, cache, MakeRequest("/"));
+
+	/* responses with a BASE are always copied */
+	Feed(pool, cache, MakeRequest("/foo/bar.html"),
+	     MakeResponse(pool).Base("/foo/")
+	     .File("bar.html", "/srv/foo/"));
+
+	auto request2 = MakeRequest("/foo/index.html");
+	request2.cache_lease = &lease;
+
+	EXPECT_GT(MeasureHit(pool, cache, request2), shared_size);
+}
+
+/**
+ * Look up deep URIs below nested BASE responses; the most specific
+ * BASE must win.
+ */
+TEST(TranslationCache, BaseDeep)
+{
+	Instance instance;
+	struct pool &pool = instance.root_pool;
+	auto &cache = instance.cache;
+
+	Feed(pool, cache, MakeRequest("/deep/index.html"),
+	     MakeResponse(pool).Base("/deep/")
+	     .File("index.html", "/srv/deep/"));
+
+	Feed(pool, cache, MakeRequest("/deep/a/b/c/index.html"),
+	     MakeResponse(pool).Base("/deep/a/b/c/")
+	     .File("index.html", "/srv/c/"));
+
+	Cached(pool, cache, MakeRequest("/deep/a/b/c/d/e/f/g/h/i/j.html"),
+	       MakeResponse(pool).Base("/deep/a/b/c/")
+	       .File("d/e/f/g/h/i/j.html", "/srv/c/"));
+
+	Cached(pool, cache, MakeRequest("/deep/a/b/x/y/z.html"),
+	       MakeResponse(pool).Base("/deep/")
+	       .File("a/b/x/y/z.html", "/srv/deep/"));
+
+	CachedError(pool, cache, MakeRequest("/deeper/a/b/c/d.html"));
+
+	/* flushing the cache must empty the BASE index as well */
+	cache.Flush();
+	CachedError(pool, cache, MakeRequest("/deep/a/b/c/d/e/f/g/h/i/j.html"));
+	CachedError(pool, cache, MakeRequest("/deep/a/b/x/y/z.html"));
+}
+
+/**
+ * Measure the cost of BASE lookups with a realistic URI depth.  This
+ * does not assert a time limit; it prints the numbers for comparing
+ * builds.
+ */
+TEST(TranslationCache, BaseLookupBenchmark)
+{
+	Instance instance;
+	struct pool &pool = instance.root_pool;
+	auto &cache = instance.cache;
+
+	constexpr unsigned n_bases = 64;
+	constexpr unsigned n_lookups = 20000;
+
+	for (unsigned i = 0; i < n_bases; ++i) {
+		const auto base = "/bench/" + std::to_string(i) + "/";
+		const auto uri = base + "index.html";
+		Feed(pool, cache, MakeRequest(uri.c_str()),
+		     MakeResponse(pool).Base(base.c_str())
+		     .File("index.html", "/srv/bench/"));
+	}
+
+	std::vector<std::string> uris;
+	uris.reserve(n_bases);
+	for (unsigned i = 0; i < n_bases; ++i)
+		uris.emplace_back("/bench/" + std::to_string(i) +
+				  "/a/b/c/d/e/f/g/h/file.html");
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (unsigned i = 0; i < n_lookups; ++i)
+		MeasureHit(pool, cache,
+			   MakeRequest(uris[i % n_bases].c_str()));
+
+	const auto duration = std::chrono::steady_clock::now() - start;
+
+	fprintf(stderr, "%u BASE lookups at depth 10: %lld ns each\n",
+		n_lookups,
+		(long long)(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / n_lookups));
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "access_log/TrafficAggregator.hxx"
+#include "net/log/Datagram.hxx"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Collects everything written to a FILE*.
+ */
+class MemoryFile {
+	char *buffer = nullptr;
+	size_t size = 0;
+	FILE *const file;
+
+public:
+	MemoryFile() noexcept
+		:file(open_memstream(&buffer, &size)) {}
+
+	~MemoryFile() noexcept {
+		fclose(file);
+		free(buffer);
+	}
+
+	MemoryFile(const MemoryFile &) = delete;
+	MemoryFile &operator=(const MemoryFile &) = delete;
+
+	operator FILE *() const noexcept {
+		return file;
+	}
+
+	/**
+	 * Return the data written so far and start over.
+	 */
+	std::string Take() noexcept {
+		fflush(file);
+		std::string result(buffer, size);
+		rewind(file);
+		/* truncate at the new position */
+		fflush(file);
+		return result;
+	}
+};
+
+static Net::Log::Datagram
+MakeDatagram(const char *site, uint64_t received, uint64_t sent) noexcept
+{
+	Net::Log::Datagram d;
+	d.site = site;
+	d.valid_traffic = true;
+	d.traffic_received = received;
+	d.traffic_sent = sent;
+	return d;
+}
+
+static void
+AddSamples(TrafficAggregator &a) noexcept
+{
+	a.Add(MakeDatagram("foo", 100, 2000));
+	a.Add(MakeDatagram("bar", 1, 2));
+	a.Add(MakeDatagram("foo", 10, 200));
+
+	/* without traffic, only the request is counted */
+	Net::Log::Datagram d;
+	d.site = "bar";
+	a.Add(d);
+
+	/* without a site, the datagram is ignored */
+	a.Add(MakeDatagram(nullptr, 1000, 1000));
+}
+
+TEST(TrafficAggregator, Text)
+{
+	MemoryFile file;
+	TrafficAggregator a(SnapshotFormat::TEXT, file);
+
+	AddSamples(a);
+	a.Snapshot(1234);
+	EXPECT_EQ(file.Take(),
+		  "bar 2 1 2\n"
+		  "foo 2 110 2200\n"
+		  "\n");
+
+	/* the table is cleared after each snapshot */
+	a.Snapshot(1235);
+	EXPECT_EQ(file.Take(), "\n");
+
+	a.Add(MakeDatagram("foo", 5, 6));
+	a.Snapshot(1236);
+	EXPECT_EQ(file.Take(),
+		  "foo 1 5 6\n"
+		  "\n");
+}
+
+TEST(TrafficAggregator, Json)
+{
+	MemoryFile file;
+	TrafficAggregator a(SnapshotFormat::JSON, file);
+
+	AddSamples(a);
+	a.Snapshot(1234);
+	EXPECT_EQ(file.Take(),
+		  "{\"time\":1234,\"sites\":{"
+		  "\"bar\":{\"requests\":2,\"received\":1,\"sent\":2},"
+		  "\"foo\":{\"requests\":2,\"received\":110,\"sent\":2200}"
+		  "}}\n");
+
+	a.Snapshot(1235);
+	EXPECT_EQ(file.Take(), "{\"time\":1235,\"sites\":{}}\n");
+}
+
+TEST(TrafficAggregator, Binary)
+{
+	MemoryFile file;
+	TrafficAggregator a(SnapshotFormat::BINARY, file);
+
+	a.Add(MakeDatagram("foo", 0x0102, 0x030405));
+	a.Snapshot(0x11223344);
+
+	static constexpr char expected[] =
+		"TRAF"
+		"\0\0\0\0\x11\x22\x33\x44" // time
+		"\0\0\0\1" // number of sites
+		"\0\3" "foo"
+		"\0\0\0\0\0\0\0\1" // requests
+		"\0\0\0\0\0\0\x01\x02" // received
+		"\0\0\0\0\0\x03\x04\x05"; // sent
+
+	EXPECT_EQ(file.Take(), std::string(expected, sizeof(expected) - 1));
+
+	a.Snapshot(0x11223344);
+	EXPECT_EQ(file.Take(),
+		  std::string("TRAF" "\0\0\0\0\x11\x22\x33\x44" "\0\0\0\0",
+			      16));
+}
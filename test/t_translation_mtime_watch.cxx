@@ -0,0 +1,255 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "translation/MtimeWatch.hxx"
+#include "thread/Pool.hxx"
+#include "event/Loop.hxx"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static void
+WaitIdle(EventLoop &event_loop, const TranslationMtimeWatch &watch) noexcept
+{
+	while (!watch.IsIdle())
+		event_loop.LoopOnce();
+}
+
+static void
+StopThreadPool() noexcept
+{
+	thread_pool_stop();
+	thread_pool_join();
+}
+
+static uint64_t
+GetMtime(const char *path) noexcept
+{
+	struct stat st;
+	if (lstat(path, &st) < 0)
+		return 0;
+
+	return st.st_mtime;
+}
+
+static void
+SetMtime(const char *path, time_t mtime) noexcept
+{
+	const struct timespec times[2]{{mtime, 0}, {mtime, 0}};
+	utimensat(AT_FDCWD, path, times, 0);
+}
+
+TEST(TranslationMtimeWatch, Inotify)
+{
+	char dir[] = "/tmp/t_translation_mtime_watch.XXXXXX";
+	ASSERT_NE(mkdtemp(dir), nullptr);
+	const std::string path = std::string(dir) + "/file";
+
+	int fd = open(path.c_str(), O_CREAT|O_WRONLY, 0666);
+	ASSERT_GE(fd, 0);
+	close(fd);
+
+	SetMtime(path.c_str(), 1000);
+	const uint64_t mtime = GetMtime(path.c_str());
+	ASSERT_EQ(mtime, 1000u);
+
+	EventLoop event_loop;
+
+	{
+		TranslationMtimeWatch watch(event_loop);
+		TranslationMtimeWatch::Handle handle;
+		watch.Register(handle, path.c_str());
+
+		/* the first probe has not finished yet; the mtime
+		   reported by the translation server is trusted */
+		ASSERT_TRUE(handle.Validate(mtime, "test"));
+
+		WaitIdle(event_loop, watch);
+
+		ASSERT_TRUE(handle.Validate(mtime, "test"));
+		ASSERT_FALSE(handle.Validate(mtime + 1, "test"));
+
+		/* watched paths need no system call */
+		const auto avoided = watch.GetValidationsAvoided();
+		ASSERT_TRUE(handle.Validate(mtime, "test"));
+		ASSERT_EQ(watch.GetValidationsAvoided(), avoided + 1);
+
+		/* touch the file; the inotify event invalidates the
+		   handle */
+		SetMtime(path.c_str(), 2000);
+
+		while (handle.Validate(mtime, "test"))
+			event_loop.LoopOnce();
+
+		/* it stays invalid, even with the new mtime */
+		ASSERT_FALSE(handle.Validate(2000, "test"));
+
+		/* a new registration sees the new mtime */
+		watch.Register(handle, path.c_str());
+		WaitIdle(event_loop, watch);
+		ASSERT_TRUE(handle.Validate(2000, "test"));
+		ASSERT_FALSE(handle.Validate(mtime, "test"));
+
+		StopThreadPool();
+	}
+
+	thread_pool_deinit();
+
+	unlink(path.c_str());
+	rmdir(dir);
+}
+
+/**
+ * Paths which cannot be watched (here: a nonexistent file) fall
+ * back to lstat() in the thread pool.
+ */
+TEST(TranslationMtimeWatch, Fallback)
+{
+	char dir[] = "/tmp/t_translation_mtime_watch.XXXXXX";
+	ASSERT_NE(mkdtemp(dir), nullptr);
+	const std::string path = std::string(dir) + "/file";
+
+	EventLoop event_loop;
+
+	{
+		TranslationMtimeWatch watch(event_loop);
+		TranslationMtimeWatch::Handle handle;
+		watch.Register(handle, path.c_str());
+		WaitIdle(event_loop, watch);
+
+		/* the special value 0 matches a nonexistent file */
+		ASSERT_TRUE(handle.Validate(0, "test"));
+		ASSERT_FALSE(handle.Validate(1000, "test"));
+
+		int fd = open(path.c_str(), O_CREAT|O_WRONLY, 0666);
+		ASSERT_GE(fd, 0);
+		close(fd);
+		SetMtime(path.c_str(), 1000);
+
+		/* the old snapshot is used until it expires */
+		ASSERT_TRUE(handle.Validate(0, "test"));
+
+		sleep(2);
+		event_loop.LoopOnceNonBlock();
+
+		/* the expired snapshot is still used while it is
+		   being refreshed in the background */
+		ASSERT_TRUE(handle.Validate(0, "test"));
+		ASSERT_FALSE(watch.IsIdle());
+
+		WaitIdle(event_loop, watch);
+
+		ASSERT_FALSE(handle.Validate(0, "test"));
+		ASSERT_TRUE(handle.Validate(1000, "test"));
+
+		StopThreadPool();
+	}
+
+	thread_pool_deinit();
+
+	unlink(path.c_str());
+	rmdir(dir);
+}
+
+/**
+ * inotify does not see an intermediate symlink being replaced; the
+ * periodic lstat() of watched paths does.
+ */
+TEST(TranslationMtimeWatch, ReplaceSymlink)
+{
+	char dir[] = "/tmp/t_translation_mtime_watch.XXXXXX";
+	ASSERT_NE(mkdtemp(dir), nullptr);
+	const std::string a = std::string(dir) + "/a";
+	const std::string b = std::string(dir) + "/b";
+	const std::string link = std::string(dir) + "/link";
+	const std::string link_tmp = link + ".tmp";
+	const std::string path = link + "/file";
+
+	for (const auto &i : {a, b}) {
+		ASSERT_EQ(mkdir(i.c_str(), 0777), 0);
+
+		const std::string file = i + "/file";
+		int fd = open(file.c_str(), O_CREAT|O_WRONLY, 0666);
+		ASSERT_GE(fd, 0);
+		close(fd);
+	}
+
+	SetMtime((a + "/file").c_str(), 1000);
+	SetMtime((b + "/file").c_str(), 2000);
+	ASSERT_EQ(symlink("a", link.c_str()), 0);
+
+	EventLoop event_loop;
+
+	{
+		TranslationMtimeWatch watch(event_loop);
+		TranslationMtimeWatch::Handle handle;
+		watch.Register(handle, path.c_str());
+		WaitIdle(event_loop, watch);
+
+		ASSERT_TRUE(handle.Validate(1000, "test"));
+
+		/* atomically replace the symlink; the watched inode
+		   (a/file) is not touched */
+		ASSERT_EQ(symlink("b", link_tmp.c_str()), 0);
+		ASSERT_EQ(rename(link_tmp.c_str(), link.c_str()), 0);
+
+		event_loop.LoopOnceNonBlock();
+		ASSERT_TRUE(handle.Validate(1000, "test"));
+
+		sleep(4);
+
+		/* the expired snapshot is refreshed in the
+		   background */
+		ASSERT_TRUE(handle.Validate(1000, "test"));
+		WaitIdle(event_loop, watch);
+
+		ASSERT_FALSE(handle.Validate(1000, "test"));
+		ASSERT_TRUE(handle.Validate(2000, "test"));
+
+		StopThreadPool();
+	}
+
+	thread_pool_deinit();
+
+	unlink(link.c_str());
+	unlink((a + "/file").c_str());
+	unlink((b + "/file").c_str());
+	rmdir(a.c_str());
+	rmdir(b.c_str());
+	rmdir(dir);
+}
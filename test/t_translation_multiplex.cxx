@@ -0,0 +1,283 @@
+/*
+ * Copyright 2007-2021 CM4all GmbH
+ * All rights reserved.
+ *
+ * author: Max Kellermann <mk@cm4all.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "translation/Multiplex.hxx"
+#include "translation/Handler.hxx"
+#include "translation/Request.hxx"
+#include "translation/Response.hxx"
+#include "translation/Protocol.hxx"
+#include "translation/Marshal.hxx"
+#include "fb_pool.hxx"
+#include "pool/pool.hxx"
+#include "PInstance.hxx"
+#include "net/AllocatedSocketAddress.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "util/Cancellable.hxx"
+#include "AllocatorPtr.hxx"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+struct MockServer {
+	/**
+	 * The number of connections (counting from 0) which are
+	 * closed by the server after receiving the first request,
+	 * emulating a server which doesn't understand
+	 * #TRANSLATE_REQUEST_ID.
+	 */
+	const unsigned close_connections;
+
+	std::atomic_uint n_connections{0};
+
+	AllocatedSocketAddress address;
+
+	UniqueSocketDescriptor listener;
+
+	std::thread thread;
+
+	explicit MockServer(unsigned _close_connections)
+		:close_connections(_close_connections)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "@t_translation_multiplex-%d-%u",
+			 (int)getpid(), _close_connections);
+		address.SetLocal(name);
+
+		if (!listener.Create(AF_LOCAL, SOCK_STREAM, 0) ||
+		    !listener.Bind(address) || !listener.Listen(4))
+			throw std::runtime_error("Failed to listen");
+
+		thread = std::thread(&MockServer::Run, this);
+	}
+
+	~MockServer() noexcept {
+		/* wake up accept() */
+		shutdown(listener.Get(), SHUT_RDWR);
+		thread.join();
+	}
+
+private:
+	static void AppendPacket(std::vector<uint8_t> &dest,
+				 TranslationCommand command,
+				 const void *payload=nullptr, size_t size=0) {
+		TranslationHeader header;
+		header.length = size;
+		header.command = command;
+
+		const auto *h = (const uint8_t *)&header;
+		dest.insert(dest.end(), h, h + sizeof(header));
+
+		const auto *p = (const uint8_t *)payload;
+		dest.insert(dest.end(), p, p + size);
+	}
+
+	/**
+	 * Read one request; returns false if the client has closed
+	 * the connection.
+	 */
+	static bool ReadRequest(UniqueSocketDescriptor &s) {
+		std::vector<uint8_t> input;
+		uint8_t buffer[4096];
+
+		while (true) {
+			ssize_t nbytes = s.Read(buffer, sizeof(buffer));
+			if (nbytes <= 0)
+				return false;
+
+			input.insert(input.end(), buffer, buffer + nbytes);
+
+			size_t position = 0;
+			while (input.size() - position >= sizeof(TranslationHeader)) {
+				TranslationHeader header;
+				memcpy(&header, input.data() + position,
+				       sizeof(header));
+				const size_t packet_size = sizeof(header) + header.length;
+				if (input.size() - position < packet_size)
+					break;
+
+				position += packet_size;
+
+				if (header.command == TranslationCommand::END)
+					return true;
+			}
+		}
+	}
+
+	static void Serve(UniqueSocketDescriptor s, bool close_early) {
+		while (ReadRequest(s)) {
+			if (close_early)
+				return;
+
+			/* respond without TRANSLATE_REQUEST_ID */
+			std::vector<uint8_t> output;
+			AppendPacket(output, TranslationCommand::BEGIN);
+			static constexpr uint16_t status = 200;
+			AppendPacket(output, TranslationCommand::STATUS,
+				     &status, sizeof(status));
+			AppendPacket(output, TranslationCommand::END);
+
+			if (s.Write(output.data(), output.size()) != (ssize_t)output.size())
+				return;
+		}
+	}
+
+	void Run() {
+		while (true) {
+			UniqueSocketDescriptor s(accept(listener.Get(),
+							nullptr, nullptr));
+			if (!s.IsDefined())
+				return;
+
+			const bool close_early =
+				n_connections++ < close_connections;
+			std::thread(Serve, std::move(s), close_early).detach();
+		}
+	}
+};
+
+struct RecordingHandler final : TranslateHandler {
+	http_status_t status = http_status_t(0);
+
+	std::exception_ptr error;
+
+	bool finished = false;
+
+	/* virtual methods from TranslateHandler */
+	void OnTranslateResponse(TranslateResponse &response) noexcept override {
+		status = response.status;
+		finished = true;
+	}
+
+	void OnTranslateError(std::exception_ptr _error) noexcept override {
+		error = std::move(_error);
+		finished = true;
+	}
+};
+
+struct Instance : PInstance {
+	const ScopeFbPoolInit fb_pool_init;
+};
+
+static void
+SendRequest(Instance &instance, TranslationService &service,
+	    RecordingHandler &handler, const char *uri="/")
+{
+	auto pool = pool_new_linear(instance.root_pool, "request", 8192);
+
+	TranslateRequest request;
+	request.uri = uri;
+
+	CancellablePointer cancel_ptr;
+	service.SendRequest(AllocatorPtr(pool), request, nullptr,
+			    handler, cancel_ptr);
+
+	while (!handler.finished)
+		instance.event_loop.LoopOnce();
+}
+
+/**
+ * The server closes the connection while the multiplexer is
+ * negotiating #TRANSLATE_REQUEST_ID; the request is sent again on a
+ * serial connection.
+ */
+TEST(TranslationMultiplexer, CloseWhileNegotiating)
+{
+	MockServer server(1);
+
+	Instance instance;
+	TranslationMultiplexer multiplexer(instance.event_loop,
+					   server.address, 64);
+
+	RecordingHandler handler;
+	SendRequest(instance, multiplexer, handler);
+	ASSERT_FALSE(handler.error);
+	ASSERT_EQ(handler.status, HTTP_STATUS_OK);
+	ASSERT_EQ(server.n_connections.load(), 2u);
+
+	/* the next request goes over the serial connection */
+	RecordingHandler handler2;
+	SendRequest(instance, multiplexer, handler2);
+	ASSERT_FALSE(handler2.error);
+	ASSERT_EQ(handler2.status, HTTP_STATUS_OK);
+	ASSERT_EQ(server.n_connections.load(), 2u);
+}
+
+/**
+ * If the retry fails as well, the request fails.
+ */
+TEST(TranslationMultiplexer, CloseRetry)
+{
+	MockServer server(2);
+
+	Instance instance;
+	TranslationMultiplexer multiplexer(instance.event_loop,
+					   server.address, 64);
+
+	RecordingHandler handler;
+	SendRequest(instance, multiplexer, handler);
+	ASSERT_TRUE(handler.error);
+	ASSERT_EQ(server.n_connections.load(), 2u);
+}
+
+/**
+ * A request which cannot be marshalled fails, and doesn't affect the
+ * following requests.
+ */
+TEST(TranslationMultiplexer, PayloadTooLarge)
+{
+	MockServer server(0);
+
+	Instance instance;
+	TranslationMultiplexer multiplexer(instance.event_loop,
+					   server.address, 64);
+
+	const std::string huge_uri(0x10000, 'x');
+
+	RecordingHandler handler;
+	SendRequest(instance, multiplexer, handler, huge_uri.c_str());
+	ASSERT_TRUE(handler.error);
+
+	RecordingHandler handler2;
+	SendRequest(instance, multiplexer, handler2);
+	ASSERT_FALSE(handler2.error);
+	ASSERT_EQ(handler2.status, HTTP_STATUS_OK);
+}